@@ -0,0 +1,198 @@
+#include "array.h"
+#include <sys/mman.h>
+#include "bigint.h"
+#include "y.tab.h"
+
+static int elementSize(int type, const ClassLayout* layout)
+{
+    switch(type)
+    {
+    case INT:    return sizeof(long);
+    case BOOL:   return sizeof(bool);
+    case DOUBLE: return sizeof(double);
+    case CHAR:   return sizeof(char);
+    case STRING: return sizeof(char*);
+    case CLASS:  return (layout != NULL ? layout->size : 0);
+    }
+
+    return 0;
+}
+
+int Array_elementSize(const Type* type)
+{
+    return elementSize(type->type, type->layout);
+}
+
+/* The elements are zeroed. Takes the parts of the type, so copies need not make it again */
+static Array* allocate(int type, int dimensions, const ClassLayout* layout, const long* sizes)
+{
+    Array* array = malloc(sizeof(*array) + 2 * dimensions * sizeof(long));
+    if(array == NULL)
+        return NULL;
+
+    array->type = type;
+    array->element_size = elementSize(type, layout);
+    array->dimensions = dimensions;
+    array->count = 1;
+    array->layout = (type == CLASS ? layout : NULL);
+    array->owns = (type == STRING || (array->layout != NULL && array->layout->owns));
+    array->first_touched = SIZE_MAX;
+    array->last_touched = 0;
+
+    for(int i = 0; i < dimensions; ++i)
+    {
+        array->sizes[i] = sizes[i];
+        if(sizes[i] <= 0 || __builtin_mul_overflow(array->count, (size_t)sizes[i], &array->count))
+        {
+            free(array);
+            return NULL;
+        }
+    }
+
+    if(__builtin_mul_overflow(array->count, (size_t)array->element_size, &array->size) || array->size > PTRDIFF_MAX)
+    {
+        free(array);
+        return NULL;
+    }
+
+    long* strides = array->sizes + dimensions;
+    long stride = array->element_size;
+    for(int i = dimensions - 1; i >= 0; --i)
+    {
+        strides[i] = stride;
+        stride *= sizes[i];
+    }
+
+    array->mapped = (array->size >= ARRAY_MAP_THRESHOLD);
+    if(array->mapped)
+    {
+        array->data = mmap(NULL, array->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(array->data == MAP_FAILED)
+            array->data = NULL;
+    }
+    else
+        array->data = calloc(1, array->size + 1);
+
+    if(array->data == NULL)
+    {
+        free(array);
+        return NULL;
+    }
+
+    return array;
+}
+
+Array* Array_create(const Type* type, const long* sizes)
+{
+    Array* array = allocate(type->type, type->dimensions, type->layout, sizes);
+    if(array == NULL || array->layout == NULL || array->layout->arrays == false)
+        return array;
+
+    array->first_touched = 0;
+    for(size_t i = 0; i < array->count; ++i)
+    {
+        array->last_touched = i;
+        if(Object_init(array->layout, array->data + i * array->element_size) != 0)
+        {
+            Array_destroy(array);
+            return NULL;
+        }
+    }
+
+    return array;
+}
+
+/* Elements that own nothing but may hold BigInts. The accesses to them are not tracked, so the whole array is looked at,
+ * and only while some BigInt exists */
+static bool holdsBigInts(const Array* array)
+{
+    return BigInt_exist() && array->owns == false && (array->type == INT || (array->layout != NULL && array->layout->ints));
+}
+
+/* Only the accessed range is copied, the other elements are still zeroed */
+Array* Array_copy(const Array* array)
+{
+    Array* copy = allocate(array->type, array->dimensions, array->layout, array->sizes);
+    if(copy == NULL)
+        return NULL;
+
+    if(array->owns == false)
+    {
+        memcpy(copy->data, array->data, array->size);
+        if(holdsBigInts(array))
+        {
+            for(size_t i = 0; i < array->count; ++i)
+            {
+                const size_t offset = i * array->element_size;
+                if(array->layout != NULL)
+                    Object_copy(array->layout, copy->data + offset, array->data + offset);
+                else
+                    *(long*)(copy->data + offset) = Int_copy(*(const long*)(array->data + offset));
+            }
+        }
+        return copy;
+    }
+
+    for(size_t i = array->first_touched; i <= array->last_touched && i < array->count; ++i)
+    {
+        if(copy->first_touched == SIZE_MAX)
+            copy->first_touched = i;
+        copy->last_touched = i;
+
+        const size_t offset = i * array->element_size;
+        if(array->layout != NULL)
+        {
+            if(Object_copy(array->layout, copy->data + offset, array->data + offset) != 0)
+            {
+                Array_destroy(copy);
+                return NULL;
+            }
+        }
+        else
+        {
+            const char* str = *(char* const*)(array->data + offset);
+            if(str != NULL && (*(char**)(copy->data + offset) = strdup(str)) == NULL)
+            {
+                Array_destroy(copy);
+                return NULL;
+            }
+        }
+    }
+
+    return copy;
+}
+
+void Array_destroy(Array* array)
+{
+    if(array == NULL)
+        return;
+
+    if(array->owns)
+    {
+        for(size_t i = array->first_touched; i <= array->last_touched && i < array->count; ++i)
+        {
+            char* element = array->data + i * array->element_size;
+            if(array->layout != NULL)
+                Object_release(array->layout, element);
+            else
+                free(*(char**)element);
+        }
+    }
+    else if(holdsBigInts(array))
+    {
+        for(size_t i = 0; i < array->count; ++i)
+        {
+            char* element = array->data + i * array->element_size;
+            if(array->layout != NULL)
+                Object_release(array->layout, element);
+            else
+                Int_release(*(long*)element);
+        }
+    }
+
+    if(array->mapped)
+        munmap(array->data, array->size);
+    else
+        free(array->data);
+    free(array);
+}
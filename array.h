@@ -0,0 +1,43 @@
+#ifndef INCLUDED_ARRAY_H
+#define INCLUDED_ARRAY_H
+
+#include "util.h"
+#include "layout.h"
+
+/* Arrays at least this large are mapped, so the pages are only committed when first touched */
+#define ARRAY_MAP_THRESHOLD (64 << 10)
+
+/* Elements are stored in row-major order. strides[i] is the distance in bytes between consecutive indices of dimension i.
+ * Objects are stored inline, each taking the size of their layout */
+typedef struct Array
+{
+    int type;            /* of the elements */
+    int element_size;
+    int dimensions;
+    size_t count;
+    size_t size;         /* in bytes */
+    char* data;
+    bool mapped;
+    const ClassLayout* layout; /* of the elements of class type */
+    bool owns;           /* the elements are strings or objects holding some, released with the array */
+
+    /* Strings and objects are only released in the range of elements that was ever accessed, so huge arrays stay untouched.
+     * Objects holding arrays are created with the array, so their range is the whole array */
+    size_t first_touched;
+    size_t last_touched;
+
+    long sizes[];        /* followed by the strides */
+} Array;
+
+/* Returns NULL if the total size overflows or the memory is not available */
+Array* Array_create(const Type* type, const long* sizes);
+Array* Array_copy(const Array* array);
+void   Array_destroy(Array* array);
+int    Array_elementSize(const Type* type);
+
+static inline const long* Array_strides(const Array* array)
+{
+    return array->sizes + array->dimensions;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#include "common.h"
+#include "../simd.h"
+
+/* Times each bulk array builtin against the for loop that computes the same thing in tema.
+ * The builtins are timed by the difference between BUILTIN_FACTOR times more repeats and the plain repeats,
+ * so the time of the setup cancels out.
+ * Both programs must print the same output with the same repeats. Set TEMA_SIMD to compare the kernel levels.
+ * Usage: bench/builtins_bench [elements] [repeats] */
+
+#define BUILTIN_FACTOR 200
+
+/* %1$ld is the number of elements and %2$ld the number of repeats */
+static const char setup[] =
+    "int a[%1$ld];\n"
+    "int b[%1$ld];\n"
+    "int c[%1$ld];\n"
+    "double x[%1$ld];\n"
+    "double y[%1$ld];\n"
+    "for(int i = 0; i < %1$ld; ++i) { a[i] = i; b[i] = 3; x[i] = .5; y[i] = .25; }\n"
+    "int s = 0;\n"
+    "int m = 0;\n"
+    "double d = 0.0;\n";
+
+typedef struct Case
+{
+    const char* name;
+    const char* builtin;
+    const char* loop;
+} Case;
+
+static const Case cases[] =
+{
+    {"fill int",
+     "for(int r = 0; r < %2$ld; ++r) fill(c, r);\n print(c[%1$ld - 1]);\n",
+     "for(int r = 0; r < %2$ld; ++r) for(int j = 0; j < %1$ld; ++j) c[j] = r;\n print(c[%1$ld - 1]);\n"},
+    {"sum int",
+     "for(int r = 0; r < %2$ld; ++r) s += sum(a);\n print(s);\n",
+     "for(int r = 0; r < %2$ld; ++r) for(int j = 0; j < %1$ld; ++j) s += a[j];\n print(s);\n"},
+    {"min int",
+     "for(int r = 0; r < %2$ld; ++r) s += min(a);\n print(s);\n",
+     "for(int r = 0; r < %2$ld; ++r) { m = a[0]; for(int j = 1; j < %1$ld; ++j) if(a[j] < m) m = a[j]; s += m; }\n print(s);\n"},
+    {"dot int",
+     "for(int r = 0; r < %2$ld; ++r) s += dot(a, b);\n print(s);\n",
+     "for(int r = 0; r < %2$ld; ++r) for(int j = 0; j < %1$ld; ++j) s += a[j] * b[j];\n print(s);\n"},
+    {"add int",
+     "for(int r = 0; r < %2$ld; ++r) add(c, a, b);\n print(c[%1$ld - 1]);\n",
+     "for(int r = 0; r < %2$ld; ++r) for(int j = 0; j < %1$ld; ++j) c[j] = a[j] + b[j];\n print(c[%1$ld - 1]);\n"},
+    {"count int",
+     "for(int r = 0; r < %2$ld; ++r) s += count(b, 3);\n print(s);\n",
+     "for(int r = 0; r < %2$ld; ++r) for(int j = 0; j < %1$ld; ++j) if(b[j] == 3) ++s;\n print(s);\n"},
+    {"sum double",
+     "for(int r = 0; r < %2$ld; ++r) d += sum(x);\n if(d > 1.0) print(1);\n",
+     "for(int r = 0; r < %2$ld; ++r) for(int j = 0; j < %1$ld; ++j) d += x[j];\n if(d > 1.0) print(1);\n"},
+    {"dot double",
+     "for(int r = 0; r < %2$ld; ++r) d += dot(x, y);\n if(d > 1.0) print(1);\n",
+     "for(int r = 0; r < %2$ld; ++r) for(int j = 0; j < %1$ld; ++j) d += x[j] * y[j];\n if(d > 1.0) print(1);\n"}
+};
+
+/* Returns the best of RUNS times taken to compile and run the setup followed by body, or -1 if it failed */
+static double timeCase(const char* body, long elements, long repeats, char* result)
+{
+    char source[4096];
+    int length = snprintf(source, sizeof(source), setup, elements);
+    length += snprintf(source + length, sizeof(source) - length, body, elements, repeats);
+
+    const double best = timeProgram(source, length);
+    strcpy(result, output);
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    const long elements = (argc >= 2 ? strtol(argv[1], NULL, 10) : 100000);
+    const long repeats  = (argc >= 3 ? strtol(argv[2], NULL, 10) : 20);
+
+    char builtin_output[sizeof(output)];
+    char loop_output[sizeof(output)];
+
+    const double base = timeCase("", elements, repeats, builtin_output);
+    if(base < 0)
+    {
+        fprintf(stderr, "the setup program failed\n");
+        return 1;
+    }
+
+    printf("%ld elements, %ld repeats, %s kernels\n", elements, repeats, Simd_kernels()->name);
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        const double builtin = timeCase(cases[i].builtin, elements, repeats * BUILTIN_FACTOR, builtin_output);
+        const double check   = timeCase(cases[i].builtin, elements, repeats, builtin_output);
+        const double loop    = timeCase(cases[i].loop,    elements, repeats, loop_output);
+        if(check < 0 || builtin < 0 || loop < 0)
+        {
+            fprintf(stderr, "the programs of %s failed\n", cases[i].name);
+            return 1;
+        }
+
+        if(strcmp(builtin_output, loop_output) != 0)
+        {
+            fprintf(stderr, "the builtin and the loop of %s printed different results\n", cases[i].name);
+            return 1;
+        }
+
+        const double builtin_ns = (builtin - check) / ((double)elements * repeats * (BUILTIN_FACTOR - 1)) * 1e9;
+        const double loop_ns    = (loop - base) / ((double)elements * repeats) * 1e9;
+        printf("%-12s builtin %8.3f ns/element   loop %8.3f ns/element   %7.1fx\n", cases[i].name, builtin_ns, loop_ns, loop_ns / builtin_ns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef INCLUDED_BENCH_COMMON_H
+#define INCLUDED_BENCH_COMMON_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+
+/* Helpers shared by the benchmarks. Each benchmark is a single file including this header, and may define RUNS before it */
+
+#ifndef RUNS
+#define RUNS 3
+#endif
+
+
+
+static inline double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+/* What the last program printed, cut to the size of the buffer. The timing functions end it with '\0' */
+static char output[4096];
+static size_t output_size = 0;
+
+static inline void captureOutput(void* data, const char* text, size_t size)
+{
+    if(output_size + size < sizeof(output))
+    {
+        memcpy(output + output_size, text, size);
+        output_size += size;
+    }
+}
+
+/* Settings of the contexts timeProgramWith creates. Zeroes are the defaults of tema_create */
+typedef struct BenchOptions
+{
+    int optimization;
+    int analysis;
+    tema_stats* stats; /* gets the counters of the last run, unless NULL */
+    int jobs;
+    int threads;
+    int memoize;
+} BenchOptions;
+
+/* Best of RUNS times to compile and run the source, or -1 if it failed to compile or stopped on a runtime error */
+static inline double timeProgramWith(const char* source, size_t size, const BenchOptions* options)
+{
+    double fastest = -1;
+    for(int run = 0; run < RUNS; ++run)
+    {
+        tema_ctx* ctx = tema_create();
+        tema_set_output(ctx, captureOutput, NULL);
+        tema_set_optimization(ctx, options->optimization);
+        tema_set_analysis(ctx, options->analysis);
+        tema_set_jobs(ctx, options->jobs);
+        tema_set_threads(ctx, options->threads);
+        tema_set_memoize(ctx, options->memoize);
+        output_size = 0;
+
+        const double start = now();
+        int error = tema_compile_buffer(ctx, source, size);
+        error |= tema_run(ctx);
+        const double elapsed = now() - start;
+        if(options->stats != NULL)
+            tema_get_stats(ctx, options->stats);
+        tema_destroy(ctx);
+
+        output[output_size] = '\0';
+        if(error != 0)
+            return -1;
+        if(fastest < 0 || elapsed < fastest)
+            fastest = elapsed;
+    }
+    return fastest;
+}
+
+static inline double timeProgram(const char* source, size_t size)
+{
+    const BenchOptions defaults = {0};
+    return timeProgramWith(source, size, &defaults);
+}
+
+
+
+/* A generated program, grown by emit */
+typedef struct Source
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+} Source;
+
+static inline void emit(Source* source, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if(source->size + length + 1 > source->capacity)
+    {
+        source->capacity = 1 + (source->size + length + 1) * 2;
+        source->data = realloc(source->data, source->capacity);
+        if(source->data == NULL)
+        {
+            fprintf(stderr, "not enough memory for the program\n");
+            exit(1);
+        }
+    }
+
+    va_start(args, format);
+    vsnprintf(source->data + source->size, length + 1, format, args);
+    va_end(args);
+    source->size += length;
+}
+
+#endif
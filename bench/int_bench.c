@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#include "common.h"
+#include "../bigint.h"
+
+/* Measures what overflow checking costs ints that never overflow, and how fast BigInts are once they do.
+ * - the checked arithmetic of bigint.h against plain wrapping arithmetic, in C;
+ * - BigInt multiplication and division of growing sizes;
+ * - a tema loop of int arithmetic against the same loop on doubles, which are not checked, and a factorial in tema.
+ * Usage: bench/int_bench [iterations] */
+
+#define ELEMENTS 4096
+
+/* The loops read the elements through a volatile pointer, so the compiler cannot compute their sums in advance */
+static long values[ELEMENTS];
+static long* volatile data = values;
+
+/* The multiplier keeps the sum small: the checks pass, but are not removed */
+static long checkedSum(long repeats)
+{
+    const long* a = data;
+    long sum = 0;
+    for(long r = 0; r < repeats; ++r)
+        for(size_t i = 0; i < ELEMENTS; ++i)
+            sum = Int_add(Int_mul(sum, a[i] & 1), a[i]);
+    return sum;
+}
+
+static long uncheckedSum(long repeats)
+{
+    const long* a = data;
+    long sum = 0;
+    for(long r = 0; r < repeats; ++r)
+        for(size_t i = 0; i < ELEMENTS; ++i)
+            sum = (long)((unsigned long)sum * (unsigned long)(a[i] & 1) + (unsigned long)a[i]);
+    return sum;
+}
+
+static double best(long (*function)(long), long repeats, long* result)
+{
+    double fastest = -1;
+    for(int run = 0; run < RUNS; ++run)
+    {
+        const double start = now();
+        *result = function(repeats);
+        const double elapsed = now() - start;
+        if(fastest < 0 || elapsed < fastest)
+            fastest = elapsed;
+    }
+    return fastest;
+}
+
+
+
+/* %1$ld is the number of iterations */
+static const char int_loop[] =
+    "int s = 0;\n"
+    "for(int i = 0; i < %1$ld; ++i) s = s + i * 3 - i / 7;\n"
+    "print(s);\n";
+
+static const char double_loop[] =
+    "double s = 0.0;\n"
+    "double x = 0.0;\n"
+    "for(int i = 0; i < %1$ld; ++i) { s = s + x * 3.0 - x / 7.0; x = x + 1.0; }\n"
+    "if(s > 1.0) print(1);\n";
+
+static const char factorial[] =
+    "int f = 1;\n"
+    "for(int i = 1; i <= %1$ld; ++i) f = f * i;\n"
+    "int digits = 0;\n"
+    "while(f != 0) { f = f / 10; ++digits; }\n"
+    "print(digits);\n";
+
+
+
+/* A number of the given limbs, all ones, so every product is as long as it can be */
+static long bigOfLimbs(int limbs)
+{
+    long value = 1;
+    for(int i = 0; i < limbs; ++i)
+        value = Int_mul(value, Int_add(BigInt_mul(4294967296L, 4294967296L), -1));
+    return value;
+}
+
+/* Best of RUNS, in microseconds per operation. Takes no operand */
+static double timeOperation(long (*operation)(long, long), long lval, long rval, long repeats)
+{
+    double fastest = -1;
+    for(int run = 0; run < RUNS; ++run)
+    {
+        const double start = now();
+        for(long r = 0; r < repeats; ++r)
+            Int_release(operation(Int_copy(lval), Int_copy(rval)));
+        const double elapsed = (now() - start) / repeats * 1e6;
+        if(fastest < 0 || elapsed < fastest)
+            fastest = elapsed;
+    }
+    return fastest;
+}
+
+static void timeBigInts()
+{
+    for(int limbs = 1; limbs <= 256; limbs *= 4)
+    {
+        const long a = bigOfLimbs(limbs);
+        const long b = Int_add(bigOfLimbs(limbs), 12345);
+        const long product = Int_mul(Int_copy(a), Int_copy(b));
+        const long repeats = 1000000 / (limbs * limbs) + 20;
+
+        const double multiply = timeOperation(BigInt_mul, a, b, repeats);
+        const double divide = timeOperation(BigInt_div, product, a, repeats);
+
+        const long quotient = Int_div(Int_copy(product), Int_copy(a));
+        const bool exact = (Int_compare(quotient, b) == 0);
+        printf("%3d x %3d limbs   mul %10.3f us   div %10.3f us%s\n", limbs, limbs, multiply, divide, (exact ? "" : "   WRONG QUOTIENT"));
+        Int_release(quotient);
+        Int_release(product);
+        Int_release(a);
+        Int_release(b);
+    }
+}
+
+
+
+int main(int argc, char** argv)
+{
+    const long iterations = (argc >= 2 ? strtol(argv[1], NULL, 10) : 5000000);
+
+    for(size_t i = 0; i < ELEMENTS; ++i)
+        values[i] = (long)(i * 2654435761u % 1000);
+
+    const long repeats = iterations / ELEMENTS + 1;
+    long checked, unchecked;
+    const double checked_time   = best(checkedSum, repeats, &checked);
+    const double unchecked_time = best(uncheckedSum, repeats, &unchecked);
+    const double operations = (double)repeats * ELEMENTS * 2;
+    printf("C, %ld operations\n", (long)operations);
+    printf("unchecked  %8.3f ns/op\n", unchecked_time / operations * 1e9);
+    printf("checked    %8.3f ns/op   %5.2fx unchecked%s\n", checked_time / operations * 1e9, checked_time / unchecked_time,
+           (checked == unchecked ? "" : "   DIFFERENT RESULT"));
+
+    printf("\nBigInt\n");
+    timeBigInts();
+
+    char source[1024];
+    snprintf(source, sizeof(source), int_loop, iterations);
+    const double int_time = timeProgram(source, strlen(source));
+    snprintf(source, sizeof(source), double_loop, iterations);
+    const double double_time = timeProgram(source, strlen(source));
+    if(int_time < 0 || double_time < 0)
+    {
+        fprintf(stderr, "the loops failed\n");
+        return 1;
+    }
+    printf("\ntema, %ld iterations\n", iterations);
+    printf("int loop    %8.3f ns/iteration\n", int_time / iterations * 1e9);
+    printf("double loop %8.3f ns/iteration   %5.2fx int\n", double_time / iterations * 1e9, double_time / int_time);
+
+    snprintf(source, sizeof(source), factorial, 3000L);
+    const double factorial_time = timeProgram(source, strlen(source));
+    if(factorial_time < 0)
+    {
+        fprintf(stderr, "the factorial failed\n");
+        return 1;
+    }
+    printf("3000! in tema %8.3f ms, %s digits\n", factorial_time * 1e3, strtok(output, "\n"));
+
+    if(bigint_count != 0)
+    {
+        fprintf(stderr, "%zu BigInts were not released\n", bigint_count);
+        return 1;
+    }
+    return 0;
+}
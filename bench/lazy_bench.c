@@ -0,0 +1,103 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../libtema.h"
+#include "common.h"
+
+/* Compiles a program declaring many functions and calling a few of them with every analysis mode, then analyzing the bodies
+ * on 2, 4 and as many threads as there are processors. The output must be the same, and only the lazy modes skip the
+ * bodies of the functions never called.
+ * Usage: bench/lazy_bench [functions] [called] */
+
+
+/* Every function has a loop and a branch, and calls the one before it but every GROUP functions, like the helpers of a library */
+#define GROUP 8
+
+static char* generate(long functions, long called, size_t* size)
+{
+    char* source = NULL;
+    FILE* fp = open_memstream(&source, size);
+    if(fp == NULL)
+        return NULL;
+
+    for(long i = 0; i < functions; ++i)
+    {
+        fprintf(fp,
+                "int f%ld(int a)\n"
+                "{\n"
+                "    int s = 0;\n"
+                "    for(int i = 0; i < a; ++i)\n"
+                "        if(i < a / 2) { s = s + i * %ld; } else { s = s - 1; }\n", i, i % 100);
+        if(i % GROUP != 0)
+            fprintf(fp, "    return s + f%ld(a - 1);\n}\n", i - 1);
+        else
+            fputs("    return s;\n}\n", fp);
+    }
+    for(long i = 0; i < called; ++i)
+        fprintf(fp, "print(f%ld(4));\n", (functions - 1) * i / (called > 1 ? called - 1 : 1));
+    fclose(fp);
+    return source;
+}
+
+int main(int argc, char** argv)
+{
+    const long functions = (argc >= 2 ? strtol(argv[1], NULL, 10) : 2000);
+    const long called = (argc >= 3 ? strtol(argv[2], NULL, 10) : 10);
+    if(functions < 1 || called < 1)
+    {
+        fprintf(stderr, "usage: %s [functions] [called]\n", argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    char* source = generate(functions, called, &size);
+    if(source == NULL)
+    {
+        fprintf(stderr, "not enough memory to generate the program\n");
+        return 1;
+    }
+
+    const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    const struct { int analysis; int jobs; const char* name; } modes[] =
+    {
+        {TEMA_ANALYSIS_EAGER,     1, "eager"},
+        {TEMA_ANALYSIS_LAZY,      1, "lazy"},
+        {TEMA_ANALYSIS_CHECK_ALL, 1, "check-all"},
+        {TEMA_ANALYSIS_EAGER,     2, "jobs 2"},
+        {TEMA_ANALYSIS_EAGER,     4, "jobs 4"},
+        {TEMA_ANALYSIS_EAGER,     (processors > 0 ? processors : 1), "jobs nproc"}
+    };
+
+    printf("%ld functions, %ld called, %zu bytes, %ld processors\n", functions, called, size, processors);
+    char expected[sizeof(output)];
+    double eager_time = 0;
+    int failures = 0;
+    for(size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+    {
+        tema_stats stats;
+        const BenchOptions options = {.analysis = modes[i].analysis, .stats = &stats, .jobs = modes[i].jobs};
+        const double elapsed = timeProgramWith(source, size, &options);
+        if(elapsed < 0)
+        {
+            fprintf(stderr, "the program failed with the %s analysis\n", modes[i].name);
+            free(source);
+            return 1;
+        }
+
+        if(i == 0)
+        {
+            strcpy(expected, output);
+            eager_time = elapsed;
+        }
+        const bool same = (strcmp(expected, output) == 0);
+        failures += !same;
+        printf("%-10s %9.3f ms   %5.2fx eager   bodies %6llu skipped %6llu analyzed later%s\n", modes[i].name, elapsed * 1e3,
+               elapsed / eager_time, stats.skipped_bodies, stats.deferred_bodies, (same ? "" : "   DIFFERENT OUTPUT"));
+    }
+
+    free(source);
+    return (failures != 0);
+}
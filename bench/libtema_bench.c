@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#include "common.h"
+
+/* Compiles and runs many tiny programs in-process, each in a fresh context.
+ * Usage: bench/libtema_bench [count] */
+
+static const char program[] =
+    "int x = 3;\n"
+    "int y = 4;\n"
+    "int sum(int a, int b) { return a + b; }\n"
+    "print(x * y + 1);\n";
+
+static size_t output_bytes = 0;
+
+static void countOutput(void* data, const char* text, size_t size)
+{
+    output_bytes += size;
+}
+
+int main(int argc, char** argv)
+{
+    const long count = (argc >= 2 ? strtol(argv[1], NULL, 10) : 100000);
+    const double start = now();
+
+    for(long i = 0; i < count; ++i)
+    {
+        tema_ctx* ctx = tema_create();
+        tema_set_output(ctx, countOutput, NULL);
+
+        if(tema_compile_buffer(ctx, program, sizeof(program) - 1) != 0)
+        {
+            fprintf(stderr, "the benchmark program failed to compile\n");
+            return 1;
+        }
+
+        tema_run(ctx);
+        tema_destroy(ctx);
+    }
+
+    const double elapsed = now() - start;
+    printf("%ld programs in %.3f s, %.2f us per program (%zu bytes of output)\n", count, elapsed, elapsed / count * 1e6, output_bytes);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#include "common.h"
+
+/* Times nested loops over 2D and 3D arrays without optimization and at level 2, where the loop passes
+ * hoist invariant expressions, reduce indexing, merge induction variables and unroll short loops.
+ * Both levels must print the same output.
+ * Usage: bench/loops_bench [size] */
+
+
+typedef struct Case
+{
+    const char* name;
+    const char* program;  /* %1$ld is the size divided by divisor */
+    long divisor;
+} Case;
+
+static const Case cases[] =
+{
+    {"matmul 2D",
+     "int n = %1$ld;\n"
+     "int a[%1$ld][%1$ld];\n"
+     "int b[%1$ld][%1$ld];\n"
+     "int c[%1$ld][%1$ld];\n"
+     "int i = 0;\n"
+     "int j = 0;\n"
+     "int k = 0;\n"
+     "for(i = 0; i < n; ++i) for(j = 0; j < n; ++j) { a[i][j] = i + j; b[i][j] = i - j; }\n"
+     "for(i = 0; i < n; ++i)\n"
+     "    for(j = 0; j < n; ++j)\n"
+     "    {\n"
+     "        int s = 0;\n"
+     "        for(k = 0; k < n; ++k)\n"
+     "            s += a[i][k] * b[k][j];\n"
+     "        c[i][j] = s;\n"
+     "    }\n"
+     "int t = 0;\n"
+     "for(i = 0; i < n; ++i) for(j = 0; j < n; ++j) t += c[i][j];\n"
+     "print(t);\n", 1},
+    {"stencil 3D",
+     "int n = %1$ld;\n"
+     "double u[%1$ld][%1$ld][%1$ld];\n"
+     "double v[%1$ld][%1$ld][%1$ld];\n"
+     "int i = 0;\n"
+     "int j = 0;\n"
+     "int k = 0;\n"
+     "double x = 0.0;\n"
+     "for(i = 0; i < n; ++i) for(j = 0; j < n; ++j) for(k = 0; k < n; ++k) { u[i][j][k] = x; x += 0.5; }\n"
+     "for(int r = 0; r < 5; ++r)\n"
+     "    for(i = 1; i < n - 1; ++i)\n"
+     "        for(j = 1; j < n - 1; ++j)\n"
+     "            for(k = 1; k < n - 1; ++k)\n"
+     "                v[i][j][k] = (u[i - 1][j][k] + u[i + 1][j][k] + u[i][j - 1][k] + u[i][j + 1][k] + u[i][j][k - 1] + u[i][j][k + 1]) * 0.1;\n"
+     "double t = 0.0;\n"
+     "for(i = 0; i < n; ++i) for(j = 0; j < n; ++j) for(k = 0; k < n; ++k) t += v[i][j][k];\n"
+     "if(t > 1.0) print(1);\n", 3},
+    {"invariant",
+     "int f(int n, int p, int q)\n"
+     "{\n"
+     "    int s = 0;\n"
+     "    for(int i = 0; i < n * n * 4; ++i)\n"
+     "        s += (p * q + p / 3 - q) * i + (p - q) * (p + q);\n"
+     "    return s;\n"
+     "}\n"
+     "print(f(%1$ld, 7, 5));\n", 1},
+    {"short inner",
+     "int w[4][4];\n"
+     "for(int i = 0; i < 4; ++i) for(int j = 0; j < 4; ++j) w[i][j] = i * j + 1;\n"
+     "int s = 0;\n"
+     "for(int r = 0; r < %1$ld * %1$ld / 4; ++r)\n"
+     "    for(int k = 0; k < 4; ++k)\n"
+     "        s += w[k][3 - k] * k + r;\n"
+     "print(s);\n", 1},
+    {"two counters",
+     "int g(int n)\n"
+     "{\n"
+     "    int a[%1$ld][%1$ld];\n"
+     "    int s = 0;\n"
+     "    for(int i = 0; i < n; ++i)\n"
+     "    {\n"
+     "        int j = 8;\n"
+     "        for(int k = 0; k < n; ++k)\n"
+     "        {\n"
+     "            a[i][j - 8] = k;\n"
+     "            s += a[i][(j - 8) / 2];\n"
+     "            ++j;\n"
+     "        }\n"
+     "    }\n"
+     "    return s;\n"
+     "}\n"
+     "print(g(%1$ld));\n", 1}
+};
+
+/* Returns the best of RUNS times taken to compile and run the program, or -1 if it failed */
+static double timeCase(const char* program, long size, int level, char* result)
+{
+    char source[4096];
+    const int length = snprintf(source, sizeof(source), program, size);
+
+    const double best = timeProgramWith(source, length, &(BenchOptions){.optimization = level});
+    strcpy(result, output);
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    const long size = (argc >= 2 ? strtol(argv[1], NULL, 10) : 120);
+
+    char plain_output[sizeof(output)];
+    char optimized_output[sizeof(output)];
+
+    printf("size %ld\n", size);
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        const double plain     = timeCase(cases[i].program, size / cases[i].divisor, 0, plain_output);
+        const double optimized = timeCase(cases[i].program, size / cases[i].divisor, 2, optimized_output);
+        if(plain < 0 || optimized < 0)
+        {
+            fprintf(stderr, "the program of %s failed\n", cases[i].name);
+            return 1;
+        }
+
+        if(strcmp(plain_output, optimized_output) != 0)
+        {
+            fprintf(stderr, "%s printed different results at -O0 and -O2\n", cases[i].name);
+            return 1;
+        }
+
+        printf("%-14s -O0 %8.3f ms   -O2 %8.3f ms   %5.2fx\n", cases[i].name, plain * 1e3, optimized * 1e3, plain / optimized);
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#include "common.h"
+
+/* Times recursive functions that call themselves again and again with the same arguments without memoization, with the default
+ * memos and with memos too small for the arguments of a call tree, which evict. The output must be the same.
+ * Usage: bench/memo_bench [n] */
+
+
+/* %1$ld is n: Fibonacci numbers, central binomial coefficients and the paths across a grid with some cells removed */
+static const char program[] =
+    "int fib(int n)\n"
+    "{\n"
+    "    if(n < 2)\n"
+    "        return n;\n"
+    "    return fib(n - 1) + fib(n - 2);\n"
+    "}\n"
+    "int binom(int n, int k)\n"
+    "{\n"
+    "    if(k == 0 || k == n)\n"
+    "        return 1;\n"
+    "    return binom(n - 1, k - 1) + binom(n - 1, k);\n"
+    "}\n"
+    "int paths(int row, int column)\n"
+    "{\n"
+    "    if(row == 0 || column == 0)\n"
+    "        return 1;\n"
+    "    if((row * 7 + column * 3) / 11 * 11 == row * 7 + column * 3)\n"
+    "        return 0;\n"
+    "    return paths(row - 1, column) + paths(row, column - 1);\n"
+    "}\n"
+    "print(fib(%1$ld));\n"
+    "print(binom(%1$ld - 4, (%1$ld - 4) / 2));\n"
+    "print(paths(%1$ld / 2, %1$ld / 2));\n";
+
+int main(int argc, char** argv)
+{
+    const long n = (argc >= 2 ? strtol(argv[1], NULL, 10) : 26);
+    if(n < 6 || n > 40)
+    {
+        fprintf(stderr, "usage: %s [n], n from 6 to 40\n", argv[0]);
+        return 1;
+    }
+
+    char source[2048];
+    snprintf(source, sizeof(source), program, n);
+
+    const struct { int entries; const char* name; } modes[] =
+    {
+        {0,                    "off"},
+        {TEMA_MEMOIZE_ENTRIES, "default"},
+        {64,                   "64 entries"},
+        {8,                    "8 entries"}
+    };
+
+    printf("n = %ld\n", n);
+    char expected[sizeof(output)];
+    double off_time = 0;
+    int failures = 0;
+    for(size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+    {
+        tema_stats stats;
+        const double elapsed = timeProgramWith(source, strlen(source), &(BenchOptions){.stats = &stats, .memoize = modes[i].entries});
+        if(elapsed < 0)
+        {
+            fprintf(stderr, "the program failed\n");
+            return 1;
+        }
+
+        if(i == 0)
+        {
+            strcpy(expected, output);
+            off_time = elapsed;
+        }
+        const bool same = (strcmp(expected, output) == 0);
+        failures += !same;
+        const unsigned long long calls = stats.memo_hits + stats.memo_misses;
+        printf("%-10s %9.3f ms  %8.1fx   %llu functions  %5.1f%% hits of %10llu calls  %8llu evictions  %8llu bytes%s\n",
+               modes[i].name, elapsed * 1e3, off_time / elapsed, stats.memoized_functions, (calls != 0 ? 100.0 * stats.memo_hits / calls : 0.0),
+               calls, stats.memo_evictions, stats.memo_bytes, (same ? "" : "   DIFFERENT OUTPUT"));
+    }
+
+    return (failures != 0);
+}
@@ -0,0 +1,122 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#define RUNS 5 /* common.h takes 3 otherwise */
+#include "common.h"
+
+/* Times every operator on every type it applies to: a loop running a statement with the operator against the same loop
+ * running a plain assignment, at -O0 so that the statements run as written. The difference is the time of the operator.
+ * Usage: bench/op_bench [iterations] */
+
+#define REPEAT 10
+
+/* %1$s declares x, y and z, %2$s is the statement, which runs REPEAT times per iteration, and %3$ld the iterations */
+static const char program[] =
+    "%1$s\n"
+    "bool b = false;\n"
+    "int i = 0;\n"
+    "while(i < %3$ld)\n"
+    "{\n"
+    "    %2$s %2$s %2$s %2$s %2$s\n"
+    "    %2$s %2$s %2$s %2$s %2$s\n"
+    "    ++i;\n"
+    "}\n"
+    "print(i);\n";
+
+static const struct { const char* name; const char* declarations; } types[] =
+{
+    {"int",    "int x = 0; int y = 1000; int z = 7;"},
+    {"bool",   "bool x = false; bool y = true; bool z = false;"},
+    {"double", "double x = 0.5; double y = 0.75; double z = 0.25;"},
+    {"char",   "char x = 'a'; char y = 'z'; char z = 'c';"},
+    {"string", "string x = \"\"; string y = \"abc\"; string z = \"abd\";"}
+};
+
+/* Which types an operator is timed on, by their bit in types */
+#define INT    (1 << 0)
+#define BOOL   (1 << 1)
+#define DOUBLE (1 << 2)
+#define CHAR   (1 << 3)
+#define STRING (1 << 4)
+
+static const struct { const char* name; const char* statement; int types; } operators[] =
+{
+    {"+",   "x = y + z;",  INT | BOOL | DOUBLE | CHAR | STRING},
+    {"-",   "x = y - z;",  INT | BOOL | DOUBLE | CHAR},
+    {"*",   "x = y * z;",  INT | BOOL | DOUBLE | CHAR},
+    {"/",   "x = y / z;",  INT | DOUBLE | CHAR},
+    {"%",   "x = y % z;",  INT | CHAR},
+    {"-x",  "x = -y;",     INT | BOOL | DOUBLE | CHAR},
+    {"!",   "x = !y;",     INT | BOOL | DOUBLE | CHAR},
+    {"+=",  "x += z;",     INT | BOOL | DOUBLE | CHAR},
+    {"++x", "++x;",        INT | BOOL | DOUBLE | CHAR},
+    {"x++", "x++;",        INT | BOOL | DOUBLE | CHAR},
+    {"==",  "b = y == z;", INT | BOOL | DOUBLE | CHAR | STRING},
+    {"<",   "b = y < z;",  INT | BOOL | DOUBLE | CHAR | STRING}
+};
+
+/* Best of RUNS times to compile and run the loop, or -1 if it failed or did not count to the end */
+static double timeLoop(const char* declarations, const char* statement, long iterations)
+{
+    char source[2048];
+    snprintf(source, sizeof(source), program, declarations, statement, iterations);
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%ld\n", iterations);
+
+    const double fastest = timeProgram(source, strlen(source));
+    if(strcmp(output, expected) != 0)
+        return -1;
+    return fastest;
+}
+
+int main(int argc, char** argv)
+{
+    const long iterations = (argc >= 2 ? strtol(argv[1], NULL, 10) : 200000);
+    if(iterations < 1)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%ld iterations of %d statements, ns per operation\n%-4s", iterations, REPEAT, "");
+    for(size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+        printf("%9s", types[t].name);
+    printf("\n");
+
+    double baselines[sizeof(types) / sizeof(types[0])];
+    for(size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+        if((baselines[t] = timeLoop(types[t].declarations, "x = y;", iterations)) < 0)
+        {
+            fprintf(stderr, "the %s loop failed\n", types[t].name);
+            return 1;
+        }
+
+    int failures = 0;
+    for(size_t o = 0; o < sizeof(operators) / sizeof(operators[0]); ++o)
+    {
+        printf("%-4s", operators[o].name);
+        for(size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+        {
+            if((operators[o].types & (1 << t)) == 0)
+            {
+                printf("%9s", "");
+                continue;
+            }
+
+            const double elapsed = timeLoop(types[t].declarations, operators[o].statement, iterations);
+            if(elapsed < 0)
+            {
+                printf("%9s", "FAILED");
+                ++failures;
+            }
+            else
+                printf("%9.2f", (elapsed - baselines[t]) * 1e9 / (iterations * REPEAT));
+        }
+        printf("\n");
+    }
+
+    return (failures != 0);
+}
@@ -0,0 +1,529 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libtema.h"
+
+/* Generates random programs and runs each one at every optimization level, checking that they print the same output
+ * and find the same number of errors. Programs that differ are written to opt_check_failure.tm.
+ * Usage: bench/opt_check [count] [seed] */
+
+#define MAX_VARIABLES 64
+#define MAX_FUNCTIONS 4
+#define MATRIX_SIZE 6
+#define MODULUS 1000003 /* ints do not wrap, so updated values are reduced to keep them from growing without bound */
+
+typedef struct Buffer
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+static void Buffer_append(Buffer* buffer, const char* text, size_t size)
+{
+    if(buffer->size + size + 1 > buffer->capacity)
+    {
+        size_t capacity = 1 + (buffer->size + size + 1) * 2;
+        buffer->data = realloc(buffer->data, capacity);
+        if(buffer->data == NULL)
+            abort();
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, text, size);
+    buffer->size += size;
+    buffer->data[buffer->size] = '\0';
+}
+
+static void emit(Buffer* buffer, const char* format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    const int size = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    Buffer_append(buffer, text, (size_t)size);
+}
+
+static void collectOutput(void* data, const char* text, size_t size)
+{
+    Buffer_append(data, text, size);
+}
+
+static void ignoreDiagnostic(void* data, const char* message)
+{
+}
+
+
+
+/******************************************************************************/
+/* Generator */
+/******************************************************************************/
+
+typedef struct Generator
+{
+    unsigned long long state;
+    Buffer program;
+
+    char variables[MAX_VARIABLES][16]; /* visible int variables, innermost last */
+    bool assignable[MAX_VARIABLES];
+    int variable_count;
+    int bool_variable;                 /* index of the visible bool variable, -1 if none */
+
+    int function_count;                /* functions that can be called */
+    bool in_function;
+    int loop_depth;
+    int max_loop_depth;
+    char counters[8][16];              /* of the loops around, always valid indices of the matrix */
+    int next_name;
+
+    char last_expression[1024];        /* repeated now and then, for value numbering */
+} Generator;
+
+static unsigned randomBelow(Generator* gen, unsigned bound)
+{
+    gen->state = gen->state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)(gen->state >> 33) % bound;
+}
+
+static void indent(Generator* gen, int depth)
+{
+    for(int i = 0; i < depth; ++i)
+        emit(&gen->program, "    ");
+}
+
+static void addVariable(Generator* gen, const char* name, bool assignable)
+{
+    if(gen->variable_count == MAX_VARIABLES)
+        return;
+    snprintf(gen->variables[gen->variable_count], sizeof(gen->variables[0]), "%s", name);
+    gen->assignable[gen->variable_count++] = assignable;
+}
+
+static int pickAssignable(Generator* gen)
+{
+    int candidates[MAX_VARIABLES];
+    int count = 0;
+    for(int i = 0; i < gen->variable_count; ++i)
+        if(gen->assignable[i])
+            candidates[count++] = i;
+    return (count == 0 ? -1 : candidates[randomBelow(gen, count)]);
+}
+
+static void generateInt(Generator* gen, Buffer* out, int depth);
+
+/* An element of the global matrix m, indexed by loop counters and constants */
+static void generateElement(Generator* gen, Buffer* out)
+{
+    emit(out, "m");
+    for(int i = 0; i < 2; ++i)
+        if(gen->loop_depth > 0 && randomBelow(gen, 3) != 0)
+            emit(out, "[%s]", gen->counters[randomBelow(gen, gen->loop_depth)]);
+        else
+            emit(out, "[%u]", randomBelow(gen, MATRIX_SIZE));
+}
+
+static void generateBool(Generator* gen, Buffer* out, int depth)
+{
+    static const char* const comparisons[] = {"<", ">", "<=", ">=", "==", "!="};
+
+    switch(depth <= 0 ? randomBelow(gen, 2) : randomBelow(gen, 6))
+    {
+    case 0:
+        if(gen->bool_variable >= 0)
+        {
+            emit(out, "b%d", gen->bool_variable);
+            break;
+        }
+        /* fallthrough */
+    case 1:
+    case 2:
+        emit(out, "(");
+        generateInt(gen, out, depth - 1);
+        emit(out, " %s ", comparisons[randomBelow(gen, 6)]);
+        generateInt(gen, out, depth - 1);
+        emit(out, ")");
+        break;
+    case 3:
+        emit(out, "!");
+        generateBool(gen, out, depth - 1);
+        break;
+    default:
+        emit(out, "(");
+        generateBool(gen, out, depth - 1);
+        emit(out, randomBelow(gen, 2) ? " && " : " || ");
+        generateBool(gen, out, depth - 1);
+        emit(out, ")");
+        break;
+    }
+}
+
+static void generateInt(Generator* gen, Buffer* out, int depth)
+{
+    static const char* const operators[] = {"+", "-", "*", "+", "-"};
+
+    switch(depth <= 0 ? randomBelow(gen, 3) : randomBelow(gen, 12))
+    {
+    case 0:
+        emit(out, "%u", randomBelow(gen, 10));
+        break;
+    case 1:
+    case 2:
+        if(randomBelow(gen, 6) == 0)
+            generateElement(gen, out);
+        else if(gen->variable_count == 0)
+            emit(out, "%u", randomBelow(gen, 100));
+        else
+            emit(out, "%s", gen->variables[randomBelow(gen, gen->variable_count)]);
+        break;
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+        emit(out, "(");
+        generateInt(gen, out, depth - 1);
+        emit(out, " %s ", operators[randomBelow(gen, 5)]);
+        generateInt(gen, out, depth - 1);
+        emit(out, ")");
+        break;
+    case 7:
+        /* Mostly constant divisors, so that few programs stop at a division by zero */
+        emit(out, "(");
+        generateInt(gen, out, depth - 1);
+        emit(out, randomBelow(gen, 2) ? " / " : " %% ");
+        if(randomBelow(gen, 16) == 0)
+            generateInt(gen, out, depth - 1);
+        else
+            emit(out, "%u", 1 + randomBelow(gen, 9));
+        emit(out, ")");
+        break;
+    case 8:
+        emit(out, "-(");
+        generateInt(gen, out, depth - 1);
+        emit(out, ")");
+        break;
+    case 9:
+        /* Not in the loops of functions, to keep the calls few */
+        if(gen->function_count > 0 && (!gen->in_function || gen->loop_depth == 0))
+        {
+            emit(out, "f%u(", randomBelow(gen, gen->function_count));
+            generateInt(gen, out, depth - 1);
+            emit(out, ", ");
+            generateInt(gen, out, depth - 1);
+            emit(out, ")");
+            break;
+        }
+        /* fallthrough */
+    case 10:
+        if(gen->last_expression[0] != '\0')
+        {
+            emit(out, "%s", gen->last_expression);
+            break;
+        }
+        /* fallthrough */
+    default:
+    {
+        /* Remembered, to be repeated by a later expression */
+        Buffer expression = {NULL, 0, 0};
+        emit(&expression, "(");
+        generateInt(gen, &expression, depth - 1);
+        emit(&expression, " * ");
+        generateInt(gen, &expression, depth - 1);
+        emit(&expression, ")");
+        if(expression.size < sizeof(gen->last_expression))
+            memcpy(gen->last_expression, expression.data, expression.size + 1);
+        Buffer_append(out, expression.data, expression.size);
+        free(expression.data);
+        break;
+    }
+    }
+}
+
+static void generateStatements(Generator* gen, int depth, int count, bool in_function);
+
+static void reduce(Generator* gen, int depth, const char* target)
+{
+    indent(gen, depth);
+    emit(&gen->program, "%s %%= %d;\n", target, MODULUS);
+}
+
+static void generateStatement(Generator* gen, int depth, bool in_function)
+{
+    static const char* const updates[] = {"=", "+=", "-=", "*=", "=", "+="};
+    Buffer* out = &gen->program;
+    const int variable = pickAssignable(gen);
+    unsigned choice = randomBelow(gen, 14);
+
+    if(variable < 0 && choice < 6)
+        choice = 6;
+    if(gen->loop_depth >= gen->max_loop_depth && choice >= 11)
+        choice = randomBelow(gen, 11);
+
+    indent(gen, depth);
+    switch(choice)
+    {
+    case 0:
+    case 1:
+    case 2:
+        emit(out, "%s %s ", gen->variables[variable], updates[randomBelow(gen, 6)]);
+        generateInt(gen, out, 3);
+        emit(out, ";\n");
+        reduce(gen, depth, gen->variables[variable]);
+        break;
+    case 3:
+        emit(out, "%s %s %u;\n", gen->variables[variable], randomBelow(gen, 2) ? "/=" : "%=", 1 + randomBelow(gen, 9));
+        break;
+    case 4:
+        emit(out, randomBelow(gen, 2) ? "++%s;\n" : "%s--;\n", gen->variables[variable]);
+        break;
+    case 5:
+        if(randomBelow(gen, 2))
+        {
+            const size_t element = out->size;
+            generateElement(gen, out);
+            const int length = (int)(out->size - element);
+            emit(out, " %s ", updates[randomBelow(gen, 6)]);
+            generateInt(gen, out, 2);
+            emit(out, ";\n");
+
+            char target[64];
+            snprintf(target, sizeof(target), "%.*s", length, out->data + element);
+            reduce(gen, depth, target);
+            break;
+        }
+        emit(out, "%s = ", gen->variables[variable]);
+        generateInt(gen, out, 1);
+        emit(out, " + %s++;\n", gen->variables[pickAssignable(gen)]);
+        reduce(gen, depth, gen->variables[variable]);
+        break;
+    case 6:
+    case 7:
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "v%d", gen->next_name++);
+        emit(out, "int %s = ", name);
+        generateInt(gen, out, 3);
+        emit(out, ";\n");
+        addVariable(gen, name, true);
+        break;
+    }
+    case 8:
+        if(!in_function || randomBelow(gen, 3) != 0)
+        {
+            emit(out, "print(");
+            generateInt(gen, out, 3);
+            emit(out, ");\n");
+            break;
+        }
+        emit(out, "if(");
+        generateBool(gen, out, 2);
+        emit(out, ") return ");
+        generateInt(gen, out, 2);
+        emit(out, ";\n");
+        break;
+    case 9:
+    case 10:
+    {
+        const int variables = gen->variable_count;
+        emit(out, "if(");
+        generateBool(gen, out, 3);
+        emit(out, ")\n");
+        indent(gen, depth);
+        emit(out, "{\n");
+        generateStatements(gen, depth + 1, 1 + randomBelow(gen, 3), in_function);
+        gen->variable_count = variables;
+        gen->last_expression[0] = '\0';
+        indent(gen, depth);
+        emit(out, "}\n");
+        if(randomBelow(gen, 2))
+        {
+            indent(gen, depth);
+            emit(out, "else\n");
+            indent(gen, depth);
+            emit(out, "{\n");
+            generateStatements(gen, depth + 1, 1 + randomBelow(gen, 3), in_function);
+            gen->variable_count = variables;
+            gen->last_expression[0] = '\0';
+            indent(gen, depth);
+            emit(out, "}\n");
+        }
+        break;
+    }
+    default:
+    {
+        /* Loops count with a variable of their own that the body does not assign, sometimes stepping another one with it */
+        const int variables = gen->variable_count;
+        const int kind = choice - 11;
+        const unsigned bound = 1 + randomBelow(gen, MATRIX_SIZE - 1);
+        char counter[16];
+        char lockstep[16] = "";
+        snprintf(counter, sizeof(counter), "i%d", gen->next_name++);
+        if(randomBelow(gen, 2))
+        {
+            snprintf(lockstep, sizeof(lockstep), "k%d", gen->next_name++);
+            emit(out, "int %s = %u;\n", lockstep, randomBelow(gen, 10));
+            addVariable(gen, lockstep, false);
+            indent(gen, depth);
+        }
+
+        if(kind == 0)
+            emit(out, "for(int %s = 0; %s < %u; ++%s)\n", counter, counter, bound, counter);
+        else
+        {
+            emit(out, "int %s = 0;\n", counter);
+            indent(gen, depth);
+            emit(out, kind == 1 ? "while(%s < %u)\n" : "do\n", counter, bound);
+        }
+        indent(gen, depth);
+        emit(out, "{\n");
+
+        addVariable(gen, counter, false);
+        snprintf(gen->counters[gen->loop_depth++], sizeof(gen->counters[0]), "%s", counter);
+        generateStatements(gen, depth + 1, 1 + randomBelow(gen, 4), in_function);
+        --gen->loop_depth;
+        gen->variable_count = variables;
+        gen->last_expression[0] = '\0';
+
+        if(lockstep[0] != '\0')
+        {
+            indent(gen, depth + 1);
+            emit(out, randomBelow(gen, 2) ? "++%s;\n" : "%s += 1;\n", lockstep);
+        }
+
+        if(kind != 0)
+        {
+            indent(gen, depth + 1);
+            emit(out, "++%s;\n", counter);
+        }
+        indent(gen, depth);
+        if(kind == 2)
+            emit(out, "} while(%s < %u);\n", counter, bound);
+        else
+            emit(out, "}\n");
+        if(kind != 0)
+            addVariable(gen, counter, false);
+        break;
+    }
+    }
+}
+
+static void generateStatements(Generator* gen, int depth, int count, bool in_function)
+{
+    for(int i = 0; i < count; ++i)
+        generateStatement(gen, depth, in_function);
+}
+
+static void generateProgram(Generator* gen)
+{
+    Buffer* out = &gen->program;
+    out->size = 0;
+    gen->variable_count = 0;
+    gen->function_count = 0;
+    gen->next_name = 0;
+    gen->last_expression[0] = '\0';
+
+    const int globals = 1 + randomBelow(gen, 3);
+    for(int i = 0; i < globals; ++i)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "g%d", i);
+        emit(out, "int %s = %u;\n", name, randomBelow(gen, 20));
+        addVariable(gen, name, true);
+    }
+    emit(out, "bool b0 = %s;\n", randomBelow(gen, 2) ? "true" : "false");
+    emit(out, "int m[%d][%d];\n", MATRIX_SIZE, MATRIX_SIZE);
+    gen->bool_variable = 0;
+
+    /* Functions call only the ones before them, so programs always end */
+    const int functions = randomBelow(gen, MAX_FUNCTIONS + 1);
+    for(int i = 0; i < functions; ++i)
+    {
+        gen->variable_count = globals;
+        gen->last_expression[0] = '\0';
+        emit(out, "int f%d(int a, int b)\n{\n", i);
+        addVariable(gen, "a", true);
+        addVariable(gen, "b", true);
+        gen->loop_depth = 0;
+        gen->max_loop_depth = 1;
+        gen->in_function = true;
+        /* Some functions only return an expression, so that the optimizer inlines them */
+        if(randomBelow(gen, 3) != 0)
+            generateStatements(gen, 1, 2 + randomBelow(gen, 6), true);
+        emit(out, "    return ");
+        generateInt(gen, out, 3);
+        emit(out, ";\n}\n");
+        ++gen->function_count;
+    }
+
+    gen->variable_count = globals;
+    gen->last_expression[0] = '\0';
+    gen->loop_depth = 0;
+    gen->max_loop_depth = 2;
+    gen->in_function = false;
+    generateStatements(gen, 0, 4 + randomBelow(gen, 10), false);
+    for(int i = 0; i < globals; ++i)
+        emit(out, "print(g%d);\n", i);
+    emit(out, "print(m[%u][%u]);\n", randomBelow(gen, MATRIX_SIZE), randomBelow(gen, MATRIX_SIZE));
+}
+
+
+
+/******************************************************************************/
+/* Checker */
+/******************************************************************************/
+
+static int run(const Buffer* program, int level, Buffer* output)
+{
+    output->size = 0;
+    Buffer_append(output, "", 0);
+
+    tema_ctx* ctx = tema_create();
+    tema_set_output(ctx, collectOutput, output);
+    tema_set_diagnostics(ctx, ignoreDiagnostic, NULL);
+    tema_set_optimization(ctx, level);
+    tema_compile_buffer(ctx, program->data, program->size);
+    tema_run(ctx);
+    const int errors = tema_error_count(ctx);
+    tema_destroy(ctx);
+    return errors;
+}
+
+int main(int argc, char** argv)
+{
+    const long count = (argc >= 2 ? strtol(argv[1], NULL, 10) : 500);
+    Generator gen = {0};
+    gen.state = (argc >= 3 ? strtoull(argv[2], NULL, 10) : 1);
+
+    Buffer outputs[3] = {{NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}};
+    long failed_runs = 0;
+
+    for(long i = 0; i < count; ++i)
+    {
+        generateProgram(&gen);
+
+        int errors[3];
+        for(int level = 0; level < 3; ++level)
+            errors[level] = run(&gen.program, level, &outputs[level]);
+        failed_runs += (errors[0] != 0);
+
+        for(int level = 1; level < 3; ++level)
+            if(errors[level] != errors[0] || strcmp(outputs[level].data, outputs[0].data) != 0)
+            {
+                fprintf(stderr, "program %ld differs at -O%d (%d errors, %d at -O0), written to opt_check_failure.tm\n", i, level, errors[level], errors[0]);
+                FILE* fp = fopen("opt_check_failure.tm", "w");
+                if(fp != NULL)
+                {
+                    fwrite(gen.program.data, 1, gen.program.size, fp);
+                    fclose(fp);
+                }
+                return 1;
+            }
+    }
+
+    printf("%ld programs print the same at -O0, -O1 and -O2 (%ld stopped by errors)\n", count, failed_runs);
+    for(int level = 0; level < 3; ++level)
+        free(outputs[level].data);
+    free(gen.program.data);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../libtema.h"
+#include "common.h"
+
+/* Times a parallel loop whose iterations do uneven work, write an element of a shared array and add to a reduction,
+ * on 1, 2, 4 and 8 threads, against the same loop written as a plain for. The output must be the same.
+ * Usage: bench/parallel_bench [iterations] [work] */
+
+
+/* %1$s is the loop, %2$ld the iterations and %3$ld the work of the last ones, which do more than the first */
+static const char program[] =
+    "int a[%2$ld];\n"
+    "int total = 0;\n"
+    "%1$s(int i = 0; i < %2$ld; ++i)\n"
+    "{\n"
+    "    int x = i;\n"
+    "    int steps = %3$ld / 2 + i * %3$ld / %2$ld;\n"
+    "    for(int k = 0; k < steps; ++k)\n"
+    "        x = (x * 7 + k) / 3 + 1;\n"
+    "    a[i] = x;\n"
+    "    total += x;\n"
+    "}\n"
+    "print(total);\n"
+    "print(a[%2$ld - 1]);\n";
+
+int main(int argc, char** argv)
+{
+    const long iterations = (argc >= 2 ? strtol(argv[1], NULL, 10) : 20000);
+    const long work = (argc >= 3 ? strtol(argv[2], NULL, 10) : 200);
+    if(iterations < 1 || work < 2)
+    {
+        fprintf(stderr, "usage: %s [iterations] [work]\n", argv[0]);
+        return 1;
+    }
+
+    char sequential[2048], parallel[2048];
+    snprintf(sequential, sizeof(sequential), program, "for", iterations, work);
+    snprintf(parallel, sizeof(parallel), program, "parallel reduce(total) for", iterations, work);
+
+    const double for_time = timeProgramWith(sequential, strlen(sequential), &(BenchOptions){.threads = 1});
+    if(for_time < 0)
+    {
+        fprintf(stderr, "the loop failed\n");
+        return 1;
+    }
+    char expected[sizeof(output)];
+    strcpy(expected, output);
+
+    printf("%ld iterations of %ld to %ld steps, %ld processors\n", iterations, work / 2, work / 2 + work, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("for          %9.3f ms\n", for_time * 1e3);
+
+    const int threads[] = {1, 2, 4, 8};
+    double single_time = 0;
+    int failures = 0;
+    for(size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+    {
+        const double elapsed = timeProgramWith(parallel, strlen(parallel), &(BenchOptions){.threads = threads[i]});
+        if(elapsed < 0)
+        {
+            fprintf(stderr, "the parallel loop failed\n");
+            return 1;
+        }
+
+        if(i == 0)
+            single_time = elapsed;
+        const bool same = (strcmp(expected, output) == 0);
+        failures += !same;
+        printf("%d thread%s    %9.3f ms   %5.2fx speedup   %5.2fx for%s\n", threads[i], (threads[i] == 1 ? " " : "s"), elapsed * 1e3,
+               single_time / elapsed, for_time / elapsed, (same ? "" : "   DIFFERENT OUTPUT"));
+    }
+
+    return (failures != 0);
+}
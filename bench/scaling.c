@@ -0,0 +1,256 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "common.h"
+
+/* Times the tema binary on families of generated programs of sizes n, 2n, 4n and 8n along each axis, fits the exponent
+ * of the growth of the time and fails when it is larger than the one of the bound declared for the axis. Axes known to
+ * exceed their bound are held to the exponent they were measured at instead, so they still fail when they get worse.
+ * The times, the exponents and the input of the largest size of each axis are kept in the results directory.
+ * Usage: bench/scaling [tema] [results directory] */
+
+#define SIZES     4
+#define TOLERANCE 0.15  /* of the exponent, for the noise of the timer and of the machine */
+
+extern char** environ;
+
+typedef struct Axis
+{
+    const char* name;
+    long n;
+    double power;       /* the bound is n^power log(n)^log_power */
+    double log_power;
+    const char* bound;
+    void (*generate)(FILE* fp, long n);
+    const char* known;  /* why the axis exceeds its bound for now, NULL if it meets it */
+    double measured;    /* highest exponent of a known axis over a few runs, which it must not exceed */
+} Axis;
+
+static void generateGlobals(FILE* fp, long n)
+{
+    for(long i = 0; i < n; ++i)
+        fprintf(fp, "int g%ld = %ld;\n", i, i);
+    fputs("print(g0);\n", fp);
+}
+
+/* The depth the parser allows is limited, so the same nest is repeated */
+static void generateNesting(FILE* fp, long n)
+{
+    fputs("int x = 0;\n", fp);
+    for(int nest = 0; nest < 8; ++nest)
+    {
+        for(long i = 0; i < n; ++i)
+            fprintf(fp, "{ int v%ld = %ld;\n", i, i);
+        fputs("x = x + 1;\n", fp);
+        for(long i = 0; i < n; ++i)
+            fputs("}\n", fp);
+    }
+    fputs("print(x);\n", fp);
+}
+
+/* The overloads take PARAMETERS objects of CLASSES classes, so their number grows and the classes stay the same.
+ * Every fourth one is called */
+#define CLASSES    8
+#define PARAMETERS 5
+
+static void generateOverloads(FILE* fp, long n)
+{
+    for(int i = 0; i < CLASSES; ++i)
+        fprintf(fp, "class C%d { public int v; }\nC%d c%d;\n", i, i, i);
+    for(long i = 0; i < n; ++i)
+    {
+        fputs("int f(", fp);
+        for(long k = 0, digits = i; k < PARAMETERS; ++k, digits /= CLASSES)
+            fprintf(fp, "%sC%ld p%ld", (k != 0 ? ", " : ""), digits % CLASSES, k);
+        fprintf(fp, ") { return %ld; }\n", i);
+    }
+    for(long i = 0; i < n; i += 4)
+    {
+        fputs("print(f(", fp);
+        for(long k = 0, digits = i; k < PARAMETERS; ++k, digits /= CLASSES)
+            fprintf(fp, "%sc%ld", (k != 0 ? ", " : ""), digits % CLASSES);
+        fputs("));\n", fp);
+    }
+}
+
+static void generateAppends(FILE* fp, long n)
+{
+    fprintf(fp, "string s = \"\";\nfor(int i = 0; i < %ld; ++i)\n    s += \"x\";\nprint(1);\n", n);
+}
+
+static void generateStatements(FILE* fp, long n)
+{
+    fputs("int x = 0;\n", fp);
+    for(long i = 0; i < n; ++i)
+        fputs("x = x + 1;\n", fp);
+    fputs("print(x);\n", fp);
+}
+
+/* The bounds are those the front end should meet, with a sorted or hashed table for every lookup */
+static const Axis axes[] =
+{
+    {"globals",    2000,  1, 1, "O(n log n)", generateGlobals,    "a declaration moves the later names of the sorted table of variables", 1.5},
+    {"nesting",    150,   1, 1, "O(n log n)", generateNesting,    "a block copies the table of the variables it sees", 1.7},
+    {"overloads",  1000,  1, 1, "O(n log n)", generateOverloads,  "the overloads of a name are compared one by one with the arguments of a call", 1.7},
+    {"appends",    10000, 1, 0, "O(n)",       generateAppends,    "every append copies the string", 2.1},
+    {"statements", 20000, 1, 0, "O(n)",       generateStatements, NULL, 0}
+};
+
+/* Returns the best of RUNS times taken by tema to run the file, or -1 if it failed */
+static double timeRun(const char* tema, const char* path)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+    char* const argv[] = {(char*)tema, (char*)path, NULL};
+    double best = -1;
+    for(int run = 0; run < RUNS; ++run)
+    {
+        const double start = now();
+        pid_t pid;
+        int status;
+        if(posix_spawn(&pid, tema, &actions, NULL, argv, environ) != 0 || waitpid(pid, &status, 0) != pid)
+        {
+            best = -1;
+            break;
+        }
+
+        const double elapsed = now() - start;
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            best = -1;
+            break;
+        }
+        if(best < 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    return best;
+}
+
+/* Slope of the least squares line through the points (log x, log y) */
+static double fitExponent(const double* x, const double* y, int count)
+{
+    double mean_x = 0;
+    double mean_y = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        mean_x += log(x[i]) / count;
+        mean_y += log(y[i]) / count;
+    }
+
+    double covariance = 0;
+    double variance = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        covariance += (log(x[i]) - mean_x) * (log(y[i]) - mean_y);
+        variance += (log(x[i]) - mean_x) * (log(x[i]) - mean_x);
+    }
+    return covariance / variance;
+}
+
+int main(int argc, char** argv)
+{
+    const char* tema = (argc >= 2 ? argv[1] : "./tema");
+    const char* directory = (argc >= 3 ? argv[2] : "bench/scaling-results");
+
+    if(mkdir(directory, 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "cannot create %s: %s\n", directory, strerror(errno));
+        return 1;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/times.csv", directory);
+    FILE* times = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s/summary.txt", directory);
+    FILE* summary = fopen(path, "w");
+    if(times == NULL || summary == NULL)
+    {
+        fprintf(stderr, "cannot write the results in %s\n", directory);
+        return 1;
+    }
+    fputs("axis,n,seconds\n", times);
+
+    /* The time to start the process and to parse nothing is taken off every run */
+    snprintf(path, sizeof(path), "%s/empty.tm", directory);
+    FILE* fp = fopen(path, "w");
+    if(fp != NULL)
+        fclose(fp);
+    const double startup = timeRun(tema, path);
+    remove(path);
+    if(startup < 0)
+    {
+        fprintf(stderr, "cannot run %s\n", tema);
+        return 1;
+    }
+
+    int failures = 0;
+    for(size_t i = 0; i < sizeof(axes) / sizeof(axes[0]); ++i)
+    {
+        const Axis* axis = &axes[i];
+        double sizes[SIZES];
+        double seconds[SIZES];
+        double bounds[SIZES];
+
+        snprintf(path, sizeof(path), "%s/%s.tm", directory, axis->name);
+        for(int j = 0; j < SIZES; ++j)
+        {
+            const long n = axis->n << j;
+            fp = fopen(path, "w");
+            if(fp == NULL)
+            {
+                fprintf(stderr, "cannot write %s\n", path);
+                return 1;
+            }
+            axis->generate(fp, n);
+            fclose(fp);
+
+            const double elapsed = timeRun(tema, path);
+            if(elapsed < 0)
+            {
+                fprintf(stderr, "%s failed at n = %ld, the input is %s\n", axis->name, n, path);
+                return 1;
+            }
+
+            sizes[j] = n;
+            seconds[j] = fmax(elapsed - startup, 1e-4);
+            bounds[j] = pow(n, axis->power) * pow(log(n), axis->log_power);
+            fprintf(times, "%s,%ld,%.6f\n", axis->name, n, seconds[j]);
+        }
+
+        const double exponent = fitExponent(sizes, seconds, SIZES);
+        const double bound = fitExponent(sizes, bounds, SIZES) + TOLERANCE;
+        const double limit = (axis->known != NULL ? axis->measured + TOLERANCE : bound);
+        const bool failed = (exponent > limit);
+        failures += failed;
+
+        const char* verdict = (failed ? "FAIL" : (exponent > bound ? "known" : (axis->known != NULL ? "ok, now within its bound" : "ok")));
+        char line[512];
+        snprintf(line, sizeof(line), "%-10s n %6ld..%-7ld %8.3f ms..%9.3f ms   exponent %5.2f   bound %-10s (at most %4.2f)   %s%s%s\n",
+                 axis->name, axis->n, axis->n << (SIZES - 1), seconds[0] * 1e3, seconds[SIZES - 1] * 1e3,
+                 exponent, axis->bound, limit, verdict, (axis->known != NULL ? ": " : ""), (axis->known != NULL ? axis->known : ""));
+        fputs(line, stdout);
+        fputs(line, summary);
+    }
+
+    fclose(times);
+    fclose(summary);
+    if(failures != 0)
+    {
+        fprintf(stderr, "%d axes grow faster than their limit, the results are in %s\n", failures, directory);
+        return 1;
+    }
+    return 0;
+}
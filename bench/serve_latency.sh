@@ -0,0 +1,26 @@
+#!/bin/sh
+# Compares the latency of running a script through fork/exec of ./tema
+# with sending it to a running `tema --serve` instance.
+# Usage: bench/serve_latency.sh [file] [count]
+
+FILE=${1:-test.txt}
+COUNT=${2:-1000}
+SOCKET=${TMPDIR:-/tmp}/tema-bench.$$.sock
+
+./tema --serve "$SOCKET" --workers 1 &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null' EXIT
+
+while [ ! -S "$SOCKET" ]; do sleep 0.01; done
+
+START=$(date +%s%N)
+i=0
+while [ $i -lt "$COUNT" ]; do
+    ./tema "$FILE" > /dev/null 2>&1
+    i=$((i + 1))
+done
+END=$(date +%s%N)
+echo "fork/exec: $(( (END - START) / COUNT / 1000 )) us per run"
+
+printf "server:    "
+./tema-client -n "$COUNT" "$SOCKET" "$FILE" 2>&1 >/dev/null | tail -n 1
@@ -0,0 +1,75 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#include "common.h"
+
+/* Times a loop dispatching on 256 case values with a switch and with the equivalent chain of if statements, for values
+ * that are dense, which take a table, and values spread out, which take a binary search. The output must be the same.
+ * Usage: bench/switch_bench [iterations] */
+
+#define CASES 256
+#define SPREAD 1009 /* between the sparse values */
+
+/* A loop adding the result of the case of every value. One value in six has no case and runs the default */
+static void writeProgram(Source* source, bool sparse, bool chain, long iterations)
+{
+    const int scale = (sparse ? SPREAD : 1);
+    source->size = 0;
+    emit(source, "int s = 0;\nint i = 0;\nwhile(i < %ld)\n{\n    int x = i %% %d * %d;\n", iterations, CASES + CASES / 5, scale);
+    if(chain)
+    {
+        for(int k = 0; k < CASES; ++k)
+            emit(source, "    %sif(x == %d) s += %d;\n", (k != 0 ? "else " : ""), k * scale, k * 37 % 101);
+        emit(source, "    else s += 1;\n");
+    }
+    else
+    {
+        emit(source, "    switch(x)\n    {\n");
+        for(int k = 0; k < CASES; ++k)
+            emit(source, "    case %d: s += %d;\n", k * scale, k * 37 % 101);
+        emit(source, "    default: s += 1;\n    }\n");
+    }
+    emit(source, "    ++i;\n}\nprint(s);\n");
+}
+
+int main(int argc, char** argv)
+{
+    const long iterations = (argc >= 2 ? strtol(argv[1], NULL, 10) : 100000);
+    if(iterations < 1)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%ld iterations, %d cases\n", iterations, CASES);
+    Source source = {NULL, 0, 0};
+    int failures = 0;
+    for(int sparse = 0; sparse < 2; ++sparse)
+    {
+        double times[2];
+        char outputs[2][sizeof(output)];
+        for(int chain = 0; chain < 2; ++chain)
+        {
+            writeProgram(&source, sparse, chain, iterations);
+            if((times[chain] = timeProgram(source.data, source.size)) < 0)
+            {
+                fprintf(stderr, "the %s %s failed\n", (sparse ? "sparse" : "dense"), (chain ? "chain" : "switch"));
+                return 1;
+            }
+            strcpy(outputs[chain], output);
+        }
+
+        const bool same = (strcmp(outputs[0], outputs[1]) == 0);
+        failures += !same;
+        printf("%-6s  switch %9.3f ms  %7.1f ns per iteration   if chain %9.3f ms  %7.1f ns   %6.1fx%s\n", (sparse ? "sparse" : "dense"),
+               times[0] * 1e3, times[0] * 1e9 / iterations, times[1] * 1e3, times[1] * 1e9 / iterations, times[1] / times[0],
+               (same ? "" : "   DIFFERENT OUTPUT"));
+    }
+
+    free(source.data);
+    return (failures != 0);
+}
@@ -0,0 +1,143 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../libtema.h"
+#include "common.h"
+
+/* Times the analysis of a program declaring many global variables and some functions, without and with statements reading them
+ * in a scattered order. The difference is the time to analyze the reads, most of it spent looking up the names.
+ * Usage: bench/symbol_bench [symbols] [reads] */
+
+#define FUNCTION_SPREAD 64
+
+typedef char Name[32];
+
+static unsigned long mix(unsigned long x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdUL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Names of a few random letters, distinct since they end with '_' and the digits of their index in base 26. Some share a
+ * long prefix */
+static void symbolName(long index, char* name)
+{
+    const unsigned long hash = mix(index + 1);
+    const char* prefixes[] = {"", "", "count_", "total_value_"};
+    int length = sprintf(name, "%s", prefixes[hash % 4]);
+    for(int k = 0; k < 2 + (int)(hash >> 8) % 4; ++k)
+        name[length++] = 'a' + (hash >> (16 + 5 * k)) % 26;
+    name[length++] = '_';
+    for(long rest = index; ; rest /= 26)
+    {
+        name[length++] = 'a' + rest % 26;
+        if(rest < 26)
+            break;
+    }
+    name[length] = '\0';
+}
+
+static int compareNames(const void* lval, const void* rval)
+{
+    return strcmp(lval, rval);
+}
+
+/* The globals and one function per FUNCTION_SPREAD of them, then reads statements adding the value of one of them, and prints
+ * the sum. Declarations come in the order of the names, which appends them to the sorted lists of the analysis, so that the
+ * time goes to the reads. The functions come first, since every body copies the scope it is declared in */
+static void writeProgram(Source* source, const Name* names, long symbols, long reads, long* sum)
+{
+    source->size = 0;
+    for(long i = 0; i < symbols; i += FUNCTION_SPREAD)
+        emit(source, "int f_%s(int x) { return x; }\n", names[i]);
+    for(long i = 0; i < symbols; ++i)
+        emit(source, "int %s = %ld;\n", names[i], i % 1000);
+
+    (*sum) = 0;
+    emit(source, "int s = 0;\n");
+    for(long i = 0; i < reads; ++i)
+    {
+        const long index = mix(i * 7919 + 13) % symbols;
+        if(i % 4 == 0)
+            emit(source, "s += f_%s(%s);\n", names[index / FUNCTION_SPREAD * FUNCTION_SPREAD], names[index]);
+        else
+            emit(source, "s += %s;\n", names[index]);
+        (*sum) += index % 1000;
+    }
+    emit(source, "print(s);\n");
+}
+
+/* Best of RUNS times to compile the source, or -1 if it failed or printed something else than expected */
+static double timeCompile(const Source* source, const char* expected)
+{
+    double fastest = -1;
+    for(int run = 0; run < RUNS; ++run)
+    {
+        tema_ctx* ctx = tema_create();
+        tema_set_output(ctx, captureOutput, NULL);
+        tema_set_optimization(ctx, 0);
+        output_size = 0;
+
+        const double start = now();
+        int error = tema_compile_buffer(ctx, source->data, source->size);
+        const double elapsed = now() - start;
+        error |= tema_run(ctx);
+        tema_destroy(ctx);
+
+        output[output_size] = '\0';
+        if(error != 0 || strcmp(output, expected) != 0)
+            return -1;
+        if(fastest < 0 || elapsed < fastest)
+            fastest = elapsed;
+    }
+    return fastest;
+}
+
+int main(int argc, char** argv)
+{
+    const long symbols = (argc >= 2 ? strtol(argv[1], NULL, 10) : 100000);
+    const long reads = (argc >= 3 ? strtol(argv[2], NULL, 10) : 400000);
+    if(symbols < 1 || reads < 1)
+    {
+        fprintf(stderr, "usage: %s [symbols] [reads]\n", argv[0]);
+        return 1;
+    }
+
+    Name* names = malloc(symbols * sizeof(names[0]));
+    if(names == NULL)
+    {
+        fprintf(stderr, "not enough memory for the names\n");
+        return 1;
+    }
+    for(long i = 0; i < symbols; ++i)
+        symbolName(i, names[i]);
+    qsort(names, symbols, sizeof(names[0]), compareNames);
+
+    Source source = {NULL, 0, 0};
+    long sum;
+    char expected[2][32];
+    double times[2];
+    for(int with_reads = 0; with_reads < 2; ++with_reads)
+    {
+        writeProgram(&source, names, symbols, (with_reads ? reads : 0), &sum);
+        snprintf(expected[with_reads], sizeof(expected[with_reads]), "%ld\n", sum);
+        if((times[with_reads] = timeCompile(&source, expected[with_reads])) < 0)
+        {
+            fprintf(stderr, "the program %s reads failed\n", (with_reads ? "with" : "without"));
+            return 1;
+        }
+    }
+
+    printf("%ld variables and %ld functions\n", symbols, (symbols + FUNCTION_SPREAD - 1) / FUNCTION_SPREAD);
+    printf("declarations %9.3f ms   with %ld reads %9.3f ms   %7.1f ns per read\n", times[0] * 1e3, reads, times[1] * 1e3,
+           (times[1] - times[0]) * 1e9 / reads);
+
+    free(source.data);
+    free(names);
+    return 0;
+}
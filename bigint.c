@@ -0,0 +1,444 @@
+#include "bigint.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#define TEN_TO_19 10000000000000000000ull /* the largest power of 10 in a limb */
+
+/* Sign and magnitude. The magnitude does not fit in a small int */
+typedef struct BigInt
+{
+    int sign;            /* 1 or -1 */
+    int size;            /* limbs, the most significant one is not 0 */
+    uint64_t limbs[];    /* least significant first */
+} BigInt;
+
+/* An operand of an operation, a BigInt or a small int spread into a limb */
+typedef struct Operand
+{
+    int sign;
+    int size;            /* 0 for zero */
+    const uint64_t* limbs;
+    uint64_t small;
+} Operand;
+
+size_t bigint_count = 0;
+
+
+
+/* malloc aligns to 16 bytes and addresses take less than 60 bits, so the address shifted right by 4 fits in the range of BigInts */
+static BigInt* bigOf(long value)
+{
+    return (BigInt*)(uintptr_t)(((unsigned long)value - (unsigned long)LONG_MIN) << 4);
+}
+
+static long valueOf(const BigInt* big)
+{
+    return (long)((unsigned long)LONG_MIN + ((uintptr_t)big >> 4));
+}
+
+static BigInt* allocate(int size)
+{
+    BigInt* big = malloc(sizeof(*big) + size * sizeof(big->limbs[0]));
+    if(big == NULL)
+    {
+        yyerror("not enough memory for an int of %d bits", size * 64);
+        abort();
+    }
+    if(((uintptr_t)big & 15) != 0 || ((uintptr_t)big >> 60) != 0)
+    {
+        yyerror("not enough memory for an int of %d bits at an address that ints can refer to", size * 64);
+        abort();
+    }
+
+    big->sign = 1;
+    big->size = size;
+    __atomic_add_fetch(&bigint_count, 1, __ATOMIC_RELAXED);
+    return big;
+}
+
+static void destroy(BigInt* big)
+{
+    __atomic_sub_fetch(&bigint_count, 1, __ATOMIC_RELAXED);
+    free(big);
+}
+
+/* Drops the leading zeros and demotes the result if it fits in a small int */
+static long finish(BigInt* big)
+{
+    while(big->size > 0 && big->limbs[big->size - 1] == 0)
+        --big->size;
+
+    if(big->size <= 1)
+    {
+        const uint64_t magnitude = (big->size == 1 ? big->limbs[0] : 0);
+        if(big->sign > 0 && magnitude <= (uint64_t)LONG_MAX)
+        {
+            destroy(big);
+            return (long)magnitude;
+        }
+        if(big->sign < 0 && magnitude <= 0ull - (unsigned long)INT_SMALL_MIN)
+        {
+            destroy(big);
+            return (long)(0ull - magnitude);
+        }
+    }
+
+    return valueOf(big);
+}
+
+static void operandOf(long value, Operand* operand)
+{
+    if(Int_isBig(value))
+    {
+        const BigInt* big = bigOf(value);
+        operand->sign = big->sign;
+        operand->size = big->size;
+        operand->limbs = big->limbs;
+        return;
+    }
+
+    operand->sign = (value < 0 ? -1 : 1);
+    operand->small = (value < 0 ? 0ul - (unsigned long)value : (unsigned long)value);
+    operand->size = (value != 0);
+    operand->limbs = &operand->small;
+}
+
+
+
+/* Magnitudes */
+static int compareMagnitudes(const Operand* lval, const Operand* rval)
+{
+    if(lval->size != rval->size)
+        return (lval->size > rval->size ? 1 : -1);
+
+    for(int i = lval->size - 1; i >= 0; --i)
+        if(lval->limbs[i] != rval->limbs[i])
+            return (lval->limbs[i] > rval->limbs[i] ? 1 : -1);
+    return 0;
+}
+
+/* lval has at least as many limbs as rval, result has one more */
+static void addMagnitudes(uint64_t* result, const Operand* lval, const Operand* rval)
+{
+    uint64_t carry = 0;
+    for(int i = 0; i < lval->size; ++i)
+    {
+        const unsigned __int128 sum = (unsigned __int128)lval->limbs[i] + (i < rval->size ? rval->limbs[i] : 0) + carry;
+        result[i] = (uint64_t)sum;
+        carry = (uint64_t)(sum >> 64);
+    }
+    result[lval->size] = carry;
+}
+
+/* lval is at least rval */
+static void subtractMagnitudes(uint64_t* result, const Operand* lval, const Operand* rval)
+{
+    uint64_t borrow = 0;
+    for(int i = 0; i < lval->size; ++i)
+    {
+        const uint64_t subtrahend = (i < rval->size ? rval->limbs[i] : 0);
+        const uint64_t difference = lval->limbs[i] - subtrahend - borrow;
+        borrow = (lval->limbs[i] < subtrahend || (lval->limbs[i] == subtrahend && borrow != 0));
+        result[i] = difference;
+    }
+}
+
+/* result has the limbs of both operands, zeroed */
+static void multiplyMagnitudes(uint64_t* result, const Operand* lval, const Operand* rval)
+{
+    for(int i = 0; i < lval->size; ++i)
+    {
+        uint64_t carry = 0;
+        for(int j = 0; j < rval->size; ++j)
+        {
+            const unsigned __int128 product = (unsigned __int128)lval->limbs[i] * rval->limbs[j] + result[i + j] + carry;
+            result[i + j] = (uint64_t)product;
+            carry = (uint64_t)(product >> 64);
+        }
+        result[i + rval->size] = carry;
+    }
+}
+
+/* quotient may be the dividend. Returns the remainder */
+static uint64_t divideByLimb(uint64_t* quotient, const uint64_t* dividend, int size, uint64_t divisor)
+{
+    uint64_t remainder = 0;
+    for(int i = size - 1; i >= 0; --i)
+    {
+        const unsigned __int128 current = ((unsigned __int128)remainder << 64) | dividend[i];
+        quotient[i] = (uint64_t)(current / divisor);
+        remainder = (uint64_t)(current % divisor);
+    }
+    return remainder;
+}
+
+/* Knuth's algorithm D, for a divisor of at least two limbs and a dividend at least as long.
+ * quotient gets size(lval) - size(rval) + 1 limbs and remainder size(rval) limbs */
+static void divideMagnitudes(uint64_t* quotient, uint64_t* remainder, const Operand* lval, const Operand* rval)
+{
+    const int m = lval->size;
+    const int n = rval->size;
+    uint64_t* u = malloc((m + 1 + n) * sizeof(u[0]));
+    if(u == NULL)
+    {
+        yyerror("not enough memory to divide an int of %d bits", m * 64);
+        abort();
+    }
+    uint64_t* v = u + m + 1;
+
+    /* The divisor is shifted until its top bit is set, so every guess of a quotient limb is at most 2 too large */
+    const int shift = __builtin_clzll(rval->limbs[n - 1]);
+    for(int i = n - 1; i >= 0; --i)
+        v[i] = (rval->limbs[i] << shift) | (shift != 0 && i > 0 ? rval->limbs[i - 1] >> (64 - shift) : 0);
+    u[m] = (shift != 0 ? lval->limbs[m - 1] >> (64 - shift) : 0);
+    for(int i = m - 1; i >= 0; --i)
+        u[i] = (lval->limbs[i] << shift) | (shift != 0 && i > 0 ? lval->limbs[i - 1] >> (64 - shift) : 0);
+
+    for(int j = m - n; j >= 0; --j)
+    {
+        const unsigned __int128 top = ((unsigned __int128)u[j + n] << 64) | u[j + n - 1];
+        unsigned __int128 guess = top / v[n - 1];
+        unsigned __int128 rest = top % v[n - 1];
+        while((guess >> 64) != 0 || guess * v[n - 2] > ((rest << 64) | u[j + n - 2]))
+        {
+            guess -= 1;
+            rest += v[n - 1];
+            if((rest >> 64) != 0)
+                break;
+        }
+
+        uint64_t carry = 0;
+        uint64_t borrow = 0;
+        for(int i = 0; i < n; ++i)
+        {
+            const unsigned __int128 product = (unsigned __int128)(uint64_t)guess * v[i] + carry;
+            carry = (uint64_t)(product >> 64);
+            const uint64_t low = (uint64_t)product;
+            const uint64_t difference = u[i + j] - low - borrow;
+            borrow = (u[i + j] < low || (u[i + j] == low && borrow != 0));
+            u[i + j] = difference;
+        }
+        const uint64_t difference = u[j + n] - carry - borrow;
+        borrow = (u[j + n] < carry || (u[j + n] == carry && borrow != 0));
+        u[j + n] = difference;
+
+        quotient[j] = (uint64_t)guess;
+        if(borrow != 0)
+        {
+            /* The guess was one too large, add the divisor back */
+            quotient[j] -= 1;
+            uint64_t add_carry = 0;
+            for(int i = 0; i < n; ++i)
+            {
+                const unsigned __int128 sum = (unsigned __int128)u[i + j] + v[i] + add_carry;
+                u[i + j] = (uint64_t)sum;
+                add_carry = (uint64_t)(sum >> 64);
+            }
+            u[j + n] += add_carry;
+        }
+    }
+
+    for(int i = 0; i < n; ++i)
+        remainder[i] = (u[i] >> shift) | (shift != 0 ? u[i + 1] << (64 - shift) : 0);
+    free(u);
+}
+
+
+
+/* Arithmetic */
+static long addSigned(long lval, long rval, int rsign)
+{
+    Operand l, r;
+    operandOf(lval, &l);
+    operandOf(rval, &r);
+    r.sign *= rsign;
+
+    const Operand* larger = &l;
+    const Operand* smaller = &r;
+    BigInt* result;
+    if(l.sign == r.sign)
+    {
+        if(r.size > l.size)
+        {
+            larger = &r;
+            smaller = &l;
+        }
+
+        result = allocate(larger->size + 1);
+        result->sign = l.sign;
+        addMagnitudes(result->limbs, larger, smaller);
+    }
+    else
+    {
+        if(compareMagnitudes(&l, &r) < 0)
+        {
+            larger = &r;
+            smaller = &l;
+        }
+
+        result = allocate(larger->size);
+        result->sign = larger->sign;
+        subtractMagnitudes(result->limbs, larger, smaller);
+    }
+
+    const long value = finish(result);
+    Int_release(lval);
+    Int_release(rval);
+    return value;
+}
+
+long BigInt_add(long lval, long rval)
+{
+    return addSigned(lval, rval, 1);
+}
+
+long BigInt_sub(long lval, long rval)
+{
+    return addSigned(lval, rval, -1);
+}
+
+long BigInt_mul(long lval, long rval)
+{
+    Operand l, r;
+    operandOf(lval, &l);
+    operandOf(rval, &r);
+
+    BigInt* result = allocate(l.size + r.size);
+    result->sign = l.sign * r.sign;
+    memset(result->limbs, 0, result->size * sizeof(result->limbs[0]));
+    if(l.size >= r.size)
+        multiplyMagnitudes(result->limbs, &l, &r);
+    else
+        multiplyMagnitudes(result->limbs, &r, &l);
+
+    const long value = finish(result);
+    Int_release(lval);
+    Int_release(rval);
+    return value;
+}
+
+static long divide(long lval, long rval, bool remainder)
+{
+    Operand l, r;
+    operandOf(lval, &l);
+    operandOf(rval, &r);
+
+    long value;
+    if(compareMagnitudes(&l, &r) < 0)
+        value = (remainder ? Int_copy(lval) : 0);
+    else
+    {
+        BigInt* quotient = allocate(l.size - r.size + 1);
+        BigInt* rest = allocate(r.size);
+        quotient->sign = l.sign * r.sign;
+        rest->sign = l.sign;
+
+        if(r.size == 1)
+            rest->limbs[0] = divideByLimb(quotient->limbs, l.limbs, l.size, r.limbs[0]);
+        else
+            divideMagnitudes(quotient->limbs, rest->limbs, &l, &r);
+
+        if(remainder)
+        {
+            destroy(quotient);
+            value = finish(rest);
+        }
+        else
+        {
+            destroy(rest);
+            value = finish(quotient);
+        }
+    }
+
+    Int_release(lval);
+    Int_release(rval);
+    return value;
+}
+
+long BigInt_div(long lval, long rval)
+{
+    return divide(lval, rval, false);
+}
+
+long BigInt_mod(long lval, long rval)
+{
+    return divide(lval, rval, true);
+}
+
+long BigInt_neg(long value)
+{
+    Operand operand;
+    operandOf(value, &operand);
+
+    BigInt* result = allocate(operand.size);
+    result->sign = -operand.sign;
+    memcpy(result->limbs, operand.limbs, operand.size * sizeof(result->limbs[0]));
+
+    const long negated = finish(result);
+    Int_release(value);
+    return negated;
+}
+
+int BigInt_compare(long lval, long rval)
+{
+    Operand l, r;
+    operandOf(lval, &l);
+    operandOf(rval, &r);
+
+    const int lsign = (l.size == 0 ? 0 : l.sign);
+    const int rsign = (r.size == 0 ? 0 : r.sign);
+    if(lsign != rsign)
+        return (lsign > rsign ? 1 : -1);
+    return lsign * compareMagnitudes(&l, &r);
+}
+
+long BigInt_copy(long value)
+{
+    const BigInt* big = bigOf(value);
+    BigInt* copy = allocate(big->size);
+    copy->sign = big->sign;
+    memcpy(copy->limbs, big->limbs, big->size * sizeof(big->limbs[0]));
+    return valueOf(copy);
+}
+
+void BigInt_release(long value)
+{
+    destroy(bigOf(value));
+}
+
+
+
+/* Groups of 19 digits are split off the least significant end */
+char* BigInt_toString(long value)
+{
+    Operand operand;
+    operandOf(value, &operand);
+
+    const int size = operand.size;
+    char* text = malloc(size * 20 + 22);
+    uint64_t* limbs = malloc((2 * size + 1) * sizeof(limbs[0]));
+    if(text == NULL || limbs == NULL)
+    {
+        yyerror("not enough memory to write an int of %d bits", size * 64);
+        abort();
+    }
+
+    uint64_t* groups = limbs + size;
+    memcpy(limbs, operand.limbs, size * sizeof(limbs[0]));
+    int count = 0;
+    for(int left = size; left > 0; )
+    {
+        groups[count++] = divideByLimb(limbs, limbs, left, TEN_TO_19);
+        while(left > 0 && limbs[left - 1] == 0)
+            --left;
+    }
+
+    int length = sprintf(text, "%s%llu", (operand.sign < 0 && size != 0 ? "-" : ""), (unsigned long long)(count != 0 ? groups[count - 1] : 0));
+    for(int i = count - 2; i >= 0; --i)
+        length += sprintf(text + length, "%019llu", (unsigned long long)groups[i]);
+
+    free(limbs);
+    return text;
+}
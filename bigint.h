@@ -0,0 +1,110 @@
+#ifndef INCLUDED_BIGINT_H
+#define INCLUDED_BIGINT_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* An int is a long. The lowest 2^56 longs stand for a BigInt, an integer of any size allocated on its own, and the other
+ * longs are small ints, their own value. Operations on small ints check for overflow and promote the results that do not fit,
+ * and BigInt results that fit are demoted, so every value has a single representation and two ints are equal when their longs are.
+ * Like strings, BigInts are owned by whoever holds them, and the arithmetic takes its operands */
+#define INT_SMALL_MIN (LONG_MIN + (1L << 56))
+
+/* BigInts allocated and not released, counted atomically since constants are folded on the threads analyzing function bodies
+ * and parallel loops compute on several threads. While there are none, arrays and objects hold no BigInt to copy or release */
+extern size_t bigint_count;
+
+static inline bool BigInt_exist()
+{
+    return __atomic_load_n(&bigint_count, __ATOMIC_RELAXED) != 0;
+}
+
+/* Any operands, small or not. The divisor is not 0. Quotients truncate toward zero and remainders take the sign of lval, like in C */
+long  BigInt_add(long lval, long rval);
+long  BigInt_sub(long lval, long rval);
+long  BigInt_mul(long lval, long rval);
+long  BigInt_div(long lval, long rval);
+long  BigInt_mod(long lval, long rval);
+long  BigInt_neg(long value);
+/* Only reads its operands. Returns a negative number, 0 or a positive number */
+int   BigInt_compare(long lval, long rval);
+long  BigInt_copy(long value);
+void  BigInt_release(long value);
+/* Decimal digits of any int, allocated */
+char* BigInt_toString(long value);
+
+
+
+static inline bool Int_isBig(long value)
+{
+    return value < INT_SMALL_MIN;
+}
+
+static inline long Int_copy(long value)
+{
+    return (Int_isBig(value) ? BigInt_copy(value) : value);
+}
+
+static inline void Int_release(long value)
+{
+    if(Int_isBig(value))
+        BigInt_release(value);
+}
+
+/* The fast paths of the arithmetic, for two small operands and a small result */
+static inline long Int_add(long lval, long rval)
+{
+    long result;
+    if(__builtin_expect(__builtin_add_overflow(lval, rval, &result) || Int_isBig(result) || Int_isBig(lval) || Int_isBig(rval), 0))
+        return BigInt_add(lval, rval);
+    return result;
+}
+
+static inline long Int_sub(long lval, long rval)
+{
+    long result;
+    if(__builtin_expect(__builtin_sub_overflow(lval, rval, &result) || Int_isBig(result) || Int_isBig(lval) || Int_isBig(rval), 0))
+        return BigInt_sub(lval, rval);
+    return result;
+}
+
+static inline long Int_mul(long lval, long rval)
+{
+    long result;
+    if(__builtin_expect(__builtin_mul_overflow(lval, rval, &result) || Int_isBig(result) || Int_isBig(lval) || Int_isBig(rval), 0))
+        return BigInt_mul(lval, rval);
+    return result;
+}
+
+static inline long Int_neg(long value)
+{
+    if(__builtin_expect(Int_isBig(value) || Int_isBig(-value), 0))
+        return BigInt_neg(value);
+    return -value;
+}
+
+/* The quotient of small ints is small, except for the negation of the largest ones */
+static inline long Int_div(long lval, long rval)
+{
+    if(__builtin_expect(Int_isBig(lval) || Int_isBig(rval), 0))
+        return BigInt_div(lval, rval);
+    return (rval == -1 ? Int_neg(lval) : lval / rval);
+}
+
+static inline long Int_mod(long lval, long rval)
+{
+    if(__builtin_expect(Int_isBig(lval) || Int_isBig(rval), 0))
+        return BigInt_mod(lval, rval);
+    return (rval == -1 ? 0 : lval % rval);
+}
+
+static inline int Int_compare(long lval, long rval)
+{
+    if(__builtin_expect(Int_isBig(lval) || Int_isBig(rval), 0))
+        return BigInt_compare(lval, rval);
+    return (lval > rval) - (lval < rval);
+}
+
+#endif
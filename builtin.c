@@ -0,0 +1,241 @@
+#include "builtin.h"
+#include "array.h"
+#include "bigint.h"
+#include "simd.h"
+#include "y.tab.h"
+
+#define INTS     {.type = INT,    .dimensions = 1}
+#define DOUBLES  {.type = DOUBLE, .dimensions = 1}
+#define AN_INT   {.type = INT,    .dimensions = 0}
+#define A_DOUBLE {.type = DOUBLE, .dimensions = 0}
+
+/* Elements of int arrays checked at once, few enough to stay in the cache when a block is redone or written */
+#define BLOCK 512
+
+typedef enum BuiltinIndex
+{
+    FILL_INT, FILL_DOUBLE,
+    COPY_INT, COPY_DOUBLE,
+    SUM_INT,  SUM_DOUBLE,
+    MIN_INT,  MIN_DOUBLE,
+    MAX_INT,  MAX_DOUBLE,
+    DOT_INT,  DOT_DOUBLE,
+    ADD_INT,  ADD_DOUBLE,
+    MUL_INT,  MUL_DOUBLE,
+    COUNT_INT, COUNT_DOUBLE
+} BuiltinIndex;
+
+/* In the order of BuiltinIndex */
+const Builtin builtins[] =
+{
+    {"fill",  VOID,   2, {INTS,    AN_INT}},
+    {"fill",  VOID,   2, {DOUBLES, A_DOUBLE}},
+    {"copy",  VOID,   2, {INTS,    INTS}},
+    {"copy",  VOID,   2, {DOUBLES, DOUBLES}},
+    {"sum",   INT,    1, {INTS}},
+    {"sum",   DOUBLE, 1, {DOUBLES}},
+    {"min",   INT,    1, {INTS}},
+    {"min",   DOUBLE, 1, {DOUBLES}},
+    {"max",   INT,    1, {INTS}},
+    {"max",   DOUBLE, 1, {DOUBLES}},
+    {"dot",   INT,    2, {INTS,    INTS}},
+    {"dot",   DOUBLE, 2, {DOUBLES, DOUBLES}},
+    {"add",   VOID,   3, {INTS,    INTS,    INTS}},
+    {"add",   VOID,   3, {DOUBLES, DOUBLES, DOUBLES}},
+    {"mul",   VOID,   3, {INTS,    INTS,    INTS}},
+    {"mul",   VOID,   3, {DOUBLES, DOUBLES, DOUBLES}},
+    {"count", INT,    2, {INTS,    AN_INT}},
+    {"count", INT,    2, {DOUBLES, A_DOUBLE}}
+};
+
+const int builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+
+
+
+/* Ints in the arrays may be BigInts and results may not fit, so the kernels run on blocks whose magnitudes prove that
+ * the result fits in a small int (at most 62 bits, well inside its range). Other blocks go element by element */
+static int bitLength(unsigned long x)
+{
+    return (x == 0 ? 0 : 64 - __builtin_clzl(x));
+}
+
+static int magnitudeBits(const SimdKernels* kernels, const long* a, size_t n)
+{
+    return bitLength(kernels->magnitude_int(a, n));
+}
+
+/* The kernels also tell the magnitudes of the elements, so the sum of a block is only redone when it may have wrapped */
+static long sumInts(const SimdKernels* kernels, const long* a, size_t n)
+{
+    long sum = 0;
+    for(size_t i = 0; i < n; i += BLOCK)
+    {
+        const size_t m = (n - i < BLOCK ? n - i : BLOCK);
+        unsigned long magnitude = 0;
+        const long block = kernels->sum_int(a + i, m, &magnitude);
+        if(bitLength(magnitude) + bitLength(m) <= 62)
+            sum = Int_add(sum, block);
+        else
+            for(size_t j = i; j < i + m; ++j)
+                sum = Int_add(sum, Int_copy(a[j]));
+    }
+    return sum;
+}
+
+static long dotInts(const SimdKernels* kernels, const long* a, const long* b, size_t n)
+{
+    long sum = 0;
+    for(size_t i = 0; i < n; i += BLOCK)
+    {
+        const size_t m = (n - i < BLOCK ? n - i : BLOCK);
+        unsigned long magnitudes[2] = {0, 0};
+        const long block = kernels->dot_int(a + i, b + i, m, magnitudes);
+        if(bitLength(magnitudes[0]) + bitLength(magnitudes[1]) + bitLength(m) <= 62)
+            sum = Int_add(sum, block);
+        else
+            for(size_t j = i; j < i + m; ++j)
+                sum = Int_add(sum, Int_mul(Int_copy(a[j]), Int_copy(b[j])));
+    }
+    return sum;
+}
+
+/* dst may be a or b. Its old elements are released, unless there is no BigInt at all */
+static void combineInts(const SimdKernels* kernels, long* dst, const long* a, const long* b, size_t n, bool multiply)
+{
+    for(size_t i = 0; i < n; i += BLOCK)
+    {
+        const size_t m = (n - i < BLOCK ? n - i : BLOCK);
+        const int abits = magnitudeBits(kernels, a + i, m);
+        const int bbits = magnitudeBits(kernels, b + i, m);
+        const bool fits = (multiply ? abits + bbits <= 62 : abits <= 61 && bbits <= 61);
+        if(fits && (BigInt_exist() == false || magnitudeBits(kernels, dst + i, m) <= 62))
+        {
+            (multiply ? kernels->mul_int : kernels->add_int)(dst + i, a + i, b + i, m);
+            continue;
+        }
+
+        for(size_t j = i; j < i + m; ++j)
+        {
+            const long result = (multiply ? Int_mul(Int_copy(a[j]), Int_copy(b[j])) : Int_add(Int_copy(a[j]), Int_copy(b[j])));
+            Int_release(dst[j]);
+            dst[j] = result;
+        }
+    }
+}
+
+/* order is 1 for the largest element, -1 for the smallest */
+static long extremeInt(const SimdKernels* kernels, const long* a, size_t n, int order)
+{
+    if(BigInt_exist() == false || magnitudeBits(kernels, a, n) <= 62)
+        return (order > 0 ? kernels->max_int(a, n) : kernels->min_int(a, n));
+
+    size_t best = 0;
+    for(size_t i = 1; i < n; ++i)
+        if(Int_compare(a[i], a[best]) * order > 0)
+            best = i;
+    return Int_copy(a[best]);
+}
+
+/* Takes value */
+static void fillInts(const SimdKernels* kernels, long* a, size_t n, long value)
+{
+    if(BigInt_exist() == false)
+    {
+        kernels->fill_int(a, n, value);
+        return;
+    }
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        Int_release(a[i]);
+        a[i] = Int_copy(value);
+    }
+    Int_release(value);
+}
+
+static void copyInts(long* dst, const long* src, size_t n)
+{
+    if(BigInt_exist() == false)
+    {
+        memmove(dst, src, n * sizeof(long));
+        return;
+    }
+    if(dst == src)
+        return;
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        const long value = Int_copy(src[i]);
+        Int_release(dst[i]);
+        dst[i] = value;
+    }
+}
+
+/* Takes value. A BigInt is never equal to a small int */
+static size_t countInts(const SimdKernels* kernels, const long* a, size_t n, long value)
+{
+    if(Int_isBig(value) == false)
+        return kernels->count_int(a, n, value);
+
+    size_t count = 0;
+    for(size_t i = 0; i < n; ++i)
+        count += (Int_compare(a[i], value) == 0);
+    Int_release(value);
+    return count;
+}
+
+
+
+static bool sameSizes(const Value* args, int count)
+{
+    for(int i = 1; i < count; ++i)
+        if(args[i].array->count != args[0].array->count)
+            return false;
+    return true;
+}
+
+bool Builtin_writes(int index)
+{
+    return builtins[index].return_type == VOID;
+}
+
+int Builtin_run(int index, const Value* args, Value* result)
+{
+    const SimdKernels* kernels = Simd_kernels();
+    const Builtin* builtin = &builtins[index];
+
+    int arrays = 0;
+    while(arrays < builtin->param_count && builtin->params[arrays].dimensions != 0)
+        ++arrays;
+    if(sameSizes(args, arrays) == false)
+        return -1;
+
+    Array* a = args[0].array;
+    const size_t n = a->count;
+    long*   ints    = (long*)a->data;
+    double* doubles = (double*)a->data;
+
+    switch((BuiltinIndex)index)
+    {
+    case FILL_INT:     fillInts(kernels, ints, n, args[1].intval); break;
+    case FILL_DOUBLE:  kernels->fill_double(doubles, n, args[1].doubleval); break;
+    case COPY_INT:     copyInts(ints, (const long*)args[1].array->data, n); break;
+    case COPY_DOUBLE:  memmove(a->data, args[1].array->data, a->size); break;
+    case SUM_INT:      result->intval = sumInts(kernels, ints, n); break;
+    case SUM_DOUBLE:   result->doubleval = kernels->sum_double(doubles, n); break;
+    case MIN_INT:      result->intval = extremeInt(kernels, ints, n, -1); break;
+    case MIN_DOUBLE:   result->doubleval = kernels->min_double(doubles, n); break;
+    case MAX_INT:      result->intval = extremeInt(kernels, ints, n, 1); break;
+    case MAX_DOUBLE:   result->doubleval = kernels->max_double(doubles, n); break;
+    case DOT_INT:      result->intval = dotInts(kernels, ints, (const long*)args[1].array->data, n); break;
+    case DOT_DOUBLE:   result->doubleval = kernels->dot_double(doubles, (const double*)args[1].array->data, n); break;
+    case ADD_INT:      combineInts(kernels, ints, (const long*)args[1].array->data, (const long*)args[2].array->data, n, false); break;
+    case ADD_DOUBLE:   kernels->add_double(doubles, (const double*)args[1].array->data, (const double*)args[2].array->data, n); break;
+    case MUL_INT:      combineInts(kernels, ints, (const long*)args[1].array->data, (const long*)args[2].array->data, n, true); break;
+    case MUL_DOUBLE:   kernels->mul_double(doubles, (const double*)args[1].array->data, (const double*)args[2].array->data, n); break;
+    case COUNT_INT:    result->intval = (long)countInts(kernels, ints, n, args[1].intval); break;
+    case COUNT_DOUBLE: result->intval = (long)kernels->count_double(doubles, n, args[1].doubleval); break;
+    }
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef INCLUDED_BUILTIN_H
+#define INCLUDED_BUILTIN_H
+
+#include "node.h"
+
+#define BUILTIN_MAX_PARAMS 3
+
+/* Functions on whole one-dimensional arrays of ints or doubles, declared in every program as ordinary overloads */
+typedef struct Builtin
+{
+    const char* name;
+    int return_type;
+    int param_count;
+    Type params[BUILTIN_MAX_PARAMS]; /* only the type and the dimensions, the ids are made when they are declared */
+} Builtin;
+
+extern const Builtin builtins[];
+extern const int builtin_count;
+
+/* Whether the builtin at the given index writes the elements of its first argument, which those returning nothing do */
+bool Builtin_writes(int index);
+
+/* Run the builtin at the given index of the table on its evaluated arguments.
+ * Takes the int arguments. Returns 0, or -1 if the arrays it was given have different sizes */
+int Builtin_run(int index, const Value* args, Value* result);
+
+#endif
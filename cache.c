@@ -0,0 +1,383 @@
+#include "cache.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libtema.h"
+#include "util.h"
+
+#define CACHE_MAGIC     "TMC"
+#define CACHE_VERSION   3
+#define CACHE_EXTENSION ".tmc"
+#define STATS_MAGIC     "TMS"
+#define STATS_NAME      "stats"
+
+/* Temporary files left behind by runs that died while storing an entry are removed after this many seconds */
+#define STALE_SECONDS 3600
+
+/* Entry layout: header, declarations, diagnostics, working directory.
+ * The declarations are an interface (see module.c) with the code of the program, and stay 8 byte aligned behind the header */
+typedef struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t source_size;
+    int32_t error_count;
+    int32_t warning_count;
+    uint32_t reserved;
+    uint32_t cwd_size;
+    uint64_t declarations_size;
+    uint64_t diagnostics_size;
+} CacheHeader;
+
+typedef struct StatsFile
+{
+    char magic[4];
+    uint32_t reserved;
+    CacheStats stats;
+} StatsFile;
+
+
+
+uint64_t Cache_key(const char* source, size_t size)
+{
+    const char version[] = TEMA_VERSION;
+    return hashBytes(source, size, hashBytes(version, sizeof(version), HASH_INIT));
+}
+
+static char* cachePath(const char* dir, const char* name)
+{
+    char* path = malloc(strlen(dir) + strlen(name) + 2);
+    if(path != NULL)
+        sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+static char* entryPath(const char* dir, uint64_t key)
+{
+    char name[32];
+    sprintf(name, "%016llx" CACHE_EXTENSION, (unsigned long long)key);
+    return cachePath(dir, name);
+}
+
+
+
+int Cache_load(const char* dir, uint64_t key, uint64_t source_size, CacheEntry* entry)
+{
+    char* path = entryPath(dir, key);
+    if(path == NULL)
+        return -1;
+
+    const int fd = open(path, O_RDONLY);
+    free(path);
+    if(fd < 0)
+        return -1;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return -1;
+    }
+
+    entry->size = st.st_size;
+    entry->data = mmap(NULL, entry->size, PROT_READ, MAP_SHARED, fd, 0);
+    if(entry->data == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    /* The modification time orders the entries for eviction */
+    futimens(fd, NULL);
+    close(fd);
+
+    const CacheHeader* header = entry->data;
+    const uint64_t size = sizeof(*header)
+                        + header->declarations_size
+                        + header->diagnostics_size
+                        + header->cwd_size;
+
+    const char* diagnostics = (const char*)entry->data + sizeof(*header) + header->declarations_size;
+    const char* cwd = diagnostics + header->diagnostics_size;
+
+    if(memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != CACHE_VERSION
+    || header->key != key || header->source_size != source_size
+    || header->declarations_size > entry->size || header->diagnostics_size > entry->size || size != entry->size
+    || header->cwd_size == 0 || cwd[header->cwd_size - 1] != '\0'
+    || (header->diagnostics_size != 0 && diagnostics[header->diagnostics_size - 1] != '\0'))
+    {
+        Cache_close(entry);
+        return -1;
+    }
+
+    /* Relative imports name other files from another directory */
+    if(cwd[0] != '\0')
+    {
+        char* current = getcwd(NULL, 0);
+        const bool same = (current != NULL && strcmp(current, cwd) == 0);
+        free(current);
+
+        if(same == false)
+        {
+            Cache_close(entry);
+            return -1;
+        }
+    }
+
+    entry->error_count       = header->error_count;
+    entry->warning_count     = header->warning_count;
+    entry->declarations      = (const char*)(header + 1);
+    entry->declarations_size = header->declarations_size;
+    entry->diagnostics       = diagnostics;
+    entry->diagnostics_size  = header->diagnostics_size;
+    entry->cwd               = cwd;
+    return 0;
+}
+
+void Cache_close(CacheEntry* entry)
+{
+    if(entry->data != NULL)
+        munmap(entry->data, entry->size);
+
+    entry->data = NULL;
+    entry->size = 0;
+}
+
+
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    return size == 0 || write(fd, data, size) == (ssize_t)size;
+}
+
+int Cache_store(const char* dir, uint64_t key, uint64_t source_size, const CacheEntry* entry)
+{
+    char* path = entryPath(dir, key);
+    char* tmp_path = (path != NULL ? malloc(strlen(path) + sizeof(".XXXXXX")) : NULL);
+    if(tmp_path == NULL)
+    {
+        free(path);
+        return -1;
+    }
+
+    strcpy(tmp_path, path);
+    strcat(tmp_path, ".XXXXXX");
+
+    CacheHeader header = {0};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version           = CACHE_VERSION;
+    header.key               = key;
+    header.source_size       = source_size;
+    header.error_count       = entry->error_count;
+    header.warning_count     = entry->warning_count;
+    header.cwd_size          = strlen(entry->cwd) + 1;
+    header.declarations_size = entry->declarations_size;
+    header.diagnostics_size  = entry->diagnostics_size;
+
+    int result = -1;
+    const int fd = mkstemp(tmp_path);
+    if(fd >= 0)
+    {
+        fchmod(fd, 0644);
+        const bool written = writeAll(fd, &header, sizeof(header))
+                          && writeAll(fd, entry->declarations, entry->declarations_size)
+                          && writeAll(fd, entry->diagnostics, entry->diagnostics_size)
+                          && writeAll(fd, entry->cwd, header.cwd_size);
+
+        if(close(fd) == 0 && written && rename(tmp_path, path) == 0)
+            result = 0;
+        else
+            unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(path);
+    return result;
+}
+
+
+
+typedef struct CacheFile
+{
+    char* name;
+    int64_t mtime;
+    uint64_t size;
+} CacheFile;
+
+static int compareFiles(const void* a, const void* b)
+{
+    const CacheFile* file1 = a;
+    const CacheFile* file2 = b;
+    return (file1->mtime > file2->mtime) - (file1->mtime < file2->mtime);
+}
+
+/* Lists the entries of a directory and their total size, removing stale temporary files on the way */
+static int listEntries(const char* dir, CacheFile** files, int* count, uint64_t* total)
+{
+    DIR* dp = opendir(dir);
+    if(dp == NULL)
+        return -1;
+
+    int capacity = 0;
+    (*files) = NULL;
+    (*count) = 0;
+    (*total) = 0;
+
+    const time_t now = time(NULL);
+    struct dirent* de;
+    while((de = readdir(dp)) != NULL)
+    {
+        const char* extension = strstr(de->d_name, CACHE_EXTENSION);
+        if(extension == NULL)
+            continue;
+
+        struct stat st;
+        if(fstatat(dirfd(dp), de->d_name, &st, 0) != 0 || S_ISREG(st.st_mode) == false)
+            continue;
+
+        if(strcmp(extension, CACHE_EXTENSION) != 0)
+        {
+            if(now - st.st_mtime > STALE_SECONDS)
+                unlinkat(dirfd(dp), de->d_name, 0);
+            continue;
+        }
+
+        if((*count) == capacity)
+        {
+            const int new_capacity = 1 + capacity * 2;
+            CacheFile* new_files = realloc(*files, new_capacity * sizeof(**files));
+            if(new_files == NULL)
+                break;
+
+            (*files) = new_files;
+            capacity = new_capacity;
+        }
+
+        CacheFile* file = &(*files)[*count];
+        file->name = strdup(de->d_name);
+        file->mtime = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+        file->size = st.st_size;
+        if(file->name == NULL)
+            break;
+
+        (*total) += file->size;
+        ++(*count);
+    }
+
+    closedir(dp);
+    return 0;
+}
+
+static void freeEntries(CacheFile* files, int count)
+{
+    for(int i = 0; i < count; ++i)
+        free(files[i].name);
+    free(files);
+}
+
+int Cache_evict(const char* dir, uint64_t max_size)
+{
+    CacheFile* files;
+    int count;
+    uint64_t total;
+    if(listEntries(dir, &files, &count, &total) != 0)
+        return 0;
+
+    int removed = 0;
+    if(total > max_size)
+    {
+        qsort(files, count, sizeof(files[0]), compareFiles);
+
+        for(int i = 0; i < count && total > max_size; ++i)
+        {
+            char* path = cachePath(dir, files[i].name);
+            if(path != NULL && unlink(path) == 0)
+                ++removed;
+
+            total -= files[i].size;
+            free(path);
+        }
+    }
+
+    freeEntries(files, count);
+    return removed;
+}
+
+
+
+static int openStats(const char* dir)
+{
+    char* path = cachePath(dir, STATS_NAME);
+    if(path == NULL)
+        return -1;
+
+    const int fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if(fd < 0)
+        return -1;
+
+    if(flock(fd, LOCK_EX) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void readStatsFile(int fd, StatsFile* file)
+{
+    if(pread(fd, file, sizeof(*file), 0) != sizeof(*file) || memcmp(file->magic, STATS_MAGIC, sizeof(file->magic)) != 0)
+    {
+        memset(file, 0, sizeof(*file));
+        memcpy(file->magic, STATS_MAGIC, sizeof(file->magic));
+    }
+}
+
+int Cache_addStats(const char* dir, const CacheStats* stats)
+{
+    const int fd = openStats(dir);
+    if(fd < 0)
+        return -1;
+
+    StatsFile file;
+    readStatsFile(fd, &file);
+
+    file.stats.hits       += stats->hits;
+    file.stats.misses     += stats->misses;
+    file.stats.evictions  += stats->evictions;
+    file.stats.load_ns    += stats->load_ns;
+    file.stats.compile_ns += stats->compile_ns;
+
+    const bool written = (pwrite(fd, &file, sizeof(file), 0) == sizeof(file));
+    close(fd);
+    return (written ? 0 : -1);
+}
+
+int Cache_readStats(const char* dir, CacheStats* stats, uint64_t* size)
+{
+    const int fd = openStats(dir);
+    if(fd < 0)
+        return -1;
+
+    StatsFile file;
+    readStatsFile(fd, &file);
+    close(fd);
+    (*stats) = file.stats;
+
+    CacheFile* files;
+    int count;
+    if(listEntries(dir, &files, &count, size) != 0)
+        return -1;
+
+    freeEntries(files, count);
+    return 0;
+}
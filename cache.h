@@ -0,0 +1,55 @@
+#ifndef INCLUDED_CACHE_H
+#define INCLUDED_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Default bound of a cache directory, in bytes */
+#define CACHE_DEFAULT_SIZE (64u << 20)
+
+/* An analyzed program: its global declarations and code, the diagnostics it produced and its counters.
+ * A loaded entry points into the mapped cache file */
+typedef struct CacheEntry
+{
+    int error_count;
+    int warning_count;
+
+    const char* declarations;
+    size_t declarations_size;
+    const char* diagnostics; /* null terminated diagnostic records */
+    size_t diagnostics_size;
+    const char* cwd;         /* the directory relative imports were resolved in, or "" */
+
+    void* data;
+    size_t size;
+} CacheEntry;
+
+/* Counters kept in the cache directory and shared by every run using it */
+typedef struct CacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t load_ns;
+    uint64_t compile_ns;
+} CacheStats;
+
+/* Key of a source buffer. It covers the compiler version, so entries of other versions are never loaded */
+uint64_t Cache_key(const char* source, size_t size);
+
+/* Map the entry stored for a key. Fails if there is none or it is invalid */
+int  Cache_load(const char* dir, uint64_t key, uint64_t source_size, CacheEntry* entry);
+void Cache_close(CacheEntry* entry);
+
+/* Write an entry through a temporary file and a rename, so concurrent runs see either a whole entry or none */
+int  Cache_store(const char* dir, uint64_t key, uint64_t source_size, const CacheEntry* entry);
+
+/* Remove the least recently used entries until the directory holds at most max_size bytes.
+ * Returns the number of entries removed */
+int  Cache_evict(const char* dir, uint64_t max_size);
+
+int  Cache_addStats(const char* dir, const CacheStats* stats);
+int  Cache_readStats(const char* dir, CacheStats* stats, uint64_t* size);
+
+#endif
@@ -0,0 +1,109 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "server.h"
+
+/* Minimal client for `tema --serve`.
+ * Usage: tema-client [-n count] socket [file]
+ * With -n the same source is sent count times over one connection and the mean round trip time is reported.
+ * Exits with 1 when the program had errors, like tema does */
+
+static char* readFile(FILE* fp, size_t* size)
+{
+    size_t capacity = 4096;
+    char* data = malloc(capacity);
+    (*size) = 0;
+
+    while(data != NULL)
+    {
+        (*size) += fread(data + (*size), 1, capacity - (*size), fp);
+        if((*size) < capacity)
+            break;
+
+        capacity *= 2;
+        char* new_data = realloc(data, capacity);
+        if(new_data == NULL)
+            free(data);
+        data = new_data;
+    }
+
+    return data;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    long count = 1;
+    int arg = 1;
+
+    if(arg + 1 < argc && strcmp(argv[arg], "-n") == 0)
+    {
+        count = strtol(argv[arg + 1], NULL, 10);
+        arg += 2;
+    }
+
+    if(arg >= argc || count < 1)
+    {
+        fprintf(stderr, "usage: %s [-n count] socket [file]\n", argv[0]);
+        return 2;
+    }
+
+    const char* socket_path = argv[arg++];
+    FILE* fp = stdin;
+    if(arg < argc)
+    {
+        fp = fopen(argv[arg], "r");
+        if(fp == NULL)
+        {
+            fprintf(stderr, "could not open file %s\n", argv[arg]);
+            return 1;
+        }
+    }
+
+    size_t size;
+    char* source = readFile(fp, &size);
+    if(source == NULL)
+    {
+        fprintf(stderr, "not enough memory to read the source\n");
+        return 1;
+    }
+
+    const int fd = connectServer(socket_path);
+    if(fd < 0)
+    {
+        fprintf(stderr, "could not connect to %s\n", socket_path);
+        return 1;
+    }
+
+    const double start = now();
+    Response response = {0};
+
+    for(long i = 0; i < count; ++i)
+    {
+        Response_clear(&response);
+        if(writeBlock(fd, source, size) != 0 || readResponse(fd, &response) != 0)
+        {
+            fprintf(stderr, "connection to %s failed\n", socket_path);
+            return 1;
+        }
+    }
+
+    const double elapsed = now() - start;
+
+    fwrite(response.output, 1, response.output_size, stdout);
+    fwrite(response.diagnostics, 1, response.diagnostics_size, stderr);
+    if(count > 1)
+        fprintf(stderr, "%ld requests, %.1f us per request\n", count, elapsed / count * 1e6);
+
+    const int error_count = response.error_count;
+    Response_clear(&response);
+    free(source);
+    close(fd);
+    return (error_count != 0);
+}
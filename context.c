@@ -0,0 +1,76 @@
+#include "context.h"
+
+extern __thread YYLTYPE yylloc;
+extern int yylineno;
+extern size_t yycolumnno;
+extern __thread int error_count;
+extern __thread int warning_count;
+
+extern __thread int scope_level;
+extern __thread VariableList varlist;
+extern __thread VariableListStack varliststack;
+extern __thread FunctionList funclist;
+extern __thread FunctionListStack funcliststack;
+extern __thread ClassList classlist;
+extern PrintQueue printqueue;
+extern ModuleList modules;
+extern Program program;
+extern __thread Routine* current_routine;
+extern __thread ClassLayout* current_class;
+extern __thread int member_access;
+
+
+
+#define SWAP(type, a, b) \
+{                        \
+    type tmp = (a);      \
+    (a) = (b);           \
+    (b) = tmp;           \
+}
+
+void Context_swap(Context* context)
+{
+    SWAP(int, context->scope_level, scope_level);
+    SWAP(int, context->error_count, error_count);
+    SWAP(int, context->warning_count, warning_count);
+
+    SWAP(VariableList, context->varlist, varlist);
+    SWAP(VariableListStack, context->varliststack, varliststack);
+    SWAP(FunctionList, context->funclist, funclist);
+    SWAP(FunctionListStack, context->funcliststack, funcliststack);
+    SWAP(ClassList, context->classlist, classlist);
+    SWAP(PrintQueue, context->printqueue, printqueue);
+    SWAP(ModuleList, context->modules, modules);
+    SWAP(Program, context->program, program);
+    SWAP(Routine*, context->routine, current_routine);
+    SWAP(ClassLayout*, context->layout, current_class);
+    SWAP(int, context->member_access, member_access);
+
+    SWAP(int, context->lineno, yylineno);
+    SWAP(size_t, context->columnno, yycolumnno);
+    SWAP(YYLTYPE, context->location, yylloc);
+}
+
+void Context_resetLocation()
+{
+    yylineno = 1;
+    yycolumnno = 1;
+    yylloc.first_line   = 1;
+    yylloc.first_column = 1;
+    yylloc.last_line    = 1;
+    yylloc.last_column  = 1;
+}
+
+void Context_clear(Context* context)
+{
+    VariableList_clear(&context->varlist, context->scope_level);
+    VariableListStack_clear(&context->varliststack);
+    FunctionList_clear(&context->funclist, context->scope_level);
+    FunctionListStack_clear(&context->funcliststack);
+    ClassList_clear(&context->classlist);
+    PrintQueue_clear(&context->printqueue);
+    ModuleList_clear(&context->modules);
+    Program_clear(&context->program);
+
+    memset(context, 0, sizeof(*context));
+}
@@ -0,0 +1,38 @@
+#ifndef INCLUDED_CONTEXT_H
+#define INCLUDED_CONTEXT_H
+
+#include "yylloc.h"
+#include "util.h"
+#include "module.h"
+#include "node.h"
+
+/* Everything the front end keeps in globals while it compiles a program */
+typedef struct Context
+{
+    int scope_level;
+    int error_count;
+    int warning_count;
+
+    VariableList varlist;
+    VariableListStack varliststack;
+    FunctionList funclist;
+    FunctionListStack funcliststack;
+    ClassList classlist;
+    PrintQueue printqueue;
+    ModuleList modules;
+    Program program;
+    Routine* routine;
+    ClassLayout* layout;
+    int member_access;
+
+    int lineno;
+    size_t columnno;
+    YYLTYPE location;
+} Context;
+
+/* Exchange the contents of the context with the globals. Swapping twice restores both */
+void Context_swap(Context* context);
+void Context_resetLocation();
+void Context_clear(Context* context);
+
+#endif
@@ -0,0 +1,217 @@
+#include "diagnostic.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+
+#define RECORD_SEPARATOR '\x1f'
+
+__thread const char* diagnostic_file = NULL;
+__thread DiagnosticList* diagnostic_buffer = NULL;
+
+static const char* const severity_names[] = {"error", "warning", "note"};
+
+
+
+void Diagnostic_init(Diagnostic* diagnostic, Severity severity, const YYLTYPE* location, const YYLTYPE* related, const char* format, char* message)
+{
+    memset(diagnostic, 0, sizeof(*diagnostic));
+    diagnostic->severity = severity;
+    diagnostic->location = *location;
+    if(related != NULL)
+        diagnostic->related = *related;
+    diagnostic->message = message;
+    if(diagnostic_file != NULL)
+        diagnostic->file = strdup(diagnostic_file);
+
+    const uint64_t hash = hashBytes(format, strlen(format), HASH_INIT);
+    snprintf(diagnostic->code, sizeof(diagnostic->code), "%c%06x", (severity == SEVERITY_ERROR ? 'E' : 'W'), (unsigned)(hash & 0xffffff));
+}
+
+void Diagnostic_clear(Diagnostic* diagnostic)
+{
+    free(diagnostic->message);
+    free(diagnostic->file);
+    memset(diagnostic, 0, sizeof(*diagnostic));
+}
+
+void Diagnostic_writeText(const Diagnostic* diagnostic, FILE* fp)
+{
+    const YYLTYPE* location = &diagnostic->location;
+    fprintf(fp, "%s: ", severity_names[diagnostic->severity]);
+    if(diagnostic->file != NULL)
+        fprintf(fp, "%s: ", diagnostic->file);
+    if(location->first_line != 0)
+        fprintf(fp, "(%zu, %zu)->(%zu, %zu): ", location->first_line, location->first_column, location->last_line, location->last_column);
+    fputs(diagnostic->message, fp);
+}
+
+static void writeJsonString(const char* str, FILE* fp)
+{
+    fputc('"', fp);
+    for(; *str != '\0'; ++str)
+    {
+        switch(*str)
+        {
+        case '"':  fputs("\\\"", fp); break;
+        case '\\': fputs("\\\\", fp); break;
+        case '\n': fputs("\\n", fp);  break;
+        case '\t': fputs("\\t", fp);  break;
+        default:
+            if((unsigned char)*str < 0x20)
+                fprintf(fp, "\\u%04x", *str);
+            else
+                fputc(*str, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/* One object per line */
+void Diagnostic_writeJson(const Diagnostic* diagnostic, FILE* fp)
+{
+    const YYLTYPE* location = &diagnostic->location;
+    fprintf(fp, "{\"severity\":\"%s\"", severity_names[diagnostic->severity]);
+    if(diagnostic->severity != SEVERITY_NOTE)
+        fprintf(fp, ",\"code\":\"%s\"", diagnostic->code);
+    if(diagnostic->file != NULL)
+    {
+        fputs(",\"file\":", fp);
+        writeJsonString(diagnostic->file, fp);
+    }
+    if(location->first_line != 0)
+        fprintf(fp, ",\"line\":%zu,\"column\":%zu,\"end_line\":%zu,\"end_column\":%zu",
+                location->first_line, location->first_column, location->last_line, location->last_column);
+
+    fputs(",\"message\":", fp);
+    writeJsonString(diagnostic->message, fp);
+
+    if(diagnostic->related.first_line != 0)
+        fprintf(fp, ",\"related\":[{\"line\":%zu,\"column\":%zu,\"message\":\"declared here\"}]",
+                diagnostic->related.first_line, diagnostic->related.first_column);
+    fputc('}', fp);
+}
+
+
+
+void Diagnostic_serialize(const Diagnostic* diagnostic, FILE* fp)
+{
+    const YYLTYPE* location = &diagnostic->location;
+    fprintf(fp, "%d %s %zu %zu %zu %zu %zu %zu%c%s%c%s", diagnostic->severity, diagnostic->code,
+            location->first_line, location->first_column, location->last_line, location->last_column,
+            diagnostic->related.first_line, diagnostic->related.first_column,
+            RECORD_SEPARATOR, (diagnostic->file != NULL ? diagnostic->file : ""), RECORD_SEPARATOR, diagnostic->message);
+    fputc('\0', fp);
+}
+
+const char* Diagnostic_deserialize(Diagnostic* diagnostic, const char* record, const char* end)
+{
+    const char* record_end = memchr(record, '\0', end - record);
+    if(record_end == NULL)
+        return NULL;
+
+    memset(diagnostic, 0, sizeof(*diagnostic));
+    YYLTYPE* location = &diagnostic->location;
+    int severity;
+    int length = 0;
+    if(sscanf(record, "%d %7s %zu %zu %zu %zu %zu %zu%n", &severity, diagnostic->code, &location->first_line, &location->first_column,
+              &location->last_line, &location->last_column, &diagnostic->related.first_line, &diagnostic->related.first_column, &length) != 8
+    || severity < SEVERITY_ERROR || severity > SEVERITY_NOTE || record[length] != RECORD_SEPARATOR)
+        return NULL;
+
+    const char* file = record + length + 1;
+    const char* message = memchr(file, RECORD_SEPARATOR, record_end - file);
+    if(message == NULL)
+        return NULL;
+
+    diagnostic->severity = severity;
+    diagnostic->related.last_line = diagnostic->related.first_line;
+    diagnostic->related.last_column = diagnostic->related.first_column;
+    diagnostic->file = (message != file ? strndup(file, message - file) : NULL);
+    diagnostic->message = strdup(message + 1);
+    if(diagnostic->message == NULL)
+    {
+        yyerror("not enough memory to read the diagnostics");
+        abort();
+    }
+    return record_end + 1;
+}
+
+
+
+int DiagnosticList_insert(DiagnosticList* list, Diagnostic* diagnostic)
+{
+    if(list->size == list->capacity)
+    {
+        const size_t new_capacity = 1 + list->capacity * 2;
+        Diagnostic* new_elements = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_elements == NULL)
+            return -1;
+
+        list->elements = new_elements;
+        list->capacity = new_capacity;
+    }
+
+    diagnostic->order = list->size;
+    list->elements[list->size++] = *diagnostic;
+    return 0;
+}
+
+static int compareLocations(const Diagnostic* lval, const Diagnostic* rval)
+{
+    const int file = compareStrings(lval->file, rval->file);
+    if(file != 0)
+        return file;
+
+    const YYLTYPE* l = &lval->location;
+    const YYLTYPE* r = &rval->location;
+    if(l->first_line != r->first_line)
+        return (l->first_line > r->first_line) - (l->first_line < r->first_line);
+    if(l->first_column != r->first_column)
+        return (l->first_column > r->first_column) - (l->first_column < r->first_column);
+    if(l->last_line != r->last_line)
+        return (l->last_line > r->last_line) - (l->last_line < r->last_line);
+    return (l->last_column > r->last_column) - (l->last_column < r->last_column);
+}
+
+static int compareDiagnostics(const void* a, const void* b)
+{
+    const Diagnostic* lval = a;
+    const Diagnostic* rval = b;
+    const int order = compareLocations(lval, rval);
+    if(order != 0)
+        return order;
+    return (lval->order > rval->order) - (lval->order < rval->order);
+}
+
+void DiagnosticList_sort(DiagnosticList* list)
+{
+    qsort(list->elements, list->size, sizeof(list->elements[0]), compareDiagnostics);
+
+    /* Repeated diagnostics have the same location, so they are among the last ones kept */
+    size_t kept = 0;
+    for(size_t i = 0; i < list->size; ++i)
+    {
+        Diagnostic* diagnostic = &list->elements[i];
+        bool repeated = false;
+        for(size_t j = kept; j > 0 && compareLocations(&list->elements[j - 1], diagnostic) == 0 && !repeated; --j)
+            repeated = (list->elements[j - 1].severity == diagnostic->severity && strcmp(list->elements[j - 1].message, diagnostic->message) == 0);
+
+        if(repeated)
+            Diagnostic_clear(diagnostic);
+        else
+            list->elements[kept++] = *diagnostic;
+    }
+    list->size = kept;
+}
+
+void DiagnosticList_clear(DiagnosticList* list)
+{
+    for(size_t i = 0; i < list->size; ++i)
+        Diagnostic_clear(&list->elements[i]);
+
+    free(list->elements);
+    list->elements = NULL;
+    list->size = 0;
+    list->capacity = 0;
+}
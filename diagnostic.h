@@ -0,0 +1,58 @@
+#ifndef INCLUDED_DIAGNOSTIC_H
+#define INCLUDED_DIAGNOSTIC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "yylloc.h"
+
+typedef enum Severity
+{
+    SEVERITY_ERROR,
+    SEVERITY_WARNING,
+    SEVERITY_NOTE
+} Severity;
+
+/* An error or a warning of the compiler or of a run */
+typedef struct Diagnostic
+{
+    Severity severity;
+    YYLTYPE location;
+    YYLTYPE related;     /* of the earlier declaration the message refers to, first_line 0 if none */
+    char code[8];        /* E or W and a hash of the format of the message, the same for every message of a kind */
+    char* message;
+    char* file;          /* module the location is in, NULL for the program */
+    size_t order;        /* in which it was reported */
+} Diagnostic;
+
+typedef struct DiagnosticList
+{
+    Diagnostic* elements;
+    size_t size;
+    size_t capacity;
+} DiagnosticList;
+
+/* Module being compiled, NULL for the program */
+extern __thread const char* diagnostic_file;
+/* Collects the diagnostics of the thread instead of the compilation if set, to merge them in order later */
+extern __thread DiagnosticList* diagnostic_buffer;
+
+/* Takes the message. related may be NULL */
+void Diagnostic_init(Diagnostic* diagnostic, Severity severity, const YYLTYPE* location, const YYLTYPE* related, const char* format, char* message);
+void Diagnostic_clear(Diagnostic* diagnostic);
+void Diagnostic_writeText(const Diagnostic* diagnostic, FILE* fp);
+void Diagnostic_writeJson(const Diagnostic* diagnostic, FILE* fp);
+
+/* The cache keeps diagnostics as null terminated records. Returns the end of the record, or NULL if it is invalid */
+void        Diagnostic_serialize(const Diagnostic* diagnostic, FILE* fp);
+const char* Diagnostic_deserialize(Diagnostic* diagnostic, const char* record, const char* end);
+
+/* Takes the diagnostic. Returns -1 if there is not enough memory */
+int  DiagnosticList_insert(DiagnosticList* list, Diagnostic* diagnostic);
+/* Sort by file and location, keeping the order of report at the same location, and drop the repeated ones */
+void DiagnosticList_sort(DiagnosticList* list);
+void DiagnosticList_clear(DiagnosticList* list);
+
+/* Collects a diagnostic of the current compilation. Defined by the library */
+void addDiagnostic(Diagnostic* diagnostic);
+
+#endif
@@ -0,0 +1,1352 @@
+#define _GNU_SOURCE /* pthread_getattr_np */
+#include "exec.h"
+#include <limits.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include "array.h"
+#include "bigint.h"
+#include "builtin.h"
+#include "context.h"
+#include "diagnostic.h"
+#include "memo.h"
+#include "module.h"
+#include "operators.h"
+#include "parallel.h"
+#include "profile.h"
+#include "sampler.h"
+#include "y.tab.h"
+
+extern __thread int error_count;
+
+/* Locals of the routines being run, released when an error unwinds the run */
+typedef struct Frame
+{
+    Value* locals;
+    const Routine* routine;
+    const Node* call;
+} Frame;
+
+typedef struct FrameStack
+{
+    Frame* elements;
+    int size;
+    int capacity;
+} FrameStack;
+
+enum
+{
+    EXEC_NEXT,
+    EXEC_RETURN
+};
+
+/* The locals of every call, one frame after the other. The whole stack is reserved at once and the kernel
+ * only commits the pages that calls reach, so it never moves and a call costs no allocation */
+typedef struct ValueStack
+{
+    Value* elements;
+    size_t size;
+    size_t capacity;
+} ValueStack;
+
+#define VALUE_STACK_SIZE (4 << 20)  /* values */
+#define STACK_MARGIN     (256 << 10) /* bytes of the thread stack kept for the calls that report an overflow */
+#define TRACE_FRAMES     8
+
+/* Every thread running iterations of a parallel loop has its own calls, its own copy of the globals
+ * and queues what it prints apart, to be merged in the order of the iterations */
+static __thread FrameStack frames = {0};
+static __thread ValueStack stack = {0};
+static __thread const char* stack_floor = NULL; /* calls below it would exhaust the stack of the thread */
+static __thread jmp_buf* failure = NULL;
+static __thread Value* globals = NULL;
+static __thread PrintQueue* prints = NULL;
+static __thread bool in_parallel = false;     /* parallel loops inside the iterations of another one run on its thread */
+/* The program of the context being run, that of the compilation when it computes constants */
+static __thread Program* running = NULL;
+static __thread ModuleList* running_modules = NULL;
+
+static Value evaluate(const Node* node, Value* locals);
+static int   execute(const Node* node, Value* locals, Value* result);
+static void  runParallelLoop(const Node* node, Value* locals);
+
+
+
+static _Noreturn void fail(const Node* node, const char* msg, ...)
+{
+    va_list args;
+    va_start(args, msg);
+    yyverrorAt(&node->location, msg, args);
+    va_end(args);
+
+    longjmp(*failure, 1);
+}
+
+static char* copyString(const char* str)
+{
+    char* copy = strdup(str != NULL ? str : "");
+    if(copy == NULL)
+    {
+        yyerror("not enough memory to copy a string");
+        abort();
+    }
+
+    return copy;
+}
+
+static char* createObject(const Node* node, const ClassLayout* layout)
+{
+    char* object = Object_create(layout);
+    if(object == NULL)
+        fail(node, "not enough memory for an object of class %s", layout->name);
+    return object;
+}
+
+static char* copyObject(const ClassLayout* layout, const char* object)
+{
+    char* copy = malloc(layout->size + 1);
+    if(copy == NULL || Object_copy(layout, copy, object) != 0)
+    {
+        yyerror("not enough memory to copy an object of class %s", layout->name);
+        abort();
+    }
+
+    return copy;
+}
+
+static Value zeroValue(const Node* node, const Type* type)
+{
+    Value value = {0};
+    if(type->type == STRING && type->dimensions == 0)
+        value.strval = copyString("");
+    else if(type->type == CLASS && type->dimensions == 0)
+        value.object = createObject(node, type->layout);
+    return value;
+}
+
+/* Drop the result of an expression */
+static void discard(const Type* type, Value* value)
+{
+    if(type->type == INT && type->dimensions == 0)
+        Int_release(value->intval);
+    else if(type->type == STRING && type->dimensions == 0)
+        free(value->strval);
+    else if(type->type == CLASS && type->dimensions == 0)
+        Object_destroy(type->layout, value->object);
+}
+
+
+
+/* Innermost calls first, with the calls between the first and the last TRACE_FRAMES left out */
+static _Noreturn void overflow(const Node* node)
+{
+    char message[2048];
+    int length = snprintf(message, sizeof(message), "stack overflow after %d nested calls", frames.size);
+    for(int i = frames.size - 1; i >= 0 && length < (int)sizeof(message); --i)
+    {
+        if(i == frames.size - 1 - TRACE_FRAMES && i >= TRACE_FRAMES)
+        {
+            length += snprintf(message + length, sizeof(message) - length, "\n\t... %d more calls", i + 1 - TRACE_FRAMES);
+            i = TRACE_FRAMES;
+            continue;
+        }
+
+        const Frame* frame = &frames.elements[i];
+        length += snprintf(message + length, sizeof(message) - length, "\n\tin %s called at (%zu, %zu)",
+                           frame->routine->name, frame->call->location.first_line, frame->call->location.first_column);
+    }
+
+    yyerrorAt(&node->location, "%s", message);
+    longjmp(*failure, 1);
+}
+
+/* Reserve the values of a call. The frame starts zeroed */
+static Value* pushFrame(const Node* call, const Routine* routine)
+{
+    char marker;
+    if(&marker < stack_floor || stack.capacity - stack.size < (size_t)routine->slots.size)
+        overflow(call);
+
+    if(frames.size == frames.capacity)
+    {
+        int new_capacity = 1 + frames.capacity * 2;
+        Frame* new_frames = realloc(frames.elements, new_capacity * sizeof(frames.elements[0]));
+        if(new_frames == NULL)
+        {
+            yyerror("not enough memory to call %s", routine->name);
+            abort();
+        }
+
+        frames.elements = new_frames;
+        frames.capacity = new_capacity;
+    }
+
+    Value* locals = stack.elements + stack.size;
+    memset(locals, 0, routine->slots.size * sizeof(locals[0]));
+    stack.size += routine->slots.size;
+
+    frames.elements[frames.size].locals = locals;
+    frames.elements[frames.size].routine = routine;
+    frames.elements[frames.size].call = call;
+    ++frames.size;
+    return locals;
+}
+
+static void popFrame()
+{
+    Frame* frame = &frames.elements[--frames.size];
+    for(int i = (frame->routine->method ? 1 : 0); i < frame->routine->slots.size; ++i)
+        Value_release(&frame->routine->slots.elements[i], &frame->locals[i]);
+    stack.size = frame->locals - stack.elements;
+}
+
+
+
+/* Scalars are stored in their natural size, in variables as well as in array elements and objects.
+ * Loading a BigInt or an object copies it, storing one moves the copy in */
+static Value load(const Type* type, const void* address)
+{
+    Value value = {0};
+    switch(type->type)
+    {
+    case INT:    value.intval    = Int_copy(*((const long*)address)); break;
+    case BOOL:   value.boolval   = *((const bool*)  address); break;
+    case DOUBLE: value.doubleval = *((const double*)address); break;
+    case CHAR:   value.charval   = *((const char*)  address); break;
+    case STRING: value.strval    = copyString(*((char* const*)address)); break;
+    case CLASS:  value.object    = copyObject(type->layout, address); break;
+    }
+
+    return value;
+}
+
+static void store(const Type* type, void* address, Value value)
+{
+    switch(type->type)
+    {
+    case INT:    Int_release(*((long*)address)); *((long*)address) = value.intval; break;
+    case BOOL:   *((bool*)  address) = value.boolval;   break;
+    case DOUBLE: *((double*)address) = value.doubleval; break;
+    case CHAR:   *((char*)  address) = value.charval;   break;
+    case STRING: free(*((char**)address)); *((char**)address) = value.strval; break;
+    case CLASS:
+        Object_release(type->layout, address);
+        memcpy(address, value.object, type->layout->size);
+        free(value.object);
+        break;
+    }
+}
+
+static bool truth(const Node* node, Value* locals)
+{
+    Value value = evaluate(node, locals);
+    switch(node->type.type)
+    {
+    case INT:
+    {
+        const bool result = (value.intval != 0);
+        Int_release(value.intval);
+        return result;
+    }
+    case BOOL:   return value.boolval;
+    case DOUBLE: return value.doubleval != 0;
+    case CHAR:   return value.charval != 0;
+    case STRING:
+    {
+        const bool result = (value.strval[0] != '\0');
+        free(value.strval);
+        return result;
+    }
+    }
+
+    return false;
+}
+
+
+
+static void* update(const Node* node, Value* locals);
+static void* address(const Node* node, Value* locals);
+
+static Value* variable(const Node* node, Value* locals)
+{
+    return (node->op == NODE_LOCAL ? &locals[node->slot] : &globals[node->slot]);
+}
+
+/* Offset of an element from the indices given in node, checking them in order */
+static size_t offsetOf(const Node* node, Array* array, const long* indices, int count, unsigned long skipped)
+{
+    const long* strides = Array_strides(array);
+    size_t offset = 0;
+    const Node* index = node->operands[1];
+    for(int i = 0; i < count && i < array->dimensions; ++i, index = index->next)
+    {
+        if(skipped & (1ul << i))
+            continue;
+        if(running->bounds_checks && (indices[i] < 0 || indices[i] >= array->sizes[i]))
+            fail(index, "index %ld is out of bounds for dimension %d of %s, whose size is %ld", indices[i], i + 1, node->name, array->sizes[i]);
+        offset += indices[i] * strides[i];
+    }
+
+    return offset;
+}
+
+static Array* arrayOf(const Node* node, Value* locals)
+{
+    Array* array = *(Array**)address(node->operands[0], locals);
+    if(array == NULL)
+        fail(node, "array %s is used before its declaration", node->name);
+    return array;
+}
+
+/* A BigInt is past the end of any array, whether bounds are checked or not */
+static long indexOf(const Node* index, Value* locals)
+{
+    const long value = evaluate(index, locals).intval;
+    if(Int_isBig(value) == false)
+        return value;
+
+    char* digits = BigInt_toString(value);
+    char text[64];
+    snprintf(text, sizeof(text), (strlen(digits) < sizeof(text) ? "%s" : "%.40s..."), digits);
+    free(digits);
+    Int_release(value);
+    fail(index, "index %s is out of bounds", text);
+}
+
+/* Iterations of a parallel loop may access the same array */
+static void touch(Array* array, size_t position)
+{
+    if(in_parallel == false)
+    {
+        if(position < array->first_touched)
+            array->first_touched = position;
+        if(position > array->last_touched)
+            array->last_touched = position;
+        return;
+    }
+
+    size_t first = __atomic_load_n(&array->first_touched, __ATOMIC_RELAXED);
+    while(position < first && __atomic_compare_exchange_n(&array->first_touched, &first, position, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+    size_t last = __atomic_load_n(&array->last_touched, __ATOMIC_RELAXED);
+    while(position > last && __atomic_compare_exchange_n(&array->last_touched, &last, position, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+}
+
+/* The indices are computed before the array is looked up, since they may run code that declares it again */
+static void* element(const Node* node, Value* locals)
+{
+    long indices[node->count + 1];
+    int count = 0;
+    for(const Node* index = node->operands[1]; index != NULL && count < node->count; index = index->next)
+        indices[count++] = indexOf(index, locals);
+
+    Array* array = arrayOf(node, locals);
+    const size_t offset = offsetOf(node, array, indices, count, 0);
+    if(array->owns)
+        touch(array, offset / array->element_size);
+
+    return array->data + offset;
+}
+
+/* Element of an array of scalars inside a loop that changes neither the array nor the invariant indices.
+ * The first access after the loop reset the variable checks every index like element() does and keeps the offset of the invariant ones,
+ * the next accesses only compute the others */
+static void* reducedElement(const Node* node, Value* locals)
+{
+    Value* kept = variable(node->operands[2], locals);
+    long indices[node->count + 1];
+    int count = 0;
+    for(const Node* index = node->operands[1]; index != NULL && count < node->count; index = index->next, ++count)
+        if(kept->intval < 0 || (node->invariant & (1ul << count)) == 0)
+            indices[count] = indexOf(index, locals);
+
+    Array* array = arrayOf(node, locals);
+    if(kept->intval < 0)
+    {
+        const size_t offset = offsetOf(node, array, indices, count, 0);
+        kept->intval = offsetOf(node, array, indices, count, ~node->invariant);
+        return array->data + offset;
+    }
+
+    return array->data + kept->intval + offsetOf(node, array, indices, count, node->invariant);
+}
+
+/* Variables hold objects by pointer, the address of an object variable is that of the object */
+static void* address(const Node* node, Value* locals)
+{
+    switch(node->op)
+    {
+    case NODE_GLOBAL:
+    case NODE_LOCAL:
+    {
+        Value* value = variable(node, locals);
+        if(node->type.type != CLASS || node->type.dimensions != 0)
+            return value;
+        if(value->object == NULL)
+            fail(node, "object %s is used before its declaration", node->name);
+        return value->object;
+    }
+
+    case NODE_INDEX:         return element(node, locals);
+    case NODE_REDUCED_INDEX: return reducedElement(node, locals);
+    case NODE_FIELD:         return (char*)address(node->operands[0], locals) + node->offset;
+    default:                 return update(node, locals);
+    }
+}
+
+
+
+static long divide(const Node* node, long lval, long rval)
+{
+    if(rval == 0)
+    {
+        Int_release(lval);
+        fail(node, "division by zero");
+    }
+    return Int_div(lval, rval);
+}
+static long modulus(const Node* node, long lval, long rval)
+{
+    if(rval == 0)
+    {
+        Int_release(lval);
+        fail(node, "division by zero");
+    }
+    return Int_mod(lval, rval);
+}
+static long isZero(long value)
+{
+    const long result = !value;
+    Int_release(value);
+    return result;
+}
+static char* concatenate(char* lval, char* rval)
+{
+    char* result = concatStrings(lval, rval);
+    free(lval);
+    free(rval);
+    return result;
+}
+static int orderOfBigInts(long lval, long rval)
+{
+    const int order = BigInt_compare(lval, rval);
+    Int_release(lval);
+    Int_release(rval);
+    return order;
+}
+static int orderOfStrings(char* lval, char* rval)
+{
+    const int order = compareStrings(lval, rval);
+    free(lval);
+    free(rval);
+    return order;
+}
+
+/* One function per row of OPERATOR_KERNELS, named after the operator and the type. Unary kernels ignore rval */
+typedef Value (*Kernel)(const Node* node, Value lval, Value rval);
+
+#define KERNEL(op, type, field, expression)                             \
+    static Value op##_##type(const Node* node, Value lval, Value rval) \
+    {                                                                  \
+        return (Value){.field = (expression)};                         \
+    }
+OPERATOR_KERNELS(KERNEL)
+#undef KERNEL
+
+/* Indexed by the operator and the id of the type of its operands */
+#define KERNEL(op, type, field, expression) [op][type] = op##_##type,
+static const Kernel kernels[NODE_GT + 1][TYPE_ID_SCALARS] = {OPERATOR_KERNELS(KERNEL)};
+#undef KERNEL
+
+static inline Value compute(const Node* node, NodeOp op, const Type* type, Value lval, Value rval)
+{
+    return kernels[op][type->id](node, lval, rval);
+}
+
+
+
+/* Assignments and prefix increments. Returns the address of the target, since the result is an lval */
+static void* update(const Node* node, Value* locals)
+{
+    const Type* type = &node->type;
+
+    if(node->op == NODE_PREINC || node->op == NODE_PREDEC)
+    {
+        void* target = address(node->operands[0], locals);
+        store(type, target, compute(node, node->op, type, load(type, target), (Value){0}));
+        return target;
+    }
+
+    Value value = evaluate(node->operands[1], locals);
+    void* target = address(node->operands[0], locals);
+    if(node->op != NODE_ASSIGN)
+        value = compute(node, node->op, type, load(type, target), value);
+
+    store(type, target, value);
+    return target;
+}
+
+/* The profile counts a statement, or an iteration of a loop, and gives the time until the next one to its line.
+ * The sampler only needs to know the line, and counts its samples between two statements */
+static void markLine(const Node* node)
+{
+    if(running->profile != NULL)
+        Profile_line(running->profile, node->location.first_line);
+    if(running->sampler != NULL)
+    {
+        running->sampler->line = node->location.first_line;
+        if(running->sampler->full)
+            Sampler_drain(running->sampler);
+    }
+}
+
+/* Run the body of the routine on the frame of a call, which it releases */
+static inline __attribute__((always_inline)) Value runCall(const Node* node, Value* callee)
+{
+    const Routine* routine = node->routine;
+    ProfileCall profiled = {0};
+    if(running->profile != NULL)
+        profiled = Profile_enter(running->profile, routine);
+    if(running->sampler != NULL)
+        Sampler_enter(running->sampler, routine);
+
+    Value result;
+    if(execute(routine->body, callee, &result) != EXEC_RETURN)
+        result = zeroValue(node, &routine->return_type);
+
+    popFrame();
+    if(running->sampler != NULL)
+        Sampler_leave(running->sampler);
+    if(running->profile != NULL)
+        Profile_leave(running->profile, routine, profiled);
+    return result;
+}
+
+/* A memoized function only runs for the arguments it has no result for. The key is taken before the body changes its parameters.
+ * Kept out of call(), which stays as small as the calls of the other routines need */
+static __attribute__((noinline)) Value callMemoized(const Node* node, Value* callee)
+{
+    Memo* memo = node->routine->memo;
+    uint64_t key[memo->key_size + 1];
+    uint64_t hash;
+    if(Memo_key(memo, callee, key, &hash) == false)
+        return runCall(node, callee);
+
+    Value result;
+    if(Memo_find(memo, key, hash, &result))
+    {
+        popFrame();
+        return result;
+    }
+
+    result = runCall(node, callee);
+    Memo_store(memo, key, hash, result);
+    return result;
+}
+
+/* The iterations of parallel loops leave the memos alone */
+static Value call(const Node* node, Value* locals)
+{
+    const Routine* routine = node->routine;
+    Value* callee = pushFrame(node, routine);
+
+    /* The object of a method is passed by reference, once the other arguments were computed */
+    const Node* object = (routine->method ? node->operands[0] : NULL);
+    int count = (routine->method ? 1 : 0);
+    for(const Node* argument = (object != NULL ? object->next : node->operands[0]); argument != NULL && count < routine->param_count; argument = argument->next)
+        callee[count++] = evaluate(argument, locals);
+    if(object != NULL)
+        callee[0].object = address(object, locals);
+
+    if(routine->memo != NULL && in_parallel == false)
+        return callMemoized(node, callee);
+    return runCall(node, callee);
+}
+
+/* An inlined call stores its arguments in the variables standing for the parameters, in the order of a call,
+ * and evaluates the copy of the expression the routine returns. Parameters are scalars, so only an int may hold something to release */
+static Value callInline(const Node* node, Value* locals)
+{
+    const Routine* routine = node->routine;
+    Value* params = (node->operands[2] != NULL ? variable(node->operands[2], locals) : NULL);
+
+    const Node* object = (routine->method ? node->operands[0] : NULL);
+    int count = (routine->method ? 1 : 0);
+    for(const Node* argument = (object != NULL ? object->next : node->operands[0]); argument != NULL && count < routine->param_count; argument = argument->next, ++count)
+    {
+        const Value value = evaluate(argument, locals);
+        Value_release(&routine->slots.elements[count], &params[count]);
+        params[count] = value;
+    }
+    if(object != NULL)
+        params[0].object = address(object, locals);
+
+    if(running->profile == NULL && running->sampler == NULL)
+        return evaluate(node->operands[1], locals);
+
+    /* Profiled like a call, with the returned expression on the line of its return statement */
+    ProfileCall profiled = {0};
+    if(running->profile != NULL)
+        profiled = Profile_enter(running->profile, routine);
+    if(running->sampler != NULL)
+        Sampler_enter(running->sampler, routine);
+    markLine(node->operands[1]);
+
+    const Value result = evaluate(node->operands[1], locals);
+    if(running->sampler != NULL)
+        Sampler_leave(running->sampler);
+    if(running->profile != NULL)
+        Profile_leave(running->profile, routine, profiled);
+    return result;
+}
+
+/* Arrays are passed by reference, so the arguments need no release */
+static Value callBuiltin(const Node* node, Value* locals)
+{
+    Value args[BUILTIN_MAX_PARAMS];
+    int count = 0;
+    for(const Node* argument = node->operands[0]; argument != NULL && count < BUILTIN_MAX_PARAMS; argument = argument->next)
+        args[count++] = evaluate(argument, locals);
+
+    Value result = {0};
+    if(Builtin_run(node->builtin, args, &result) != 0)
+        fail(node, "the arrays given to %s have different sizes", builtins[node->builtin].name);
+    return result;
+}
+
+static Value evaluate(const Node* node, Value* locals)
+{
+    switch(node->op)
+    {
+    case NODE_CONST:
+        if(node->type.type == STRING)
+            return (Value){.strval = copyString(node->value.strval)};
+        return node->value;
+
+    case NODE_GLOBAL:
+    case NODE_LOCAL:
+    case NODE_INDEX:
+    case NODE_REDUCED_INDEX:
+    case NODE_FIELD:
+        if(node->type.dimensions != 0)
+            return (Value){.array = *(Array**)address(node, locals)};
+        return load(&node->type, address(node, locals));
+
+    case NODE_CALL:
+        return call(node, locals);
+
+    case NODE_BUILTIN:
+        return callBuiltin(node, locals);
+
+    case NODE_INLINE:
+        return callInline(node, locals);
+
+    case NODE_ASSIGN:
+    case NODE_ADD_ASSIGN:
+    case NODE_SUB_ASSIGN:
+    case NODE_MUL_ASSIGN:
+    case NODE_DIV_ASSIGN:
+    case NODE_MOD_ASSIGN:
+    case NODE_PREINC:
+    case NODE_PREDEC:
+        return load(&node->type, update(node, locals));
+
+    case NODE_POSTINC:
+    case NODE_POSTDEC:
+    {
+        void* target = address(node->operands[0], locals);
+        const Value value = load(&node->type, target);
+        store(&node->type, target, compute(node, (node->op == NODE_POSTINC ? NODE_PREINC : NODE_PREDEC), &node->type, load(&node->type, target), (Value){0}));
+        return value;
+    }
+
+    case NODE_ADD:
+    case NODE_SUB:
+    case NODE_MUL:
+    case NODE_DIV:
+    case NODE_MOD:
+    {
+        const Value lval = evaluate(node->operands[0], locals);
+        const Value rval = evaluate(node->operands[1], locals);
+        return compute(node, node->op, &node->type, lval, rval);
+    }
+
+    case NODE_NEG:
+    case NODE_NOT:
+        return compute(node, node->op, &node->type, evaluate(node->operands[0], locals), (Value){0});
+
+    case NODE_AND:
+        return (Value){.boolval = truth(node->operands[0], locals) && truth(node->operands[1], locals)};
+    case NODE_OR:
+        return (Value){.boolval = truth(node->operands[0], locals) || truth(node->operands[1], locals)};
+
+    case NODE_EQ:
+    case NODE_NE:
+    case NODE_LE:
+    case NODE_GE:
+    case NODE_LT:
+    case NODE_GT:
+    {
+        const Value lval = evaluate(node->operands[0], locals);
+        const Value rval = evaluate(node->operands[1], locals);
+        return compute(node, node->op, &node->operands[0]->type, lval, rval);
+    }
+    }
+
+    yyerror("debug: evaluate: node %d is not an expression", node->op);
+    abort();
+}
+
+
+
+static void declareArray(const Node* node, Value* locals)
+{
+    long sizes[node->count + 1];
+    int count = 0;
+    for(const Node* size = node->operands[1]; size != NULL && count < node->count; size = size->next)
+        sizes[count++] = size->value.intval;
+
+    Array* array = (count == node->type.dimensions ? Array_create(&node->type, sizes) : NULL);
+    if(array == NULL)
+        fail(node, "not enough memory for array %s", node->operands[0]->name);
+
+    Value* target = variable(node->operands[0], locals);
+    Value_release(&node->type, target);
+    target->array = array;
+}
+
+/* A module runs when the first import statement naming it runs */
+static void runModule(int index)
+{
+    Module* module = &running_modules->elements[index];
+    if(module->initialized)
+        return;
+
+    module->initialized = true;
+    if(running->profile != NULL)
+        Profile_enterModule(running->profile);
+    if(running->sampler != NULL)
+        Sampler_enter(running->sampler, NULL);
+
+    for(const Node* statement = module->init; statement != NULL; statement = statement->next)
+    {
+        Value result;
+        if(execute(statement, NULL, &result) == EXEC_RETURN)
+            break;
+    }
+
+    if(running->sampler != NULL)
+        Sampler_leave(running->sampler);
+    if(running->profile != NULL)
+        Profile_leaveModule(running->profile);
+}
+
+/* No case has a BigInt value, so those go to the default */
+static const Node* selectCase(const Node* node, Value* locals)
+{
+    const Value value = evaluate(node->operands[0], locals);
+    if(node->operands[0]->type.type == CHAR)
+        return SwitchTable_find(node->table, value.charval);
+    if(Int_isBig(value.intval))
+    {
+        Int_release(value.intval);
+        return node->table->otherwise;
+    }
+    return SwitchTable_find(node->table, value.intval);
+}
+
+static int executeList(const Node* statement, Value* locals, Value* result)
+{
+    for(; statement != NULL; statement = statement->next)
+        if(execute(statement, locals, result) == EXEC_RETURN)
+            return EXEC_RETURN;
+
+    return EXEC_NEXT;
+}
+
+static int execute(const Node* node, Value* locals, Value* result)
+{
+    if(node == NULL)
+        return EXEC_NEXT;
+    if(node->op != NODE_BLOCK)
+        markLine(node);
+
+    switch(node->op)
+    {
+    case NODE_EXP:
+    {
+        Value value = evaluate(node->operands[0], locals);
+        discard(&node->operands[0]->type, &value);
+        break;
+    }
+
+    case NODE_BLOCK:
+        return executeList(node->operands[0], locals, result);
+
+    case NODE_PRINT:
+        if(PrintQueue_push(prints, evaluate(node->operands[0], locals).intval) != 0)
+        {
+            yyerror("not enough memory to add integer to the print queue");
+            abort();
+        }
+        break;
+
+    case NODE_RETURN:
+        (*result) = (node->operands[0] != NULL ? evaluate(node->operands[0], locals) : (Value){0});
+        return EXEC_RETURN;
+
+    case NODE_IF:
+        if(truth(node->operands[0], locals))
+            return execute(node->operands[1], locals, result);
+        return execute(node->operands[2], locals, result);
+
+    case NODE_SWITCH:
+    {
+        const Node* selected = selectCase(node, locals);
+        return (selected != NULL ? executeList(selected->operands[1], locals, result) : EXEC_NEXT);
+    }
+
+    case NODE_WHILE:
+        while(truth(node->operands[0], locals))
+        {
+            if(execute(node->operands[1], locals, result) == EXEC_RETURN)
+                return EXEC_RETURN;
+            markLine(node);
+        }
+        break;
+
+    case NODE_DO:
+        do
+        {
+            if(execute(node->operands[1], locals, result) == EXEC_RETURN)
+                return EXEC_RETURN;
+            markLine(node);
+        }
+        while(truth(node->operands[0], locals));
+        break;
+
+    case NODE_FOR:
+        if(execute(node->operands[0], locals, result) == EXEC_RETURN)
+            return EXEC_RETURN;
+        for(; truth(node->operands[1], locals); execute(node->operands[2], locals, result))
+        {
+            if(execute(node->operands[3], locals, result) == EXEC_RETURN)
+                return EXEC_RETURN;
+            if(node->operands[2] == NULL) /* the step marks the line otherwise */
+                markLine(node);
+        }
+        break;
+
+    case NODE_PARALLEL_FOR:
+        runParallelLoop(node, locals);
+        break;
+
+    case NODE_DECL:
+    {
+        Value value = (node->operands[1] != NULL ? evaluate(node->operands[1], locals) : (Value){0});
+        if(node->operands[1] == NULL && node->type.type == CLASS)
+            value.object = createObject(node, node->type.layout);
+
+        Value* target = variable(node->operands[0], locals);
+        Value_release(&node->type, target);
+        (*target) = value;
+        break;
+    }
+
+    case NODE_DECL_ARRAY:
+        declareArray(node, locals);
+        break;
+
+    case NODE_IMPORT:
+        runModule(node->module);
+        break;
+
+    default:
+        yyerror("debug: execute: node %d is not a statement", node->op);
+        abort();
+    }
+
+    return EXEC_NEXT;
+}
+
+
+
+/* Releases the stacks of a thread that ran programs when it exits. The thread-locals are still there for its destructors */
+static pthread_key_t stack_key;
+static pthread_once_t stack_key_once = PTHREAD_ONCE_INIT;
+
+static void releaseStacks(void* data)
+{
+    munmap(data, VALUE_STACK_SIZE * sizeof(Value));
+    stack = (ValueStack){0};
+    free(frames.elements);
+    frames = (FrameStack){0};
+}
+
+static void createStackKey()
+{
+    pthread_key_create(&stack_key, releaseStacks);
+}
+
+/* The value stack is reserved by the first run and kept for the next ones on the same thread */
+static int reserveStack()
+{
+    if(stack.elements != NULL)
+        return 0;
+
+    void* data = mmap(NULL, VALUE_STACK_SIZE * sizeof(Value), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(data == MAP_FAILED)
+        return -1;
+
+    pthread_once(&stack_key_once, createStackKey);
+    pthread_setspecific(stack_key, data);
+    stack.elements = data;
+    stack.capacity = VALUE_STACK_SIZE;
+    return 0;
+}
+
+/* Runs go as deep as the stack of their thread allows. Returns NULL, so no limit, if the thread cannot tell where its stack ends */
+static const char* findStackFloor()
+{
+    pthread_attr_t attr;
+    if(pthread_getattr_np(pthread_self(), &attr) != 0)
+        return NULL;
+
+    void* low;
+    size_t size;
+    const char* floor = NULL;
+    if(pthread_attr_getstack(&attr, &low, &size) == 0 && size > 2 * STACK_MARGIN)
+        floor = (const char*)low + STACK_MARGIN;
+
+    pthread_attr_destroy(&attr);
+    return floor;
+}
+
+static int allocateGlobals(Program* target)
+{
+    if(target->value_count == target->globals.size)
+        return 0;
+
+    Value* values = realloc(target->values, target->globals.size * sizeof(values[0]));
+    if(values == NULL)
+        return -1;
+
+    memset(values + target->value_count, 0, (target->globals.size - target->value_count) * sizeof(values[0]));
+    target->values = values;
+    target->value_count = target->globals.size;
+    return 0;
+}
+
+/* Iterations of a parallel loop run in chunks. A chunk queues what it prints and keeps its diagnostics apart,
+ * and stops at its first failing iteration */
+typedef struct IterationChunk
+{
+    long first;
+    PrintQueue prints;
+    DiagnosticList diagnostics;
+    int error_count;
+    bool failed;
+} IterationChunk;
+
+/* The locals and the globals of a thread running iterations. Those of the loop start zeroed, the others are the ones of the loop */
+typedef struct IterationWorker
+{
+    Value* locals;
+    Value* globals;
+    IterationChunk* chunks;
+    int size;
+    int capacity;
+} IterationWorker;
+
+typedef struct IterationRun
+{
+    Program* program;
+    ModuleList* modules;
+    const Node* loop;
+    Value* locals;           /* of the routine running the loop, NULL at top level */
+    int local_count;
+    Value* globals;
+    VariableSet variables;   /* of the loop */
+    long stop;               /* first iteration that failed, updated atomically */
+    IterationWorker workers[PARALLEL_MAX_THREADS];
+} IterationRun;
+
+static Value* copyOf(IterationWorker* worker, const Node* variable)
+{
+    return (variable->op == NODE_LOCAL ? &worker->locals[variable->slot] : &worker->globals[variable->slot]);
+}
+
+static void startWorker(IterationRun* run, IterationWorker* worker)
+{
+    worker->globals = malloc((run->program->value_count + 1) * sizeof(Value));
+    worker->locals = malloc((run->local_count + 1) * sizeof(Value));
+    if(worker->globals == NULL || worker->locals == NULL)
+    {
+        yyerror("not enough memory to run a parallel loop");
+        abort();
+    }
+
+    if(run->program->value_count != 0)
+        memcpy(worker->globals, run->globals, run->program->value_count * sizeof(Value));
+    if(run->locals != NULL)
+        memcpy(worker->locals, run->locals, run->local_count * sizeof(Value));
+    for(int i = 0; i < run->variables.size; ++i)
+        *copyOf(worker, run->variables.elements[i]) = (Value){0};
+    for(const Node* reduction = run->loop->operands[3]; reduction != NULL; reduction = reduction->next)
+        *copyOf(worker, reduction) = (Value){0};
+}
+
+static IterationChunk* addChunk(IterationWorker* worker, long first)
+{
+    if(worker->size == worker->capacity)
+    {
+        int new_capacity = 1 + worker->capacity * 2;
+        IterationChunk* new_chunks = realloc(worker->chunks, new_capacity * sizeof(worker->chunks[0]));
+        if(new_chunks == NULL)
+        {
+            yyerror("not enough memory to run a parallel loop");
+            abort();
+        }
+
+        worker->chunks = new_chunks;
+        worker->capacity = new_capacity;
+    }
+
+    IterationChunk* chunk = &worker->chunks[worker->size++];
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->first = first;
+    return chunk;
+}
+
+/* Chunks past a failed iteration are not run, since the program stops there */
+static void runChunk(void* data, int index, long first, long end)
+{
+    IterationRun* run = data;
+    IterationWorker* worker = &run->workers[index];
+    if(first > __atomic_load_n(&run->stop, __ATOMIC_RELAXED))
+        return;
+
+    if(worker->globals == NULL)
+        startWorker(run, worker);
+    if(reserveStack() != 0)
+    {
+        yyerror("not enough memory for the call stack");
+        abort();
+    }
+
+    IterationChunk* chunk = addChunk(worker, first);
+    Program* saved_program = running;
+    ModuleList* saved_modules = running_modules;
+    Value* saved_globals = globals;
+    PrintQueue* saved_prints = prints;
+    jmp_buf* saved_failure = failure;
+    DiagnosticList* saved_buffer = diagnostic_buffer;
+    const int saved_error_count = error_count;
+    const int depth = frames.size;
+    if(stack_floor == NULL && index != 0)
+        stack_floor = findStackFloor();
+
+    jmp_buf jump;
+    volatile long iteration = first;
+    running = run->program;
+    running_modules = run->modules;
+    globals = worker->globals;
+    prints = &chunk->prints;
+    failure = &jump;
+    diagnostic_buffer = &chunk->diagnostics;
+    error_count = 0;
+    in_parallel = true;
+
+    if(setjmp(jump) == 0)
+    {
+        Value* counter = variable(run->loop->operands[0]->operands[0], worker->locals);
+        for(; iteration < end && iteration <= __atomic_load_n(&run->stop, __ATOMIC_RELAXED); ++iteration)
+        {
+            Value ignored;
+            counter->intval = iteration;
+            execute(run->loop->operands[2], worker->locals, &ignored);
+        }
+    }
+    else
+    {
+        while(frames.size > depth)
+            popFrame();
+        chunk->failed = true;
+
+        long stop = __atomic_load_n(&run->stop, __ATOMIC_RELAXED);
+        while(iteration < stop && __atomic_compare_exchange_n(&run->stop, &stop, iteration, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+    }
+
+    chunk->error_count = error_count;
+    in_parallel = false;
+    error_count = saved_error_count;
+    diagnostic_buffer = saved_buffer;
+    failure = saved_failure;
+    prints = saved_prints;
+    globals = saved_globals;
+    running_modules = saved_modules;
+    running = saved_program;
+}
+
+static int compareChunks(const void* lval, const void* rval)
+{
+    const long lfirst = (*(const IterationChunk* const*)lval)->first;
+    const long rfirst = (*(const IterationChunk* const*)rval)->first;
+    return (lfirst > rfirst) - (lfirst < rfirst);
+}
+
+/* What the chunks printed and reported goes to the loop in the order of their iterations, up to the first that failed.
+ * Returns whether one failed */
+static bool mergeChunks(IterationRun* run)
+{
+    int count = 0;
+    for(int i = 0; i < PARALLEL_MAX_THREADS; ++i)
+        count += run->workers[i].size;
+
+    IterationChunk** chunks = malloc((count + 1) * sizeof(chunks[0]));
+    if(chunks == NULL)
+    {
+        yyerror("not enough memory to run a parallel loop");
+        abort();
+    }
+
+    count = 0;
+    for(int i = 0; i < PARALLEL_MAX_THREADS; ++i)
+        for(int j = 0; j < run->workers[i].size; ++j)
+            chunks[count++] = &run->workers[i].chunks[j];
+    qsort(chunks, count, sizeof(chunks[0]), compareChunks);
+
+    bool failed = false;
+    for(int i = 0; i < count; ++i)
+    {
+        IterationChunk* chunk = chunks[i];
+        for(int j = 0; j < chunk->prints.size && !failed; ++j)
+        {
+            if(PrintQueue_push(prints, chunk->prints.elements[j]) != 0)
+            {
+                yyerror("not enough memory to add integer to the print queue");
+                abort();
+            }
+        }
+        for(size_t j = 0; j < chunk->diagnostics.size && !failed; ++j)
+            addDiagnostic(&chunk->diagnostics.elements[j]);
+        if(!failed)
+        {
+            error_count += chunk->error_count;
+            chunk->prints.size = 0;
+            chunk->diagnostics.size = 0;
+        }
+
+        PrintQueue_clear(&chunk->prints);
+        DiagnosticList_clear(&chunk->diagnostics);
+        failed = failed || chunk->failed;
+    }
+
+    free(chunks);
+    return failed;
+}
+
+/* The copies of the reduction variables are added to them in the order of the threads */
+static void finishWorkers(IterationRun* run, Value* locals, bool failed)
+{
+    for(int i = 0; i < PARALLEL_MAX_THREADS; ++i)
+    {
+        IterationWorker* worker = &run->workers[i];
+        if(worker->globals == NULL)
+            continue;
+
+        for(const Node* reduction = run->loop->operands[3]; reduction != NULL; reduction = reduction->next)
+        {
+            Value* copy = copyOf(worker, reduction);
+            Value* target = variable(reduction, locals);
+            if(reduction->type.type == DOUBLE)
+                target->doubleval += copy->doubleval;
+            else if(failed)
+                Int_release(copy->intval);
+            else
+                target->intval = Int_add(target->intval, copy->intval);
+        }
+        for(int j = 0; j < run->variables.size; ++j)
+            Value_release(&run->variables.elements[j]->type, copyOf(worker, run->variables.elements[j]));
+
+        free(worker->chunks);
+        free(worker->locals);
+        free(worker->globals);
+    }
+}
+
+static void runSequentially(const Node* node, Value* locals, long first, long end)
+{
+    Value* counter = variable(node->operands[0]->operands[0], locals);
+    for(long iteration = first; iteration < end; ++iteration)
+    {
+        Value ignored;
+        counter->intval = iteration;
+        execute(node->operands[2], locals, &ignored);
+        markLine(node);
+    }
+}
+
+/* The variable of the loop is declared and the end computed once, by this thread. Loops with fewer iterations than two,
+ * nested in another parallel loop or profiled run here, as do those started while another thread uses the pool */
+static void runParallelLoop(const Node* node, Value* locals)
+{
+    Value ignored;
+    execute(node->operands[0], locals, &ignored);
+    const long first = variable(node->operands[0]->operands[0], locals)->intval;
+    const long end = evaluate(node->operands[1], locals).intval;
+    if(Int_isBig(first) || Int_isBig(end))
+    {
+        Int_release(end);
+        fail(node->operands[1], "the bounds of a parallel loop must fit in a machine word");
+    }
+
+    const int threads = (running->threads > 0 ? running->threads : Parallel_processors());
+    if(threads <= 1 || in_parallel || running->profile != NULL || running->sampler != NULL || end <= first || (unsigned long)end - (unsigned long)first < 2)
+    {
+        runSequentially(node, locals, first, end);
+        return;
+    }
+
+    IterationRun* run = calloc(1, sizeof(*run));
+    if(run == NULL)
+    {
+        yyerror("not enough memory to run a parallel loop");
+        abort();
+    }
+
+    run->program = running;
+    run->modules = running_modules;
+    run->loop = node;
+    run->locals = locals;
+    run->local_count = (locals != NULL && frames.size > 0 ? frames.elements[frames.size - 1].routine->slots.size : 0);
+    run->globals = globals;
+    run->stop = LONG_MAX;
+    VariableSet_collect(&run->variables, node);
+
+    if(Parallel_for(threads, first, end, runChunk, run) < 0)
+    {
+        VariableSet_clear(&run->variables);
+        free(run);
+        runSequentially(node, locals, first, end);
+        return;
+    }
+
+    const bool failed = mergeChunks(run);
+    finishWorkers(run, locals, failed);
+    VariableSet_clear(&run->variables);
+    free(run);
+    if(failed)
+        longjmp(*failure, 1);
+}
+
+int Program_run(Context* context, const Node* code)
+{
+    if(allocateGlobals(&context->program) != 0)
+    {
+        yyerror("not enough memory for the global variables");
+        return -1;
+    }
+    if(reserveStack() != 0)
+    {
+        yyerror("not enough memory for the call stack");
+        return -1;
+    }
+    if(context->program.memoize > 0)
+        Program_memoize(&context->program, context->program.memoize);
+
+    jmp_buf jump;
+    jmp_buf* saved_failure = failure;
+    const char* saved_floor = stack_floor;
+    Program* saved_program = running;
+    ModuleList* saved_modules = running_modules;
+    Value* saved_globals = globals;
+    PrintQueue* saved_prints = prints;
+    const int depth = frames.size;
+    int result = 0;
+
+    failure = &jump;
+    stack_floor = findStackFloor();
+    running = &context->program;
+    running_modules = &context->modules;
+    globals = running->values;
+    prints = &context->printqueue;
+    if(running->profile != NULL)
+        Profile_start(running->profile);
+    if(running->sampler != NULL)
+        Sampler_start(running->sampler);
+
+    if(setjmp(jump) == 0)
+    {
+        Value ignored;
+        executeList(code, NULL, &ignored);
+    }
+    else
+    {
+        while(frames.size > depth)
+            popFrame();
+        result = -1;
+    }
+
+    if(running->sampler != NULL)
+        Sampler_stop(running->sampler);
+    if(running->profile != NULL)
+        Profile_stop(running->profile);
+
+    failure = saved_failure;
+    stack_floor = saved_floor;
+    globals = saved_globals;
+    prints = saved_prints;
+    running_modules = saved_modules;
+    running = saved_program;
+    return result;
+}
+
+int Program_evaluate(const Node* node, Value* value)
+{
+    jmp_buf jump;
+    jmp_buf* saved_failure = failure;
+    Program* saved_program = running;
+    Value* saved_globals = globals;
+    int result = 0;
+
+    failure = &jump;
+    running = &program;
+    globals = program.values;
+    if(setjmp(jump) == 0)
+        (*value) = evaluate(node, NULL);
+    else
+        result = -1;
+
+    failure = saved_failure;
+    running = saved_program;
+    globals = saved_globals;
+    return result;
+}
+
+/* Constants are small ints */
+static int constantResult(int type, Value* result)
+{
+    if(type == INT && Int_isBig(result->intval))
+    {
+        Int_release(result->intval);
+        return -1;
+    }
+    return 0;
+}
+
+int Program_compute(NodeOp op, int type, int operand_type, Value lval, Value rval, Value* result)
+{
+    const Node node = {.op = op, .type = Type_make(type, NULL, 0, NULL)};
+    const bool comparison = (op >= NODE_EQ && op <= NODE_GT);
+    const Type operands = (comparison ? Type_make(operand_type, NULL, 0, NULL) : node.type);
+    if(op < NODE_ADD_ASSIGN || op > NODE_GT || operands.id >= TYPE_ID_SCALARS || kernels[op][operands.id] == NULL)
+        return -1;
+
+    const bool division = (op == NODE_DIV || op == NODE_MOD || op == NODE_DIV_ASSIGN || op == NODE_MOD_ASSIGN);
+    if(division && ((type == INT && rval.intval == 0) || (type == CHAR && rval.charval == 0)))
+        return -1;
+
+    (*result) = compute(&node, op, &operands, lval, rval);
+    return (comparison ? 0 : constantResult(type, result));
+}
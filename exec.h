@@ -0,0 +1,19 @@
+#ifndef INCLUDED_EXEC_H
+#define INCLUDED_EXEC_H
+
+#include "node.h"
+
+/* Run top-level statements of the program of a context, which need not be the one being compiled. It prints to the queue
+ * of the context. A runtime error is reported like the compile errors and stops the run. Returns 0, or -1 after an error */
+struct Context;
+int Program_run(struct Context* context, const Node* code);
+
+/* Compute an operation on constants during the analysis. Returns 0, or -1 after reporting an error */
+int Program_evaluate(const Node* node, Value* value);
+
+/* Compute an operation on scalar constants for the optimizer, without reporting anything. Assignment operators compute the arithmetic
+ * of their assignment form and increments step their operand. Returns -1 for a division by zero, which is left for the run to report,
+ * and for an int result that does not fit in a small int */
+int Program_compute(NodeOp op, int type, int operand_type, Value lval, Value rval, Value* result);
+
+#endif
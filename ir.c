@@ -0,0 +1,1114 @@
+#include "ir.h"
+#include <ctype.h>
+#include "builtin.h"
+#include "y.tab.h"
+
+#define IR_MAX_DEFINITIONS (16 << 20) /* variables times blocks, above which code is not optimized */
+
+/* Operands of an opaque value while they are built */
+typedef struct IrList
+{
+    IrValue** elements;
+    int size;
+    int capacity;
+} IrList;
+
+static const char* const op_names[] =
+{
+    "const", "global", "local", "index", "reduced_index", "field", "call", "builtin", "inline",
+    "assign", "add_assign", "sub_assign", "mul_assign", "div_assign", "mod_assign", "preinc", "predec", "postinc", "postdec",
+    "add", "sub", "mul", "div", "mod", "neg", "not", "and", "or", "eq", "ne", "le", "ge", "lt", "gt",
+    "exp", "block", "print", "return", "if", "while", "do", "for", "parallel_for", "decl", "decl_array", "import", "switch", "case"
+};
+
+static IrValue* build(Ir* ir, Node* node);
+static void     buildList(Ir* ir, Node* node);
+
+
+
+static void* allocate(Ir* ir, size_t size)
+{
+    return memset(Arena_alloc(&ir->arena, size), 0, size);
+}
+
+/* Arrays of the IR live in its arena, so growing one leaves the old elements behind */
+static void* grow(Ir* ir, void* elements, int size, int* capacity, size_t element_size)
+{
+    if(size < (*capacity))
+        return elements;
+
+    const int new_capacity = 1 + (*capacity) * 2;
+    void* new_elements = Arena_alloc(&ir->arena, new_capacity * element_size);
+    if(size != 0)
+        memcpy(new_elements, elements, size * element_size);
+
+    (*capacity) = new_capacity;
+    return new_elements;
+}
+
+static void IrList_append(Ir* ir, IrList* list, IrValue* value)
+{
+    list->elements = grow(ir, list->elements, list->size, &list->capacity, sizeof(list->elements[0]));
+    list->elements[list->size++] = value;
+}
+
+static bool isScalar(const Type* type)
+{
+    return type->dimensions == 0 && (type->type == INT || type->type == BOOL || type->type == DOUBLE || type->type == CHAR);
+}
+
+static bool isUpdate(NodeOp op)
+{
+    return op >= NODE_ASSIGN && op <= NODE_POSTDEC;
+}
+
+
+
+/* Nodes */
+static size_t hashNode(const Ir* ir, const Node* node)
+{
+    return hashBytes(&node, sizeof(node), HASH_INIT) & (ir->node_capacity - 1);
+}
+
+static IrNode* recordNode(Ir* ir, const Node* node)
+{
+    size_t i = hashNode(ir, node);
+    while(ir->nodes[i].node != NULL && ir->nodes[i].node != node)
+        i = (i + 1) & (ir->node_capacity - 1);
+
+    IrNode* info = &ir->nodes[i];
+    if(info->node == NULL)
+    {
+        info->node = node;
+        info->copy_of = -1;
+        info->alive = true;
+    }
+
+    return info;
+}
+
+IrNode* Ir_findNode(const Ir* ir, const Node* node)
+{
+    if(ir->node_capacity == 0)
+        return NULL;
+
+    size_t i = hashNode(ir, node);
+    while(ir->nodes[i].node != NULL && ir->nodes[i].node != node)
+        i = (i + 1) & (ir->node_capacity - 1);
+    return (ir->nodes[i].node != NULL ? &ir->nodes[i] : NULL);
+}
+
+
+
+/* Variables */
+static int* findSlot(const Ir* ir, const Node* node)
+{
+    if(node->op == NODE_LOCAL && node->slot >= 0 && node->slot < ir->local_count)
+        return &ir->local_variables[node->slot];
+    if(node->op == NODE_GLOBAL && node->slot >= 0 && node->slot < ir->global_count)
+        return &ir->global_variables[node->slot];
+    return NULL;
+}
+
+int Ir_findVariable(const Ir* ir, const Node* node)
+{
+    const int* slot = findSlot(ir, node);
+    return (slot != NULL && (*slot) >= 0 ? (*slot) : -1);
+}
+
+static void registerVariable(Ir* ir, const Node* node)
+{
+    int* slot = findSlot(ir, node);
+    if(slot == NULL || (*slot) != -1 || isScalar(&node->type) == false)
+        return;
+
+    ir->variables = grow(ir, ir->variables, ir->variable_count, &ir->variable_capacity, sizeof(ir->variables[0]));
+    ir->variables[ir->variable_count] = (IrVariable){node->op == NODE_GLOBAL, node->slot, node->type.type, node->name};
+    (*slot) = ir->variable_count++;
+}
+
+/* The result of an assignment is an lval. A variable assigned through one is left to memory */
+static void excludeVariable(Ir* ir, const Node* node)
+{
+    while(isUpdate(node->op))
+        node = node->operands[0];
+
+    int* slot = findSlot(ir, node);
+    if(slot != NULL)
+        (*slot) = -2;
+}
+
+/* Find the variables and count the nodes and the blocks the code will need */
+static void scan(Ir* ir, const Node* node, size_t* node_count, size_t* block_count)
+{
+    for(; node != NULL; node = node->next)
+    {
+        ++(*node_count);
+        switch(node->op)
+        {
+        case NODE_LOCAL:
+        case NODE_GLOBAL: registerVariable(ir, node); break;
+        case NODE_IF:
+        case NODE_WHILE:
+        case NODE_DO:
+        case NODE_FOR:    (*block_count) += 3; break;
+        case NODE_AND:
+        case NODE_OR:     (*block_count) += 2; break;
+        case NODE_RETURN: (*block_count) += 1; break;
+        case NODE_SWITCH: (*block_count) += 1; break;
+        case NODE_CASE:   (*block_count) += 1 + node->count; break;
+        }
+
+        if(isUpdate(node->op) && isUpdate(node->operands[0]->op))
+            excludeVariable(ir, node->operands[0]);
+
+        for(int i = 0; i < 4; ++i)
+            scan(ir, node->operands[i], node_count, block_count);
+    }
+}
+
+
+
+/* Blocks and values */
+static IrBlock* newBlock(Ir* ir)
+{
+    IrBlock* block = allocate(ir, sizeof(*block));
+    block->id = ir->block_count;
+    block->order = -1;
+    if(ir->variable_count != 0)
+        block->definitions = allocate(ir, ir->variable_count * sizeof(block->definitions[0]));
+
+    ir->blocks = grow(ir, ir->blocks, ir->block_count, &ir->block_capacity, sizeof(ir->blocks[0]));
+    ir->blocks[ir->block_count++] = block;
+    return block;
+}
+
+static void addPredecessor(Ir* ir, IrBlock* block, IrBlock* predecessor)
+{
+    block->predecessors = grow(ir, block->predecessors, block->predecessor_count, &block->predecessor_capacity, sizeof(block->predecessors[0]));
+    block->predecessors[block->predecessor_count++] = predecessor;
+}
+
+static IrValue* createValue(Ir* ir, IrKind kind, int type, Node* node, int operand_count)
+{
+    IrValue* value = allocate(ir, sizeof(*value));
+    value->kind = kind;
+    value->type = type;
+    value->node = node;
+    value->variable = -1;
+    value->source = -1;
+    value->id = ir->value_count++;
+    value->operand_count = operand_count;
+    if(operand_count != 0)
+        value->operands = allocate(ir, operand_count * sizeof(value->operands[0]));
+    return value;
+}
+
+static IrValue* appendValue(IrBlock* block, IrValue* value)
+{
+    value->block = block;
+    if(block->last == NULL)
+        block->first = value;
+    else
+        block->last->next = value;
+    block->last = value;
+    return value;
+}
+
+static IrValue* prependValue(IrBlock* block, IrValue* value)
+{
+    value->block = block;
+    value->next = block->first;
+    block->first = value;
+    if(block->last == NULL)
+        block->last = value;
+    return value;
+}
+
+static IrValue* addValue(Ir* ir, IrKind kind, int type, Node* node, int operand_count)
+{
+    return appendValue(ir->current, createValue(ir, kind, type, node, operand_count));
+}
+
+static IrValue* addConstant(Ir* ir, int type, Value constant)
+{
+    IrValue* value = addValue(ir, IR_CONST, type, NULL, 0);
+    value->constant = constant;
+    return value;
+}
+
+static IrValue* addOpaque(Ir* ir, Node* node, const IrList* operands)
+{
+    IrValue* value = addValue(ir, IR_OPAQUE, VOID, node, operands->size);
+    for(int i = 0; i < operands->size; ++i)
+        value->operands[i] = operands->elements[i];
+    return value;
+}
+
+static IrValue* addUnary(Ir* ir, IrKind kind, NodeOp op, int type, Node* node, IrValue* operand)
+{
+    IrValue* value = addValue(ir, kind, type, node, 1);
+    value->op = op;
+    value->operands[0] = operand;
+    return value;
+}
+
+static IrValue* addBinary(Ir* ir, NodeOp op, int type, Node* node, IrValue* lval, IrValue* rval)
+{
+    IrValue* value = addValue(ir, IR_OP, type, node, 2);
+    value->op = op;
+    value->operands[0] = lval;
+    value->operands[1] = rval;
+    return value;
+}
+
+
+
+/* SSA construction as described by Braun et al., "Simple and Efficient Construction of Static Single Assignment Form".
+ * A block is sealed once all its predecessors are known. Until then reads in it create phis that get their operands later */
+static IrValue* readVariable(Ir* ir, int variable, IrBlock* block);
+
+/* Parameters and globals come from outside, the other locals start zeroed. Unreachable code reads anything */
+static IrValue* initialValue(Ir* ir, int variable, IrBlock* block)
+{
+    const IrVariable* var = &ir->variables[variable];
+    const bool entry = (block == ir->blocks[0] && (var->global || var->slot < ir->routine->param_count));
+
+    IrValue* value = createValue(ir, (entry ? IR_ENTRY : IR_CONST), var->type, NULL, 0);
+    value->variable = (entry ? variable : -1);
+    return prependValue(block, value);
+}
+
+static void addPhiOperands(Ir* ir, IrValue* phi)
+{
+    const IrBlock* block = phi->block;
+    phi->operand_count = block->predecessor_count;
+    phi->operands = allocate(ir, block->predecessor_count * sizeof(phi->operands[0]));
+    for(int i = 0; i < block->predecessor_count; ++i)
+        phi->operands[i] = readVariable(ir, phi->variable, block->predecessors[i]);
+}
+
+static IrValue* readVariable(Ir* ir, int variable, IrBlock* block)
+{
+    IrBlock* start = block;
+    while(block->definitions[variable] == NULL && block->sealed && block->predecessor_count == 1)
+        block = block->predecessors[0];
+
+    IrValue* value = block->definitions[variable];
+    if(value == NULL && block->sealed && block->predecessor_count == 0)
+        value = block->definitions[variable] = initialValue(ir, variable, block);
+    else if(value == NULL)
+    {
+        value = createValue(ir, IR_PHI, ir->variables[variable].type, NULL, 0);
+        value->variable = variable;
+        value->block = block;
+        value->next = block->phis;
+        block->phis = value;
+
+        block->definitions[variable] = value;
+        if(block->sealed)
+            addPhiOperands(ir, value);
+    }
+
+    for(; start != block; start = start->predecessors[0])
+        start->definitions[variable] = value;
+    return value;
+}
+
+static void sealBlock(Ir* ir, IrBlock* block)
+{
+    block->sealed = true;
+    for(IrValue* phi = block->phis; phi != NULL; phi = phi->next)
+        if(phi->variable >= 0 && phi->operands == NULL)
+            addPhiOperands(ir, phi);
+}
+
+static IrValue* addCopy(Ir* ir, int variable, IrValue* operand, Node* node)
+{
+    IrValue* copy = addUnary(ir, IR_COPY, NODE_ASSIGN, ir->variables[variable].type, node, operand);
+    copy->variable = variable;
+    ir->current->definitions[variable] = copy;
+    return copy;
+}
+
+/* A call may assign any global */
+static void clobberGlobals(Ir* ir, Node* node)
+{
+    for(int i = 0; i < ir->variable_count; ++i)
+    {
+        const IrVariable* var = &ir->variables[i];
+        if(var->global && ir->global_variables[var->slot] == i)
+        {
+            IrValue* value = addValue(ir, IR_ENTRY, var->type, node, 0);
+            value->variable = i;
+            ir->current->definitions[i] = value;
+        }
+    }
+}
+
+static void jump(Ir* ir, IrBlock* target)
+{
+    ir->current->successors[0] = target;
+    addPredecessor(ir, target, ir->current);
+}
+
+static IrValue* branch(Ir* ir, Node* node, IrValue* value, IrBlock* then, IrBlock* otherwise)
+{
+    IrBlock* block = ir->current;
+    block->condition = addUnary(ir, IR_TRUTH, NODE_NOT, BOOL, node, value);
+    block->successors[0] = then;
+    block->successors[1] = otherwise;
+    addPredecessor(ir, then, block);
+    addPredecessor(ir, otherwise, block);
+    return block->condition;
+}
+
+
+
+/* Code. The values are created in the order the program computes them */
+static void buildAddress(Ir* ir, Node* node, IrList* operands);
+
+/* Assignments and prefix increments, whose result is the stored value */
+static IrValue* buildUpdate(Ir* ir, Node* node)
+{
+    const bool increment = (node->op == NODE_PREINC || node->op == NODE_PREDEC);
+    IrValue* value = (increment ? NULL : build(ir, node->operands[1]));
+
+    const int variable = Ir_findVariable(ir, node->operands[0]);
+    if(variable < 0)
+    {
+        IrList operands = {0};
+        if(value != NULL)
+            IrList_append(ir, &operands, value);
+        buildAddress(ir, node->operands[0], &operands);
+        return addOpaque(ir, node, &operands);
+    }
+
+    if(node->op != NODE_ASSIGN)
+    {
+        IrValue* old = readVariable(ir, variable, ir->current);
+        value = (increment ? addUnary(ir, IR_OP, node->op, ir->variables[variable].type, node, old)
+                           : addBinary(ir, node->op, ir->variables[variable].type, node, old, value));
+    }
+
+    IrValue* copy = addCopy(ir, variable, value, node);
+    if(node->op == NODE_ASSIGN)
+        copy->source = Ir_findVariable(ir, node->operands[1]);
+
+    recordNode(ir, node)->store = copy;
+    return copy;
+}
+
+/* Postfix increments store the stepped value and result in the old one */
+static IrValue* buildPostfix(Ir* ir, Node* node)
+{
+    const int variable = Ir_findVariable(ir, node->operands[0]);
+    if(variable < 0)
+    {
+        IrList operands = {0};
+        buildAddress(ir, node->operands[0], &operands);
+        return addOpaque(ir, node, &operands);
+    }
+
+    IrValue* old = readVariable(ir, variable, ir->current);
+    IrValue* stepped = addUnary(ir, IR_OP, (node->op == NODE_POSTINC ? NODE_PREINC : NODE_PREDEC), ir->variables[variable].type, node, old);
+    recordNode(ir, node)->store = addCopy(ir, variable, stepped, node);
+    return old;
+}
+
+/* Memory outside the tracked variables. Only the values computing the address are built */
+static void buildAddress(Ir* ir, Node* node, IrList* operands)
+{
+    switch(node->op)
+    {
+    case NODE_GLOBAL:
+    case NODE_LOCAL:
+        break;
+
+    case NODE_INDEX:
+    case NODE_REDUCED_INDEX:
+    {
+        int count = 0;
+        for(Node* index = node->operands[1]; index != NULL && count < node->count; index = index->next, ++count)
+            IrList_append(ir, operands, build(ir, index));
+        buildAddress(ir, node->operands[0], operands);
+        break;
+    }
+
+    case NODE_FIELD:
+        buildAddress(ir, node->operands[0], operands);
+        break;
+
+    default:
+        IrList_append(ir, operands, buildUpdate(ir, node));
+        break;
+    }
+}
+
+static IrValue* buildCall(Ir* ir, Node* node)
+{
+    IrList operands = {0};
+    if(node->op == NODE_BUILTIN)
+    {
+        int count = 0;
+        for(Node* argument = node->operands[0]; argument != NULL && count < BUILTIN_MAX_PARAMS; argument = argument->next, ++count)
+            IrList_append(ir, &operands, build(ir, argument));
+        return addOpaque(ir, node, &operands);
+    }
+
+    const Routine* routine = node->routine;
+    Node* object = (routine->method ? node->operands[0] : NULL);
+    int count = (routine->method ? 1 : 0);
+    for(Node* argument = (object != NULL ? object->next : node->operands[0]); argument != NULL && count < routine->param_count; argument = argument->next, ++count)
+        IrList_append(ir, &operands, build(ir, argument));
+    if(object != NULL)
+        buildAddress(ir, object, &operands);
+
+    IrValue* value = addOpaque(ir, node, &operands);
+    clobberGlobals(ir, node);
+    return value;
+}
+
+/* An inlined call stores its arguments into the variables standing for the parameters, and its value is that of the copied expression */
+static IrValue* buildInline(Ir* ir, Node* node)
+{
+    const Routine* routine = node->routine;
+    const Node* parameters = node->operands[2];
+    Node* object = (routine->method ? node->operands[0] : NULL);
+    int count = (routine->method ? 1 : 0);
+    for(Node* argument = (object != NULL ? object->next : node->operands[0]); argument != NULL && count < routine->param_count; argument = argument->next, ++count)
+    {
+        IrValue* value = build(ir, argument);
+        const int variable = Ir_findVariable(ir, &(Node){.op = parameters->op, .slot = parameters->slot + count});
+        if(variable >= 0)
+            addCopy(ir, variable, value, node)->source = Ir_findVariable(ir, argument);
+    }
+
+    if(object != NULL)
+    {
+        IrList operands = {0};
+        buildAddress(ir, object, &operands);
+        addOpaque(ir, node, &operands);
+    }
+
+    return build(ir, node->operands[1]);
+}
+
+/* The right operand only runs if the left one does not decide the result */
+static IrValue* buildLogical(Ir* ir, Node* node)
+{
+    const bool and = (node->op == NODE_AND);
+    IrValue* left = build(ir, node->operands[0]);
+    IrValue* shortcut = addConstant(ir, BOOL, (Value){.boolval = !and});
+
+    IrBlock* right_block = newBlock(ir);
+    IrBlock* join = newBlock(ir);
+    branch(ir, node, left, (and ? right_block : join), (and ? join : right_block));
+    sealBlock(ir, right_block);
+
+    ir->current = right_block;
+    IrValue* right = addUnary(ir, IR_TRUTH, NODE_NOT, BOOL, node, build(ir, node->operands[1]));
+    jump(ir, join);
+    sealBlock(ir, join);
+
+    ir->current = join;
+    IrValue* phi = createValue(ir, IR_PHI, BOOL, node, 2);
+    phi->block = join;
+    phi->operands[0] = shortcut;
+    phi->operands[1] = right;
+    phi->next = join->phis;
+    join->phis = phi;
+    return phi;
+}
+
+static IrValue* build(Ir* ir, Node* node)
+{
+    IrValue* value = NULL;
+    switch(node->op)
+    {
+    case NODE_CONST:
+        if(isScalar(&node->type))
+        {
+            value = addConstant(ir, node->type.type, node->value);
+            value->node = node;
+        }
+        else
+            value = addOpaque(ir, node, &(IrList){0});
+        break;
+
+    case NODE_GLOBAL:
+    case NODE_LOCAL:
+    {
+        const int variable = Ir_findVariable(ir, node);
+        if(variable >= 0)
+        {
+            /* A variable holding a copy of another can be read from the other while both keep the value */
+            value = readVariable(ir, variable, ir->current);
+            if(value->kind == IR_COPY && value->source >= 0 && value->source != variable && value->type == ir->variables[value->source].type
+                && readVariable(ir, value->source, ir->current) == value->operands[0])
+                recordNode(ir, node)->copy_of = value->source;
+            break;
+        }
+    }
+    /* fallthrough */
+    case NODE_INDEX:
+    case NODE_REDUCED_INDEX:
+    case NODE_FIELD:
+    {
+        IrList operands = {0};
+        buildAddress(ir, node, &operands);
+        value = addOpaque(ir, node, &operands);
+        break;
+    }
+
+    case NODE_CALL:
+    case NODE_BUILTIN:
+        value = buildCall(ir, node);
+        break;
+
+    case NODE_INLINE:
+        value = buildInline(ir, node);
+        break;
+
+    case NODE_ASSIGN:
+    case NODE_ADD_ASSIGN:
+    case NODE_SUB_ASSIGN:
+    case NODE_MUL_ASSIGN:
+    case NODE_DIV_ASSIGN:
+    case NODE_MOD_ASSIGN:
+    case NODE_PREINC:
+    case NODE_PREDEC:
+        value = buildUpdate(ir, node);
+        break;
+
+    case NODE_POSTINC:
+    case NODE_POSTDEC:
+        value = buildPostfix(ir, node);
+        break;
+
+    case NODE_ADD:
+    case NODE_SUB:
+    case NODE_MUL:
+    case NODE_DIV:
+    case NODE_MOD:
+    case NODE_EQ:
+    case NODE_NE:
+    case NODE_LE:
+    case NODE_GE:
+    case NODE_LT:
+    case NODE_GT:
+    {
+        IrValue* lval = build(ir, node->operands[0]);
+        IrValue* rval = build(ir, node->operands[1]);
+        if(isScalar(&node->operands[0]->type) && isScalar(&node->operands[1]->type))
+        {
+            value = addBinary(ir, node->op, node->type.type, node, lval, rval);
+            value->operand_type = node->operands[0]->type.type;
+        }
+        else
+        {
+            IrList operands = {0};
+            IrList_append(ir, &operands, lval);
+            IrList_append(ir, &operands, rval);
+            value = addOpaque(ir, node, &operands);
+        }
+        break;
+    }
+
+    case NODE_NEG:
+    case NODE_NOT:
+        value = addUnary(ir, IR_OP, node->op, node->type.type, node, build(ir, node->operands[0]));
+        break;
+
+    case NODE_AND:
+    case NODE_OR:
+        value = buildLogical(ir, node);
+        break;
+
+    default:
+        yyerror("debug: build: node %d is not an expression", node->op);
+        abort();
+    }
+
+    recordNode(ir, node)->value = value;
+    return value;
+}
+
+static void buildStatement(Ir* ir, Node* node);
+
+/* A switch compares its value with the labels one after the other, like the if statements it stands for.
+ * The comparisons belong to the labels, and the block of every case to its node */
+static void buildSwitch(Ir* ir, Node* node)
+{
+    IrValue* selector = build(ir, node->operands[0]);
+
+    IrBlock* join = newBlock(ir);
+    IrBlock* otherwise = join;
+    for(Node* target = node->operands[1]; target != NULL; target = target->next)
+    {
+        IrBlock* body = newBlock(ir);
+        recordNode(ir, target)->block = body;
+        for(Node* label = target->operands[0]; label != NULL; label = label->next)
+        {
+            if(label->type.type == VOID)
+            {
+                otherwise = body;
+                continue;
+            }
+
+            IrValue* equal = addBinary(ir, NODE_EQ, BOOL, label, selector, addConstant(ir, label->type.type, label->value));
+            equal->operand_type = label->type.type;
+            IrBlock* next = newBlock(ir);
+            branch(ir, label, equal, body, next);
+            sealBlock(ir, next);
+            ir->current = next;
+        }
+    }
+    jump(ir, otherwise);
+
+    for(Node* target = node->operands[1]; target != NULL; target = target->next)
+    {
+        IrBlock* body = Ir_findNode(ir, target)->block;
+        sealBlock(ir, body);
+        ir->current = body;
+        buildList(ir, target->operands[1]);
+        jump(ir, join);
+    }
+
+    sealBlock(ir, join);
+    ir->current = join;
+}
+
+static void buildStatement(Ir* ir, Node* node)
+{
+    if(node == NULL)
+        return;
+
+    IrNode* info = recordNode(ir, node);
+    info->block = ir->current;
+
+    switch(node->op)
+    {
+    case NODE_EXP:
+        build(ir, node->operands[0]);
+        break;
+
+    case NODE_BLOCK:
+        buildList(ir, node->operands[0]);
+        break;
+
+    case NODE_PRINT:
+    case NODE_RETURN:
+    {
+        IrList operands = {0};
+        if(node->operands[0] != NULL)
+            IrList_append(ir, &operands, build(ir, node->operands[0]));
+        addOpaque(ir, node, &operands);
+
+        /* Code after a return is unreachable */
+        if(node->op == NODE_RETURN)
+        {
+            ir->current = newBlock(ir);
+            ir->current->sealed = true;
+        }
+        break;
+    }
+
+    case NODE_IF:
+    {
+        IrBlock* then = newBlock(ir);
+        IrBlock* otherwise = (node->operands[2] != NULL ? newBlock(ir) : NULL);
+        IrBlock* join = newBlock(ir);
+        info->value = branch(ir, node, build(ir, node->operands[0]), then, (otherwise != NULL ? otherwise : join));
+
+        sealBlock(ir, then);
+        ir->current = then;
+        buildStatement(ir, node->operands[1]);
+        jump(ir, join);
+
+        if(otherwise != NULL)
+        {
+            sealBlock(ir, otherwise);
+            ir->current = otherwise;
+            buildStatement(ir, node->operands[2]);
+            jump(ir, join);
+        }
+
+        sealBlock(ir, join);
+        ir->current = join;
+        break;
+    }
+
+    case NODE_WHILE:
+    case NODE_FOR:
+    {
+        const bool loop_for = (node->op == NODE_FOR);
+        if(loop_for)
+            buildStatement(ir, node->operands[0]);
+
+        IrBlock* header = newBlock(ir);
+        IrBlock* body = newBlock(ir);
+        IrBlock* exit = newBlock(ir);
+        jump(ir, header);
+
+        ir->current = header;
+        info->value = branch(ir, node, build(ir, node->operands[loop_for ? 1 : 0]), body, exit);
+        sealBlock(ir, body);
+
+        ir->current = body;
+        buildStatement(ir, node->operands[loop_for ? 3 : 1]);
+        if(loop_for)
+            buildStatement(ir, node->operands[2]);
+        jump(ir, header);
+
+        sealBlock(ir, header);
+        sealBlock(ir, exit);
+        ir->current = exit;
+        break;
+    }
+
+    case NODE_DO:
+    {
+        IrBlock* body = newBlock(ir);
+        IrBlock* exit = newBlock(ir);
+        jump(ir, body);
+
+        ir->current = body;
+        buildStatement(ir, node->operands[1]);
+        info->value = branch(ir, node, build(ir, node->operands[0]), body, exit);
+
+        sealBlock(ir, body);
+        sealBlock(ir, exit);
+        ir->current = exit;
+        break;
+    }
+
+    case NODE_SWITCH:
+        buildSwitch(ir, node);
+        break;
+
+    case NODE_DECL:
+    {
+        IrValue* value = (node->operands[1] != NULL ? build(ir, node->operands[1]) : NULL);
+        const int variable = Ir_findVariable(ir, node->operands[0]);
+        if(variable >= 0)
+        {
+            if(value == NULL)
+                value = addConstant(ir, ir->variables[variable].type, (Value){0});
+            info->store = addCopy(ir, variable, value, node);
+            if(node->operands[1] != NULL)
+                info->store->source = Ir_findVariable(ir, node->operands[1]);
+            break;
+        }
+
+        IrList operands = {0};
+        if(value != NULL)
+            IrList_append(ir, &operands, value);
+        addOpaque(ir, node, &operands);
+        break;
+    }
+
+    case NODE_DECL_ARRAY:
+        addOpaque(ir, node, &(IrList){0});
+        break;
+
+    case NODE_IMPORT:
+        addOpaque(ir, node, &(IrList){0});
+        clobberGlobals(ir, node);
+        break;
+
+    default:
+        yyerror("debug: buildStatement: node %d is not a statement", node->op);
+        abort();
+    }
+}
+
+static void buildList(Ir* ir, Node* node)
+{
+    for(; node != NULL; node = node->next)
+        buildStatement(ir, node);
+}
+
+
+
+int Ir_build(Ir* ir, const Routine* routine, Node* code)
+{
+    memset(ir, 0, sizeof(*ir));
+    ir->routine = routine;
+    ir->name = (routine == NULL ? "top level" : routine->name != NULL ? routine->name : "function");
+
+    ir->local_count = (routine != NULL ? routine->slots.size : 0);
+    ir->global_count = program.globals.size;
+    ir->local_variables = Arena_alloc(&ir->arena, (ir->local_count + 1) * sizeof(int));
+    ir->global_variables = Arena_alloc(&ir->arena, (ir->global_count + 1) * sizeof(int));
+    memset(ir->local_variables, 0xff, (ir->local_count + 1) * sizeof(int));
+    memset(ir->global_variables, 0xff, (ir->global_count + 1) * sizeof(int));
+
+    size_t node_count = 0, block_count = 1;
+    scan(ir, code, &node_count, &block_count);
+    if((size_t)ir->variable_count * block_count > IR_MAX_DEFINITIONS)
+    {
+        Ir_clear(ir);
+        return -1;
+    }
+
+    ir->node_capacity = 16;
+    while(ir->node_capacity < 2 * node_count)
+        ir->node_capacity *= 2;
+    ir->nodes = allocate(ir, ir->node_capacity * sizeof(ir->nodes[0]));
+
+    ir->current = newBlock(ir);
+    ir->current->sealed = true;
+    buildList(ir, code);
+    return 0;
+}
+
+void Ir_clear(Ir* ir)
+{
+    Arena_clear(&ir->arena);
+    memset(ir, 0, sizeof(*ir));
+}
+
+
+
+IrValue* Ir_resolve(IrValue* value)
+{
+    while(value != NULL && value->replacement != NULL)
+        value = value->replacement;
+    return value;
+}
+
+IrValue* Ir_entryValue(const IrBlock* block, int variable)
+{
+    for(IrValue* phi = block->phis; phi != NULL; phi = phi->next)
+        if(phi->variable == variable)
+            return (phi->replacement != NULL ? Ir_resolve(phi) : Ir_resolve(phi->operands[0]));
+    return NULL;
+}
+
+bool Ir_isEdgeExecutable(const IrBlock* from, const IrBlock* to)
+{
+    for(int i = 0; i < to->predecessor_count; ++i)
+        if(to->predecessors[i] == from && (to->edges == NULL || to->edges[i]))
+            return true;
+    return false;
+}
+
+IrValue* Ir_firstValue(const IrBlock* block)
+{
+    return (block->phis != NULL ? block->phis : block->first);
+}
+
+IrValue* Ir_nextValue(const IrBlock* block, const IrValue* value)
+{
+    return (value->kind == IR_PHI && value->next == NULL ? block->first : value->next);
+}
+
+
+
+void Ir_computeUses(Ir* ir)
+{
+    for(int i = 0; i < ir->block_count; ++i)
+        for(IrValue* value = Ir_firstValue(ir->blocks[i]); value != NULL; value = Ir_nextValue(ir->blocks[i], value))
+            value->user_count = 0;
+
+    for(int i = 0; i < ir->block_count; ++i)
+    {
+        IrBlock* block = ir->blocks[i];
+        block->condition = Ir_resolve(block->condition);
+        for(IrValue* value = Ir_firstValue(block); value != NULL; value = Ir_nextValue(block, value))
+            for(int j = 0; j < value->operand_count; ++j)
+                ++(value->operands[j] = Ir_resolve(value->operands[j]))->user_count;
+    }
+
+    for(int i = 0; i < ir->block_count; ++i)
+        for(IrValue* value = Ir_firstValue(ir->blocks[i]); value != NULL; value = Ir_nextValue(ir->blocks[i], value))
+        {
+            value->users = allocate(ir, (value->user_count + 1) * sizeof(value->users[0]));
+            value->user_count = 0;
+        }
+
+    for(int i = 0; i < ir->block_count; ++i)
+        for(IrValue* value = Ir_firstValue(ir->blocks[i]); value != NULL; value = Ir_nextValue(ir->blocks[i], value))
+            for(int j = 0; j < value->operand_count; ++j)
+            {
+                IrValue* operand = value->operands[j];
+                operand->users[operand->user_count++] = value;
+            }
+}
+
+
+
+static IrBlock* intersect(IrBlock* lval, IrBlock* rval)
+{
+    while(lval != rval)
+    {
+        while(lval->order > rval->order)
+            lval = lval->dominator;
+        while(rval->order > lval->order)
+            rval = rval->dominator;
+    }
+
+    return lval;
+}
+
+/* Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm" */
+void Ir_computeDominators(Ir* ir)
+{
+    IrBlock** blocks = malloc(ir->block_count * sizeof(blocks[0]));
+    IrBlock** stack = malloc(ir->block_count * sizeof(stack[0]));
+    int* positions = malloc(ir->block_count * sizeof(positions[0]));
+    if(blocks == NULL || stack == NULL || positions == NULL)
+    {
+        yyerror("not enough memory to optimize %s", ir->name);
+        abort();
+    }
+
+    for(int i = 0; i < ir->block_count; ++i)
+    {
+        IrBlock* block = ir->blocks[i];
+        block->order = -1;
+        block->dominator = NULL;
+        block->children = NULL;
+        block->sibling = NULL;
+    }
+
+    /* Depth first search through the executable edges, numbering the blocks in postorder */
+    int count = 0, depth = 0;
+    stack[depth] = ir->blocks[0];
+    positions[depth++] = 0;
+    ir->blocks[0]->order = -2;
+    while(depth != 0)
+    {
+        IrBlock* block = stack[depth - 1];
+        IrBlock* successor = NULL;
+        while(successor == NULL && positions[depth - 1] < 2)
+        {
+            IrBlock* target = block->successors[positions[depth - 1]++];
+            if(target != NULL && target->order == -1 && Ir_isEdgeExecutable(block, target))
+                successor = target;
+        }
+
+        if(successor != NULL)
+        {
+            successor->order = -2;
+            stack[depth] = successor;
+            positions[depth++] = 0;
+        }
+        else
+            blocks[count++] = stack[--depth];
+    }
+
+    for(int i = 0; i < count / 2; ++i)
+    {
+        IrBlock* block = blocks[i];
+        blocks[i] = blocks[count - 1 - i];
+        blocks[count - 1 - i] = block;
+    }
+    for(int i = 0; i < count; ++i)
+        blocks[i]->order = i;
+
+    ir->blocks[0]->dominator = ir->blocks[0];
+    for(bool changed = true; changed; )
+    {
+        changed = false;
+        for(int i = 1; i < count; ++i)
+        {
+            IrBlock* block = blocks[i];
+            IrBlock* dominator = NULL;
+            for(int j = 0; j < block->predecessor_count; ++j)
+            {
+                IrBlock* predecessor = block->predecessors[j];
+                if(predecessor->order < 0 || predecessor->dominator == NULL || (block->edges != NULL && block->edges[j] == false))
+                    continue;
+                dominator = (dominator == NULL ? predecessor : intersect(predecessor, dominator));
+            }
+
+            if(block->dominator != dominator)
+            {
+                block->dominator = dominator;
+                changed = true;
+            }
+        }
+    }
+
+    for(int i = count - 1; i >= 1; --i)
+    {
+        IrBlock* block = blocks[i];
+        block->sibling = block->dominator->children;
+        block->dominator->children = block;
+    }
+    ir->blocks[0]->dominator = NULL;
+
+    free(blocks);
+    free(stack);
+    free(positions);
+}
+
+
+
+static void dumpConstant(int type, Value value, FILE* fp)
+{
+    switch(type)
+    {
+    case INT:    fprintf(fp, "%ld", value.intval); break;
+    case BOOL:   fputs(value.boolval ? "true" : "false", fp); break;
+    case DOUBLE: fprintf(fp, "%g", value.doubleval); break;
+    case CHAR:   fprintf(fp, (isprint((unsigned char)value.charval) ? "'%c'" : "'\\x%02x'"), (unsigned char)value.charval); break;
+    }
+}
+
+static void dumpValue(const Ir* ir, const IrValue* value, FILE* fp)
+{
+    fprintf(fp, "    v%d = ", value->id);
+    switch(value->kind)
+    {
+    case IR_CONST:  fputs("const ", fp); dumpConstant(value->type, value->constant, fp); break;
+    case IR_ENTRY:  fprintf(fp, "entry %s", ir->variables[value->variable].name); break;
+    case IR_PHI:    fprintf(fp, "phi %s", (value->variable >= 0 ? ir->variables[value->variable].name : "-")); break;
+    case IR_COPY:   fprintf(fp, "copy %s", ir->variables[value->variable].name); break;
+    case IR_OP:     fputs(op_names[value->op], fp); break;
+    case IR_TRUTH:  fputs("truth", fp); break;
+    case IR_OPAQUE: fprintf(fp, "opaque %s", (value->node != NULL ? op_names[value->node->op] : "-")); break;
+    }
+
+    for(int i = 0; i < value->operand_count; ++i)
+        fprintf(fp, " v%d", Ir_resolve(value->operands[i])->id);
+
+    if(ir->executable_known && value->kind != IR_CONST && value->lattice == IR_CONSTANT)
+    {
+        fputs("  ; ", fp);
+        dumpConstant(value->type, value->constant, fp);
+    }
+    fputc('\n', fp);
+}
+
+void Ir_dump(const Ir* ir, const char* pass, FILE* fp)
+{
+    fprintf(fp, "%s after %s:\n", ir->name, pass);
+    for(int i = 0; i < ir->block_count; ++i)
+    {
+        const IrBlock* block = ir->blocks[i];
+        fprintf(fp, "  b%d:", block->id);
+        if(ir->executable_known && block->executable == false)
+        {
+            fputs(" unreachable\n", fp);
+            continue;
+        }
+
+        for(int j = 0; j < block->predecessor_count; ++j)
+            fprintf(fp, "%s b%d", (j == 0 ? " <-" : ""), block->predecessors[j]->id);
+        fputc('\n', fp);
+
+        for(const IrValue* value = Ir_firstValue(block); value != NULL; value = Ir_nextValue(block, value))
+            if(value->replacement == NULL && (ir->live_known == false || value->live))
+                dumpValue(ir, value, fp);
+
+        if(block->condition != NULL)
+            fprintf(fp, "    branch v%d b%d b%d\n", Ir_resolve(block->condition)->id, block->successors[0]->id, block->successors[1]->id);
+        else if(block->successors[0] != NULL)
+            fprintf(fp, "    jump b%d\n", block->successors[0]->id);
+    }
+
+    fputc('\n', fp);
+}
@@ -0,0 +1,161 @@
+#ifndef INCLUDED_IR_H
+#define INCLUDED_IR_H
+
+#include <stdio.h>
+#include "node.h"
+
+/* SSA form of the code of a routine, or of top-level code, built from its tree for the optimizer.
+ * Only scalar variables (int, bool, double and char) take part: every assignment to one of them defines a new value,
+ * and the values meet in phis where control flow joins. Everything else (calls, arrays, objects, strings, printing)
+ * becomes opaque values that keep their operands alive. Values remember their node, so that what the passes find
+ * can be applied back to the tree */
+
+typedef enum IrKind
+{
+    IR_CONST,
+    IR_ENTRY,   /* value of a parameter or a global when the code starts, or of a global after a call */
+    IR_PHI,     /* one operand per predecessor of its block */
+    IR_COPY,    /* assignment of its operand to a variable */
+    IR_OP,      /* operation of the tree. Assignment operators compute their arithmetic, increments step */
+    IR_TRUTH,   /* operand converted to bool, like conditions are */
+    IR_OPAQUE   /* computed by code the IR does not model, or with effects the program can observe */
+} IrKind;
+
+typedef struct IrValue
+{
+    IrKind kind;
+    NodeOp op;                   /* of IR_OP */
+    int type;                    /* INT, BOOL, DOUBLE or CHAR, VOID for values that are not scalars */
+    int operand_type;            /* of comparisons */
+    int variable;                /* defined by an entry, a phi or a copy, -1 otherwise */
+    int source;                  /* variable a copy was read from, -1 otherwise */
+    Value constant;
+
+    struct IrValue** operands;
+    int operand_count;
+
+    struct IrBlock* block;
+    Node* node;                  /* whose value it is, or the statement of an opaque value */
+    int id;
+
+    /* Filled by Ir_computeUses */
+    struct IrValue** users;
+    int user_count;
+
+    /* Results of the passes */
+    struct IrValue* replacement; /* value known to be equal, which takes its place */
+    int lattice;                 /* IR_UNKNOWN, IR_CONSTANT or IR_VARYING */
+    bool live;
+
+    struct IrValue* next;        /* in its block */
+    struct IrValue* work;        /* in the worklist or the hash table of a pass */
+    bool listed;
+} IrValue;
+
+enum
+{
+    IR_UNKNOWN,
+    IR_CONSTANT,
+    IR_VARYING
+};
+
+typedef struct IrBlock
+{
+    int id;
+    IrValue* phis;
+    IrValue* first;
+    IrValue* last;
+
+    struct IrBlock** predecessors;
+    bool* edges;                     /* executable edge from every predecessor, NULL until constants are propagated */
+    int predecessor_count;
+    int predecessor_capacity;
+    struct IrBlock* successors[2];   /* targets of a branch when its condition is true and false, or of a jump */
+    IrValue* condition;              /* of the branch, NULL for a jump */
+
+    IrValue** definitions;           /* current value of every variable while the block is built */
+    bool sealed;                     /* every predecessor is known */
+
+    bool executable;
+    int order;                       /* in reverse postorder, -1 if unreachable */
+    struct IrBlock* dominator;       /* immediate */
+    struct IrBlock* children;        /* in the dominator tree */
+    struct IrBlock* sibling;
+    struct IrBlock* work;
+} IrBlock;
+
+typedef struct IrVariable
+{
+    bool global;
+    int slot;
+    int type;
+    const char* name;
+} IrVariable;
+
+/* What the IR knows of a node: the value of an expression, the block where a statement starts,
+ * the value stored by an assignment or a declaration, and for a read of a variable that holds a copy of another,
+ * the other variable. alive and temporary are used while the results are applied */
+typedef struct IrNode
+{
+    const Node* node;
+    IrValue* value;
+    IrValue* store;
+    IrBlock* block;
+    int copy_of;
+    bool alive;
+    bool needed;      /* computes the value of a redundant expression */
+    Node* temporary;  /* variable keeping that value */
+} IrNode;
+
+typedef struct Ir
+{
+    Arena arena;
+    const char* name;          /* of the routine, for dumps */
+    const Routine* routine;    /* NULL for top-level code */
+
+    IrBlock** blocks;          /* in creation order, the entry first */
+    int block_count;
+    int block_capacity;
+    int value_count;
+    bool executable_known;     /* constants were propagated */
+    bool live_known;           /* dead code was found */
+
+    IrVariable* variables;
+    int variable_count;
+    int variable_capacity;
+    int* local_variables;      /* variable of every local slot, -1 if not tracked */
+    int* global_variables;     /* same for the globals */
+    int local_count;           /* slots when the IR was built */
+    int global_count;
+
+    IrNode* nodes;             /* hash table */
+    size_t node_capacity;
+
+    IrBlock* current;
+} Ir;
+
+/* Build the IR of a list of top-level statements (routine == NULL) or of the body of a routine.
+ * Returns -1, with nothing to clear, if the code is too large to optimize */
+int  Ir_build(Ir* ir, const Routine* routine, Node* code);
+void Ir_clear(Ir* ir);
+
+IrValue* Ir_resolve(IrValue* value);
+IrNode*  Ir_findNode(const Ir* ir, const Node* node);
+/* Variable tracked by the IR that a node names, or -1 */
+int      Ir_findVariable(const Ir* ir, const Node* node);
+/* Value of a variable when control enters a block from its first predecessor, NULL if the block has no phi for it */
+IrValue* Ir_entryValue(const IrBlock* block, int variable);
+bool     Ir_isEdgeExecutable(const IrBlock* from, const IrBlock* to);
+
+/* The phis of a block, then the other values in order */
+IrValue* Ir_firstValue(const IrBlock* block);
+IrValue* Ir_nextValue(const IrBlock* block, const IrValue* value);
+
+/* Resolve the operands of every value and list the users of each one */
+void Ir_computeUses(Ir* ir);
+/* Reverse postorder and dominator tree of the blocks reachable through executable edges */
+void Ir_computeDominators(Ir* ir);
+
+void Ir_dump(const Ir* ir, const char* pass, FILE* fp);
+
+#endif
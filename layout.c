@@ -0,0 +1,343 @@
+#include "layout.h"
+#include "array.h"
+#include "bigint.h"
+#include "y.tab.h"
+
+
+
+/* LayoutList */
+static void clearLayout(ClassLayout* layout)
+{
+    for(int i = 0; i < layout->fields.size; ++i)
+    {
+        Field* field = &layout->fields.elements[i];
+        free(field->sizes);
+        free(field->name);
+    }
+
+    for(int i = 0; i < layout->methods.size; ++i)
+    {
+        TypeList_clear(&layout->methods.elements[i].paramtypes);
+        free(layout->methods.elements[i].name);
+    }
+
+    free(layout->fields.elements);
+    free(layout->methods.elements);
+    free(layout->name);
+    Type_releaseLayout(layout);
+    free(layout);
+}
+
+void LayoutList_clear(LayoutList* list)
+{
+    for(int i = 0; i < list->size; ++i)
+        clearLayout(list->elements[i]);
+
+    free(list->elements);
+    list->elements = NULL;
+    list->capacity = 0;
+    list->size = 0;
+}
+
+int LayoutList_insert(LayoutList* list, ClassLayout* layout)
+{
+    if(list->size == list->capacity)
+    {
+        int new_capacity = 1 + list->capacity * 2;
+        ClassLayout** new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_list == NULL)
+        {
+            new_capacity = 1 + list->capacity;
+            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+            if(new_list == NULL)
+                return -1;
+        }
+
+        list->elements = new_list;
+        list->capacity = new_capacity;
+    }
+
+    list->elements[list->size] = layout;
+    ++list->size;
+    return 0;
+}
+
+
+
+/* ClassLayout */
+bool ClassLayout_fieldSize(const Type* type, size_t* size, size_t* alignment)
+{
+    if(type->dimensions != 0)
+    {
+        (*size) = (*alignment) = sizeof(struct Array*);
+        return true;
+    }
+
+    switch(type->type)
+    {
+    case INT:    (*size) = (*alignment) = sizeof(long);   return true;
+    case BOOL:   (*size) = (*alignment) = sizeof(bool);   return true;
+    case DOUBLE: (*size) = (*alignment) = sizeof(double); return true;
+    case CHAR:   (*size) = (*alignment) = sizeof(char);   return true;
+    case STRING: (*size) = (*alignment) = sizeof(char*);  return true;
+    case CLASS:
+        if(type->layout == NULL || type->layout->complete == false)
+            return false;
+        (*size) = type->layout->size;
+        (*alignment) = type->layout->alignment;
+        return true;
+    }
+
+    return false;
+}
+
+int ClassLayout_addField(ClassLayout* layout, char* name, const Type* type, long* sizes, int access)
+{
+    FieldList* list = &layout->fields;
+    if(list->size == list->capacity)
+    {
+        int new_capacity = 1 + list->capacity * 2;
+        Field* new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_list == NULL)
+        {
+            new_capacity = 1 + list->capacity;
+            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+            if(new_list == NULL)
+                return -1;
+        }
+
+        list->elements = new_list;
+        list->capacity = new_capacity;
+    }
+
+    size_t size = 0, alignment = 1;
+    ClassLayout_fieldSize(type, &size, &alignment);
+
+    Field* field = &list->elements[list->size];
+    field->name   = name;
+    field->type   = (*type);
+    field->access = access;
+    field->offset = (layout->size + alignment - 1) / alignment * alignment;
+    field->size   = size;
+    field->sizes  = sizes;
+    ++list->size;
+
+    layout->size = field->offset + size;
+    if(alignment > layout->alignment)
+        layout->alignment = alignment;
+
+    if(type->dimensions != 0 || type->type == STRING || (type->type == CLASS && type->layout->owns))
+        layout->owns = true;
+    if(type->dimensions != 0 || (type->type == CLASS && type->layout->arrays))
+        layout->arrays = true;
+    if(type->dimensions == 0 && (type->type == INT || (type->type == CLASS && type->layout->ints)))
+        layout->ints = true;
+    return 0;
+}
+
+int ClassLayout_addMethod(ClassLayout* layout, char* name, TypeList* paramtypes, struct Routine* routine, int access)
+{
+    MethodList* list = &layout->methods;
+    if(list->size == list->capacity)
+    {
+        int new_capacity = 1 + list->capacity * 2;
+        Method* new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_list == NULL)
+        {
+            new_capacity = 1 + list->capacity;
+            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+            if(new_list == NULL)
+                return -1;
+        }
+
+        list->elements = new_list;
+        list->capacity = new_capacity;
+    }
+
+    Method* method = &list->elements[list->size];
+    method->name       = name;
+    method->paramtypes = (*paramtypes);
+    method->access     = access;
+    method->routine    = routine;
+    ++list->size;
+    return 0;
+}
+
+/* The size is rounded to the alignment, so the objects of an array stay aligned */
+void ClassLayout_finish(ClassLayout* layout)
+{
+    if(layout->alignment == 0)
+        layout->alignment = 1;
+    layout->size = (layout->size + layout->alignment - 1) / layout->alignment * layout->alignment;
+    layout->complete = true;
+}
+
+/* The cached member is checked by name like any other, so it can never resolve to the wrong member.
+ * Function bodies analyzed on several threads share the cache and the counters, which are updated atomically */
+Field* ClassLayout_findField(ClassLayout* layout, const char* name)
+{
+    FieldList* fields = &layout->fields;
+    const int last = __atomic_load_n(&layout->last_field, __ATOMIC_RELAXED);
+    if(last >= 0 && last < fields->size && strcmp(name, fields->elements[last].name) == 0)
+    {
+        __atomic_add_fetch(&layout->hits, 1, __ATOMIC_RELAXED);
+        return &fields->elements[last];
+    }
+
+    __atomic_add_fetch(&layout->misses, 1, __ATOMIC_RELAXED);
+    for(int i = 0; i < fields->size; ++i)
+    {
+        if(strcmp(name, fields->elements[i].name) == 0)
+        {
+            __atomic_store_n(&layout->last_field, i, __ATOMIC_RELAXED);
+            return &fields->elements[i];
+        }
+    }
+
+    return NULL;
+}
+
+Method* ClassLayout_findMethod(ClassLayout* layout, const char* name, const TypeList* paramtypes)
+{
+    MethodList* methods = &layout->methods;
+    const int last = __atomic_load_n(&layout->last_method, __ATOMIC_RELAXED);
+    if(last >= 0 && last < methods->size)
+    {
+        Method* method = &methods->elements[last];
+        if(strcmp(name, method->name) == 0 && TypeList_equal(&method->paramtypes, paramtypes))
+        {
+            __atomic_add_fetch(&layout->hits, 1, __ATOMIC_RELAXED);
+            return method;
+        }
+    }
+
+    __atomic_add_fetch(&layout->misses, 1, __ATOMIC_RELAXED);
+    for(int i = 0; i < methods->size; ++i)
+    {
+        Method* method = &methods->elements[i];
+        if(strcmp(name, method->name) == 0 && TypeList_equal(&method->paramtypes, paramtypes))
+        {
+            __atomic_store_n(&layout->last_method, i, __ATOMIC_RELAXED);
+            return method;
+        }
+    }
+
+    return NULL;
+}
+
+
+
+/* Object */
+char* Object_create(const ClassLayout* layout)
+{
+    char* object = calloc(1, layout->size + 1);
+    if(object == NULL)
+        return NULL;
+
+    if(Object_init(layout, object) != 0)
+    {
+        Object_destroy(layout, object);
+        return NULL;
+    }
+
+    return object;
+}
+
+/* Zeroed memory is a valid object unless some field is an array */
+int Object_init(const ClassLayout* layout, char* object)
+{
+    if(layout->arrays == false)
+        return 0;
+
+    for(int i = 0; i < layout->fields.size; ++i)
+    {
+        const Field* field = &layout->fields.elements[i];
+        if(field->type.dimensions != 0)
+        {
+            Array* array = Array_create(&field->type, field->sizes);
+            *(Array**)(object + field->offset) = array;
+            if(array == NULL)
+                return -1;
+        }
+        else if(field->type.type == CLASS && Object_init(field->type.layout, object + field->offset) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Int fields hold no BigInt while there are none */
+static bool holdsOwned(const ClassLayout* layout)
+{
+    return layout->owns || (layout->ints && BigInt_exist());
+}
+
+/* dst is raw memory. After a failure the fields that were not copied are empty, so dst can still be released */
+int Object_copy(const ClassLayout* layout, char* dst, const char* src)
+{
+    memcpy(dst, src, layout->size);
+    if(holdsOwned(layout) == false)
+        return 0;
+
+    int result = 0;
+    for(int i = 0; i < layout->fields.size; ++i)
+    {
+        const Field* field = &layout->fields.elements[i];
+        char* target = dst + field->offset;
+
+        if(field->type.dimensions != 0)
+        {
+            Array* copy = (result == 0 ? Array_copy(*(Array* const*)(src + field->offset)) : NULL);
+            *(Array**)target = copy;
+            if(copy == NULL)
+                result = -1;
+        }
+        else if(field->type.type == STRING)
+        {
+            char* const source = *(char* const*)(src + field->offset);
+            char* copy = (result == 0 && source != NULL ? strdup(source) : NULL);
+            *(char**)target = copy;
+            if(copy == NULL && source != NULL)
+                result = -1;
+        }
+        else if(field->type.type == INT)
+            *(long*)target = Int_copy(*(const long*)(src + field->offset));
+        else if(field->type.type == CLASS && holdsOwned(field->type.layout))
+        {
+            if(result == 0)
+                result = Object_copy(field->type.layout, target, src + field->offset);
+            else
+                memset(target, 0, field->size);
+        }
+    }
+
+    return result;
+}
+
+void Object_release(const ClassLayout* layout, char* object)
+{
+    if(holdsOwned(layout) == false)
+        return;
+
+    for(int i = 0; i < layout->fields.size; ++i)
+    {
+        const Field* field = &layout->fields.elements[i];
+        if(field->type.dimensions != 0)
+            Array_destroy(*(Array**)(object + field->offset));
+        else if(field->type.type == STRING)
+            free(*(char**)(object + field->offset));
+        else if(field->type.type == INT)
+            Int_release(*(long*)(object + field->offset));
+        else if(field->type.type == CLASS)
+            Object_release(field->type.layout, object + field->offset);
+    }
+}
+
+void Object_destroy(const ClassLayout* layout, char* object)
+{
+    if(object == NULL)
+        return;
+
+    Object_release(layout, object);
+    free(object);
+}
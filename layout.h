@@ -0,0 +1,97 @@
+#ifndef INCLUDED_LAYOUT_H
+#define INCLUDED_LAYOUT_H
+
+#include "util.h"
+
+/* Field of a class. Objects store scalars and nested objects inline, strings and arrays by pointer */
+typedef struct Field
+{
+    char* name;
+    Type type;
+    int access;     /* PUBLIC or PRIVATE */
+    size_t offset;
+    size_t size;
+    long* sizes;    /* of an array field, created with the object */
+} Field;
+
+typedef struct FieldList
+{
+    Field* elements;
+    int size;
+    int capacity;
+} FieldList;
+
+/* Method of a class. Its routine takes the object as a hidden first parameter */
+typedef struct Method
+{
+    char* name;
+    TypeList paramtypes;
+    int access;
+    struct Routine* routine;
+} Method;
+
+typedef struct MethodList
+{
+    Method* elements;
+    int size;
+    int capacity;
+} MethodList;
+
+
+
+/* Layout of the objects of a class, computed when the class is declared.
+ * Fields are placed in declaration order at offsets aligned to their size, like the members of a C struct */
+typedef struct ClassLayout
+{
+    char* name;
+    FieldList fields;
+    MethodList methods;
+    size_t size;
+    size_t alignment;
+    bool owns;                /* some field, maybe nested, holds a string or an array */
+    bool arrays;              /* some field, maybe nested, is an array, so objects need more than zeroed memory */
+    bool ints;                /* some field, maybe nested, is an int, which may hold a BigInt */
+    bool complete;            /* the declaration ended, so the size is final */
+
+    /* Index of the member found by the last lookup, -1 before the first one.
+     * Accesses to the same member tend to come together, so it is compared first */
+    int last_field;
+    int last_method;
+    unsigned long long hits;
+    unsigned long long misses;
+
+    struct Routine* routine;  /* whose body declared the class, NULL at global scope */
+    int module;               /* index of the module that declared it, -1 for the program */
+    int index;                /* in the layouts of the program */
+} ClassLayout;
+
+typedef struct LayoutList
+{
+    ClassLayout** elements;
+    int size;
+    int capacity;
+} LayoutList;
+
+void LayoutList_clear(LayoutList* list);
+int  LayoutList_insert(LayoutList* list, ClassLayout* layout);
+
+/* Returns -1 if there is not enough memory. sizes belongs to the layout afterwards */
+int     ClassLayout_addField(ClassLayout* layout, char* name, const Type* type, long* sizes, int access);
+int     ClassLayout_addMethod(ClassLayout* layout, char* name, TypeList* paramtypes, struct Routine* routine, int access);
+void    ClassLayout_finish(ClassLayout* layout);
+Field*  ClassLayout_findField(ClassLayout* layout, const char* name);
+Method* ClassLayout_findMethod(ClassLayout* layout, const char* name, const TypeList* paramtypes);
+
+/* A field of the given type takes size bytes aligned to alignment. Returns false for a class that is not complete */
+bool ClassLayout_fieldSize(const Type* type, size_t* size, size_t* alignment);
+
+
+
+/* Objects. Every function returns -1 or NULL if there is not enough memory */
+char* Object_create(const ClassLayout* layout);
+int   Object_init(const ClassLayout* layout, char* object);
+int   Object_copy(const ClassLayout* layout, char* dst, const char* src);
+void  Object_release(const ClassLayout* layout, char* object);
+void  Object_destroy(const ClassLayout* layout, char* object);
+
+#endif
@@ -0,0 +1,663 @@
+#include "libtema.h"
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "yylloc.h"
+#include "util.h"
+#include "context.h"
+#include "bigint.h"
+#include "cache.h"
+#include "diagnostic.h"
+#include "exec.h"
+#include "memo.h"
+#include "opt.h"
+#include "parallel.h"
+#include "profile.h"
+#include "sampler.h"
+
+int yyparse();
+void yyrestart(FILE* fp);
+void analyzeDeferredBodies();
+void discardQueuedTokens();
+
+extern __thread int error_count;
+
+
+
+/* Top-level code of the programs compiled and not run yet */
+typedef struct CodeList
+{
+    const Node** elements;
+    int size;
+    int capacity;
+} CodeList;
+
+struct tema_ctx
+{
+    Context state;
+    bool compiled;
+    CodeList pending;
+
+    char* cache_dir;
+    uint64_t cache_size;
+
+    tema_output_fn output;
+    void* output_data;
+    tema_diagnostic_fn diagnostic;
+    void* diagnostic_data;
+
+    DiagnosticList diagnostics; /* of the compilation going on, written when it ends */
+    int max_errors;
+    int diagnostics_format;
+};
+
+static pthread_mutex_t compile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tema_ctx* current_ctx = NULL;
+
+
+
+static void writeStdout(void* data, const char* text, size_t size)
+{
+    fwrite(text, 1, size, stdout);
+}
+static void writeStderr(void* data, const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+}
+
+/* Diagnostics outside of a compilation are written right away */
+void addDiagnostic(Diagnostic* diagnostic)
+{
+    DiagnosticList* list = (diagnostic_buffer != NULL ? diagnostic_buffer : current_ctx != NULL ? &current_ctx->diagnostics : NULL);
+    if(list == NULL || DiagnosticList_insert(list, diagnostic) != 0)
+    {
+        Diagnostic_writeText(diagnostic, stderr);
+        fputc('\n', stderr);
+        Diagnostic_clear(diagnostic);
+    }
+}
+
+/* Sorted, without repetitions and with at most max_errors errors. The default callback gets them all in one write,
+ * other callbacks one at a time */
+static void flushDiagnostics(tema_ctx* ctx)
+{
+    DiagnosticList* list = &ctx->diagnostics;
+    if(list->size == 0)
+        return;
+
+    DiagnosticList_sort(list);
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* fp = open_memstream(&text, &size);
+    if(fp == NULL)
+    {
+        yyerror("not enough memory to write the diagnostics");
+        abort();
+    }
+
+    const bool separate = (ctx->diagnostic != writeStderr);
+    size_t error_count = 0;
+    size_t omitted = 0;
+    char note_text[64];
+    Diagnostic note = {.severity = SEVERITY_NOTE, .message = note_text};
+    for(size_t i = 0; i <= list->size; ++i)
+    {
+        const Diagnostic* diagnostic = (i < list->size ? &list->elements[i] : &note);
+        if(diagnostic->severity == SEVERITY_ERROR && ctx->max_errors > 0 && ++error_count > (size_t)ctx->max_errors)
+        {
+            ++omitted;
+            continue;
+        }
+
+        if(diagnostic == &note)
+        {
+            if(omitted == 0)
+                break;
+            snprintf(note_text, sizeof(note_text), "%zu more errors not shown", omitted);
+        }
+
+        const size_t start = size;
+        if(ctx->diagnostics_format == TEMA_DIAGNOSTICS_JSON)
+            Diagnostic_writeJson(diagnostic, fp);
+        else
+            Diagnostic_writeText(diagnostic, fp);
+
+        fputc(separate ? '\0' : '\n', fp);
+        if(separate)
+        {
+            fflush(fp);
+            ctx->diagnostic(ctx->diagnostic_data, text + start);
+        }
+    }
+    fclose(fp);
+
+    if(!separate)
+        fwrite(text, 1, size, stderr);
+
+    free(text);
+    DiagnosticList_clear(list);
+}
+
+
+
+/* The front end works on globals. A context is moved into them for the duration of a compilation */
+static void loadContext(tema_ctx* ctx)
+{
+    Context_swap(&ctx->state);
+    Context_resetLocation();
+    current_ctx = ctx;
+}
+static void storeContext(tema_ctx* ctx)
+{
+    Context_swap(&ctx->state);
+    current_ctx = NULL;
+}
+
+
+
+tema_ctx* tema_create()
+{
+    tema_ctx* ctx = calloc(1, sizeof(*ctx));
+    if(ctx == NULL)
+        return NULL;
+
+    ctx->output = writeStdout;
+    ctx->diagnostic = writeStderr;
+    ctx->state.program.bounds_checks = true;
+    ctx->state.program.inline_limit = INLINE_DEFAULT_LIMIT;
+    return ctx;
+}
+
+void tema_destroy(tema_ctx* ctx)
+{
+    if(ctx == NULL)
+        return;
+
+    Context_clear(&ctx->state);
+    DiagnosticList_clear(&ctx->diagnostics);
+    free(ctx->pending.elements);
+    free(ctx->cache_dir);
+    free(ctx);
+}
+
+
+
+void tema_set_output(tema_ctx* ctx, tema_output_fn output, void* data)
+{
+    ctx->output = (output == NULL ? writeStdout : output);
+    ctx->output_data = data;
+}
+void tema_set_diagnostics(tema_ctx* ctx, tema_diagnostic_fn diagnostic, void* data)
+{
+    ctx->diagnostic = (diagnostic == NULL ? writeStderr : diagnostic);
+    ctx->diagnostic_data = data;
+}
+void tema_set_max_errors(tema_ctx* ctx, int count)
+{
+    ctx->max_errors = (count < 0 ? 0 : count);
+}
+void tema_set_diagnostics_format(tema_ctx* ctx, int format)
+{
+    ctx->diagnostics_format = format;
+}
+void tema_set_bounds_checks(tema_ctx* ctx, int enabled)
+{
+    ctx->state.program.bounds_checks = enabled;
+}
+void tema_set_optimization(tema_ctx* ctx, int level)
+{
+    ctx->state.program.optimization = (level < 0 ? 0 : level > 2 ? 2 : level);
+}
+void tema_set_ir_dump(tema_ctx* ctx, FILE* fp)
+{
+    ctx->state.program.ir_dump = fp;
+}
+void tema_set_inline_limit(tema_ctx* ctx, int nodes)
+{
+    ctx->state.program.inline_limit = (nodes < 0 ? 0 : nodes);
+}
+void tema_set_inline_report(tema_ctx* ctx, FILE* fp)
+{
+    ctx->state.program.inline_report = fp;
+}
+void tema_set_analysis(tema_ctx* ctx, int mode)
+{
+    ctx->state.program.analysis = (mode < TEMA_ANALYSIS_EAGER ? TEMA_ANALYSIS_EAGER : mode > TEMA_ANALYSIS_CHECK_ALL ? TEMA_ANALYSIS_CHECK_ALL : mode);
+}
+void tema_set_jobs(tema_ctx* ctx, int count)
+{
+    ctx->state.program.jobs = (count < 1 ? 1 : count);
+}
+void tema_set_threads(tema_ctx* ctx, int count)
+{
+    ctx->state.program.threads = (count < 0 ? 0 : count);
+}
+void tema_set_memoize(tema_ctx* ctx, int entries)
+{
+    Program* program = &ctx->state.program;
+    program->memoize = (entries < 0 ? 0 : entries);
+    if(program->memoize == 0)
+        for(int i = 0; i < program->routines.size; ++i)
+        {
+            Memo_destroy(program->routines.elements[i]->memo);
+            program->routines.elements[i]->memo = NULL;
+        }
+}
+void tema_set_profile(tema_ctx* ctx, int enabled)
+{
+    Program* program = &ctx->state.program;
+    if(enabled && program->profile == NULL)
+        program->profile = Profile_create();
+    else if(!enabled)
+    {
+        Profile_destroy(program->profile);
+        program->profile = NULL;
+    }
+}
+void tema_set_sample_profile(tema_ctx* ctx, int hz)
+{
+    Program* program = &ctx->state.program;
+    if(hz > 0 && program->sampler == NULL)
+        program->sampler = Sampler_create(hz);
+    else if(hz > 0)
+        program->sampler->hz = hz;
+    else
+    {
+        Sampler_destroy(program->sampler);
+        program->sampler = NULL;
+    }
+}
+
+
+
+static void queueCode(tema_ctx* ctx, const Node* code)
+{
+    CodeList* pending = &ctx->pending;
+    if(pending->size == pending->capacity)
+    {
+        int new_capacity = 1 + pending->capacity * 2;
+        const Node** new_elements = realloc(pending->elements, new_capacity * sizeof(pending->elements[0]));
+        if(new_elements == NULL)
+        {
+            yyerror("not enough memory to keep the program until it runs");
+            abort();
+        }
+
+        pending->elements = new_elements;
+        pending->capacity = new_capacity;
+    }
+    pending->elements[pending->size++] = code;
+}
+
+/* Programs run outside of the compile lock, so the programs of different contexts run at the same time. They run in the order
+ * they were compiled, each after the ones before it, and a runtime error stops them */
+static void runPending(tema_ctx* ctx)
+{
+    if(ctx->pending.size == 0)
+        return;
+
+    DiagnosticList* saved_buffer = diagnostic_buffer;
+    const int saved_error_count = error_count;
+    diagnostic_buffer = &ctx->diagnostics;
+    error_count = 0;
+
+    for(int i = 0; i < ctx->pending.size && error_count == 0; ++i)
+        Program_run(&ctx->state, ctx->pending.elements[i]);
+
+    ctx->state.error_count += error_count;
+    ctx->pending.size = 0;
+    error_count = saved_error_count;
+    diagnostic_buffer = saved_buffer;
+}
+
+
+
+static int compileFile(tema_ctx* ctx, FILE* fp)
+{
+    pthread_mutex_lock(&compile_mutex);
+    loadContext(ctx);
+
+    yyrestart(fp);
+    yyparse();
+    discardQueuedTokens();
+    if(program.analysis != ANALYSIS_LAZY)
+        analyzeDeferredBodies();
+    Program_checkParallelLoops(program.code);
+
+    if(error_count == 0)
+        Program_optimize();
+
+    storeContext(ctx);
+    pthread_mutex_unlock(&compile_mutex);
+
+    if(ctx->state.error_count == 0)
+        queueCode(ctx, ctx->state.program.code);
+
+    ctx->compiled = true;
+    return ctx->state.error_count;
+}
+
+static int compileBuffer(tema_ctx* ctx, const char* buffer, size_t size)
+{
+    FILE* fp = fmemopen((void*)buffer, size, "r");
+    if(fp == NULL)
+        return -1;
+
+    const int error_count = compileFile(ctx, fp);
+    fclose(fp);
+    return error_count;
+}
+
+
+
+static uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Put a cached program into a fresh context as if it had just been compiled */
+static int restoreProgram(tema_ctx* ctx, const CacheEntry* entry)
+{
+    const YYLTYPE location = {1, 1, 1, 1};
+
+    pthread_mutex_lock(&compile_mutex);
+    loadContext(ctx);
+
+    const int result = importDeclarations(entry->declarations, entry->declarations_size, &location);
+    if(result == 0)
+    {
+        const char* end = entry->diagnostics + entry->diagnostics_size;
+        for(const char* record = entry->diagnostics; record != NULL && record < end; )
+        {
+            Diagnostic diagnostic;
+            record = Diagnostic_deserialize(&diagnostic, record, end);
+            if(record != NULL)
+                addDiagnostic(&diagnostic);
+        }
+    }
+
+    storeContext(ctx);
+    pthread_mutex_unlock(&compile_mutex);
+
+    if(result != 0)
+        return -1;
+
+    /* Only the analysis is cached, the program runs again */
+    ctx->state.error_count += entry->error_count;
+    ctx->state.warning_count += entry->warning_count;
+    ctx->compiled = true;
+    if(ctx->state.error_count == 0)
+        queueCode(ctx, ctx->state.program.code);
+    return 0;
+}
+
+static void storeProgram(tema_ctx* ctx, uint64_t key, size_t size, const char* diagnostics, size_t diagnostics_size)
+{
+    CacheEntry entry = {0};
+    char* declarations = NULL;
+    char* cwd = (ctx->state.modules.size != 0 ? getcwd(NULL, 0) : strdup(""));
+
+    if(cwd != NULL && exportDeclarations(&ctx->state, &declarations, &entry.declarations_size) == 0)
+    {
+        entry.error_count      = ctx->state.error_count;
+        entry.warning_count    = ctx->state.warning_count;
+        entry.declarations     = declarations;
+        entry.diagnostics      = diagnostics;
+        entry.diagnostics_size = diagnostics_size;
+        entry.cwd              = cwd;
+        Cache_store(ctx->cache_dir, key, size, &entry);
+    }
+
+    free(declarations);
+    free(cwd);
+}
+
+/* Load the program from the cache, or compile it and store it there */
+static int compileCached(tema_ctx* ctx, const char* source, size_t size)
+{
+    CacheStats stats = {0};
+    const uint64_t start = now();
+    /* The optimized code is cached, so each level and inlining limit has its own entries */
+    const int options[2] = {ctx->state.program.optimization, (ctx->state.program.optimization > 0 ? ctx->state.program.inline_limit : 0)};
+    const uint64_t key = hashBytes(options, sizeof(options), Cache_key(source, size));
+
+    CacheEntry entry;
+    if(Cache_load(ctx->cache_dir, key, size, &entry) == 0)
+    {
+        const int result = restoreProgram(ctx, &entry);
+        Cache_close(&entry);
+
+        if(result == 0)
+        {
+            stats.hits = 1;
+            stats.load_ns = now() - start;
+            Cache_addStats(ctx->cache_dir, &stats);
+            return ctx->state.error_count;
+        }
+    }
+
+    const int error_count = compileBuffer(ctx, source, size);
+
+    /* The diagnostics are not written yet, the entry keeps them */
+    char* diagnostics = NULL;
+    size_t diagnostics_size = 0;
+    FILE* log = (error_count == 0 ? open_memstream(&diagnostics, &diagnostics_size) : NULL);
+    if(log != NULL)
+    {
+        for(size_t i = 0; i < ctx->diagnostics.size; ++i)
+            Diagnostic_serialize(&ctx->diagnostics.elements[i], log);
+        fclose(log);
+    }
+
+    /* The bodies the lazy analysis skipped have no code to store */
+    if(error_count == 0 && diagnostics != NULL && ctx->state.program.skipped_bodies == ctx->state.program.deferred_bodies)
+    {
+        storeProgram(ctx, key, size, diagnostics, diagnostics_size);
+        stats.evictions = Cache_evict(ctx->cache_dir, ctx->cache_size);
+    }
+    free(diagnostics);
+
+    stats.misses = 1;
+    stats.compile_ns = now() - start;
+    Cache_addStats(ctx->cache_dir, &stats);
+    return error_count;
+}
+
+
+
+static int compileSource(tema_ctx* ctx, const char* buffer, size_t size)
+{
+    if(size == 0)
+        return ctx->state.error_count;
+
+    if(ctx->cache_dir != NULL && ctx->compiled == false)
+        return compileCached(ctx, buffer, size);
+    return compileBuffer(ctx, buffer, size);
+}
+
+static int compileStream(tema_ctx* ctx, FILE* fp)
+{
+    if(ctx->cache_dir == NULL || ctx->compiled == true)
+        return compileFile(ctx, fp);
+
+    /* The cache is keyed by the whole source */
+    char* source = NULL;
+    size_t size = 0;
+    FILE* buffer = open_memstream(&source, &size);
+    if(buffer == NULL)
+        return compileFile(ctx, fp);
+
+    char block[4096];
+    size_t count;
+    while((count = fread(block, 1, sizeof(block), fp)) != 0)
+        fwrite(block, 1, count, buffer);
+    fclose(buffer);
+
+    const int error_count = compileSource(ctx, source, size);
+    free(source);
+    return error_count;
+}
+
+int tema_compile_buffer(tema_ctx* ctx, const char* buffer, size_t size)
+{
+    runPending(ctx);
+    const int error_count = compileSource(ctx, buffer, size);
+    flushDiagnostics(ctx);
+    return error_count;
+}
+
+int tema_compile_file(tema_ctx* ctx, FILE* fp)
+{
+    if(fp == NULL)
+        return -1;
+
+    runPending(ctx);
+    const int error_count = compileStream(ctx, fp);
+    flushDiagnostics(ctx);
+    return error_count;
+}
+
+
+
+int tema_run(tema_ctx* ctx)
+{
+    runPending(ctx);
+    flushDiagnostics(ctx);
+    if(ctx->state.error_count != 0)
+        return -1;
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* fp = open_memstream(&text, &size);
+    if(fp == NULL)
+        return -1;
+
+    for(int i = 0; i < ctx->state.printqueue.size; ++i)
+    {
+        const long value = ctx->state.printqueue.elements[i];
+        if(Int_isBig(value))
+        {
+            char* digits = BigInt_toString(value);
+            fprintf(fp, "%s\n", digits);
+            free(digits);
+        }
+        else
+            fprintf(fp, "%ld\n", value);
+    }
+    fclose(fp);
+
+    if(size != 0)
+        ctx->output(ctx->output_data, text, size);
+
+    free(text);
+    PrintQueue_clear(&ctx->state.printqueue);
+    return 0;
+}
+
+
+
+int tema_error_count(const tema_ctx* ctx)
+{
+    return ctx->state.error_count;
+}
+int tema_warning_count(const tema_ctx* ctx)
+{
+    return ctx->state.warning_count;
+}
+
+void tema_get_stats(const tema_ctx* ctx, tema_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    const LayoutList* layouts = &ctx->state.program.layouts;
+    for(int i = 0; i < layouts->size; ++i)
+    {
+        stats->member_hits   += layouts->elements[i]->hits;
+        stats->member_misses += layouts->elements[i]->misses;
+    }
+    stats->skipped_bodies  = ctx->state.program.skipped_bodies;
+    stats->deferred_bodies = ctx->state.program.deferred_bodies;
+
+    const RoutineList* routines = &ctx->state.program.routines;
+    for(int i = 0; i < routines->size; ++i)
+    {
+        const Memo* memo = routines->elements[i]->memo;
+        if(memo == NULL)
+            continue;
+
+        ++stats->memoized_functions;
+        stats->memo_hits      += memo->hits;
+        stats->memo_misses    += memo->misses;
+        stats->memo_evictions += memo->evictions;
+        stats->memo_bytes     += Memo_bytes(memo);
+    }
+}
+
+int tema_write_profile(const tema_ctx* ctx, FILE* fp, const char* source, size_t size)
+{
+    if(ctx->state.program.profile == NULL)
+        return -1;
+
+    Profile_report(ctx->state.program.profile, &ctx->state.program.routines, fp, source, size);
+    return 0;
+}
+
+int tema_write_annotated_source(const tema_ctx* ctx, FILE* fp, const char* source, size_t size)
+{
+    if(ctx->state.program.profile == NULL || source == NULL)
+        return -1;
+
+    Profile_annotate(ctx->state.program.profile, fp, source, size);
+    return 0;
+}
+
+int tema_write_folded_stacks(const tema_ctx* ctx, FILE* fp)
+{
+    if(ctx->state.program.sampler == NULL)
+        return -1;
+
+    Sampler_write(ctx->state.program.sampler, fp);
+    return 0;
+}
+
+
+
+int tema_set_cache(tema_ctx* ctx, const char* dir, size_t max_size)
+{
+    char* cache_dir = NULL;
+    if(dir != NULL)
+    {
+        if(mkdir(dir, 0755) != 0 && errno != EEXIST)
+            return -1;
+
+        cache_dir = strdup(dir);
+        if(cache_dir == NULL)
+            return -1;
+    }
+
+    free(ctx->cache_dir);
+    ctx->cache_dir = cache_dir;
+    ctx->cache_size = (max_size != 0 ? max_size : CACHE_DEFAULT_SIZE);
+    return 0;
+}
+
+int tema_get_cache_stats(const char* dir, tema_cache_stats* stats)
+{
+    CacheStats cache_stats;
+    uint64_t size;
+    if(Cache_readStats(dir, &cache_stats, &size) != 0)
+        return -1;
+
+    stats->hits            = cache_stats.hits;
+    stats->misses          = cache_stats.misses;
+    stats->evictions       = cache_stats.evictions;
+    stats->load_seconds    = cache_stats.load_ns / 1e9;
+    stats->compile_seconds = cache_stats.compile_ns / 1e9;
+    stats->size            = size;
+    return 0;
+}
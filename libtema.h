@@ -0,0 +1,141 @@
+#ifndef INCLUDED_LIBTEMA_H
+#define INCLUDED_LIBTEMA_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Part of the program cache keys. Change it whenever the analysis of some program changes */
+#define TEMA_VERSION "0.13.0"
+
+/* A context owns every declaration, queued print value and counter of the programs compiled into it.
+ * Contexts are independent of each other. Calls on different contexts may come from different threads.
+ * Compilation is serialized since the scanner and the parser are not reentrant, the programs run at the same time */
+typedef struct tema_ctx tema_ctx;
+
+/* Receives print output. text is not null terminated */
+typedef void (*tema_output_fn)(void* data, const char* text, size_t size);
+/* Receives one diagnostic at a time, without the trailing new line */
+typedef void (*tema_diagnostic_fn)(void* data, const char* message);
+
+enum
+{
+    TEMA_DIAGNOSTICS_TEXT, /* severity: (first line, first column)->(last line, last column): message */
+    TEMA_DIAGNOSTICS_JSON  /* an object with severity, code, file, line, column, end_line, end_column, message and related */
+};
+
+tema_ctx* tema_create();
+void      tema_destroy(tema_ctx* ctx);
+
+/* A NULL callback restores the default (stdout for output, stderr for diagnostics) */
+void tema_set_output(tema_ctx* ctx, tema_output_fn output, void* data);
+void tema_set_diagnostics(tema_ctx* ctx, tema_diagnostic_fn diagnostic, void* data);
+/* The diagnostics of a compilation, and those of a run, are collected, sorted by location, stripped of repetitions
+ * and written when it ends. The default writes them to stderr at once. At most count errors are written (0, the default, for all),
+ * followed by a note telling how many were left out */
+void tema_set_max_errors(tema_ctx* ctx, int count);
+void tema_set_diagnostics_format(tema_ctx* ctx, int format);
+
+/* Check array indices against the array sizes while programs run (the default). Out of bounds accesses are runtime errors */
+void tema_set_bounds_checks(tema_ctx* ctx, int enabled);
+
+/* Optimize programs before running them: 0 runs them as parsed (the default), 1 propagates constants and copies
+ * and removes dead code and dead stores, 2 also removes common subexpressions. Output and errors are the same at every level */
+void tema_set_optimization(tema_ctx* ctx, int level);
+/* Write the IR of the optimized code to fp after every pass, NULL to stop */
+void tema_set_ir_dump(tema_ctx* ctx, FILE* fp);
+/* When optimizing, inline the calls to functions and methods that return an expression of at most nodes nodes (16 by default),
+ * 0 to inline nothing. fp receives a line for every inlined call, NULL to stop */
+void tema_set_inline_limit(tema_ctx* ctx, int nodes);
+void tema_set_inline_report(tema_ctx* ctx, FILE* fp);
+enum
+{
+    TEMA_ANALYSIS_EAGER,    /* analyze every function body while parsing it (the default) */
+    TEMA_ANALYSIS_LAZY,     /* skip the bodies of global functions and analyze each one on the first call that resolves to it */
+    TEMA_ANALYSIS_CHECK_ALL /* like TEMA_ANALYSIS_LAZY, then analyze the bodies never called, which reports the errors of the eager analysis */
+};
+/* When function bodies are analyzed. Errors in a body the lazy analysis never analyzes are not reported */
+void tema_set_analysis(tema_ctx* ctx, int mode);
+/* Analyze the bodies of global functions on count threads once the program is parsed (1, the default, analyzes them
+ * while parsing). Diagnostics are the same, the counters of member lookups may differ */
+void tema_set_jobs(tema_ctx* ctx, int count);
+/* Run the iterations of parallel loops on count threads, 0 (the default) for one per processor */
+void tema_set_threads(tema_ctx* ctx, int count);
+/* Keep the results of the calls to pure functions, which neither print nor use global variables and only call pure functions,
+ * and answer the calls with the same arguments from them. Only functions taking and returning ints, bools, doubles and chars
+ * are memoized, each keeping the results of at most entries calls (TEMA_MEMOIZE_ENTRIES is a good start) and dropping the least
+ * recently used ones past that. 0, the default, stops memoizing and forgets the results */
+#define TEMA_MEMOIZE_ENTRIES 65536
+void tema_set_memoize(tema_ctx* ctx, int entries);
+/* Count the executions and the time of every source line and routine of the programs that run from now on.
+ * 0 stops counting and forgets the counts */
+void tema_set_profile(tema_ctx* ctx, int enabled);
+/* Sample the routines and the line the programs run hz times per second of CPU time from now on,
+ * with a SIGPROF timer of the running thread. Sampled programs of different contexts run one at a time.
+ * 0 stops sampling and forgets the samples */
+void tema_set_sample_profile(tema_ctx* ctx, int hz);
+
+/* Compile a program into the context, to be run by tema_run if it has no errors. Declarations and variables of earlier programs
+ * remain visible, and the programs compiled and not run yet run first.
+ * Returns the number of errors found, or -1 if the source could not be read */
+int tema_compile_buffer(tema_ctx* ctx, const char* buffer, size_t size);
+int tema_compile_file(tema_ctx* ctx, FILE* fp);
+
+/* Run the compiled programs in order and send their output to the output callback. Errors at runtime stop the programs
+ * and are counted with the others, and the output is then dropped.
+ * Returns 0, or -1 if there were errors */
+int tema_run(tema_ctx* ctx);
+
+int tema_error_count(const tema_ctx* ctx);
+int tema_warning_count(const tema_ctx* ctx);
+
+typedef struct tema_stats
+{
+    unsigned long long member_hits;   /* member lookups answered by the member the class found last */
+    unsigned long long member_misses;
+    unsigned long long skipped_bodies;  /* function bodies the lazy analysis skipped */
+    unsigned long long deferred_bodies; /* skipped bodies analyzed later */
+    unsigned long long memoized_functions; /* pure functions whose calls are memoized */
+    unsigned long long memo_hits;       /* calls answered from a memo */
+    unsigned long long memo_misses;
+    unsigned long long memo_evictions;
+    unsigned long long memo_bytes;      /* taken by the memos, not counting the BigInts they keep */
+} tema_stats;
+
+/* Counters of the programs compiled into the context */
+void tema_get_stats(const tema_ctx* ctx, tema_stats* stats);
+
+/* Write the lines and the routines that took the most time to fp, quoting the lines from source if not NULL,
+ * or the whole source with the count and the time of every line. Return -1 if the context is not profiling */
+int tema_write_profile(const tema_ctx* ctx, FILE* fp, const char* source, size_t size);
+int tema_write_annotated_source(const tema_ctx* ctx, FILE* fp, const char* source, size_t size);
+/* Write the sampled stacks to fp as folded stacks, one line per stack with its frames separated by ';' and its number of samples,
+ * which flame graph tools read. Return -1 if the context is not sampling */
+int tema_write_folded_stacks(const tema_ctx* ctx, FILE* fp);
+
+/* Store analyzed programs in dir (created if missing) and reuse them for identical sources instead of compiling.
+ * Only the first compilation of a context uses the cache, and only programs without errors are stored.
+ * max_size bounds the directory in bytes, 0 for the default of 64 MiB. A NULL dir disables the cache */
+int tema_set_cache(tema_ctx* ctx, const char* dir, size_t max_size);
+
+typedef struct tema_cache_stats
+{
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    double load_seconds;    /* total over the hits */
+    double compile_seconds; /* total over the misses, storing included */
+    unsigned long long size;
+} tema_cache_stats;
+
+/* Counters accumulated by every run using the cache directory */
+int tema_get_cache_stats(const char* dir, tema_cache_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
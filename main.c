@@ -0,0 +1,305 @@
+#include <signal.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "libtema.h"
+#include "server.h"
+
+void handleSIGSEGV(int s)
+{
+    fputs("error: SIGSEGV caught... aborting\n", stderr);
+    abort();
+}
+
+
+
+static void writeStream(void* data, const char* text, size_t size)
+{
+    fwrite(text, 1, size, data);
+}
+static void writeLine(void* data, const char* message)
+{
+    fprintf(data, "%s\n", message);
+}
+
+static const char* cache_dir = NULL;
+static size_t cache_size = 0;
+static bool bounds_checks = true;
+static int optimization = 0;
+static bool dump_ir = false;
+static int inline_limit = -1; /* the default of the library */
+static bool inline_report = false;
+static bool profile = false;
+static const char* annotate_file = NULL;
+static int sample_hz = 0;
+static const char* sample_file = NULL;
+static int max_errors = 0;
+static int diagnostics_format = TEMA_DIAGNOSTICS_TEXT;
+static int analysis = TEMA_ANALYSIS_EAGER;
+static int jobs = 1;
+static int threads = 0;
+static int memoize = 0;
+
+static tema_ctx* createContext()
+{
+    tema_ctx* ctx = tema_create();
+    if(ctx != NULL && cache_dir != NULL && tema_set_cache(ctx, cache_dir, cache_size) != 0)
+        fprintf(stderr, "could not use cache directory %s\n", cache_dir);
+    if(ctx != NULL)
+    {
+        tema_set_bounds_checks(ctx, bounds_checks);
+        tema_set_optimization(ctx, optimization);
+        tema_set_ir_dump(ctx, (dump_ir ? stderr : NULL));
+        if(inline_limit >= 0)
+            tema_set_inline_limit(ctx, inline_limit);
+        tema_set_inline_report(ctx, (inline_report ? stderr : NULL));
+        tema_set_sample_profile(ctx, sample_hz);
+        tema_set_max_errors(ctx, max_errors);
+        tema_set_diagnostics_format(ctx, diagnostics_format);
+        tema_set_analysis(ctx, analysis);
+        tema_set_jobs(ctx, jobs);
+        tema_set_threads(ctx, threads);
+        tema_set_memoize(ctx, memoize);
+    }
+    return ctx;
+}
+
+void handleRequest(const char* source, size_t size, Response* response)
+{
+    FILE* output = open_memstream(&response->output, &response->output_size);
+    FILE* diagnostics = open_memstream(&response->diagnostics, &response->diagnostics_size);
+    tema_ctx* ctx = createContext();
+    if(output == NULL || diagnostics == NULL || ctx == NULL)
+    {
+        fprintf(stderr, "not enough memory to handle a request\n");
+        abort();
+    }
+
+    tema_set_output(ctx, writeStream, output);
+    tema_set_diagnostics(ctx, writeLine, diagnostics);
+
+    /* Runtime errors count too */
+    response->error_count = tema_compile_buffer(ctx, source, size);
+    if(response->error_count >= 0)
+    {
+        tema_run(ctx);
+        response->error_count = tema_error_count(ctx);
+    }
+
+    tema_destroy(ctx);
+    fclose(output);
+    fclose(diagnostics);
+}
+
+
+
+static int printCacheStats()
+{
+    tema_cache_stats stats;
+    if(tema_get_cache_stats(cache_dir, &stats) != 0)
+    {
+        fprintf(stderr, "could not read cache directory %s\n", cache_dir);
+        return 1;
+    }
+
+    printf("hits: %llu\n", stats.hits);
+    printf("misses: %llu\n", stats.misses);
+    printf("evictions: %llu\n", stats.evictions);
+    printf("size: %llu bytes\n", stats.size);
+    printf("mean load time: %.1f us\n", stats.hits != 0 ? stats.load_seconds / stats.hits * 1e6 : 0.0);
+    printf("mean compile time: %.1f us\n", stats.misses != 0 ? stats.compile_seconds / stats.misses * 1e6 : 0.0);
+    return 0;
+}
+
+static void printStats(const tema_ctx* ctx)
+{
+    tema_stats stats;
+    tema_get_stats(ctx, &stats);
+    fprintf(stderr, "member lookups: %llu hits, %llu misses\n", stats.member_hits, stats.member_misses);
+    fprintf(stderr, "function bodies: %llu skipped, %llu analyzed later\n", stats.skipped_bodies, stats.deferred_bodies);
+    const unsigned long long calls = stats.memo_hits + stats.memo_misses;
+    fprintf(stderr, "memoized calls: %llu hits, %llu misses (%.1f%% hit rate), %llu evictions, %llu bytes for %llu functions\n",
+            stats.memo_hits, stats.memo_misses, (calls != 0 ? 100.0 * stats.memo_hits / calls : 0.0), stats.memo_evictions,
+            stats.memo_bytes, stats.memoized_functions);
+}
+
+/* The profile quotes the source, so a profiled program is read whole before it compiles */
+static char* readSource(FILE* fp, size_t* size)
+{
+    char* source = NULL;
+    FILE* buffer = open_memstream(&source, size);
+    if(buffer == NULL)
+        return NULL;
+
+    char block[4096];
+    size_t count;
+    while((count = fread(block, 1, sizeof(block), fp)) != 0)
+        fwrite(block, 1, count, buffer);
+    fclose(buffer);
+    return source;
+}
+
+static void writeProfile(const tema_ctx* ctx, const char* source, size_t size)
+{
+    if(profile)
+        tema_write_profile(ctx, stderr, source, size);
+
+    if(annotate_file != NULL)
+    {
+        FILE* fp = fopen(annotate_file, "w");
+        if(fp == NULL)
+        {
+            fprintf(stderr, "could not open file %s\n", annotate_file);
+            return;
+        }
+        tema_write_annotated_source(ctx, fp, source, size);
+        fclose(fp);
+    }
+}
+
+static void writeSamples(const tema_ctx* ctx)
+{
+    FILE* fp = (sample_file != NULL ? fopen(sample_file, "w") : stderr);
+    if(fp == NULL)
+    {
+        fprintf(stderr, "could not open file %s\n", sample_file);
+        return;
+    }
+
+    tema_write_folded_stacks(ctx, fp);
+    if(fp != stderr)
+        fclose(fp);
+}
+
+static int usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-O0|-O1|-O2] [--max-errors count] [--diagnostics-format=text|json] [--lazy|--check-all] [--jobs count] [--threads count] [--memoize[=entries]] [--dump-ir] [--inline-limit nodes] [--inline-report] [--no-bounds-checks] [--stats] [--profile] [--profile-annotate file] [--sample-profile=hz [--sample-output file]] [--cache-dir dir [--cache-size bytes]] [file]\n", name);
+    fprintf(stderr, "       %s --cache-dir dir --cache-stats\n", name);
+    fprintf(stderr, "       %s --serve socket [--workers count] [-O0|-O1|-O2] [--max-errors count] [--diagnostics-format=text|json] [--lazy|--check-all] [--jobs count] [--threads count] [--memoize[=entries]] [--inline-limit nodes] [--no-bounds-checks] [--cache-dir dir [--cache-size bytes]]\n", name);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    signal(SIGSEGV, handleSIGSEGV);
+
+    const char* socket_path = NULL;
+    const char* file = NULL;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    bool show_stats = false;
+    bool print_stats = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const bool has_value = (i + 1 < argc);
+        if(strcmp(argv[i], "--serve") == 0 && has_value)
+            socket_path = argv[++i];
+        else if(strcmp(argv[i], "--workers") == 0 && has_value)
+            workers = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--cache-dir") == 0 && has_value)
+            cache_dir = argv[++i];
+        else if(strcmp(argv[i], "--cache-size") == 0 && has_value)
+            cache_size = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--cache-stats") == 0)
+            show_stats = true;
+        else if(strcmp(argv[i], "--no-bounds-checks") == 0)
+            bounds_checks = false;
+        else if(strcmp(argv[i], "--stats") == 0)
+            print_stats = true;
+        else if(strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0)
+            optimization = argv[i][2] - '0';
+        else if(strcmp(argv[i], "--dump-ir") == 0)
+            dump_ir = true;
+        else if(strcmp(argv[i], "--inline-limit") == 0 && has_value)
+            inline_limit = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--inline-report") == 0)
+            inline_report = true;
+        else if(strcmp(argv[i], "--profile") == 0)
+            profile = true;
+        else if(strcmp(argv[i], "--profile-annotate") == 0 && has_value)
+            annotate_file = argv[++i];
+        else if(strncmp(argv[i], "--sample-profile=", 17) == 0 && atoi(argv[i] + 17) > 0)
+            sample_hz = atoi(argv[i] + 17);
+        else if(strcmp(argv[i], "--sample-output") == 0 && has_value)
+            sample_file = argv[++i];
+        else if(strcmp(argv[i], "--max-errors") == 0 && has_value)
+            max_errors = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--diagnostics-format=text") == 0)
+            diagnostics_format = TEMA_DIAGNOSTICS_TEXT;
+        else if(strcmp(argv[i], "--diagnostics-format=json") == 0)
+            diagnostics_format = TEMA_DIAGNOSTICS_JSON;
+        else if(strcmp(argv[i], "--lazy") == 0)
+            analysis = TEMA_ANALYSIS_LAZY;
+        else if(strcmp(argv[i], "--check-all") == 0)
+            analysis = TEMA_ANALYSIS_CHECK_ALL;
+        else if(strcmp(argv[i], "--jobs") == 0 && has_value && atoi(argv[i + 1]) > 0)
+            jobs = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--threads") == 0 && has_value && atoi(argv[i + 1]) > 0)
+            threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--memoize") == 0)
+            memoize = TEMA_MEMOIZE_ENTRIES;
+        else if(strncmp(argv[i], "--memoize=", 10) == 0 && atoi(argv[i] + 10) > 0)
+            memoize = atoi(argv[i] + 10);
+        else if(argv[i][0] != '-' && file == NULL)
+            file = argv[i];
+        else
+            return usage(argv[0]);
+    }
+
+    if(show_stats)
+        return (cache_dir != NULL ? printCacheStats() : usage(argv[0]));
+    /* The server sends the diagnostics of each request back to its client, and has no output of its own for the rest */
+    const bool local_output = (print_stats || profile || annotate_file != NULL || sample_hz != 0 || dump_ir || inline_report);
+    if(socket_path != NULL)
+        return (file == NULL && local_output == false ? runServer(socket_path, workers, handleRequest) : usage(argv[0]));
+
+    FILE* fp = stdin;
+    if(file != NULL)
+    {
+        fp = fopen(file, "r");
+        if(fp == NULL)
+        {
+            fprintf(stderr, "could not open file %s\n", file);
+            return 1;
+        }
+    }
+
+    tema_ctx* ctx = createContext();
+    if(ctx == NULL)
+    {
+        fprintf(stderr, "not enough memory to create a context\n");
+        return 1;
+    }
+
+    if(profile || annotate_file != NULL)
+    {
+        size_t size = 0;
+        char* source = readSource(fp, &size);
+        if(source == NULL)
+        {
+            fprintf(stderr, "not enough memory to read the program\n");
+            return 1;
+        }
+
+        tema_set_profile(ctx, 1);
+        tema_compile_buffer(ctx, source, size);
+        tema_run(ctx);
+        writeProfile(ctx, source, size);
+        free(source);
+    }
+    else
+    {
+        tema_compile_file(ctx, fp);
+        tema_run(ctx);
+    }
+    if(print_stats)
+        printStats(ctx);
+    if(sample_hz != 0)
+        writeSamples(ctx);
+
+    const int error_count = tema_error_count(ctx);
+    tema_destroy(ctx);
+    if(fp != stdin)
+        fclose(fp);
+    return (error_count != 0);
+}
@@ -0,0 +1,317 @@
+#include "memo.h"
+#include <stdlib.h>
+#include <string.h>
+#include "bigint.h"
+#include "util.h"
+#include "y.tab.h"
+
+#define MEMO_MIN_BUCKETS 16
+
+
+
+static bool isKeyType(const Type* type)
+{
+    return type->dimensions == 0 && (type->type == INT || type->type == BOOL || type->type == DOUBLE || type->type == CHAR);
+}
+
+static void* resize(void* elements, size_t size)
+{
+    void* new_elements = realloc(elements, size);
+    if(new_elements == NULL && size != 0)
+    {
+        yyerror("not enough memory to memoize a function");
+        abort();
+    }
+    return new_elements;
+}
+
+static int bucketOf(const Memo* memo, uint64_t hash)
+{
+    return (int)(hash & (uint64_t)(memo->bucket_count - 1));
+}
+
+static void addToBucket(Memo* memo, int index)
+{
+    MemoEntry* entry = &memo->entries[index];
+    int* first = &memo->buckets[bucketOf(memo, entry->hash)];
+    entry->chain = (*first);
+    (*first) = index;
+}
+
+static void removeFromBucket(Memo* memo, int index)
+{
+    int* link = &memo->buckets[bucketOf(memo, memo->entries[index].hash)];
+    while((*link) != index)
+        link = &memo->entries[*link].chain;
+    (*link) = memo->entries[index].chain;
+}
+
+/* The order of use */
+static void forget(Memo* memo, int index)
+{
+    MemoEntry* entry = &memo->entries[index];
+    if(entry->newer >= 0)
+        memo->entries[entry->newer].older = entry->older;
+    else
+        memo->newest = entry->older;
+    if(entry->older >= 0)
+        memo->entries[entry->older].newer = entry->newer;
+    else
+        memo->oldest = entry->newer;
+}
+
+static void use(Memo* memo, int index)
+{
+    MemoEntry* entry = &memo->entries[index];
+    entry->newer = -1;
+    entry->older = memo->newest;
+    if(memo->newest >= 0)
+        memo->entries[memo->newest].newer = index;
+    else
+        memo->oldest = index;
+    memo->newest = index;
+}
+
+/* Entries grow like lists until the limit, and the buckets with them */
+static void grow(Memo* memo)
+{
+    int capacity = 1 + memo->capacity * 2;
+    if(capacity > memo->limit)
+        capacity = memo->limit;
+
+    memo->entries = resize(memo->entries, capacity * sizeof(memo->entries[0]));
+    memo->keys = resize(memo->keys, (size_t)capacity * memo->key_size * sizeof(memo->keys[0]));
+    memo->capacity = capacity;
+
+    int bucket_count = MEMO_MIN_BUCKETS;
+    while(bucket_count < capacity)
+        bucket_count *= 2;
+    if(bucket_count == memo->bucket_count)
+        return;
+
+    memo->buckets = resize(memo->buckets, bucket_count * sizeof(memo->buckets[0]));
+    memo->bucket_count = bucket_count;
+    memset(memo->buckets, -1, bucket_count * sizeof(memo->buckets[0]));
+    for(int i = 0; i < memo->size; ++i)
+        addToBucket(memo, i);
+}
+
+/* The least recently used entry, emptied */
+static int evict(Memo* memo)
+{
+    const int index = memo->oldest;
+    removeFromBucket(memo, index);
+    forget(memo, index);
+    Value_release(&memo->routine->return_type, &memo->entries[index].result);
+    ++memo->evictions;
+    return index;
+}
+
+
+
+Memo* Memo_create(const Routine* routine, int limit)
+{
+    if(routine->method || isKeyType(&routine->return_type) == false || limit <= 0)
+        return NULL;
+    for(int i = 0; i < routine->param_count; ++i)
+        if(isKeyType(&routine->slots.elements[i]) == false)
+            return NULL;
+
+    Memo* memo = calloc(1, sizeof(*memo));
+    if(memo == NULL)
+    {
+        yyerror("not enough memory to memoize a function");
+        abort();
+    }
+
+    memo->routine = routine;
+    memo->key_size = routine->param_count;
+    memo->limit = limit;
+    memo->newest = -1;
+    memo->oldest = -1;
+    return memo;
+}
+
+void Memo_destroy(Memo* memo)
+{
+    if(memo == NULL)
+        return;
+
+    for(int i = 0; i < memo->size; ++i)
+        Value_release(&memo->routine->return_type, &memo->entries[i].result);
+    free(memo->entries);
+    free(memo->keys);
+    free(memo->buckets);
+    free(memo);
+}
+
+bool Memo_key(const Memo* memo, const Value* args, uint64_t* key, uint64_t* hash)
+{
+    for(int i = 0; i < memo->key_size; ++i)
+    {
+        switch(memo->routine->slots.elements[i].type)
+        {
+        case INT:
+            if(Int_isBig(args[i].intval))
+                return false;
+            key[i] = (uint64_t)args[i].intval;
+            break;
+        case BOOL:   key[i] = args[i].boolval; break;
+        case CHAR:   key[i] = (unsigned char)args[i].charval; break;
+        case DOUBLE: memcpy(&key[i], &args[i].doubleval, sizeof(key[i])); break;
+        }
+    }
+
+    (*hash) = hashBytes(key, memo->key_size * sizeof(key[0]), HASH_INIT);
+    return true;
+}
+
+bool Memo_find(Memo* memo, const uint64_t* key, uint64_t hash, Value* result)
+{
+    if(memo->size != 0)
+        for(int index = memo->buckets[bucketOf(memo, hash)]; index >= 0; index = memo->entries[index].chain)
+        {
+            const MemoEntry* entry = &memo->entries[index];
+            if(entry->hash != hash || memcmp(&memo->keys[(size_t)index * memo->key_size], key, memo->key_size * sizeof(key[0])) != 0)
+                continue;
+
+            if(memo->newest != index)
+            {
+                forget(memo, index);
+                use(memo, index);
+            }
+            (*result) = entry->result;
+            if(memo->routine->return_type.type == INT)
+                result->intval = Int_copy(result->intval);
+            ++memo->hits;
+            return true;
+        }
+
+    ++memo->misses;
+    return false;
+}
+
+void Memo_store(Memo* memo, const uint64_t* key, uint64_t hash, Value result)
+{
+    if(memo->size == memo->capacity && memo->capacity < memo->limit)
+        grow(memo);
+
+    const int index = (memo->size < memo->capacity ? memo->size++ : evict(memo));
+    MemoEntry* entry = &memo->entries[index];
+    entry->hash = hash;
+    entry->result = result;
+    if(memo->routine->return_type.type == INT)
+        entry->result.intval = Int_copy(result.intval);
+    memcpy(&memo->keys[(size_t)index * memo->key_size], key, memo->key_size * sizeof(key[0]));
+    addToBucket(memo, index);
+    use(memo, index);
+}
+
+size_t Memo_bytes(const Memo* memo)
+{
+    return sizeof(*memo) + (size_t)memo->capacity * (sizeof(memo->entries[0]) + memo->key_size * sizeof(memo->keys[0]))
+         + (size_t)memo->bucket_count * sizeof(memo->buckets[0]);
+}
+
+
+
+/* Calls from a routine to another, by index in the routines of the program */
+typedef struct Call
+{
+    int caller;
+    int callee;
+} Call;
+
+typedef struct CallList
+{
+    Call* elements;
+    int size;
+    int capacity;
+} CallList;
+
+static void CallList_insert(CallList* list, int caller, int callee)
+{
+    if(list->size == list->capacity)
+    {
+        list->capacity = 1 + list->capacity * 2;
+        list->elements = resize(list->elements, list->capacity * sizeof(list->elements[0]));
+    }
+    list->elements[list->size++] = (Call){caller, callee};
+}
+
+/* A method writes a field of its object through this, its first local */
+static bool writesObject(const Routine* routine, const Node* target)
+{
+    if(target->op != NODE_FIELD)
+        return false;
+    while(target->op == NODE_FIELD)
+        target = target->operands[0];
+    return routine->method && target->op == NODE_LOCAL && target->slot == 0;
+}
+
+/* Whether the code of a routine is pure but for the routines it calls, which are listed */
+static bool isPure(const Routine* routine, const Node* node, CallList* calls)
+{
+    for(; node != NULL; node = node->next)
+    {
+        switch(node->op)
+        {
+        case NODE_PRINT:
+        case NODE_IMPORT:
+        case NODE_GLOBAL:
+            return false;
+
+        case NODE_CALL:
+        case NODE_INLINE:
+            CallList_insert(calls, routine->index, node->routine->index);
+            break;
+
+        default:
+            if(node->op >= NODE_ASSIGN && node->op <= NODE_POSTDEC && writesObject(routine, node->operands[0]))
+                return false;
+            break;
+        }
+
+        for(int i = 0; i < 4; ++i)
+            if(isPure(routine, node->operands[i], calls) == false)
+                return false;
+    }
+
+    return true;
+}
+
+void Program_memoize(Program* program, int limit)
+{
+    RoutineList* routines = &program->routines;
+    bool* pure = resize(NULL, routines->size * sizeof(pure[0]) + 1);
+    CallList calls = {0};
+    for(int i = 0; i < routines->size; ++i)
+        pure[i] = (limit > 0 && routines->elements[i]->body != NULL && isPure(routines->elements[i], routines->elements[i]->body, &calls));
+
+    /* Callers of impure routines are impure. Routines mostly call those declared before them, so few rounds are needed */
+    for(bool changed = true; changed; )
+    {
+        changed = false;
+        for(int i = 0; i < calls.size; ++i)
+            if(pure[calls.elements[i].caller] && pure[calls.elements[i].callee] == false)
+            {
+                pure[calls.elements[i].caller] = false;
+                changed = true;
+            }
+    }
+
+    for(int i = 0; i < routines->size; ++i)
+    {
+        Routine* routine = routines->elements[i];
+        if(routine->memo != NULL && (pure[i] == false || routine->memo->limit != limit))
+        {
+            Memo_destroy(routine->memo);
+            routine->memo = NULL;
+        }
+        if(routine->memo == NULL && pure[i])
+            routine->memo = Memo_create(routine, limit);
+    }
+
+    free(calls.elements);
+    free(pure);
+}
@@ -0,0 +1,56 @@
+#ifndef INCLUDED_MEMO_H
+#define INCLUDED_MEMO_H
+
+#include <stdint.h>
+#include "node.h"
+
+/* A call remembered by a Memo. Entries are chained in their bucket and, from the most recently used to the least, in the memo */
+typedef struct MemoEntry
+{
+    uint64_t hash;
+    Value result;
+    int chain;  /* next entry of the bucket, -1 at its end */
+    int newer;  /* -1 for the most recently used entry */
+    int older;  /* -1 for the least recently used entry */
+} MemoEntry;
+
+/* Results of the calls to a pure function, keyed by the bits of its scalar arguments. It grows up to limit entries,
+ * then every new result replaces the least recently used one */
+typedef struct Memo
+{
+    const Routine* routine;
+    int key_size;       /* arguments, one uint64_t each */
+    MemoEntry* entries;
+    uint64_t* keys;     /* key_size for every entry */
+    int size;
+    int capacity;
+    int limit;
+    int* buckets;       /* first entry of every bucket, -1 if empty. A power of 2 of them, at least capacity */
+    int bucket_count;
+    int newest;
+    int oldest;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} Memo;
+
+/* NULL if the routine cannot be memoized: a method, or a function taking or returning something else than an int, a bool,
+ * a double or a char */
+Memo*  Memo_create(const Routine* routine, int limit);
+void   Memo_destroy(Memo* memo);
+
+/* Key of a call from its arguments. Returns false for BigInt arguments, whose calls are not memoized */
+bool   Memo_key(const Memo* memo, const Value* args, uint64_t* key, uint64_t* hash);
+/* Copy the result of an earlier call with the same key to result, making it the most recently used. Returns false on a miss */
+bool   Memo_find(Memo* memo, const uint64_t* key, uint64_t hash, Value* result);
+/* Keep a copy of the result of a call that missed */
+void   Memo_store(Memo* memo, const uint64_t* key, uint64_t hash, Value result);
+size_t Memo_bytes(const Memo* memo);
+
+/* Give a memo of at most limit entries to the pure functions of the program that can be memoized, 0 to take the memos away.
+ * Pure routines neither print, nor use global variables, nor write the fields of their object, nor import modules,
+ * and only call pure routines, so the result of a pure function only depends on its arguments */
+void   Program_memoize(Program* program, int limit);
+
+#endif
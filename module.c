@@ -0,0 +1,1682 @@
+#include "module.h"
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bigint.h"
+#include "builtin.h"
+#include "context.h"
+#include "diagnostic.h"
+#include "node.h"
+#include "y.tab.h"
+
+#define INTERFACE_MAGIC     "TMI"
+#define INTERFACE_VERSION   10
+#define INTERFACE_EXTENSION ".tmi"
+
+/* Sources modified less than this many seconds before their interface was written are always hashed,
+ * since a second change within the timestamp granularity would otherwise go unnoticed */
+#define RACY_SECONDS 2
+
+extern __thread int scope_level;
+extern __thread int error_count;
+extern __thread int warning_count;
+extern __thread VariableList varlist;
+extern __thread FunctionList funclist;
+extern __thread ClassList classlist;
+extern ModuleList modules;
+
+int parseModule(FILE* fp, Context* module);
+Variable* declareVariable(VariableList* varlist, int scope_level, char* name, const Type* type, bool constant, bool initialized, const YYLTYPE* yylloc);
+Function* declareFunction(FunctionList* funclist, int scope_level, char* name, const Type* return_type, TypeList* typelist, const YYLTYPE* yylloc);
+Class*    declareClass(ClassList* classlist, int scope_level, char* name, const YYLTYPE* yylloc);
+
+/* Modules whose import is in progress, to detect cycles */
+static ModuleList importing = {0};
+
+
+
+/* ModuleList */
+void ModuleList_clear(ModuleList* list)
+{
+    for(int i = 0; i < list->size; ++i)
+        free(list->elements[i].path);
+
+    free(list->elements);
+    list->elements = NULL;
+    list->capacity = 0;
+    list->size = 0;
+}
+
+int ModuleList_find(const ModuleList* list, const char* path)
+{
+    for(int i = 0; i < list->size; ++i)
+        if(strcmp(path, list->elements[i].path) == 0)
+            return i;
+
+    return -1;
+}
+
+int ModuleList_insert(ModuleList* list, char* path)
+{
+    if(list->size == list->capacity)
+    {
+        int new_capacity = 1 + list->capacity * 2;
+        Module* new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_list == NULL)
+        {
+            new_capacity = 1 + list->capacity;
+            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+            if(new_list == NULL)
+                return -1;
+        }
+
+        list->elements = new_list;
+        list->capacity = new_capacity;
+    }
+
+    memset(&list->elements[list->size], 0, sizeof(list->elements[0]));
+    list->elements[list->size].path = path;
+    ++list->size;
+    return 0;
+}
+
+
+
+/* Interface file layout: header, dependencies, classes, class layouts, fields, methods, array sizes, functions, parameter types,
+ * variables, routines, slot types, nodes, strings.
+ * Strings are referenced by their offset in the string table, offset 0 is the empty string.
+ * Nodes are referenced by their index plus one, 0 is NULL. Globals, routines and layouts of other modules are referenced by the dependency
+ * plus one and their index in that module, 0 is the interface itself.
+ * Every class layout is stored, including those of classes declared inside functions, and its offsets are computed again when loaded.
+ * Module interfaces declare only constants, the declarations stored in the program cache hold every global variable */
+typedef struct InterfaceHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    int64_t created_sec;
+    uint32_t dependency_count;
+    uint32_t class_count;
+    uint32_t layout_count;
+    uint32_t field_count;
+    uint32_t method_count;
+    uint32_t size_count;
+    uint32_t function_count;
+    uint32_t type_count;
+    uint32_t constant_count;
+    uint32_t global_count;   /* the first slot types */
+    uint32_t routine_count;
+    uint32_t slot_count;
+    uint32_t node_count;
+    uint32_t init;           /* top-level statements */
+    uint32_t strings_size;
+    uint32_t reserved;
+} InterfaceHeader;
+
+typedef struct InterfaceDependency
+{
+    uint32_t path;
+    uint32_t reserved;
+    uint64_t source_hash;
+} InterfaceDependency;
+
+/* The type code, with the array dimensions above the first 8 bits, and the layout of a class */
+typedef struct InterfaceType
+{
+    int32_t type;
+    uint32_t class_name;
+    uint32_t layout_module;
+    uint32_t layout;
+} InterfaceType;
+
+typedef struct InterfaceClass
+{
+    uint32_t name;
+    uint32_t layout;
+} InterfaceClass;
+
+typedef struct InterfaceLayout
+{
+    uint32_t name;
+    uint32_t first_field;
+    uint32_t field_count;
+    uint32_t first_method;
+    uint32_t method_count;
+    uint32_t reserved;
+} InterfaceLayout;
+
+#define INTERFACE_PRIVATE 1
+
+typedef struct InterfaceField
+{
+    uint32_t name;
+    InterfaceType type;
+    uint32_t access;
+    uint32_t first_size; /* of an array */
+    uint32_t reserved;
+} InterfaceField;
+
+typedef struct InterfaceMethod
+{
+    uint32_t name;
+    uint32_t first_param;
+    uint32_t param_count;
+    uint32_t routine;
+    uint32_t access;
+    uint32_t reserved;
+} InterfaceMethod;
+
+typedef struct InterfaceFunction
+{
+    uint32_t name;
+    InterfaceType return_type;
+    uint32_t first_param;
+    uint32_t param_count;
+    uint32_t routine;
+} InterfaceFunction;
+
+#define INTERFACE_CONSTANT    1
+#define INTERFACE_INITIALIZED 2
+#define INTERFACE_KNOWN       4
+
+typedef struct InterfaceConstant
+{
+    uint32_t name;
+    InterfaceType type;
+    uint32_t flags;
+    uint32_t slot;
+    uint32_t reserved;
+
+    union
+    {
+        int64_t intval;
+        double doubleval;
+        uint32_t strval;
+    };
+} InterfaceConstant;
+
+typedef struct InterfaceRoutine
+{
+    uint32_t name;
+    InterfaceType return_type;
+    uint32_t param_count;
+    uint32_t first_slot;
+    uint32_t slot_count;
+    uint32_t body;
+    int32_t line;
+    int32_t column;
+    uint32_t method;
+} InterfaceRoutine;
+
+typedef struct InterfaceNode
+{
+    uint32_t op;
+    InterfaceType type;
+    int32_t first_line;
+    int32_t first_column;
+    int32_t last_line;
+    int32_t last_column;
+    uint32_t operands[4];
+    uint32_t next;
+    int32_t count;
+    uint32_t name;
+    uint32_t module;
+    uint32_t reserved;
+
+    union
+    {
+        int64_t intval;
+        double doubleval;
+        uint32_t strval;
+        uint32_t index;   /* of the slot, the routine or the builtin */
+        uint64_t offset;  /* of a field */
+    };
+} InterfaceNode;
+
+typedef struct Interface
+{
+    char* data;
+    size_t size;
+    bool mapped;
+
+    const InterfaceHeader* header;
+    const InterfaceDependency* dependencies;
+    const InterfaceClass* classes;
+    const InterfaceLayout* layouts;
+    const InterfaceField* fields;
+    const InterfaceMethod* methods;
+    const int64_t* sizes;
+    const InterfaceFunction* functions;
+    const InterfaceType* types;
+    const InterfaceConstant* constants;
+    const InterfaceRoutine* routines;
+    const InterfaceType* slots;
+    const InterfaceNode* nodes;
+    const char* strings;
+} Interface;
+
+
+
+/* Token values change with the grammar, the interface stores its own codes */
+static int32_t encodeType(int type)
+{
+    switch(type)
+    {
+    case INT:    return 1;
+    case BOOL:   return 2;
+    case DOUBLE: return 3;
+    case CHAR:   return 4;
+    case STRING: return 5;
+    case VOID:   return 6;
+    case CLASS:  return 7;
+    }
+
+    return 0;
+}
+static int decodeType(int32_t code)
+{
+    switch(code & 0xff)
+    {
+    case 1: return INT;
+    case 2: return BOOL;
+    case 3: return DOUBLE;
+    case 4: return CHAR;
+    case 5: return STRING;
+    case 6: return VOID;
+    case 7: return CLASS;
+    }
+
+    return INVAL_TYPE;
+}
+
+
+
+static char* interfacePath(const char* path)
+{
+    char* iface_path = malloc(strlen(path) + sizeof(INTERFACE_EXTENSION));
+    if(iface_path == NULL)
+    {
+        yyerror("not enough memory to import module %s", path);
+        abort();
+    }
+
+    strcpy(iface_path, path);
+    strcat(iface_path, INTERFACE_EXTENSION);
+    return iface_path;
+}
+
+static char* readSource(const char* path, struct stat* st)
+{
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    char* data = NULL;
+    if(fstat(fd, st) == 0)
+    {
+        data = malloc(st->st_size + 1);
+        if(data != NULL && read(fd, data, st->st_size) != st->st_size)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    close(fd);
+    return data;
+}
+
+static bool isTimestampCurrent(const InterfaceHeader* header, const struct stat* st)
+{
+    return header->source_size       == (uint64_t)st->st_size
+        && header->source_mtime_sec  == st->st_mtim.tv_sec
+        && header->source_mtime_nsec == st->st_mtim.tv_nsec
+        && header->source_mtime_sec  <  header->created_sec - RACY_SECONDS;
+}
+
+static bool readHeader(int fd, InterfaceHeader* header)
+{
+    return pread(fd, header, sizeof(*header), 0) == sizeof(*header)
+        && memcmp(header->magic, INTERFACE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == INTERFACE_VERSION;
+}
+
+/* Hash of the current contents of a source file. The timestamps in its interface spare reading it when they still match */
+static int sourceHash(const char* path, uint64_t* hash)
+{
+    struct stat st;
+    if(stat(path, &st) != 0)
+        return -1;
+
+    char* iface_path = interfacePath(path);
+    const int fd = open(iface_path, O_RDONLY);
+    free(iface_path);
+
+    if(fd >= 0)
+    {
+        InterfaceHeader header;
+        const bool current = readHeader(fd, &header) && isTimestampCurrent(&header, &st);
+        close(fd);
+
+        if(current)
+        {
+            (*hash) = header.source_hash;
+            return 0;
+        }
+    }
+
+    char* data = readSource(path, &st);
+    if(data == NULL)
+        return -1;
+
+    (*hash) = hashBytes(data, st.st_size, HASH_INIT);
+    free(data);
+    return 0;
+}
+
+
+
+static void Interface_close(Interface* iface)
+{
+    if(iface->mapped)
+        munmap(iface->data, iface->size);
+    else
+        free(iface->data);
+
+    iface->data = NULL;
+    iface->size = 0;
+}
+
+/* Point the sections into the data and check that every count, index and offset stays inside it */
+static int Interface_open(Interface* iface)
+{
+    const InterfaceHeader* header = (const InterfaceHeader*)iface->data;
+    if(iface->size < sizeof(*header) || memcmp(header->magic, INTERFACE_MAGIC, sizeof(header->magic)) != 0 || header->version != INTERFACE_VERSION)
+        return -1;
+
+    const uint64_t size = sizeof(*header)
+                        + (uint64_t)header->dependency_count * sizeof(InterfaceDependency)
+                        + (uint64_t)header->class_count      * sizeof(InterfaceClass)
+                        + (uint64_t)header->layout_count     * sizeof(InterfaceLayout)
+                        + (uint64_t)header->field_count      * sizeof(InterfaceField)
+                        + (uint64_t)header->method_count     * sizeof(InterfaceMethod)
+                        + (uint64_t)header->size_count       * sizeof(int64_t)
+                        + (uint64_t)header->function_count   * sizeof(InterfaceFunction)
+                        + (uint64_t)header->type_count       * sizeof(InterfaceType)
+                        + (uint64_t)header->constant_count   * sizeof(InterfaceConstant)
+                        + (uint64_t)header->routine_count    * sizeof(InterfaceRoutine)
+                        + (uint64_t)header->slot_count       * sizeof(InterfaceType)
+                        + (uint64_t)header->node_count       * sizeof(InterfaceNode)
+                        + header->strings_size;
+    if(size != iface->size || header->strings_size == 0 || header->global_count > header->slot_count || header->init > header->node_count)
+        return -1;
+
+    iface->header       = header;
+    iface->dependencies = (const InterfaceDependency*)(header + 1);
+    iface->classes      = (const InterfaceClass*)(iface->dependencies + header->dependency_count);
+    iface->layouts      = (const InterfaceLayout*)(iface->classes + header->class_count);
+    iface->fields       = (const InterfaceField*)(iface->layouts + header->layout_count);
+    iface->methods      = (const InterfaceMethod*)(iface->fields + header->field_count);
+    iface->sizes        = (const int64_t*)(iface->methods + header->method_count);
+    iface->functions    = (const InterfaceFunction*)(iface->sizes + header->size_count);
+    iface->types        = (const InterfaceType*)(iface->functions + header->function_count);
+    iface->constants    = (const InterfaceConstant*)(iface->types + header->type_count);
+    iface->routines     = (const InterfaceRoutine*)(iface->constants + header->constant_count);
+    iface->slots        = (const InterfaceType*)(iface->routines + header->routine_count);
+    iface->nodes        = (const InterfaceNode*)(iface->slots + header->slot_count);
+    iface->strings      = (const char*)(iface->nodes + header->node_count);
+
+    if(iface->strings[header->strings_size - 1] != '\0')
+        return -1;
+
+    #define CHECK_STRING(offset) if((offset) >= header->strings_size) return -1;
+    #define CHECK_TYPE(t) if(decodeType((t).type) == INVAL_TYPE || (t).class_name >= header->strings_size || (t).layout_module > header->dependency_count \
+                             || ((t).layout_module == 0 && decodeType((t).type) == CLASS && (t).layout >= header->layout_count)) return -1;
+
+    for(uint32_t i = 0; i < header->dependency_count; ++i)
+        CHECK_STRING(iface->dependencies[i].path)
+    for(uint32_t i = 0; i < header->class_count; ++i)
+    {
+        CHECK_STRING(iface->classes[i].name)
+        if(iface->classes[i].layout >= header->layout_count)
+            return -1;
+    }
+    for(uint32_t i = 0; i < header->layout_count; ++i)
+    {
+        const InterfaceLayout* layout = &iface->layouts[i];
+        CHECK_STRING(layout->name)
+        if((uint64_t)layout->first_field + layout->field_count > header->field_count || (uint64_t)layout->first_method + layout->method_count > header->method_count)
+            return -1;
+    }
+    for(uint32_t i = 0; i < header->field_count; ++i)
+    {
+        const InterfaceField* field = &iface->fields[i];
+        CHECK_STRING(field->name)
+        CHECK_TYPE(field->type)
+        if((uint64_t)field->first_size + ((uint32_t)field->type.type >> 8) > header->size_count)
+            return -1;
+    }
+    for(uint32_t i = 0; i < header->method_count; ++i)
+    {
+        const InterfaceMethod* method = &iface->methods[i];
+        CHECK_STRING(method->name)
+        if((uint64_t)method->first_param + method->param_count > header->type_count || method->routine >= header->routine_count
+           || iface->routines[method->routine].method == 0)
+            return -1;
+    }
+    for(uint32_t i = 0; i < header->size_count; ++i)
+        if(iface->sizes[i] <= 0)
+            return -1;
+    for(uint32_t i = 0; i < header->type_count; ++i)
+        CHECK_TYPE(iface->types[i])
+    for(uint32_t i = 0; i < header->slot_count; ++i)
+        CHECK_TYPE(iface->slots[i])
+    for(uint32_t i = 0; i < header->function_count; ++i)
+    {
+        const InterfaceFunction* function = &iface->functions[i];
+        CHECK_STRING(function->name)
+        CHECK_TYPE(function->return_type)
+        if((uint64_t)function->first_param + function->param_count > header->type_count || function->routine >= header->routine_count)
+            return -1;
+    }
+    for(uint32_t i = 0; i < header->constant_count; ++i)
+    {
+        const InterfaceConstant* constant = &iface->constants[i];
+        CHECK_STRING(constant->name)
+        CHECK_TYPE(constant->type)
+        if(constant->slot >= header->global_count)
+            return -1;
+        if(decodeType(constant->type.type) == STRING && (constant->flags & INTERFACE_KNOWN))
+            CHECK_STRING(constant->strval)
+        /* Constants are small ints, a BigInt would be a pointer of the run that wrote them */
+        if(decodeType(constant->type.type) == INT && (constant->flags & INTERFACE_KNOWN) && Int_isBig(constant->intval))
+            return -1;
+    }
+    for(uint32_t i = 0; i < header->routine_count; ++i)
+    {
+        const InterfaceRoutine* routine = &iface->routines[i];
+        CHECK_STRING(routine->name)
+        CHECK_TYPE(routine->return_type)
+        if(routine->first_slot < header->global_count || (uint64_t)routine->first_slot + routine->slot_count > header->slot_count
+           || routine->param_count > routine->slot_count || routine->body > header->node_count || routine->method > (routine->param_count > 0))
+            return -1;
+    }
+    for(uint32_t i = 0; i < header->node_count; ++i)
+    {
+        const InterfaceNode* node = &iface->nodes[i];
+        if(node->op > NODE_CASE || node->module > header->dependency_count || node->next > header->node_count || node->count < 0)
+            return -1;
+
+        CHECK_TYPE(node->type)
+        CHECK_STRING(node->name)
+        for(int j = 0; j < 4; ++j)
+            if(node->operands[j] > header->node_count)
+                return -1;
+
+        switch(node->op)
+        {
+        case NODE_CONST:
+            if(decodeType(node->type.type) == STRING)
+                CHECK_STRING(node->strval)
+            if(decodeType(node->type.type) == INT && Int_isBig(node->intval))
+                return -1;
+            break;
+        case NODE_GLOBAL:
+            if(node->module == 0 && node->index >= header->global_count)
+                return -1;
+            break;
+        case NODE_CALL:
+        case NODE_INLINE:
+            if(node->module == 0 && node->index >= header->routine_count)
+                return -1;
+            break;
+        case NODE_BUILTIN:
+            if(node->index >= (uint32_t)builtin_count)
+                return -1;
+            break;
+        case NODE_IMPORT:
+            if(node->module == 0)
+                return -1;
+            break;
+        }
+    }
+
+    #undef CHECK_TYPE
+    #undef CHECK_STRING
+
+    return 0;
+}
+
+static bool areDependenciesCurrent(const Interface* iface)
+{
+    for(uint32_t i = 0; i < iface->header->dependency_count; ++i)
+    {
+        uint64_t hash;
+        const InterfaceDependency* dependency = &iface->dependencies[i];
+        if(sourceHash(iface->strings + dependency->path, &hash) != 0 || hash != dependency->source_hash)
+            return false;
+    }
+
+    return true;
+}
+
+/* Map the interface of a module if it is still valid for the current sources */
+static int loadInterface(const char* path, Interface* iface)
+{
+    char* iface_path = interfacePath(path);
+    const int fd = open(iface_path, O_RDWR);
+    free(iface_path);
+    if(fd < 0)
+        return -1;
+
+    struct stat iface_st;
+    if(fstat(fd, &iface_st) != 0 || iface_st.st_size < sizeof(InterfaceHeader))
+    {
+        close(fd);
+        return -1;
+    }
+
+    iface->size = iface_st.st_size;
+    iface->data = mmap(NULL, iface->size, PROT_READ, MAP_SHARED, fd, 0);
+    iface->mapped = true;
+    if(iface->data == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if(Interface_open(iface) != 0)
+    {
+        Interface_close(iface);
+        close(fd);
+        return -1;
+    }
+
+    /* The source itself */
+    struct stat st;
+    if(stat(path, &st) != 0)
+    {
+        Interface_close(iface);
+        close(fd);
+        return -1;
+    }
+
+    if(isTimestampCurrent(iface->header, &st) == false)
+    {
+        uint64_t hash;
+        if(sourceHash(path, &hash) != 0 || hash != iface->header->source_hash)
+        {
+            Interface_close(iface);
+            close(fd);
+            return -1;
+        }
+
+        /* Only touched. Record the new timestamps so the next import does not hash again */
+        InterfaceHeader header = (*iface->header);
+        header.source_size       = st.st_size;
+        header.source_mtime_sec  = st.st_mtim.tv_sec;
+        header.source_mtime_nsec = st.st_mtim.tv_nsec;
+        header.created_sec       = time(NULL);
+        pwrite(fd, &header, sizeof(header), 0);
+    }
+
+    close(fd);
+
+    /* Everything it imported, since its constants may have been computed from theirs */
+    if(areDependenciesCurrent(iface) == false)
+    {
+        Interface_close(iface);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+/* Growable byte buffer used to serialize an interface */
+typedef struct Buffer
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+static size_t Buffer_append(Buffer* buffer, const void* data, size_t size)
+{
+    if(buffer->size + size > buffer->capacity)
+    {
+        size_t new_capacity = 64 + buffer->capacity * 2;
+        while(new_capacity < buffer->size + size)
+            new_capacity *= 2;
+
+        char* new_data = realloc(buffer->data, new_capacity);
+        if(new_data == NULL)
+        {
+            yyerror("not enough memory to build a module interface");
+            abort();
+        }
+
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
+    }
+
+    const size_t offset = buffer->size;
+    if(size != 0)
+        memcpy(buffer->data + offset, data, size);
+    buffer->size += size;
+    return offset;
+}
+
+static uint32_t Buffer_appendString(Buffer* strings, const char* str)
+{
+    if(str == NULL || str[0] == '\0')
+        return 0;
+    return Buffer_append(strings, str, strlen(str) + 1);
+}
+
+/* Code of a context being written. Globals and routines are renumbered, since those of imported modules are not part of it */
+typedef struct Serializer
+{
+    const Context* context;
+    Buffer nodes;
+    Buffer strings;
+    uint32_t node_count;
+    int* globals;    /* own index of every global, -1 for those of modules */
+    int* routines;   /* own index of every routine, -1 for those of modules */
+    int* layouts;    /* own index of every class layout, -1 for those of modules */
+} Serializer;
+
+static void globalReference(const Serializer* serializer, int slot, uint32_t* module, uint32_t* index)
+{
+    if(serializer->globals[slot] >= 0)
+    {
+        (*module) = 0;
+        (*index) = serializer->globals[slot];
+        return;
+    }
+
+    const ModuleList* modules = &serializer->context->modules;
+    for(int i = 0; i < modules->size; ++i)
+    {
+        if(slot >= modules->elements[i].global_base && slot < modules->elements[i].global_base + modules->elements[i].global_count)
+        {
+            (*module) = i + 1;
+            (*index) = slot - modules->elements[i].global_base;
+            return;
+        }
+    }
+
+    yyerror("debug: serializeInterface: global %d belongs to no module", slot);
+    abort();
+}
+
+static void routineReference(const Serializer* serializer, const Routine* routine, uint32_t* module, uint32_t* index)
+{
+    if(routine->module < 0)
+    {
+        (*module) = 0;
+        (*index) = serializer->routines[routine->index];
+    }
+    else
+    {
+        (*module) = routine->module + 1;
+        (*index) = routine->index - serializer->context->modules.elements[routine->module].routine_base;
+    }
+}
+
+static void layoutReference(const Serializer* serializer, const ClassLayout* layout, uint32_t* module, uint32_t* index)
+{
+    if(layout->module < 0)
+    {
+        (*module) = 0;
+        (*index) = serializer->layouts[layout->index];
+    }
+    else
+    {
+        (*module) = layout->module + 1;
+        (*index) = layout->index - serializer->context->modules.elements[layout->module].layout_base;
+    }
+}
+
+static InterfaceType makeType(Serializer* serializer, const Type* type)
+{
+    InterfaceType result = {encodeType(type->type) | (type->dimensions << 8), 0, 0, 0};
+    if(type->type == CLASS)
+    {
+        if(type->layout == NULL)
+        {
+            yyerror("debug: serializeInterface: class %s has no layout", Type_className(type));
+            abort();
+        }
+
+        result.class_name = Buffer_appendString(&serializer->strings, Type_className(type));
+        layoutReference(serializer, type->layout, &result.layout_module, &result.layout);
+    }
+    return result;
+}
+
+static uint32_t writeChain(Serializer* serializer, const Node* node);
+
+/* The record is reserved first and completed once the operands have their references */
+static uint32_t writeNode(Serializer* serializer, const Node* node)
+{
+    InterfaceNode record = {0};
+    const uint32_t reference = ++serializer->node_count;
+    const size_t offset = Buffer_append(&serializer->nodes, &record, sizeof(record));
+
+    record.op           = node->op;
+    record.type         = makeType(serializer, &node->type);
+    record.first_line   = node->location.first_line;
+    record.first_column = node->location.first_column;
+    record.last_line    = node->location.last_line;
+    record.last_column  = node->location.last_column;
+    record.count        = node->count;
+    record.name         = Buffer_appendString(&serializer->strings, node->name);
+
+    switch(node->op)
+    {
+    case NODE_CONST:
+        if(node->type.dimensions != 0)
+            break;
+
+        switch(node->type.type)
+        {
+        case INT:    record.intval    = node->value.intval;    break;
+        case BOOL:   record.intval    = node->value.boolval;   break;
+        case DOUBLE: record.doubleval = node->value.doubleval; break;
+        case CHAR:   record.intval    = node->value.charval;   break;
+        case STRING: record.strval    = Buffer_appendString(&serializer->strings, node->value.strval); break;
+        }
+        break;
+
+    case NODE_GLOBAL: globalReference(serializer, node->slot, &record.module, &record.index); break;
+    case NODE_LOCAL:  record.index = node->slot; break;
+    case NODE_CALL:
+    case NODE_INLINE: routineReference(serializer, node->routine, &record.module, &record.index); break;
+    case NODE_BUILTIN: record.index = node->builtin; break;
+    case NODE_FIELD:  record.offset = node->offset; break;
+    case NODE_REDUCED_INDEX: record.offset = node->invariant; break;
+    case NODE_IMPORT: record.module = node->module + 1; break;
+    }
+
+    for(int i = 0; i < 4; ++i)
+        record.operands[i] = writeChain(serializer, node->operands[i]);
+
+    memcpy(serializer->nodes.data + offset, &record, sizeof(record));
+    return reference;
+}
+
+static uint32_t writeChain(Serializer* serializer, const Node* node)
+{
+    uint32_t first = 0, previous = 0;
+    for(; node != NULL; node = node->next)
+    {
+        const uint32_t reference = writeNode(serializer, node);
+        if(previous == 0)
+            first = reference;
+        else
+            ((InterfaceNode*)serializer->nodes.data)[previous - 1].next = reference;
+        previous = reference;
+    }
+
+    return first;
+}
+
+/* The exports of a module are the classes, functions and constants it declared itself at global scope, with the code they need.
+ * A whole program also keeps its variables */
+static void serializeInterface(const Context* module, const struct stat* st, uint64_t hash, bool program, Interface* iface)
+{
+    InterfaceHeader header = {0};
+    Buffer dependencies = {0}, classes = {0}, layouts = {0}, fields = {0}, methods = {0}, sizes = {0};
+    Buffer functions = {0}, types = {0}, constants = {0}, routines = {0}, slots = {0};
+    Serializer serializer = {module, {0}, {0}, 0, NULL, NULL, NULL};
+    Buffer* strings = &serializer.strings;
+
+    Buffer_append(strings, "", 1);
+
+    const TypeList* globals = &module->program.globals;
+    const RoutineList* program_routines = &module->program.routines;
+    const LayoutList* program_layouts = &module->program.layouts;
+    serializer.globals = malloc((globals->size + 1) * sizeof(int));
+    serializer.routines = malloc((program_routines->size + 1) * sizeof(int));
+    serializer.layouts = malloc((program_layouts->size + 1) * sizeof(int));
+    if(serializer.globals == NULL || serializer.routines == NULL || serializer.layouts == NULL)
+    {
+        yyerror("not enough memory to build a module interface");
+        abort();
+    }
+
+    for(int i = 0; i < globals->size; ++i)
+        serializer.globals[i] = 0;
+
+    for(int i = 0; i < module->modules.size; ++i)
+    {
+        const Module* dependency_module = &module->modules.elements[i];
+        for(int j = 0; j < dependency_module->global_count; ++j)
+            serializer.globals[dependency_module->global_base + j] = -1;
+
+        InterfaceDependency dependency = {0};
+        dependency.path = Buffer_appendString(strings, dependency_module->path);
+        if(sourceHash(dependency_module->path, &dependency.source_hash) != 0)
+            dependency.source_hash = 0;
+
+        Buffer_append(&dependencies, &dependency, sizeof(dependency));
+        ++header.dependency_count;
+    }
+
+    for(int i = 0; i < program_layouts->size; ++i)
+        serializer.layouts[i] = (program_layouts->elements[i]->module < 0 ? (int)header.layout_count++ : -1);
+
+    for(int i = 0; i < globals->size; ++i)
+    {
+        if(serializer.globals[i] < 0)
+            continue;
+
+        serializer.globals[i] = header.global_count++;
+        InterfaceType type = makeType(&serializer, &globals->elements[i]);
+        Buffer_append(&slots, &type, sizeof(type));
+        ++header.slot_count;
+    }
+
+    for(int i = 0; i < program_routines->size; ++i)
+        serializer.routines[i] = (program_routines->elements[i]->module < 0 ? (int)header.routine_count++ : -1);
+
+    /* In declaration order, so the classes of the fields of a layout come before it */
+    for(int i = 0; i < program_layouts->size; ++i)
+    {
+        const ClassLayout* layout = program_layouts->elements[i];
+        if(layout->module >= 0)
+            continue;
+
+        InterfaceLayout record = {0};
+        record.name         = Buffer_appendString(strings, layout->name);
+        record.first_field  = header.field_count;
+        record.field_count  = layout->fields.size;
+        record.first_method = header.method_count;
+        record.method_count = layout->methods.size;
+
+        for(int j = 0; j < layout->fields.size; ++j)
+        {
+            const Field* field = &layout->fields.elements[j];
+            InterfaceField field_record = {0};
+            field_record.name       = Buffer_appendString(strings, field->name);
+            field_record.type       = makeType(&serializer, &field->type);
+            field_record.access     = (field->access == PRIVATE ? INTERFACE_PRIVATE : 0);
+            field_record.first_size = header.size_count;
+
+            for(int k = 0; k < field->type.dimensions; ++k)
+            {
+                const int64_t size = field->sizes[k];
+                Buffer_append(&sizes, &size, sizeof(size));
+                ++header.size_count;
+            }
+
+            Buffer_append(&fields, &field_record, sizeof(field_record));
+            ++header.field_count;
+        }
+
+        for(int j = 0; j < layout->methods.size; ++j)
+        {
+            const Method* method = &layout->methods.elements[j];
+            InterfaceMethod method_record = {0};
+            method_record.name        = Buffer_appendString(strings, method->name);
+            method_record.first_param = header.type_count;
+            method_record.param_count = method->paramtypes.size;
+            method_record.routine     = serializer.routines[method->routine->index];
+            method_record.access      = (method->access == PRIVATE ? INTERFACE_PRIVATE : 0);
+
+            for(int k = 0; k < method->paramtypes.size; ++k)
+            {
+                InterfaceType type = makeType(&serializer, &method->paramtypes.elements[k]);
+                Buffer_append(&types, &type, sizeof(type));
+                ++header.type_count;
+            }
+
+            Buffer_append(&methods, &method_record, sizeof(method_record));
+            ++header.method_count;
+        }
+
+        Buffer_append(&layouts, &record, sizeof(record));
+    }
+
+    for(int i = 0; i < program_routines->size; ++i)
+    {
+        const Routine* routine = program_routines->elements[i];
+        if(routine->module >= 0)
+            continue;
+
+        InterfaceRoutine record = {0};
+        record.name        = Buffer_appendString(strings, routine->name);
+        record.return_type = makeType(&serializer, &routine->return_type);
+        record.param_count = routine->param_count;
+        record.first_slot  = header.slot_count;
+        record.slot_count  = routine->slots.size;
+        record.body        = writeChain(&serializer, routine->body);
+        record.line        = routine->location.first_line;
+        record.column      = routine->location.first_column;
+        record.method      = routine->method;
+
+        for(int j = 0; j < routine->slots.size; ++j)
+        {
+            InterfaceType type = makeType(&serializer, &routine->slots.elements[j]);
+            Buffer_append(&slots, &type, sizeof(type));
+            ++header.slot_count;
+        }
+
+        Buffer_append(&routines, &record, sizeof(record));
+    }
+
+    header.init = writeChain(&serializer, module->program.code);
+
+    for(int i = 0; i < module->classlist.size; ++i)
+    {
+        const Class* class = &module->classlist.elements[i];
+        if(class->scope_level != 0 || class->imported == true || class->layout == NULL)
+            continue;
+
+        InterfaceClass record = {Buffer_appendString(strings, class->name), serializer.layouts[class->layout->index]};
+        Buffer_append(&classes, &record, sizeof(record));
+        ++header.class_count;
+    }
+
+    for(int i = 0; i < module->funclist.size; ++i)
+    {
+        const Function* function = &module->funclist.elements[i];
+        const Declaration* declaration = &module->funclist.declarations[i];
+        if(declaration->scope_level != 0 || declaration->imported == true)
+            continue;
+
+        InterfaceFunction record = {0};
+        record.name        = Buffer_appendString(strings, function->name);
+        record.return_type = makeType(&serializer, &function->return_type);
+        record.first_param = header.type_count;
+        record.param_count = function->paramtypes.size;
+        record.routine     = serializer.routines[function->routine->index];
+
+        for(int j = 0; j < function->paramtypes.size; ++j)
+        {
+            InterfaceType type = makeType(&serializer, &function->paramtypes.elements[j]);
+            Buffer_append(&types, &type, sizeof(type));
+            ++header.type_count;
+        }
+
+        Buffer_append(&functions, &record, sizeof(record));
+        ++header.function_count;
+    }
+
+    for(int i = 0; i < module->varlist.size; ++i)
+    {
+        const Variable* var = &module->varlist.elements[i];
+        const Declaration* declaration = &module->varlist.declarations[i];
+        if(declaration->scope_level != 0 || declaration->imported == true)
+            continue;
+        if(program == false && (var->constant == false || var->type.type == CLASS))
+            continue;
+
+        InterfaceConstant record = {0};
+        record.name  = Buffer_appendString(strings, var->name);
+        record.type  = makeType(&serializer, &var->type);
+        record.flags = (var->constant ? INTERFACE_CONSTANT : 0) | (var->initialized ? INTERFACE_INITIALIZED : 0) | (var->known ? INTERFACE_KNOWN : 0);
+        record.slot  = serializer.globals[var->slot];
+
+        if(var->known)
+        {
+            switch(var->type.type)
+            {
+            case INT:    record.intval    = var->intval;  break;
+            case BOOL:   record.intval    = var->boolval; break;
+            case DOUBLE: record.doubleval = var->doubleval; break;
+            case CHAR:   record.intval    = var->charval; break;
+            case STRING: record.strval    = Buffer_appendString(strings, var->strval); break;
+            }
+        }
+
+        Buffer_append(&constants, &record, sizeof(record));
+        ++header.constant_count;
+    }
+
+    memcpy(header.magic, INTERFACE_MAGIC, sizeof(header.magic));
+    header.version           = INTERFACE_VERSION;
+    header.source_hash       = hash;
+    header.source_size       = (st != NULL ? st->st_size : 0);
+    header.source_mtime_sec  = (st != NULL ? st->st_mtim.tv_sec : 0);
+    header.source_mtime_nsec = (st != NULL ? st->st_mtim.tv_nsec : 0);
+    header.created_sec       = time(NULL);
+    header.node_count        = serializer.node_count;
+    header.strings_size      = strings->size;
+
+    Buffer result = {0};
+    Buffer_append(&result, &header, sizeof(header));
+    Buffer_append(&result, dependencies.data, dependencies.size);
+    Buffer_append(&result, classes.data, classes.size);
+    Buffer_append(&result, layouts.data, layouts.size);
+    Buffer_append(&result, fields.data, fields.size);
+    Buffer_append(&result, methods.data, methods.size);
+    Buffer_append(&result, sizes.data, sizes.size);
+    Buffer_append(&result, functions.data, functions.size);
+    Buffer_append(&result, types.data, types.size);
+    Buffer_append(&result, constants.data, constants.size);
+    Buffer_append(&result, routines.data, routines.size);
+    Buffer_append(&result, slots.data, slots.size);
+    Buffer_append(&result, serializer.nodes.data, serializer.nodes.size);
+    Buffer_append(&result, strings->data, strings->size);
+
+    free(dependencies.data);
+    free(classes.data);
+    free(layouts.data);
+    free(fields.data);
+    free(methods.data);
+    free(sizes.data);
+    free(functions.data);
+    free(types.data);
+    free(constants.data);
+    free(routines.data);
+    free(slots.data);
+    free(serializer.nodes.data);
+    free(strings->data);
+    free(serializer.globals);
+    free(serializer.routines);
+    free(serializer.layouts);
+
+    iface->data = result.data;
+    iface->size = result.size;
+    iface->mapped = false;
+}
+
+/* Write to a temporary file and rename it, so concurrent imports never see a partial interface.
+ * Failing to write (e.g. a read-only directory) only loses the caching */
+static void writeInterface(const char* path, const Interface* iface)
+{
+    char* iface_path = interfacePath(path);
+    char* tmp_path = malloc(strlen(iface_path) + sizeof(".XXXXXX"));
+    if(tmp_path == NULL)
+    {
+        free(iface_path);
+        return;
+    }
+
+    strcpy(tmp_path, iface_path);
+    strcat(tmp_path, ".XXXXXX");
+
+    const int fd = mkstemp(tmp_path);
+    if(fd >= 0)
+    {
+        fchmod(fd, 0644);
+        const bool written = (write(fd, iface->data, iface->size) == (ssize_t)iface->size);
+        if(close(fd) != 0 || written == false || rename(tmp_path, iface_path) != 0)
+            unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(iface_path);
+}
+
+/* Compile the module in a fresh context and extract its interface */
+static int buildInterface(const char* path, Interface* iface)
+{
+    struct stat st;
+    char* source = readSource(path, &st);
+    if(source == NULL)
+    {
+        yyerror("could not read module %s", path);
+        return -1;
+    }
+
+    /* The extra new line keeps fmemopen away from empty buffers */
+    const uint64_t hash = hashBytes(source, st.st_size, HASH_INIT);
+    source[st.st_size] = '\n';
+
+    FILE* fp = fmemopen(source, st.st_size + 1, "r");
+    if(fp == NULL)
+    {
+        free(source);
+        yyerror("could not read module %s", path);
+        return -1;
+    }
+
+    /* The diagnostics of the module point into its file */
+    const char* saved_file = diagnostic_file;
+    Context module = {0};
+    diagnostic_file = path;
+    parseModule(fp, &module);
+    diagnostic_file = saved_file;
+    fclose(fp);
+    free(source);
+
+    error_count += module.error_count;
+    warning_count += module.warning_count;
+
+    if(module.error_count != 0)
+    {
+        yyerror("module %s has %d errors", path, module.error_count);
+        Context_clear(&module);
+        return -1;
+    }
+
+    serializeInterface(&module, &st, hash, false, iface);
+    Context_clear(&module);
+
+    if(Interface_open(iface) != 0)
+    {
+        yyerror("debug: importModule: invalid interface built for %s", path);
+        abort();
+    }
+
+    writeInterface(path, iface);
+    return 0;
+}
+
+
+
+/* State of loading an interface. Class types resolve to the layouts loaded so far and to those of the dependencies */
+typedef struct Loader
+{
+    const Interface* iface;
+    int* dependencies;      /* index in modules of every dependency */
+    int layout_base;
+    uint32_t layout_count;
+    bool valid;             /* false once some reference did not resolve */
+} Loader;
+
+static ClassLayout* findLayout(Loader* loader, const InterfaceType* record)
+{
+    int index = -1;
+    if(record->layout_module == 0)
+    {
+        if(record->layout < loader->layout_count)
+            index = loader->layout_base + (int)record->layout;
+    }
+    else
+    {
+        const Module* dependency = &modules.elements[loader->dependencies[record->layout_module - 1]];
+        if(record->layout < (uint32_t)dependency->layout_count)
+            index = dependency->layout_base + (int)record->layout;
+    }
+
+    if(index < 0)
+    {
+        loader->valid = false;
+        return NULL;
+    }
+    return program.layouts.elements[index];
+}
+
+static void readType(Loader* loader, const InterfaceType* record, Type* type)
+{
+    const int kind = decodeType(record->type);
+    if(kind == CLASS)
+        (*type) = Type_make(kind, loader->iface->strings + record->class_name, ((uint32_t)record->type >> 8), findLayout(loader, record));
+    else
+        (*type) = Type_make(kind, NULL, ((uint32_t)record->type >> 8), NULL);
+}
+
+/* Base and size of the globals or the routines a node refers to */
+static int resolveReference(const int* dependencies, uint32_t module, uint32_t index, int own_base, uint32_t own_count, bool routine)
+{
+    if(module == 0)
+        return (index < own_count ? own_base + (int)index : -1);
+
+    const Module* dependency = &modules.elements[dependencies[module - 1]];
+    const int base  = (routine ? dependency->routine_base  : dependency->global_base);
+    const int count = (routine ? dependency->routine_count : dependency->global_count);
+    return (index < (uint32_t)count ? base + (int)index : -1);
+}
+
+/* The fields of a layout can only use the classes of the layouts before it, so every layout is complete once its fields are added */
+static void loadLayouts(Loader* loader, int module)
+{
+    const Interface* iface = loader->iface;
+    loader->layout_base = program.layouts.size;
+
+    for(uint32_t i = 0; i < iface->header->layout_count; ++i)
+    {
+        const InterfaceLayout* record = &iface->layouts[i];
+        ClassLayout* layout = Program_addLayout(iface->strings + record->name);
+        layout->module = module;
+        loader->layout_count = i;
+
+        for(uint32_t j = 0; j < record->field_count; ++j)
+        {
+            const InterfaceField* field = &iface->fields[record->first_field + j];
+            Type type;
+            readType(loader, &field->type, &type);
+
+            size_t size, alignment;
+            if(type.type == CLASS && (type.layout == NULL || (type.dimensions == 0 && ClassLayout_fieldSize(&type, &size, &alignment) == false)))
+            {
+                loader->valid = false;
+                continue;
+            }
+
+            long* sizes = NULL;
+            if(type.dimensions != 0)
+            {
+                sizes = malloc(type.dimensions * sizeof(long));
+                if(sizes == NULL)
+                {
+                    yyerror("not enough memory to import class %s", layout->name);
+                    abort();
+                }
+                for(int k = 0; k < type.dimensions; ++k)
+                    sizes[k] = iface->sizes[field->first_size + k];
+            }
+
+            char* name = strdup(iface->strings + field->name);
+            if(name == NULL || ClassLayout_addField(layout, name, &type, sizes, (field->access & INTERFACE_PRIVATE ? PRIVATE : PUBLIC)) != 0)
+            {
+                yyerror("not enough memory to import class %s", layout->name);
+                abort();
+            }
+        }
+
+        ClassLayout_finish(layout);
+    }
+
+    loader->layout_count = iface->header->layout_count;
+}
+
+/* The methods are added once the routines they call exist */
+static void loadMethods(Loader* loader, int routine_base)
+{
+    const Interface* iface = loader->iface;
+    for(uint32_t i = 0; i < iface->header->layout_count; ++i)
+    {
+        const InterfaceLayout* record = &iface->layouts[i];
+        ClassLayout* layout = program.layouts.elements[loader->layout_base + i];
+
+        for(uint32_t j = 0; j < record->method_count; ++j)
+        {
+            const InterfaceMethod* method = &iface->methods[record->first_method + j];
+            TypeList paramtypes = {0};
+            for(uint32_t k = 0; k < method->param_count; ++k)
+            {
+                Type type;
+                readType(loader, &iface->types[method->first_param + k], &type);
+                if(TypeList_insert(&paramtypes, &type) != 0)
+                {
+                    yyerror("not enough memory to import class %s", layout->name);
+                    abort();
+                }
+            }
+
+            char* name = strdup(iface->strings + method->name);
+            Routine* routine = program.routines.elements[routine_base + method->routine];
+            if(name == NULL || ClassLayout_addMethod(layout, name, &paramtypes, routine, (method->access & INTERFACE_PRIVATE ? PRIVATE : PUBLIC)) != 0)
+            {
+                yyerror("not enough memory to import class %s", layout->name);
+                abort();
+            }
+        }
+    }
+}
+
+/* A field node must stay inside the object of its operand */
+static bool isFieldValid(const Node* node)
+{
+    const Node* object = node->operands[0];
+    if(object == NULL || object->type.type != CLASS || object->type.dimensions != 0 || object->type.layout == NULL)
+        return false;
+
+    size_t size, alignment;
+    return (ClassLayout_fieldSize(&node->type, &size, &alignment) && node->offset <= object->type.layout->size
+            && size <= object->type.layout->size - node->offset);
+}
+
+/* Append the layouts, globals, routines and nodes of an interface to the program, relocating the references into the modules it imported.
+ * module is the index of the module being imported, -1 for a program */
+static int loadCode(Loader* loader, int module, int* global_base, int* routine_base, Node** init)
+{
+    const Interface* iface = loader->iface;
+    const InterfaceHeader* header = iface->header;
+    int* dependencies = loader->dependencies;
+    Node** nodes = Arena_alloc(&program.arena, (header->node_count + 1) * sizeof(Node*));
+
+    for(uint32_t i = 0; i < header->dependency_count; ++i)
+    {
+        dependencies[i] = ModuleList_find(&modules, iface->strings + iface->dependencies[i].path);
+        if(dependencies[i] < 0)
+            return -1;
+    }
+
+    loadLayouts(loader, module);
+
+    (*global_base) = program.globals.size;
+    for(uint32_t i = 0; i < header->global_count; ++i)
+    {
+        Type type;
+        readType(loader, &iface->slots[i], &type);
+        Program_addGlobal(&type);
+    }
+
+    (*routine_base) = program.routines.size;
+    for(uint32_t i = 0; i < header->routine_count; ++i)
+    {
+        const InterfaceRoutine* record = &iface->routines[i];
+        const YYLTYPE location = {record->line, record->column, record->line, record->column};
+        Type return_type;
+        readType(loader, &record->return_type, &return_type);
+
+        Routine* routine = Program_addRoutine(&return_type, &location);
+
+        routine->name = strdup(iface->strings + record->name);
+        routine->param_count = record->param_count;
+        routine->method = record->method;
+        routine->module = module;
+        for(uint32_t j = 0; j < record->slot_count; ++j)
+        {
+            Type type;
+            readType(loader, &iface->slots[record->first_slot + j], &type);
+            if(routine->name == NULL || TypeList_insert(&routine->slots, &type) != 0)
+            {
+                yyerror("not enough memory to import function %s", iface->strings + record->name);
+                abort();
+            }
+        }
+    }
+
+    loadMethods(loader, *routine_base);
+
+    nodes[0] = NULL;
+    for(uint32_t i = 1; i <= header->node_count; ++i)
+        nodes[i] = Arena_alloc(&program.arena, sizeof(Node));
+
+    for(uint32_t i = 0; i < header->node_count; ++i)
+    {
+        const InterfaceNode* record = &iface->nodes[i];
+        Node* node = nodes[i + 1];
+        memset(node, 0, sizeof(*node));
+
+        node->op = record->op;
+        readType(loader, &record->type, &node->type);
+        node->location.first_line   = record->first_line;
+        node->location.first_column = record->first_column;
+        node->location.last_line    = record->last_line;
+        node->location.last_column  = record->last_column;
+        for(int j = 0; j < 4; ++j)
+            node->operands[j] = nodes[record->operands[j]];
+        node->next  = nodes[record->next];
+        node->count = record->count;
+        node->name  = (record->name != 0 ? Arena_strdup(&program.arena, iface->strings + record->name) : NULL);
+
+        int index;
+        switch(node->op)
+        {
+        case NODE_CONST:
+            if(node->type.dimensions != 0)
+                break;
+
+            switch(node->type.type)
+            {
+            case INT:    node->value.intval    = record->intval;    break;
+            case BOOL:   node->value.boolval   = record->intval;    break;
+            case DOUBLE: node->value.doubleval = record->doubleval; break;
+            case CHAR:   node->value.charval   = record->intval;    break;
+            case STRING: node->value.strval    = Arena_strdup(&program.arena, iface->strings + record->strval); break;
+            }
+            break;
+
+        case NODE_GLOBAL:
+            index = resolveReference(dependencies, record->module, record->index, *global_base, header->global_count, false);
+            if(index < 0)
+                return -1;
+            node->slot = index;
+            break;
+
+        case NODE_LOCAL:
+            node->slot = record->index;
+            break;
+
+        case NODE_FIELD:
+            node->offset = record->offset;
+            break;
+
+        case NODE_REDUCED_INDEX:
+            node->invariant = record->offset;
+            break;
+
+        case NODE_CALL:
+        case NODE_INLINE:
+            index = resolveReference(dependencies, record->module, record->index, *routine_base, header->routine_count, true);
+            if(index < 0)
+                return -1;
+            node->routine = program.routines.elements[index];
+            break;
+
+        case NODE_BUILTIN:
+            node->builtin = record->index;
+            break;
+
+        case NODE_IMPORT:
+            node->module = dependencies[record->module - 1];
+            break;
+        }
+    }
+
+    for(uint32_t i = 1; i <= header->node_count; ++i)
+        if(nodes[i]->op == NODE_FIELD && isFieldValid(nodes[i]) == false)
+            return -1;
+    for(uint32_t i = 1; i <= header->node_count; ++i)
+        if(nodes[i]->op == NODE_SWITCH && Node_compileSwitch(nodes[i], NULL) != 0)
+            return -1;
+
+    for(uint32_t i = 0; i < header->routine_count; ++i)
+        program.routines.elements[*routine_base + i]->body = nodes[iface->routines[i].body];
+
+    /* The exports are declared without failing, so their classes are checked here */
+    for(uint32_t i = 0; i < header->function_count; ++i)
+    {
+        const InterfaceFunction* record = &iface->functions[i];
+        if(decodeType(record->return_type.type) == CLASS)
+            findLayout(loader, &record->return_type);
+        for(uint32_t j = 0; j < record->param_count; ++j)
+            if(decodeType(iface->types[record->first_param + j].type) == CLASS)
+                findLayout(loader, &iface->types[record->first_param + j]);
+    }
+    for(uint32_t i = 0; i < header->constant_count; ++i)
+        if(decodeType(iface->constants[i].type.type) == CLASS)
+            findLayout(loader, &iface->constants[i].type);
+
+    (*init) = nodes[header->init];
+    return (loader->valid ? 0 : -1);
+}
+
+/* Declare the exports of an interface and load its code. module is the index of the module being imported, -1 for a program */
+static void declareInterface(const Interface* iface, int module, const YYLTYPE* yylloc)
+{
+    Loader loader = {iface, malloc((iface->header->dependency_count + 1) * sizeof(int)), 0, 0, true};
+    if(loader.dependencies == NULL)
+    {
+        yyerror("not enough memory to import a module");
+        abort();
+    }
+
+    int global_base, routine_base;
+    Node* init;
+    if(loadCode(&loader, module, &global_base, &routine_base, &init) != 0)
+    {
+        yyerror("the code of module %s is invalid", (module >= 0 ? modules.elements[module].path : "cache"));
+        free(loader.dependencies);
+        return;
+    }
+
+    if(module >= 0)
+    {
+        Module* entry = &modules.elements[module];
+        entry->init = init;
+        entry->global_base = global_base;
+        entry->global_count = iface->header->global_count;
+        entry->routine_base = routine_base;
+        entry->routine_count = iface->header->routine_count;
+        entry->layout_base = loader.layout_base;
+        entry->layout_count = iface->header->layout_count;
+    }
+    else
+        program.code = init;
+
+    for(uint32_t i = 0; i < iface->header->class_count; ++i)
+    {
+        Class* class = declareClass(&classlist, 0, strdup(iface->strings + iface->classes[i].name), yylloc);
+        if(class != NULL)
+        {
+            class->imported = true;
+            class->layout = program.layouts.elements[loader.layout_base + iface->classes[i].layout];
+        }
+    }
+
+    for(uint32_t i = 0; i < iface->header->function_count; ++i)
+    {
+        const InterfaceFunction* record = &iface->functions[i];
+        Type return_type;
+        TypeList paramtypes = {0};
+
+        readType(&loader, &record->return_type, &return_type);
+        for(uint32_t j = 0; j < record->param_count; ++j)
+        {
+            Type type;
+            readType(&loader, &iface->types[record->first_param + j], &type);
+            if(TypeList_insert(&paramtypes, &type) != 0)
+            {
+                yyerror("not enough memory to import function %s", iface->strings + record->name);
+                abort();
+            }
+        }
+
+        Function* function = declareFunction(&funclist, 0, strdup(iface->strings + record->name), &return_type, &paramtypes, yylloc);
+        if(function != NULL)
+        {
+            FunctionList_declaration(&funclist, function)->imported = true;
+            function->routine = program.routines.elements[routine_base + record->routine];
+        }
+    }
+
+    for(uint32_t i = 0; i < iface->header->constant_count; ++i)
+    {
+        const InterfaceConstant* record = &iface->constants[i];
+        Type type;
+        readType(&loader, &record->type, &type);
+
+        Variable* var = declareVariable(&varlist, 0, strdup(iface->strings + record->name), &type, (record->flags & INTERFACE_CONSTANT),
+                                        (record->flags & INTERFACE_INITIALIZED), yylloc);
+        if(var == NULL)
+            continue;
+
+        VariableList_declaration(&varlist, var)->imported = true;
+        var->slot = global_base + record->slot;
+        var->known = (record->flags & INTERFACE_KNOWN);
+        if(var->known)
+        {
+            switch(type.type)
+            {
+            case INT:    var->intval    = record->intval;    break;
+            case BOOL:   var->boolval   = record->intval;    break;
+            case DOUBLE: var->doubleval = record->doubleval; break;
+            case CHAR:   var->charval   = record->intval;    break;
+            case STRING: var->strval    = strdup(iface->strings + record->strval); break;
+            }
+        }
+    }
+
+    free(loader.dependencies);
+}
+
+
+
+static Node* importStatement(int module)
+{
+    Node* node = Node_create(NODE_IMPORT, &Type_void, NULL, NULL, NULL, NULL);
+    node->module = module;
+    return node;
+}
+
+Node* importModule(const char* path, const YYLTYPE* yylloc)
+{
+    if(scope_level != 0)
+    {
+        yyerror("modules can only be imported at global scope");
+        return NULL;
+    }
+
+    char* real_path = realpath(path, NULL);
+    if(real_path == NULL)
+    {
+        yyerror("could not find module %s", path);
+        return NULL;
+    }
+
+    int index = ModuleList_find(&modules, real_path);
+    if(index >= 0)
+    {
+        free(real_path);
+        return importStatement(index);
+    }
+    if(ModuleList_find(&importing, real_path) >= 0)
+    {
+        yyerror("module %s imports itself", path);
+        free(real_path);
+        return NULL;
+    }
+
+    if(ModuleList_insert(&importing, real_path) != 0)
+    {
+        yyerror("not enough memory to import module %s", path);
+        abort();
+    }
+
+    /* The module is listed before its declarations so that its routines know their module */
+    Interface iface;
+    const bool loaded = (loadInterface(real_path, &iface) == 0 || buildInterface(real_path, &iface) == 0);
+    if(loaded)
+        for(uint32_t i = 0; i < iface.header->dependency_count; ++i)
+            importModule(iface.strings + iface.dependencies[i].path, yylloc);
+
+    --importing.size;
+    if(ModuleList_insert(&modules, real_path) != 0)
+    {
+        yyerror("not enough memory to import module %s", path);
+        abort();
+    }
+
+    index = modules.size - 1;
+    if(loaded == false)
+        return NULL;
+
+    declareInterface(&iface, index, yylloc);
+    Interface_close(&iface);
+    return importStatement(index);
+}
+
+
+
+int exportDeclarations(const Context* context, char** data, size_t* size)
+{
+    Interface iface;
+    serializeInterface(context, NULL, 0, true, &iface);
+
+    (*data) = iface.data;
+    (*size) = iface.size;
+    return 0;
+}
+
+int importDeclarations(const char* data, size_t size, const YYLTYPE* yylloc)
+{
+    Interface iface = {(char*)data, size, false};
+    if(Interface_open(&iface) != 0 || areDependenciesCurrent(&iface) == false)
+        return -1;
+
+    for(uint32_t i = 0; i < iface.header->dependency_count; ++i)
+        importModule(iface.strings + iface.dependencies[i].path, yylloc);
+
+    declareInterface(&iface, -1, yylloc);
+
+    /* The code of a stored program was optimized before it was stored */
+    for(int i = 0; i < program.routines.size; ++i)
+        if(program.routines.elements[i]->module < 0)
+            program.routines.elements[i]->optimized = true;
+    return 0;
+}
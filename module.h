@@ -0,0 +1,49 @@
+#ifndef INCLUDED_MODULE_H
+#define INCLUDED_MODULE_H
+
+#include "yylloc.h"
+#include "util.h"
+
+/* A module imported into a program. Its globals, routines and class layouts are contiguous in the program */
+typedef struct Module
+{
+    char* path; /* absolute */
+    const struct Node* init; /* top-level statements, run by the first import statement that runs */
+    bool initialized;
+
+    int global_base;
+    int global_count;
+    int routine_base;
+    int routine_count;
+    int layout_base;
+    int layout_count;
+} Module;
+
+typedef struct ModuleList
+{
+    Module* elements;
+    int size;
+    int capacity;
+} ModuleList;
+
+void ModuleList_clear(ModuleList* list);
+int  ModuleList_find(const ModuleList* list, const char* path);
+int  ModuleList_insert(ModuleList* list, char* path);
+
+
+
+/* import "path";
+ * Declares the classes, functions and constants of a module at global scope and loads its code.
+ * The module is compiled once into an interface file (path.tmi) which later imports map instead of parsing the source.
+ * An interface is used only while its source and the sources of every module it imported are unchanged.
+ * Returns the statement running the module, or NULL */
+struct Node* importModule(const char* path, const YYLTYPE* yylloc);
+
+/* Every global declaration and the code of a compiled program, in the interface format, for the program cache.
+ * importDeclarations fails without declaring anything if the data is invalid or an imported module changed since.
+ * Otherwise the code is left in program.code */
+struct Context;
+int exportDeclarations(const struct Context* context, char** data, size_t* size);
+int importDeclarations(const char* data, size_t size, const YYLTYPE* yylloc);
+
+#endif
@@ -0,0 +1,464 @@
+#include "node.h"
+#include <stddef.h>
+#include "array.h"
+#include "bigint.h"
+#include "exec.h"
+#include "memo.h"
+#include "profile.h"
+#include "sampler.h"
+#include "y.tab.h"
+
+#define ARENA_BLOCK_SIZE (64 << 10)
+
+__thread YYLTYPE node_location = {1, 1, 1, 1};
+__thread Arena* node_arena = NULL;
+
+void freeDeferredBody(struct DeferredBody* body);
+
+
+
+/* Arena */
+typedef struct ArenaBlock
+{
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} ArenaBlock;
+
+void* Arena_alloc(Arena* arena, size_t size)
+{
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+
+    ArenaBlock* block = arena->blocks;
+    if(block == NULL || block->used + size > block->size)
+    {
+        const size_t block_size = (size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+        block = malloc(sizeof(*block) + block_size);
+        if(block == NULL)
+        {
+            yyerror("not enough memory to allocate %zu bytes for the program", size);
+            abort();
+        }
+
+        block->next = arena->blocks;
+        block->size = block_size;
+        block->used = 0;
+        arena->blocks = block;
+    }
+
+    void* memory = (char*)block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+char* Arena_strdup(Arena* arena, const char* str)
+{
+    const size_t size = strlen(str) + 1;
+    return memcpy(Arena_alloc(arena, size), str, size);
+}
+
+/* The blocks of other go after those of arena, whose first block keeps being filled */
+void Arena_merge(Arena* arena, Arena* other)
+{
+    ArenaBlock** last = &arena->blocks;
+    while((*last) != NULL)
+        last = &(*last)->next;
+    (*last) = other->blocks;
+    other->blocks = NULL;
+}
+
+void Arena_clear(Arena* arena)
+{
+    while(arena->blocks != NULL)
+    {
+        ArenaBlock* next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+}
+
+
+
+/* Node */
+Arena* Node_arena()
+{
+    return (node_arena != NULL ? node_arena : &program.arena);
+}
+
+Node* Node_create(NodeOp op, const Type* type, Node* first, Node* second, Node* third, Node* fourth)
+{
+    Node* node = Arena_alloc(Node_arena(), sizeof(*node));
+    memset(node, 0, sizeof(*node));
+
+    node->op = op;
+    node->type = (*type);
+    node->location = node_location;
+    node->operands[0] = first;
+    node->operands[1] = second;
+    node->operands[2] = third;
+    node->operands[3] = fourth;
+    return node;
+}
+
+Node* Node_constant(const Type* type, const void* data)
+{
+    Node* node = Node_create(NODE_CONST, type, NULL, NULL, NULL, NULL);
+    if(data == NULL)
+        return node;
+
+    switch(type->type)
+    {
+    case INT:    node->value.intval    = *((const long*)  data); break;
+    case BOOL:   node->value.boolval   = *((const bool*)  data); break;
+    case DOUBLE: node->value.doubleval = *((const double*)data); break;
+    case CHAR:   node->value.charval   = *((const char*)  data); break;
+    case STRING: node->value.strval    = Arena_strdup(Node_arena(), (*(char* const*)data != NULL ? *(char* const*)data : "")); break;
+    }
+
+    return node;
+}
+
+Node* Node_variable(const Variable* var)
+{
+    Node* node = Node_create((var->routine != NULL ? NODE_LOCAL : NODE_GLOBAL), &var->type, NULL, NULL, NULL, NULL);
+    node->slot = var->slot;
+    node->name = Arena_strdup(Node_arena(), var->name);
+    return node;
+}
+
+static bool isConstant(const Node* node)
+{
+    return node == NULL || node->op == NODE_CONST;
+}
+
+Node* Node_fold(Node* node)
+{
+    if(node->op < NODE_ADD || node->op > NODE_GT || isConstant(node->operands[0]) == false || isConstant(node->operands[1]) == false)
+        return node;
+
+    Value value;
+    if(Program_evaluate(node, &value) != 0)
+        return node;
+
+    /* Constants are small ints, a result that needs a BigInt is computed by the run */
+    if(node->type.type == INT && Int_isBig(value.intval))
+    {
+        Int_release(value.intval);
+        return node;
+    }
+
+    Node* result = Node_constant(&node->type, &value);
+    if(node->type.type == STRING)
+        free(value.strval);
+    return result;
+}
+
+
+
+/* Switch */
+typedef struct SwitchLabel
+{
+    long value;
+    int order;         /* in the source, so that a repeated label is reported with the first one */
+    const Node* label;
+    Node* target;
+} SwitchLabel;
+
+static int compareLabels(const void* lhs, const void* rhs)
+{
+    const SwitchLabel* lval = lhs;
+    const SwitchLabel* rval = rhs;
+    if(lval->value != rval->value)
+        return (lval->value < rval->value ? -1 : 1);
+    return lval->order - rval->order;
+}
+
+int Node_compileSwitch(Node* node, void (*duplicate)(const Node* label, const Node* previous))
+{
+    if(node->operands[0] == NULL)
+        return -1;
+
+    const Type* type = &node->operands[0]->type;
+    if(type->dimensions != 0 || (type->type != INT && type->type != CHAR))
+        return -1;
+
+    node->table = NULL;
+    int count = 0;
+    for(const Node* target = node->operands[1]; target != NULL; target = target->next)
+    {
+        if(target->op != NODE_CASE)
+            return -1;
+        for(const Node* label = target->operands[0]; label != NULL; label = label->next)
+        {
+            if(label->op != NODE_CONST || (label->type.type != VOID && Type_equal(&label->type, type) == false))
+                return -1;
+            if(label->type.type == INT && Int_isBig(label->value.intval))
+                return -1;
+            count += (label->type.type != VOID);
+        }
+    }
+
+    SwitchLabel* labels = malloc((count + 1) * sizeof(labels[0]));
+    if(labels == NULL)
+    {
+        yyerror("not enough memory for the cases of a switch");
+        abort();
+    }
+
+    /* Labels in the order of the source */
+    int duplicates = 0;
+    const Node* default_label = NULL;
+    Node* otherwise = NULL;
+    count = 0;
+    for(Node* target = node->operands[1]; target != NULL; target = target->next)
+        for(const Node* label = target->operands[0]; label != NULL; label = label->next)
+        {
+            if(label->type.type != VOID)
+            {
+                const long value = (label->type.type == CHAR ? label->value.charval : label->value.intval);
+                labels[count] = (SwitchLabel){value, count, label, target};
+                ++count;
+            }
+            else if(default_label != NULL)
+            {
+                if(duplicate != NULL)
+                    duplicate(label, default_label);
+                ++duplicates;
+            }
+            else
+            {
+                default_label = label;
+                otherwise = target;
+            }
+        }
+
+    qsort(labels, count, sizeof(labels[0]), compareLabels);
+    for(int i = 1, first = 0; i < count; ++i)
+    {
+        if(labels[i].value != labels[first].value)
+        {
+            first = i;
+            continue;
+        }
+
+        if(duplicate != NULL)
+            duplicate(labels[i].label, labels[first].label);
+        ++duplicates;
+    }
+
+    if(duplicates != 0)
+    {
+        free(labels);
+        return duplicates;
+    }
+
+    SwitchTable* table = Arena_alloc(Node_arena(), sizeof(*table));
+    table->first = (count != 0 ? labels[0].value : 0);
+    table->range = 0;
+    table->values = NULL;
+    table->size = count;
+    table->otherwise = otherwise;
+
+    const unsigned long span = (count != 0 ? (unsigned long)labels[count - 1].value - (unsigned long)table->first : 0);
+    if(count != 0 && span / SWITCH_DENSITY < (unsigned long)count)
+    {
+        table->range = span + 1;
+        table->cases = Arena_alloc(Node_arena(), table->range * sizeof(table->cases[0]));
+        for(unsigned long i = 0; i < table->range; ++i)
+            table->cases[i] = otherwise;
+        for(int i = 0; i < count; ++i)
+            table->cases[(unsigned long)labels[i].value - (unsigned long)table->first] = labels[i].target;
+    }
+    else
+    {
+        table->values = Arena_alloc(Node_arena(), (count + 1) * sizeof(table->values[0]));
+        table->cases = Arena_alloc(Node_arena(), (count + 1) * sizeof(table->cases[0]));
+        for(int i = 0; i < count; ++i)
+        {
+            table->values[i] = labels[i].value;
+            table->cases[i] = labels[i].target;
+        }
+    }
+
+    free(labels);
+    node->table = table;
+    return 0;
+}
+
+const Node* SwitchTable_find(const SwitchTable* table, long value)
+{
+    if(table->range != 0)
+    {
+        const unsigned long index = (unsigned long)value - (unsigned long)table->first;
+        return (index < table->range ? table->cases[index] : table->otherwise);
+    }
+
+    int low = 0, high = table->size;
+    while(low < high)
+    {
+        const int middle = low + (high - low) / 2;
+        if(table->values[middle] < value)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return (low < table->size && table->values[low] == value ? table->cases[low] : table->otherwise);
+}
+
+
+
+/* NodeList */
+void NodeList_init(NodeList* list)
+{
+    list->first = NULL;
+    list->last = NULL;
+    list->size = 0;
+    list->valid = true;
+}
+
+void NodeList_append(NodeList* list, Node* node)
+{
+    if(node == NULL)
+        return;
+
+    if(list->last == NULL)
+        list->first = node;
+    else
+        list->last->next = node;
+
+    list->last = node;
+    ++list->size;
+}
+
+void NodeList_prepend(NodeList* list, Node* node)
+{
+    if(node == NULL)
+        return;
+
+    node->next = list->first;
+    list->first = node;
+    if(list->last == NULL)
+        list->last = node;
+    ++list->size;
+}
+
+
+
+/* RoutineList */
+void RoutineList_clear(RoutineList* list)
+{
+    for(int i = 0; i < list->size; ++i)
+    {
+        Routine* routine = list->elements[i];
+        freeDeferredBody(routine->deferred);
+        Memo_destroy(routine->memo);
+        TypeList_clear(&routine->slots);
+        free(routine->name);
+        free(routine);
+    }
+
+    free(list->elements);
+    list->elements = NULL;
+    list->capacity = 0;
+    list->size = 0;
+}
+
+int RoutineList_insert(RoutineList* list, Routine* routine)
+{
+    if(list->size == list->capacity)
+    {
+        int new_capacity = 1 + list->capacity * 2;
+        Routine** new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_list == NULL)
+        {
+            new_capacity = 1 + list->capacity;
+            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+            if(new_list == NULL)
+                return -1;
+        }
+
+        list->elements = new_list;
+        list->capacity = new_capacity;
+    }
+
+    list->elements[list->size] = routine;
+    ++list->size;
+    return 0;
+}
+
+
+
+/* Program */
+Routine* Program_addRoutine(const Type* return_type, const YYLTYPE* location)
+{
+    Routine* routine = calloc(1, sizeof(*routine));
+    if(routine == NULL || RoutineList_insert(&program.routines, routine) != 0)
+    {
+        yyerror("not enough memory to declare function");
+        abort();
+    }
+
+    routine->return_type = (*return_type);
+    routine->location = (*location);
+    routine->module = -1;
+    routine->index = program.routines.size - 1;
+    return routine;
+}
+
+ClassLayout* Program_addLayout(const char* name)
+{
+    ClassLayout* layout = calloc(1, sizeof(*layout));
+    if(layout == NULL || (layout->name = strdup(name)) == NULL || LayoutList_insert(&program.layouts, layout) != 0)
+    {
+        yyerror("not enough memory to declare class %s", name);
+        abort();
+    }
+
+    layout->module = -1;
+    layout->index = program.layouts.size - 1;
+    layout->last_field = -1;
+    layout->last_method = -1;
+    return layout;
+}
+
+int Program_addGlobal(const Type* type)
+{
+    Type slot = (*type);
+    if(TypeList_insert(&program.globals, &slot) != 0)
+    {
+        yyerror("not enough memory to declare variable");
+        abort();
+    }
+
+    return program.globals.size - 1;
+}
+
+void Value_release(const Type* type, Value* value)
+{
+    if(type->dimensions != 0)
+        Array_destroy(value->array);
+    else if(type->type == INT)
+        Int_release(value->intval);
+    else if(type->type == STRING)
+        free(value->strval);
+    else if(type->type == CLASS)
+        Object_destroy(type->layout, value->object);
+}
+
+void Program_clear(Program* program)
+{
+    for(int i = 0; i < program->value_count; ++i)
+        Value_release(&program->globals.elements[i], &program->values[i]);
+
+    free(program->values);
+    TypeList_clear(&program->globals);
+    RoutineList_clear(&program->routines);
+    LayoutList_clear(&program->layouts);
+    Arena_clear(&program->arena);
+    Profile_destroy(program->profile);
+    Sampler_destroy(program->sampler);
+
+    memset(program, 0, sizeof(*program));
+}
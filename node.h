@@ -0,0 +1,247 @@
+#ifndef INCLUDED_NODE_H
+#define INCLUDED_NODE_H
+
+#include "yylloc.h"
+#include "util.h"
+#include "layout.h"
+
+/* Value of a variable or an expression while the program runs. Strings and BigInts are owned by whoever holds them */
+typedef union Value
+{
+    long intval;
+    bool boolval;
+    double doubleval;
+    char charval;
+    char* strval;
+    struct Array* array;
+    char* object;     /* of a class, laid out by its ClassLayout */
+} Value;
+
+
+
+/* Operations of the code tree. The comments list the operands */
+typedef enum NodeOp
+{
+    NODE_CONST,       /* value */
+    NODE_GLOBAL,      /* slot */
+    NODE_LOCAL,       /* slot */
+    NODE_INDEX,       /* array variable, first index */
+    NODE_REDUCED_INDEX, /* array variable, first index, variable keeping the offset of the invariant indices */
+    NODE_FIELD,       /* object, at offset */
+    NODE_CALL,        /* routine, first argument */
+    NODE_BUILTIN,     /* builtin, first argument */
+    NODE_INLINE,      /* routine, first argument, copy of the returned expression, variable standing for the first local or NULL */
+
+    NODE_ASSIGN,      /* target, value */
+    NODE_ADD_ASSIGN,
+    NODE_SUB_ASSIGN,
+    NODE_MUL_ASSIGN,
+    NODE_DIV_ASSIGN,
+    NODE_MOD_ASSIGN,
+    NODE_PREINC,      /* target */
+    NODE_PREDEC,
+    NODE_POSTINC,
+    NODE_POSTDEC,
+
+    NODE_ADD,         /* left, right */
+    NODE_SUB,
+    NODE_MUL,
+    NODE_DIV,
+    NODE_MOD,
+    NODE_NEG,         /* operand */
+    NODE_NOT,
+    NODE_AND,         /* left, right */
+    NODE_OR,
+    NODE_EQ,
+    NODE_NE,
+    NODE_LE,
+    NODE_GE,
+    NODE_LT,
+    NODE_GT,
+
+    NODE_EXP,         /* expression */
+    NODE_BLOCK,       /* first statement */
+    NODE_PRINT,       /* expression */
+    NODE_RETURN,      /* expression or NULL */
+    NODE_IF,          /* condition, then, else */
+    NODE_WHILE,       /* condition, body */
+    NODE_DO,          /* condition, body */
+    NODE_FOR,         /* initialization, condition, step, body */
+    NODE_PARALLEL_FOR, /* declaration of the variable, end, body, first reduction variable */
+    NODE_DECL,        /* variable, initial value or NULL */
+    NODE_DECL_ARRAY,  /* variable, first size */
+    NODE_IMPORT,      /* module */
+    NODE_SWITCH,      /* value, first case, and the table finding the case of a value */
+    NODE_CASE         /* first label, first statement. Labels are constants, a void one for default, and count those that are not */
+} NodeOp;
+
+typedef struct Node
+{
+    NodeOp op;
+    Type type;               /* of the value. The class name lives in the program arena */
+    YYLTYPE location;
+    struct Node* operands[4];
+    struct Node* next;       /* next statement, argument, index or size in a list */
+    int count;               /* length of the list of a call, index or array declaration */
+    const char* name;        /* variable of GLOBAL, LOCAL and INDEX nodes and field of FIELD nodes, for messages */
+
+    union
+    {
+        Value value;
+        int slot;
+        struct Routine* routine;
+        int builtin;
+        int module;
+        size_t offset;
+        unsigned long invariant; /* mask of the indices of REDUCED_INDEX nodes */
+        struct SwitchTable* table;
+    };
+} Node;
+
+/* Location of the grammar rule being reduced, given to the nodes it creates */
+extern __thread YYLTYPE node_location;
+
+Node* Node_create(NodeOp op, const Type* type, Node* first, Node* second, Node* third, Node* fourth);
+Node* Node_constant(const Type* type, const void* data);
+Node* Node_variable(const Variable* var);
+
+/* Replace an operation on constants by its result. A failing operation is reported and kept */
+Node* Node_fold(Node* node);
+
+/* Cases of a switch by value: a table indexed by the value minus the smallest one when at least one value in
+ * SWITCH_DENSITY of the range has a case, otherwise the sorted values, which are searched by bisection */
+#define SWITCH_DENSITY 4
+
+typedef struct SwitchTable
+{
+    long first;             /* smallest value of the dense table */
+    unsigned long range;    /* entries of the dense table, 0 for sorted values */
+    long* values;           /* sorted, NULL for a dense table */
+    struct Node** cases;    /* of every entry or value. Entries without a value of their own go to the default */
+    int size;
+    struct Node* otherwise; /* case with the default label, NULL if none */
+} SwitchTable;
+
+/* Build the table of a switch in the node arena. Labels repeating an earlier one are given to duplicate, if set, with it,
+ * and leave the switch without a table. Returns the number of repeated labels, or -1 if a label is not a constant of
+ * the type of the value */
+int Node_compileSwitch(Node* node, void (*duplicate)(const Node* label, const Node* previous));
+/* The case running for a value, NULL if none */
+const Node* SwitchTable_find(const SwitchTable* table, long value);
+
+
+
+typedef struct NodeList
+{
+    Node* first;
+    Node* last;
+    int size;
+    bool valid; /* false once an invalid node was added */
+} NodeList;
+
+void NodeList_init(NodeList* list);
+void NodeList_append(NodeList* list, Node* node);
+void NodeList_prepend(NodeList* list, Node* node);
+
+/* Arguments of a call while it is parsed */
+typedef struct Arguments
+{
+    TypeList types;
+    NodeList nodes;
+} Arguments;
+
+
+
+/* Function bodies. Parameters take the first local slots.
+ * The first parameter of a method is this, which points to the object it was called on and is not released with the locals */
+typedef struct Routine
+{
+    char* name;       /* with the parameter types, for messages */
+    Type return_type;
+    int param_count;
+    bool method;
+    TypeList slots;   /* types of the local variables */
+    Node* body;
+    YYLTYPE location;
+    int module;       /* index of the module that defined it, -1 for the program */
+    int index;        /* in the routines of the program */
+    bool optimized;
+    struct DeferredBody* deferred; /* the tokens and scope of a body the lazy analysis skipped, until it is analyzed */
+    struct Memo* memo; /* results of the calls to a pure function, when memoizing */
+} Routine;
+
+typedef struct RoutineList
+{
+    Routine** elements;
+    int size;
+    int capacity;
+} RoutineList;
+
+void RoutineList_clear(RoutineList* list);
+int  RoutineList_insert(RoutineList* list, Routine* routine);
+
+
+
+/* Nodes and their strings are allocated in blocks and freed together */
+typedef struct Arena
+{
+    struct ArenaBlock* blocks;
+} Arena;
+
+void* Arena_alloc(Arena* arena, size_t size);
+char* Arena_strdup(Arena* arena, const char* str);
+void  Arena_merge(Arena* arena, Arena* other);
+void  Arena_clear(Arena* arena);
+
+/* The arena a thread analyzing function bodies allocates its nodes in, the one of the program if NULL */
+extern __thread Arena* node_arena;
+Arena* Node_arena();
+
+
+
+/* The code of everything compiled into a context and the storage of its global variables */
+typedef struct Program
+{
+    Arena arena;
+    RoutineList routines;
+    LayoutList layouts;  /* of every class, including those declared inside functions */
+    TypeList globals;    /* types of the global variables */
+    Value* values;       /* the global variables, allocated when the program runs */
+    int value_count;
+    Node* code;          /* top-level statements of the last source parsed */
+    bool bounds_checks;
+    int optimization;    /* level of the optimizer, 0 to run the code as parsed */
+    FILE* ir_dump;       /* receives the IR of the optimized code after every pass, if set */
+    int inline_limit;    /* largest returned expression inlined, in nodes, 0 to inline nothing */
+    FILE* inline_report; /* receives a line for every inlined call, if set */
+    struct Profile* profile; /* counts the lines and calls that run, if set */
+    struct Sampler* sampler; /* samples the stack of the runs, if set */
+    int analysis;        /* when function bodies are analyzed, one of the ANALYSIS values */
+    int skipped_bodies;  /* by the lazy analysis */
+    int deferred_bodies; /* skipped bodies analyzed later */
+    int jobs;            /* threads analyzing the skipped bodies once the program is parsed */
+    int threads;         /* running the iterations of parallel loops, 0 for one per processor */
+    int parallel_loops;  /* parsed, checked once the program is analyzed */
+    int memoize;         /* results kept for every pure function, 0 to memoize nothing */
+} Program;
+
+/* Function bodies are analyzed while they are parsed, or skipped and analyzed on the first call that resolves to them.
+ * ANALYSIS_CHECK_ALL also analyzes the bodies never called once the program is parsed, which reports what ANALYSIS_EAGER does */
+enum
+{
+    ANALYSIS_EAGER,
+    ANALYSIS_LAZY,
+    ANALYSIS_CHECK_ALL
+};
+
+extern Program program;
+
+Routine*     Program_addRoutine(const Type* return_type, const YYLTYPE* location);
+ClassLayout* Program_addLayout(const char* name);
+int          Program_addGlobal(const Type* type);
+void         Program_clear(Program* program);
+
+/* Release a BigInt, a string, an array or an object held by a variable of the given type */
+void Value_release(const Type* type, Value* value);
+
+#endif
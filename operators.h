@@ -0,0 +1,106 @@
+#ifndef INCLUDED_OPERATORS_H
+#define INCLUDED_OPERATORS_H
+
+/* The operators of expressions, one row each: its node, the Expression_ function of util.c checking it, its symbol, its name in
+ * the messages about the types it does not apply to, its form and the node whose kernels compute it.
+ * Forms tell what the operands must be:
+ *   ASSIGNMENT  an lval and a value of its type, of any type
+ *   COMPOUND    an lval and a value of its type, which the kernel combines
+ *   PREFIX      an lval, the result is the lval
+ *   POSTFIX     an lval, the result is its old value
+ *   BINARY      two values of the same type, which is the type of the result
+ *   UNARY       a value of the type of the result
+ *   LOGICAL     two scalar values converted to bool
+ *   COMPARISON  two values of the same type, the result is a bool */
+#define OPERATORS(X) \
+    X(NODE_ASSIGN,     assign,    "=",   "assignment",         ASSIGNMENT, NODE_ASSIGN)     \
+    X(NODE_ADD_ASSIGN, addassign, "+=",  "addition",           COMPOUND,   NODE_ADD_ASSIGN) \
+    X(NODE_SUB_ASSIGN, subassign, "-=",  "substraction",       COMPOUND,   NODE_SUB_ASSIGN) \
+    X(NODE_MUL_ASSIGN, mulassign, "*=",  "multiplication",     COMPOUND,   NODE_MUL_ASSIGN) \
+    X(NODE_DIV_ASSIGN, divassign, "/=",  "division",           COMPOUND,   NODE_DIV_ASSIGN) \
+    X(NODE_MOD_ASSIGN, modassign, "%=",  "modulus",            COMPOUND,   NODE_MOD_ASSIGN) \
+    X(NODE_PREINC,     preinc,    "++X", "preincrement",       PREFIX,     NODE_PREINC)     \
+    X(NODE_PREDEC,     predec,    "--X", "predecrement",       PREFIX,     NODE_PREDEC)     \
+    X(NODE_POSTINC,    postinc,   "X++", "postincrement",      POSTFIX,    NODE_PREINC)     \
+    X(NODE_POSTDEC,    postdec,   "X--", "postdecrement",      POSTFIX,    NODE_PREDEC)     \
+    X(NODE_ADD,        add,       "+",   "addition",           BINARY,     NODE_ADD)        \
+    X(NODE_SUB,        sub,       "-",   "substraction",       BINARY,     NODE_SUB)        \
+    X(NODE_MUL,        mul,       "*",   "multiplication",     BINARY,     NODE_MUL)        \
+    X(NODE_DIV,        div,       "/",   "division",           BINARY,     NODE_DIV)        \
+    X(NODE_MOD,        mod,       "%",   "modulus",            BINARY,     NODE_MOD)        \
+    X(NODE_NEG,        neg,       "-",   "unary minus",        UNARY,      NODE_NEG)        \
+    X(NODE_NOT,        not,       "!",   "'!'",                UNARY,      NODE_NOT)        \
+    X(NODE_AND,        and,       "&&",  "conversion to bool", LOGICAL,    NODE_AND)        \
+    X(NODE_OR,         or,        "||",  "conversion to bool", LOGICAL,    NODE_OR)         \
+    X(NODE_EQ,         eq,        "==",  "'=='",               COMPARISON, NODE_EQ)         \
+    X(NODE_NE,         neq,       "!=",  "'!='",               COMPARISON, NODE_NE)         \
+    X(NODE_LE,         leq,       "<=",  "'<='",               COMPARISON, NODE_LE)         \
+    X(NODE_GE,         geq,       ">=",  "'>='",               COMPARISON, NODE_GE)         \
+    X(NODE_LT,         low,       "<",   "'<'",                COMPARISON, NODE_LT)         \
+    X(NODE_GT,         gre,       ">",   "'>'",                COMPARISON, NODE_GT)
+
+/* The kernels of the operators, one row per operator and type of the operands: the field of the result and the expression
+ * computing it from lval and rval, which it takes, in exec.c. Types are given by id, since their tokens are macros.
+ * An operator applies to the types it has a kernel for.
+ * Operators and their assignment forms agree except for bool, where '+' is xor while '+=' is or */
+#define OPERATOR_KERNELS(X) \
+    KERNEL_PAIR(X, NODE_ADD, TYPE_ID_INT, intval, Int_add(lval.intval, rval.intval))           \
+    KERNEL_PAIR(X, NODE_SUB, TYPE_ID_INT, intval, Int_sub(lval.intval, rval.intval))           \
+    KERNEL_PAIR(X, NODE_MUL, TYPE_ID_INT, intval, Int_mul(lval.intval, rval.intval))           \
+    KERNEL_PAIR(X, NODE_DIV, TYPE_ID_INT, intval, divide(node, lval.intval, rval.intval))      \
+    KERNEL_PAIR(X, NODE_MOD, TYPE_ID_INT, intval, modulus(node, lval.intval, rval.intval))     \
+    X(NODE_NEG,    TYPE_ID_INT, intval, Int_neg(lval.intval))                                  \
+    X(NODE_NOT,    TYPE_ID_INT, intval, isZero(lval.intval))                                   \
+    X(NODE_PREINC, TYPE_ID_INT, intval, Int_add(lval.intval, 1))                               \
+    X(NODE_PREDEC, TYPE_ID_INT, intval, Int_add(lval.intval, -1))                              \
+    COMPARISON_KERNELS(X, TYPE_ID_INT, COMPARE_INTS, intval)                                   \
+                                                                                               \
+    X(NODE_ADD,        TYPE_ID_BOOL, boolval, lval.boolval != rval.boolval)                    \
+    X(NODE_ADD_ASSIGN, TYPE_ID_BOOL, boolval, lval.boolval || rval.boolval)                    \
+    KERNEL_PAIR(X, NODE_SUB, TYPE_ID_BOOL, boolval, lval.boolval != rval.boolval)              \
+    KERNEL_PAIR(X, NODE_MUL, TYPE_ID_BOOL, boolval, lval.boolval && rval.boolval)              \
+    X(NODE_NEG,    TYPE_ID_BOOL, boolval, lval.boolval)                                        \
+    X(NODE_NOT,    TYPE_ID_BOOL, boolval, !lval.boolval)                                       \
+    X(NODE_PREINC, TYPE_ID_BOOL, boolval, true)                                                \
+    X(NODE_PREDEC, TYPE_ID_BOOL, boolval, !lval.boolval)                                       \
+    COMPARISON_KERNELS(X, TYPE_ID_BOOL, COMPARE_VALUES, boolval)                               \
+                                                                                               \
+    KERNEL_PAIR(X, NODE_ADD, TYPE_ID_DOUBLE, doubleval, lval.doubleval + rval.doubleval)       \
+    KERNEL_PAIR(X, NODE_SUB, TYPE_ID_DOUBLE, doubleval, lval.doubleval - rval.doubleval)       \
+    KERNEL_PAIR(X, NODE_MUL, TYPE_ID_DOUBLE, doubleval, lval.doubleval * rval.doubleval)       \
+    KERNEL_PAIR(X, NODE_DIV, TYPE_ID_DOUBLE, doubleval, lval.doubleval / rval.doubleval)       \
+    X(NODE_NEG,    TYPE_ID_DOUBLE, doubleval, -lval.doubleval)                                 \
+    X(NODE_NOT,    TYPE_ID_DOUBLE, doubleval, !lval.doubleval)                                 \
+    X(NODE_PREINC, TYPE_ID_DOUBLE, doubleval, lval.doubleval + 1)                              \
+    X(NODE_PREDEC, TYPE_ID_DOUBLE, doubleval, lval.doubleval - 1)                              \
+    COMPARISON_KERNELS(X, TYPE_ID_DOUBLE, COMPARE_VALUES, doubleval)                           \
+                                                                                               \
+    KERNEL_PAIR(X, NODE_ADD, TYPE_ID_CHAR, charval, lval.charval + rval.charval)               \
+    KERNEL_PAIR(X, NODE_SUB, TYPE_ID_CHAR, charval, lval.charval - rval.charval)               \
+    KERNEL_PAIR(X, NODE_MUL, TYPE_ID_CHAR, charval, lval.charval * rval.charval)               \
+    KERNEL_PAIR(X, NODE_DIV, TYPE_ID_CHAR, charval, divide(node, lval.charval, rval.charval))  \
+    KERNEL_PAIR(X, NODE_MOD, TYPE_ID_CHAR, charval, modulus(node, lval.charval, rval.charval)) \
+    X(NODE_NEG,    TYPE_ID_CHAR, charval, -lval.charval)                                       \
+    X(NODE_NOT,    TYPE_ID_CHAR, charval, !lval.charval)                                       \
+    X(NODE_PREINC, TYPE_ID_CHAR, charval, lval.charval + 1)                                    \
+    X(NODE_PREDEC, TYPE_ID_CHAR, charval, lval.charval - 1)                                    \
+    COMPARISON_KERNELS(X, TYPE_ID_CHAR, COMPARE_VALUES, charval)                               \
+                                                                                               \
+    KERNEL_PAIR(X, NODE_ADD, TYPE_ID_STRING, strval, concatenate(lval.strval, rval.strval))    \
+    COMPARISON_KERNELS(X, TYPE_ID_STRING, COMPARE_STRINGS, strval)
+
+#define KERNEL_PAIR(X, op, type, field, expression) X(op, type, field, expression) X(op##_ASSIGN, type, field, expression)
+
+#define COMPARISON_KERNELS(X, type, compare, field) \
+    X(NODE_EQ, type, boolval, compare(field, ==))   \
+    X(NODE_NE, type, boolval, compare(field, !=))   \
+    X(NODE_LE, type, boolval, compare(field, <=))   \
+    X(NODE_GE, type, boolval, compare(field, >=))   \
+    X(NODE_LT, type, boolval, compare(field, <))    \
+    X(NODE_GT, type, boolval, compare(field, >))
+
+#define COMPARE_VALUES(field, op)  (lval.field op rval.field)
+#define COMPARE_INTS(field, op)    (Int_isBig(lval.intval) || Int_isBig(rval.intval) ? orderOfBigInts(lval.intval, rval.intval) op 0 : lval.intval op rval.intval)
+#define COMPARE_STRINGS(field, op) (orderOfStrings(lval.strval, rval.strval) op 0)
+
+#endif
@@ -0,0 +1,1671 @@
+#include "opt.h"
+#include "bigint.h"
+#include "ir.h"
+#include "exec.h"
+#include "y.tab.h"
+
+#define CSE_MIN_NODES 5       /* smaller expressions cost less to compute again than to keep in a variable */
+#define HOIST_MIN_NODES 3     /* a variable or a constant is as cheap to read as the variable keeping it */
+#define UNROLL_MAX_TRIPS 8
+#define UNROLL_MAX_NODES 256  /* of all the copies of the body */
+#define REDUCE_MAX_INDICES 32 /* the invariant indices of an element are a mask */
+#define INLINE_MAX_DEPTH 8    /* of copies inlined into copies */
+
+/* Applies what the passes found to the tree */
+typedef struct Rewriter
+{
+    Ir* ir;
+    Routine* routine;
+    bool eliminate_common;
+} Rewriter;
+
+
+
+static bool isScalar(const Type* type)
+{
+    return type->dimensions == 0 && (type->type == INT || type->type == BOOL || type->type == DOUBLE || type->type == CHAR);
+}
+
+static bool isConstant(const IrValue* value)
+{
+    return value != NULL && (value->kind == IR_CONST || value->lattice == IR_CONSTANT);
+}
+
+static bool truthOf(int type, Value value)
+{
+    switch(type)
+    {
+    case INT:    return value.intval != 0;
+    case BOOL:   return value.boolval;
+    case DOUBLE: return value.doubleval != 0;
+    case CHAR:   return value.charval != 0;
+    }
+
+    return false;
+}
+
+static bool sameConstant(int type, Value lval, Value rval)
+{
+    switch(type)
+    {
+    case INT:    return lval.intval == rval.intval;
+    case BOOL:   return lval.boolval == rval.boolval;
+    case DOUBLE: return memcmp(&lval.doubleval, &rval.doubleval, sizeof(double)) == 0;
+    case CHAR:   return lval.charval == rval.charval;
+    }
+
+    return false;
+}
+
+static void dump(const Ir* ir, const char* pass)
+{
+    if(program.ir_dump != NULL)
+        Ir_dump(ir, pass, program.ir_dump);
+}
+
+static void* allocate(Ir* ir, size_t size)
+{
+    return memset(Arena_alloc(&ir->arena, size), 0, size);
+}
+
+
+
+/* Sparse conditional constant propagation, after Wegman and Zadeck.
+ * Values start unknown and only move up to constant and then to varying, blocks start unreachable.
+ * Branches on constants only make their taken edge executable, and phis ignore the operands of edges that are not */
+typedef struct Propagation
+{
+    IrValue* values;
+    IrBlock* blocks;
+} Propagation;
+
+static void pushValue(Propagation* propagation, IrValue* value)
+{
+    if(value->listed)
+        return;
+
+    value->listed = true;
+    value->work = propagation->values;
+    propagation->values = value;
+}
+
+static int evaluateValue(const IrValue* value, Value* result)
+{
+    switch(value->kind)
+    {
+    case IR_CONST:
+        (*result) = value->constant;
+        return IR_CONSTANT;
+
+    case IR_ENTRY:
+    case IR_OPAQUE:
+        return IR_VARYING;
+
+    case IR_COPY:
+        if(value->operands[0]->type != value->type)
+            return IR_VARYING;
+        (*result) = value->operands[0]->constant;
+        return value->operands[0]->lattice;
+
+    case IR_PHI:
+    {
+        int lattice = IR_UNKNOWN;
+        for(int i = 0; i < value->operand_count; ++i)
+        {
+            const IrValue* operand = value->operands[i];
+            if(value->block->edges[i] == false || operand->lattice == IR_UNKNOWN)
+                continue;
+            if(operand->lattice == IR_VARYING || operand->type != value->type
+                || (lattice == IR_CONSTANT && sameConstant(value->type, *result, operand->constant) == false))
+                return IR_VARYING;
+
+            lattice = IR_CONSTANT;
+            (*result) = operand->constant;
+        }
+        return lattice;
+    }
+
+    case IR_OP:
+    case IR_TRUTH:
+        break;
+    }
+
+    for(int i = 0; i < value->operand_count; ++i)
+        if(value->operands[i]->lattice == IR_VARYING)
+            return IR_VARYING;
+    for(int i = 0; i < value->operand_count; ++i)
+        if(value->operands[i]->lattice == IR_UNKNOWN)
+            return IR_UNKNOWN;
+
+    const IrValue* lval = value->operands[0];
+    if(value->kind == IR_TRUTH)
+    {
+        result->boolval = truthOf(lval->type, lval->constant);
+        return IR_CONSTANT;
+    }
+
+    const Value rval = (value->operand_count > 1 ? value->operands[1]->constant : (Value){0});
+    if(Program_compute(value->op, value->type, value->operand_type, lval->constant, rval, result) != 0)
+        return IR_VARYING;
+    return IR_CONSTANT;
+}
+
+static void markEdge(Propagation* propagation, IrBlock* from, IrBlock* to)
+{
+    bool marked = false;
+    for(int i = 0; i < to->predecessor_count; ++i)
+        if(to->predecessors[i] == from && to->edges[i] == false)
+            to->edges[i] = marked = true;
+
+    if(marked == false)
+        return;
+
+    if(to->executable == false)
+    {
+        to->executable = true;
+        to->work = propagation->blocks;
+        propagation->blocks = to;
+    }
+    else
+    {
+        for(IrValue* phi = to->phis; phi != NULL; phi = phi->next)
+            pushValue(propagation, phi);
+    }
+}
+
+static void visitBranch(Propagation* propagation, IrBlock* block)
+{
+    const IrValue* condition = block->condition;
+    if(condition == NULL)
+    {
+        if(block->successors[0] != NULL)
+            markEdge(propagation, block, block->successors[0]);
+    }
+    else if(condition->lattice == IR_CONSTANT)
+        markEdge(propagation, block, block->successors[condition->constant.boolval ? 0 : 1]);
+    else if(condition->lattice == IR_VARYING)
+    {
+        markEdge(propagation, block, block->successors[0]);
+        markEdge(propagation, block, block->successors[1]);
+    }
+}
+
+static void visitValue(Propagation* propagation, IrValue* value)
+{
+    Value result = {0};
+    const int lattice = evaluateValue(value, &result);
+    if(lattice <= value->lattice)
+        return;
+
+    value->lattice = lattice;
+    value->constant = result;
+    for(int i = 0; i < value->user_count; ++i)
+        pushValue(propagation, value->users[i]);
+    if(value->block->condition == value)
+        visitBranch(propagation, value->block);
+}
+
+static void propagateConstants(Ir* ir)
+{
+    Ir_computeUses(ir);
+    for(int i = 0; i < ir->block_count; ++i)
+        ir->blocks[i]->edges = allocate(ir, (ir->blocks[i]->predecessor_count + 1) * sizeof(bool));
+
+    Propagation propagation = {NULL, ir->blocks[0]};
+    ir->blocks[0]->executable = true;
+    while(propagation.blocks != NULL || propagation.values != NULL)
+    {
+        if(propagation.blocks != NULL)
+        {
+            IrBlock* block = propagation.blocks;
+            propagation.blocks = block->work;
+            for(IrValue* value = Ir_firstValue(block); value != NULL; value = Ir_nextValue(block, value))
+                visitValue(&propagation, value);
+            visitBranch(&propagation, block);
+        }
+        else
+        {
+            IrValue* value = propagation.values;
+            propagation.values = value->work;
+            value->listed = false;
+            if(value->block->executable)
+                visitValue(&propagation, value);
+        }
+    }
+
+    ir->executable_known = true;
+}
+
+
+
+/* Copy propagation. A copy is replaced by the value it copies,
+ * and so is a phi whose operands over executable edges are that one value or the phi itself */
+static void propagateCopies(Ir* ir)
+{
+    for(int i = 0; i < ir->block_count; ++i)
+        for(IrValue* value = ir->blocks[i]->first; value != NULL; value = value->next)
+            if(value->kind == IR_COPY && value->operands[0]->type == value->type)
+                value->replacement = value->operands[0];
+
+    for(bool changed = true; changed; )
+    {
+        changed = false;
+        for(int i = 0; i < ir->block_count; ++i)
+        {
+            const IrBlock* block = ir->blocks[i];
+            if(block->executable == false)
+                continue;
+
+            for(IrValue* phi = block->phis; phi != NULL; phi = phi->next)
+            {
+                if(phi->replacement != NULL)
+                    continue;
+
+                IrValue* same = NULL;
+                bool trivial = true;
+                for(int j = 0; j < phi->operand_count && trivial; ++j)
+                {
+                    IrValue* operand = Ir_resolve(phi->operands[j]);
+                    if(block->edges[j] == false || operand == phi || operand == same)
+                        continue;
+                    trivial = (same == NULL);
+                    same = operand;
+                }
+
+                if(trivial && same != NULL && same->type == phi->type)
+                {
+                    phi->replacement = same;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    Ir_computeUses(ir);
+}
+
+
+
+/* Global value numbering over the dominator tree. An operation equal to one that dominates it is replaced by it */
+typedef struct Numbering
+{
+    IrValue** buckets;
+    size_t capacity;
+    IrValue** scope;  /* values entered in the table, removed when the walk leaves the block that added them */
+    int size;
+} Numbering;
+
+static size_t hashValue(const Numbering* numbering, const IrValue* value)
+{
+    uint64_t hash = HASH_INIT;
+    const int key[] = {value->kind, value->op, value->type, value->operand_type};
+    hash = hashBytes(key, sizeof(key), hash);
+    for(int i = 0; i < value->operand_count; ++i)
+        hash = hashBytes(&value->operands[i]->id, sizeof(int), hash);
+    return hash & (numbering->capacity - 1);
+}
+
+static bool sameValue(const IrValue* lval, const IrValue* rval)
+{
+    if(lval->kind != rval->kind || lval->op != rval->op || lval->type != rval->type || lval->operand_type != rval->operand_type
+        || lval->operand_count != rval->operand_count)
+        return false;
+
+    for(int i = 0; i < lval->operand_count; ++i)
+        if(lval->operands[i] != rval->operands[i])
+            return false;
+    return true;
+}
+
+static void numberBlock(Numbering* numbering, IrBlock* block)
+{
+    const int base = numbering->size;
+    for(IrValue* value = block->first; value != NULL; value = value->next)
+    {
+        if((value->kind != IR_OP && value->kind != IR_TRUTH) || value->lattice == IR_CONSTANT || value->replacement != NULL)
+            continue;
+
+        for(int i = 0; i < value->operand_count; ++i)
+            value->operands[i] = Ir_resolve(value->operands[i]);
+
+        const size_t hash = hashValue(numbering, value);
+        IrValue* other = numbering->buckets[hash];
+        while(other != NULL && sameValue(other, value) == false)
+            other = other->work;
+
+        if(other != NULL)
+            value->replacement = other;
+        else
+        {
+            value->work = numbering->buckets[hash];
+            numbering->buckets[hash] = value;
+            numbering->scope[numbering->size++] = value;
+        }
+    }
+
+    for(IrBlock* child = block->children; child != NULL; child = child->sibling)
+        numberBlock(numbering, child);
+
+    while(numbering->size > base)
+    {
+        IrValue* value = numbering->scope[--numbering->size];
+        numbering->buckets[hashValue(numbering, value)] = value->work;
+    }
+}
+
+static void numberValues(Ir* ir)
+{
+    Ir_computeDominators(ir);
+
+    Numbering numbering = {NULL, 16, NULL, 0};
+    while(numbering.capacity < 2 * (size_t)ir->value_count)
+        numbering.capacity *= 2;
+    numbering.buckets = allocate(ir, numbering.capacity * sizeof(numbering.buckets[0]));
+    numbering.scope = allocate(ir, (ir->value_count + 1) * sizeof(numbering.scope[0]));
+
+    numberBlock(&numbering, ir->blocks[0]);
+    Ir_computeUses(ir);
+}
+
+
+
+/* Dead code elimination. Whatever the program can observe is live, and so is every value it needs.
+ * Stores to globals are observable, stores to locals only through the reads that use them.
+ * Divisions that may stop the program at a zero divisor are observable too */
+static bool mayFail(const IrValue* value)
+{
+    if(value->kind != IR_OP || (value->type != INT && value->type != CHAR))
+        return false;
+    if(value->op != NODE_DIV && value->op != NODE_MOD && value->op != NODE_DIV_ASSIGN && value->op != NODE_MOD_ASSIGN)
+        return false;
+
+    const IrValue* divisor = value->operands[1];
+    if(divisor->kind != IR_CONST)
+        return true;
+    return (value->type == CHAR ? divisor->constant.charval == 0 : divisor->constant.intval == 0);
+}
+
+static void markLive(IrValue* value, IrValue** work)
+{
+    if(value == NULL || value->live)
+        return;
+
+    value->live = true;
+    value->work = (*work);
+    (*work) = value;
+}
+
+static void eliminateDeadCode(Ir* ir)
+{
+    IrValue* work = NULL;
+    for(int i = 0; i < ir->block_count; ++i)
+    {
+        IrBlock* block = ir->blocks[i];
+        markLive(block->condition, &work);
+        for(IrValue* value = Ir_firstValue(block); value != NULL; value = Ir_nextValue(block, value))
+            if(value->kind == IR_OPAQUE || mayFail(value) || (value->kind == IR_COPY && ir->variables[value->variable].global))
+                markLive(value, &work);
+    }
+
+    while(work != NULL)
+    {
+        IrValue* value = work;
+        work = value->work;
+        for(int i = 0; i < value->operand_count; ++i)
+            markLive(value->operands[i], &work);
+    }
+
+    ir->live_known = true;
+}
+
+
+
+/* Expressions the program can skip: no effects, and no runtime error unless the IR shows the divisor is never zero */
+static bool isNonZero(const Ir* ir, const Node* node)
+{
+    Value value;
+    const IrNode* info = Ir_findNode(ir, node);
+    if(node->op == NODE_CONST)
+        value = node->value;
+    else if(info != NULL && isConstant(info->value) && info->value->type == node->type.type)
+        value = info->value->constant;
+    else
+        return false;
+
+    return (node->type.type == CHAR ? value.charval != 0 : value.intval != 0);
+}
+
+static bool isPure(const Ir* ir, const Node* node)
+{
+    switch(node->op)
+    {
+    case NODE_INDEX:
+    case NODE_REDUCED_INDEX:
+    case NODE_FIELD:
+    case NODE_CALL:
+    case NODE_BUILTIN:
+    case NODE_INLINE:
+        return false;
+
+    case NODE_GLOBAL:
+    case NODE_LOCAL:
+        return node->type.type != CLASS || node->type.dimensions != 0;
+
+    case NODE_DIV:
+    case NODE_MOD:
+        if((node->type.type == INT || node->type.type == CHAR) && isNonZero(ir, node->operands[1]) == false)
+            return false;
+        break;
+
+    default:
+        if(node->op >= NODE_ASSIGN && node->op <= NODE_POSTDEC)
+            return false;
+        break;
+    }
+
+    for(int i = 0; i < 4; ++i)
+        for(const Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            if(isPure(ir, operand) == false)
+                return false;
+    return true;
+}
+
+static int countNodes(const Node* node)
+{
+    int count = 1;
+    for(int i = 0; i < 4; ++i)
+        for(const Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            count += countNodes(operand);
+    return count;
+}
+
+/* The nodes of a subtree leave the program */
+static void killNodes(const Ir* ir, const Node* node)
+{
+    IrNode* info = Ir_findNode(ir, node);
+    if(info != NULL)
+        info->alive = false;
+
+    for(int i = 0; i < 4; ++i)
+        for(const Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            killNodes(ir, operand);
+}
+
+static void clearOperands(Node* node)
+{
+    memset(node->operands, 0, sizeof(node->operands));
+    node->count = 0;
+}
+
+/* The node becomes a read of a variable */
+static void readVariable(Node* node, const Node* variable)
+{
+    clearOperands(node);
+    node->op = variable->op;
+    node->slot = variable->slot;
+    node->name = variable->name;
+}
+
+/* Returns a copy of the node, which is left without operands to be replaced */
+static Node* moveNode(Node* node)
+{
+    Node* copy = Node_create(node->op, &node->type, NULL, NULL, NULL, NULL);
+    (*copy) = (*node);
+    copy->next = NULL;
+    clearOperands(node);
+    return copy;
+}
+
+/* New variable of the optimizer: a local of the routine, or a global for top-level code */
+static Node* newTemporary(const char* name, Routine* routine, const Type* type, const YYLTYPE* location)
+{
+    Node* variable = Node_create((routine != NULL ? NODE_LOCAL : NODE_GLOBAL), type, NULL, NULL, NULL, NULL);
+    variable->location = (*location);
+    variable->name = "temporary";
+    if(routine == NULL)
+        variable->slot = Program_addGlobal(type);
+    else
+    {
+        Type copy = (*type);
+        if(TypeList_insert(&routine->slots, &copy) != 0)
+        {
+            yyerror("not enough memory to optimize %s", name);
+            abort();
+        }
+        variable->slot = routine->slots.size - 1;
+    }
+
+    return variable;
+}
+
+
+
+/* Common subexpressions. The first computation of a value keeps it in a new variable and the redundant ones read that */
+static IrNode* findLeader(const Ir* ir, const IrNode* info)
+{
+    IrValue* value = info->value;
+    IrValue* leader = Ir_resolve(value);
+    if(value->kind != IR_OP || leader == value || leader->kind != IR_OP || leader->node == NULL)
+        return NULL;
+
+    IrNode* source = Ir_findNode(ir, leader->node);
+    return (source != NULL && source->value == leader ? source : NULL);
+}
+
+static bool isRedundant(const Ir* ir, const IrNode* info)
+{
+    const Node* node = info->node;
+    return info->block == NULL && info->value != NULL && isScalar(&node->type) && isPure(ir, node) && countNodes(node) >= CSE_MIN_NODES;
+}
+
+static void markNeeded(Ir* ir)
+{
+    for(size_t i = 0; i < ir->node_capacity; ++i)
+    {
+        const IrNode* info = &ir->nodes[i];
+        if(info->node == NULL || info->value == NULL || isRedundant(ir, info) == false)
+            continue;
+
+        IrNode* source = findLeader(ir, info);
+        if(source != NULL)
+            source->needed = true;
+    }
+}
+
+static bool reuseValue(Rewriter* rewriter, Node* node, const IrNode* info)
+{
+    const IrNode* source = findLeader(rewriter->ir, info);
+    if(source == NULL || source->alive == false || source->temporary == NULL || isRedundant(rewriter->ir, info) == false)
+        return false;
+
+    killNodes(rewriter->ir, node);
+    readVariable(node, source->temporary);
+    return true;
+}
+
+static void keepValue(Rewriter* rewriter, Node* node, IrNode* info)
+{
+    Node* variable = newTemporary(rewriter->ir->name, rewriter->routine, &node->type, &node->location);
+    Node* computation = moveNode(node);
+    node->op = NODE_ASSIGN;
+    node->operands[0] = variable;
+    node->operands[1] = computation;
+    info->temporary = variable;
+}
+
+
+
+static void rewriteExpression(Rewriter* rewriter, Node* node)
+{
+    IrNode* info = Ir_findNode(rewriter->ir, node);
+    if(info != NULL && info->value != NULL && node->op != NODE_CONST)
+    {
+        const IrValue* value = info->value;
+        if(isConstant(value) && isScalar(&node->type) && value->type == node->type.type && isPure(rewriter->ir, node))
+        {
+            killNodes(rewriter->ir, node);
+            clearOperands(node);
+            node->op = NODE_CONST;
+            node->value = value->constant;
+            node->name = NULL;
+            return;
+        }
+
+        if(rewriter->eliminate_common && reuseValue(rewriter, node, info))
+            return;
+
+        if(info->copy_of >= 0)
+        {
+            const IrVariable* var = &rewriter->ir->variables[info->copy_of];
+            node->op = (var->global ? NODE_GLOBAL : NODE_LOCAL);
+            node->slot = var->slot;
+            node->name = var->name;
+        }
+    }
+
+    /* Children in the order they run, so that the first computation of a value is met before those reusing it */
+    if(node->op >= NODE_ASSIGN && node->op <= NODE_MOD_ASSIGN)
+    {
+        rewriteExpression(rewriter, node->operands[1]);
+        rewriteExpression(rewriter, node->operands[0]);
+    }
+    else if((node->op == NODE_CALL || node->op == NODE_INLINE) && node->routine->method)
+    {
+        for(Node* argument = node->operands[0]->next; argument != NULL; argument = argument->next)
+            rewriteExpression(rewriter, argument);
+        rewriteExpression(rewriter, node->operands[0]);
+        if(node->operands[1] != NULL)
+            rewriteExpression(rewriter, node->operands[1]);
+    }
+    else
+    {
+        for(int i = 0; i < 4; ++i)
+            for(Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+                rewriteExpression(rewriter, operand);
+    }
+
+    if(info != NULL && info->needed && info->alive)
+        keepValue(rewriter, node, info);
+}
+
+/* Whether a loop or an if statement always goes the same way */
+static bool knownCondition(const Rewriter* rewriter, const Node* node, const Node* condition, bool* truth)
+{
+    const IrNode* info = Ir_findNode(rewriter->ir, node);
+    if(info == NULL || isConstant(info->value) == false || isPure(rewriter->ir, condition) == false)
+        return false;
+
+    (*truth) = info->value->constant.boolval;
+    return true;
+}
+
+/* Whether a switch always runs the same case, which is NULL when it runs none */
+static bool knownCase(const Rewriter* rewriter, const Node* node, Node** selected)
+{
+    const Node* selector = node->operands[0];
+    const IrNode* info = Ir_findNode(rewriter->ir, selector);
+    if(info == NULL || isConstant(info->value) == false || isPure(rewriter->ir, selector) == false)
+        return false;
+
+    const Value value = info->value->constant;
+    if(selector->type.type == INT && Int_isBig(value.intval))
+        return false;
+
+    (*selected) = (Node*)SwitchTable_find(node->table, (selector->type.type == CHAR ? value.charval : value.intval));
+    return true;
+}
+
+/* A statement reduced to one of its parts becomes a block holding it */
+static Node* replaceStatement(Node* node, Node* statement)
+{
+    if(statement == NULL)
+        return NULL;
+
+    clearOperands(node);
+    node->op = NODE_BLOCK;
+    node->operands[0] = statement;
+    return node;
+}
+
+static Node* rewriteList(Rewriter* rewriter, Node* first);
+
+/* Returns the statement, or NULL if it was removed */
+static Node* rewriteStatement(Rewriter* rewriter, Node* node)
+{
+    if(node == NULL)
+        return NULL;
+
+    const IrNode* info = Ir_findNode(rewriter->ir, node);
+    if(info != NULL && info->block != NULL && info->block->executable == false)
+    {
+        killNodes(rewriter->ir, node);
+        return NULL;
+    }
+
+    bool truth;
+    switch(node->op)
+    {
+    case NODE_EXP:
+        rewriteExpression(rewriter, node->operands[0]);
+        break;
+
+    case NODE_PRINT:
+    case NODE_RETURN:
+        if(node->operands[0] != NULL)
+            rewriteExpression(rewriter, node->operands[0]);
+        break;
+
+    case NODE_DECL:
+        if(node->operands[1] != NULL)
+            rewriteExpression(rewriter, node->operands[1]);
+        break;
+
+    case NODE_BLOCK:
+        node->operands[0] = rewriteList(rewriter, node->operands[0]);
+        break;
+
+    case NODE_IF:
+        if(knownCondition(rewriter, node, node->operands[0], &truth))
+        {
+            killNodes(rewriter->ir, node->operands[0]);
+            if(node->operands[truth ? 2 : 1] != NULL)
+                killNodes(rewriter->ir, node->operands[truth ? 2 : 1]);
+            return replaceStatement(node, rewriteStatement(rewriter, node->operands[truth ? 1 : 2]));
+        }
+
+        rewriteExpression(rewriter, node->operands[0]);
+        node->operands[1] = rewriteStatement(rewriter, node->operands[1]);
+        node->operands[2] = rewriteStatement(rewriter, node->operands[2]);
+        break;
+
+    case NODE_SWITCH:
+    {
+        Node* selected;
+        if(knownCase(rewriter, node, &selected))
+        {
+            killNodes(rewriter->ir, node->operands[0]);
+            for(Node* target = node->operands[1]; target != NULL; target = target->next)
+                if(target != selected)
+                    killNodes(rewriter->ir, target);
+            return replaceStatement(node, (selected != NULL ? rewriteList(rewriter, selected->operands[1]) : NULL));
+        }
+
+        rewriteExpression(rewriter, node->operands[0]);
+        for(Node* target = node->operands[1]; target != NULL; target = target->next)
+            target->operands[1] = rewriteList(rewriter, target->operands[1]);
+        break;
+    }
+
+    case NODE_WHILE:
+        if(knownCondition(rewriter, node, node->operands[0], &truth) && truth == false)
+        {
+            killNodes(rewriter->ir, node);
+            return NULL;
+        }
+
+        rewriteExpression(rewriter, node->operands[0]);
+        node->operands[1] = rewriteStatement(rewriter, node->operands[1]);
+        break;
+
+    case NODE_DO:
+    {
+        Node* body = rewriteStatement(rewriter, node->operands[1]);
+        if(knownCondition(rewriter, node, node->operands[0], &truth) && truth == false)
+        {
+            killNodes(rewriter->ir, node->operands[0]);
+            return replaceStatement(node, body);
+        }
+
+        node->operands[1] = body;
+        rewriteExpression(rewriter, node->operands[0]);
+        break;
+    }
+
+    case NODE_FOR:
+    {
+        Node* init = rewriteStatement(rewriter, node->operands[0]);
+        if(knownCondition(rewriter, node, node->operands[1], &truth) && truth == false)
+        {
+            for(int i = 1; i < 4; ++i)
+                if(node->operands[i] != NULL)
+                    killNodes(rewriter->ir, node->operands[i]);
+            return replaceStatement(node, init);
+        }
+
+        node->operands[0] = init;
+        rewriteExpression(rewriter, node->operands[1]);
+        node->operands[3] = rewriteStatement(rewriter, node->operands[3]);
+        node->operands[2] = rewriteStatement(rewriter, node->operands[2]);
+        break;
+    }
+    }
+
+    return node;
+}
+
+static Node* rewriteList(Rewriter* rewriter, Node* first)
+{
+    Node** link = &first;
+    while((*link) != NULL)
+    {
+        Node* node = (*link);
+        if(rewriteStatement(rewriter, node) == NULL)
+            (*link) = node->next;
+        else
+            link = &node->next;
+    }
+
+    return first;
+}
+
+
+
+/* Statements left without effect once dead values are known */
+static bool isDeadStore(const Ir* ir, const Node* node)
+{
+    const IrNode* info = Ir_findNode(ir, node);
+    return info != NULL && info->store != NULL && info->store->live == false && ir->variables[info->store->variable].global == false;
+}
+
+static Node* sweepList(const Ir* ir, Node* first);
+
+static Node* sweepStatement(const Ir* ir, Node* node)
+{
+    if(node == NULL)
+        return NULL;
+
+    switch(node->op)
+    {
+    case NODE_EXP:
+    {
+        Node* exp = node->operands[0];
+        const bool division = ((exp->op == NODE_DIV_ASSIGN || exp->op == NODE_MOD_ASSIGN) && (exp->type.type == INT || exp->type.type == CHAR));
+        if(exp->op >= NODE_ASSIGN && exp->op <= NODE_POSTDEC && division == false && isDeadStore(ir, exp))
+        {
+            if(exp->op >= NODE_PREINC)
+                return NULL;
+            node->operands[0] = exp = exp->operands[1];
+        }
+
+        return (isPure(ir, exp) ? NULL : node);
+    }
+
+    case NODE_DECL:
+        if(isDeadStore(ir, node))
+        {
+            Node* exp = node->operands[1];
+            if(exp == NULL || isPure(ir, exp))
+                return NULL;
+
+            clearOperands(node);
+            node->op = NODE_EXP;
+            node->type = exp->type;
+            node->operands[0] = exp;
+        }
+        return node;
+
+    case NODE_BLOCK:
+        node->operands[0] = sweepList(ir, node->operands[0]);
+        return node;
+
+    case NODE_IF:
+        node->operands[1] = sweepStatement(ir, node->operands[1]);
+        node->operands[2] = sweepStatement(ir, node->operands[2]);
+        return node;
+
+    case NODE_WHILE:
+    case NODE_DO:
+        node->operands[1] = sweepStatement(ir, node->operands[1]);
+        return node;
+
+    case NODE_SWITCH:
+        for(Node* target = node->operands[1]; target != NULL; target = target->next)
+            target->operands[1] = sweepList(ir, target->operands[1]);
+        return node;
+
+    case NODE_FOR:
+        node->operands[0] = sweepStatement(ir, node->operands[0]);
+        node->operands[2] = sweepStatement(ir, node->operands[2]);
+        node->operands[3] = sweepStatement(ir, node->operands[3]);
+        return node;
+    }
+
+    return node;
+}
+
+static Node* sweepList(const Ir* ir, Node* first)
+{
+    Node** link = &first;
+    while((*link) != NULL)
+    {
+        Node* node = (*link);
+        if(sweepStatement(ir, node) == NULL)
+            (*link) = node->next;
+        else
+            link = &node->next;
+    }
+
+    return first;
+}
+
+
+
+/* Loops. A pass visits every FOR, WHILE and DO statement knowing how many times its condition, step and body assign every variable.
+ * Statements that must run before or after the loop go with it into a block that takes its place in the tree */
+typedef struct Loop
+{
+    Node* node;
+    Node* entry;         /* block around the loop, NULL until something runs before or after it */
+    int* locals;         /* assignments by slot */
+    int* globals;
+    int local_count;
+    int global_count;
+    bool calls;          /* calls and imports may assign any global */
+} Loop;
+
+typedef struct LoopPass
+{
+    Ir* ir;
+    Routine* routine;
+    bool (*visit)(struct LoopPass* pass, Loop* loop);  /* returns whether it changed the loop */
+    bool inner_first;
+    int changes;
+} LoopPass;
+
+
+
+static Node* bodyOf(const Node* loop)
+{
+    return loop->operands[loop->op == NODE_FOR ? 3 : 1];
+}
+
+static Node* conditionOf(const Node* loop)
+{
+    return loop->operands[loop->op == NODE_FOR ? 1 : 0];
+}
+
+static bool sameVariable(const Node* lval, const Node* rval)
+{
+    return (lval->op == NODE_LOCAL || lval->op == NODE_GLOBAL) && lval->op == rval->op && lval->slot == rval->slot;
+}
+
+/* Deep copy of a subtree, for the copies of an unrolled body */
+static Node* cloneNode(const Node* node)
+{
+    Node* copy = Node_create(node->op, &node->type, NULL, NULL, NULL, NULL);
+    (*copy) = (*node);
+    copy->next = NULL;
+
+    for(int i = 0; i < 4; ++i)
+    {
+        Node** link = &copy->operands[i];
+        for(const Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+        {
+            (*link) = cloneNode(operand);
+            link = &(*link)->next;
+        }
+    }
+
+    /* The table of a switch points to its cases */
+    if(copy->op == NODE_SWITCH)
+        Node_compileSwitch(copy, NULL);
+
+    return copy;
+}
+
+static Node* newStatement(const Loop* loop, Node* exp)
+{
+    Node* statement = Node_create(NODE_EXP, &exp->type, exp, NULL, NULL, NULL);
+    statement->location = exp->location = loop->node->location;
+    return statement;
+}
+
+static void countAssignment(Loop* loop, NodeOp op, int slot)
+{
+    if(op == NODE_LOCAL && slot < loop->local_count)
+        ++loop->locals[slot];
+    else if(op == NODE_GLOBAL && slot < loop->global_count)
+        ++loop->globals[slot];
+}
+
+static void countAssignments(Loop* loop, const Node* node)
+{
+    if((node->op >= NODE_ASSIGN && node->op <= NODE_POSTDEC) || node->op == NODE_DECL || node->op == NODE_DECL_ARRAY)
+        countAssignment(loop, node->operands[0]->op, node->operands[0]->slot);
+    else if(node->op == NODE_INLINE)
+        for(int i = 0; i < node->routine->param_count; ++i)
+            countAssignment(loop, node->operands[2]->op, node->operands[2]->slot + i);
+    else if(node->op == NODE_CALL || node->op == NODE_IMPORT)
+        loop->calls = true;
+
+    for(int i = 0; i < 4; ++i)
+        for(const Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            countAssignments(loop, operand);
+}
+
+static void initLoop(LoopPass* pass, Loop* loop, Node* node)
+{
+    loop->node = node;
+    loop->entry = NULL;
+    loop->local_count = (pass->routine != NULL ? pass->routine->slots.size : 0);
+    loop->global_count = program.globals.size;
+    loop->locals = allocate(pass->ir, (loop->local_count + 1) * sizeof(int));
+    loop->globals = allocate(pass->ir, (loop->global_count + 1) * sizeof(int));
+    loop->calls = false;
+
+    /* The initialization of a FOR loop runs once, before it */
+    for(int i = (node->op == NODE_FOR ? 1 : 0); i < 4; ++i)
+        if(node->operands[i] != NULL)
+            countAssignments(loop, node->operands[i]);
+}
+
+/* Assignments of a variable in the loop, or -1 if calls may assign it or the loop was visited before it existed */
+static int assignmentsOf(const Loop* loop, const Node* variable)
+{
+    if(variable->op == NODE_LOCAL && variable->slot < loop->local_count)
+        return loop->locals[variable->slot];
+    if(variable->op == NODE_GLOBAL && variable->slot < loop->global_count && loop->calls == false)
+        return loop->globals[variable->slot];
+    return -1;
+}
+
+/* Scalar expressions that compute the same value in every iteration */
+static bool isInvariant(const Loop* loop, const Node* node)
+{
+    if(isScalar(&node->type) == false)
+        return false;
+
+    switch(node->op)
+    {
+    case NODE_CONST:
+        return true;
+
+    case NODE_GLOBAL:
+    case NODE_LOCAL:
+        return assignmentsOf(loop, node) == 0;
+    }
+
+    if(node->op < NODE_ADD || node->op > NODE_GT)
+        return false;
+
+    for(int i = 0; i < 2; ++i)
+        if(node->operands[i] != NULL && isInvariant(loop, node->operands[i]) == false)
+            return false;
+    return true;
+}
+
+/* The loop moves into a new node, and its node becomes a block running the initialization of a FOR loop and then the loop */
+static void wrapLoop(Loop* loop)
+{
+    if(loop->entry != NULL)
+        return;
+
+    Node* node = loop->node;
+    Node* moved = Node_create(node->op, &node->type, NULL, NULL, NULL, NULL);
+    (*moved) = (*node);
+    moved->next = NULL;
+
+    Node* first = moved;
+    if(moved->op == NODE_FOR && moved->operands[0] != NULL)
+    {
+        first = moved->operands[0];
+        first->next = moved;
+        moved->operands[0] = NULL;
+    }
+
+    clearOperands(node);
+    node->op = NODE_BLOCK;
+    node->operands[0] = first;
+    loop->entry = node;
+    loop->node = moved;
+}
+
+static void addBeforeLoop(Loop* loop, Node* statement)
+{
+    wrapLoop(loop);
+
+    Node** link = &loop->entry->operands[0];
+    while((*link) != loop->node)
+        link = &(*link)->next;
+    statement->next = loop->node;
+    (*link) = statement;
+}
+
+static void addAfterLoop(Loop* loop, Node* statement)
+{
+    wrapLoop(loop);
+    statement->next = loop->node->next;
+    loop->node->next = statement;
+}
+
+static void visitStatement(LoopPass* pass, Node* node);
+
+static void visitLoop(LoopPass* pass, Node* node)
+{
+    if(pass->inner_first)
+        visitStatement(pass, bodyOf(node));
+
+    Loop loop;
+    initLoop(pass, &loop, node);
+    if(pass->visit(pass, &loop))
+        ++pass->changes;
+
+    if(pass->inner_first == false && (loop.node->op == NODE_FOR || loop.node->op == NODE_WHILE || loop.node->op == NODE_DO))
+        visitStatement(pass, bodyOf(loop.node));
+}
+
+static void visitStatement(LoopPass* pass, Node* node)
+{
+    if(node == NULL)
+        return;
+
+    switch(node->op)
+    {
+    case NODE_BLOCK:
+        for(Node* statement = node->operands[0]; statement != NULL; statement = statement->next)
+            visitStatement(pass, statement);
+        break;
+
+    case NODE_IF:
+        visitStatement(pass, node->operands[1]);
+        visitStatement(pass, node->operands[2]);
+        break;
+
+    case NODE_SWITCH:
+        for(Node* target = node->operands[1]; target != NULL; target = target->next)
+            for(Node* statement = target->operands[1]; statement != NULL; statement = statement->next)
+                visitStatement(pass, statement);
+        break;
+
+    case NODE_WHILE:
+    case NODE_DO:
+    case NODE_FOR:
+        visitLoop(pass, node);
+        break;
+    }
+}
+
+static int runLoopPass(Ir* ir, Routine* routine, Node* code, bool (*visit)(LoopPass*, Loop*), bool inner_first)
+{
+    LoopPass pass = {ir, routine, visit, inner_first, 0};
+    for(Node* statement = code; statement != NULL; statement = statement->next)
+        visitStatement(&pass, statement);
+    return pass.changes;
+}
+
+
+
+/* Induction variables: an INT variable that a statement steps by a constant at the end of every iteration */
+static Node* findStep(const Node* statement, long* delta)
+{
+    if(statement == NULL || statement->op != NODE_EXP)
+        return NULL;
+
+    const Node* exp = statement->operands[0];
+    switch(exp->op)
+    {
+    case NODE_PREINC:
+    case NODE_POSTINC:
+        (*delta) = 1;
+        break;
+
+    case NODE_PREDEC:
+    case NODE_POSTDEC:
+        (*delta) = -1;
+        break;
+
+    case NODE_ADD_ASSIGN:
+    case NODE_SUB_ASSIGN:
+        if(exp->operands[1]->op != NODE_CONST)
+            return NULL;
+        (*delta) = exp->operands[1]->value.intval;
+        if(exp->op == NODE_SUB_ASSIGN)
+            (*delta) = (long)(0ul - (unsigned long)(*delta));
+        break;
+
+    default:
+        return NULL;
+    }
+
+    Node* variable = exp->operands[0];
+    if((variable->op != NODE_LOCAL && variable->op != NODE_GLOBAL) || variable->type.type != INT || variable->type.dimensions != 0)
+        return NULL;
+    return variable;
+}
+
+static Node* lastStatement(Node* body, Node** previous)
+{
+    (*previous) = NULL;
+    if(body == NULL || body->op != NODE_BLOCK)
+        return body;
+
+    Node* last = body->operands[0];
+    while(last != NULL && last->next != NULL)
+    {
+        (*previous) = last;
+        last = last->next;
+    }
+
+    return last;
+}
+
+/* The statement that ends every iteration: the step of a FOR loop and the last statement of the body of the others,
+ * and the statement that runs right before it */
+static Node* stepOf(const Loop* loop, Node** previous)
+{
+    Node* last = lastStatement(bodyOf(loop->node), previous);
+    if(loop->node->op != NODE_FOR)
+        return last;
+
+    (*previous) = last;
+    return loop->node->operands[2];
+}
+
+/* Constant value of a variable when the loop starts, from the phi of the block that runs first in every iteration */
+static bool entryConstant(const Ir* ir, const Node* loop, const Node* variable, long* value)
+{
+    const IrNode* info = Ir_findNode(ir, loop);
+    const int index = Ir_findVariable(ir, variable);
+    if(info == NULL || info->block == NULL || info->block->condition != NULL || info->block->successors[0] == NULL || index < 0)
+        return false;
+
+    const IrValue* entry = Ir_entryValue(info->block->successors[0], index);
+    if(isConstant(entry) == false || entry->type != INT)
+        return false;
+
+    (*value) = entry->constant.intval;
+    return true;
+}
+
+
+
+/* Unrolling. A loop whose condition compares its induction variable with a constant, and that starts it at a constant,
+ * runs a number of iterations known here. When few and small, the body is copied that many times and the loop goes away */
+static int countTrips(NodeOp op, long start, long bound, long delta, bool test_first)
+{
+    Value value = {.intval = start};
+    for(int trips = 0; trips <= UNROLL_MAX_TRIPS; ++trips)
+    {
+        Value truth;
+        if((test_first || trips > 0) && (Program_compute(op, BOOL, INT, value, (Value){.intval = bound}, &truth) != 0 || truth.boolval == false))
+            return trips;
+        if(Program_compute(NODE_ADD_ASSIGN, INT, INT, value, (Value){.intval = delta}, &value) != 0)
+            return -1;
+    }
+
+    return -1;
+}
+
+static bool unrollLoop(LoopPass* pass, Loop* loop)
+{
+    Node* node = loop->node;
+    Node* previous;
+    long delta;
+    long start;
+    Node* step = stepOf(loop, &previous);
+    const Node* variable = findStep(step, &delta);
+    const Node* condition = conditionOf(node);
+    if(variable == NULL || assignmentsOf(loop, variable) != 1 || condition == NULL || condition->op < NODE_EQ || condition->op > NODE_GT)
+        return false;
+
+    NodeOp op = condition->op;
+    const Node* lval = condition->operands[0];
+    const Node* rval = condition->operands[1];
+    if(rval->op != NODE_CONST)
+    {
+        const Node* swap = lval;
+        lval = rval;
+        rval = swap;
+        if(op == NODE_LT || op == NODE_GT)
+            op = (op == NODE_LT ? NODE_GT : NODE_LT);
+        else if(op == NODE_LE || op == NODE_GE)
+            op = (op == NODE_LE ? NODE_GE : NODE_LE);
+    }
+
+    if(sameVariable(lval, variable) == false || rval->op != NODE_CONST || rval->type.type != INT
+        || entryConstant(pass->ir, node, variable, &start) == false)
+        return false;
+
+    Node* body = bodyOf(node);
+    const int trips = countTrips(op, start, rval->value.intval, delta, node->op != NODE_DO);
+    const int size = (body != NULL ? countNodes(body) : 0) + (node->op == NODE_FOR ? countNodes(step) : 0);
+    if(trips < 0 || trips * size > UNROLL_MAX_NODES)
+        return false;
+
+    Node* first = (node->op == NODE_FOR ? node->operands[0] : NULL);
+    Node** link = (first != NULL ? &first->next : &first);
+    for(int i = 0; i < trips; ++i)
+    {
+        if(body != NULL)
+        {
+            (*link) = cloneNode(body);
+            link = &(*link)->next;
+        }
+        if(node->op == NODE_FOR)
+        {
+            (*link) = cloneNode(step);
+            link = &(*link)->next;
+        }
+    }
+
+    clearOperands(node);
+    node->op = NODE_BLOCK;
+    node->operands[0] = first;
+    return true;
+}
+
+
+
+/* Redundant induction variables. A local stepped right before the induction variable, by the same constant,
+ * stays at the difference of their values when the loop started. Ints do not wrap, so this holds whatever values they reach,
+ * as long as the difference is a small int itself.
+ * The loop reads it as the induction variable plus that difference, and it is set once after the loop */
+static Node* valueAfter(const Node* induction, long difference)
+{
+    Node* value = cloneNode(induction);
+    if(difference == 0)
+        return value;
+
+    Node* sum = Node_create(NODE_ADD, &induction->type, value, Node_constant(&Type_int, &difference), NULL, NULL);
+    sum->location = induction->location;
+    return sum;
+}
+
+static void replaceReads(Node* node, const Node* variable, const Node* induction, long difference)
+{
+    if(sameVariable(node, variable))
+    {
+        Node* value = valueAfter(induction, difference);
+        value->next = node->next;
+        (*node) = (*value);
+        return;
+    }
+
+    for(int i = 0; i < 4; ++i)
+        for(Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            replaceReads(operand, variable, induction, difference);
+}
+
+static void removeStatement(Node* body, Node* statement)
+{
+    if(body == statement)
+    {
+        clearOperands(body);
+        body->op = NODE_BLOCK;
+        return;
+    }
+
+    Node** link = &body->operands[0];
+    while((*link) != statement)
+        link = &(*link)->next;
+    (*link) = statement->next;
+}
+
+static bool mergeInductions(LoopPass* pass, Loop* loop)
+{
+    Node* previous;
+    long delta;
+    long other_delta;
+    long start;
+    long other_start;
+    const Node* induction = findStep(stepOf(loop, &previous), &delta);
+    Node* variable = findStep(previous, &other_delta);
+    if(induction == NULL || variable == NULL || variable->op != NODE_LOCAL || other_delta != delta || sameVariable(induction, variable)
+        || assignmentsOf(loop, induction) != 1 || assignmentsOf(loop, variable) != 1
+        || entryConstant(pass->ir, loop->node, induction, &start) == false
+        || entryConstant(pass->ir, loop->node, variable, &other_start) == false)
+        return false;
+
+    long difference;
+    if(__builtin_sub_overflow(other_start, start, &difference) || Int_isBig(difference))
+        return false;
+
+    Node* body = bodyOf(loop->node);
+    removeStatement(body, previous);
+    for(int i = (loop->node->op == NODE_FOR ? 1 : 0); i < 4; ++i)
+        if(loop->node->operands[i] != NULL)
+            replaceReads(loop->node->operands[i], variable, induction, difference);
+
+    Node* assignment = Node_create(NODE_ASSIGN, &variable->type, cloneNode(variable), valueAfter(induction, difference), NULL, NULL);
+    addAfterLoop(loop, newStatement(loop, assignment));
+    return true;
+}
+
+
+
+/* Invariant code motion. The largest invariant expressions of the loop are computed once before it, into new variables */
+static int hoistExpression(LoopPass* pass, Loop* loop, Node* node)
+{
+    if(isInvariant(loop, node) && countNodes(node) >= HOIST_MIN_NODES && isPure(pass->ir, node))
+    {
+        Node* variable = newTemporary(pass->ir->name, pass->routine, &node->type, &node->location);
+        Node* computation = moveNode(node);
+        readVariable(node, variable);
+        addBeforeLoop(loop, newStatement(loop, Node_create(NODE_ASSIGN, &variable->type, variable, computation, NULL, NULL)));
+        return 1;
+    }
+
+    int count = 0;
+    for(int i = 0; i < 4; ++i)
+        for(Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            count += hoistExpression(pass, loop, operand);
+    return count;
+}
+
+static bool hoistInvariants(LoopPass* pass, Loop* loop)
+{
+    int count = 0;
+    Node* node = loop->node;
+    for(int i = (node->op == NODE_FOR ? 1 : 0); i < 4; ++i)
+        if(node->operands[i] != NULL)
+            count += hoistExpression(pass, loop, node->operands[i]);
+    return count > 0;
+}
+
+
+
+/* Strength reduction of indexing. An element of an array that the loop does not assign, some of whose indices are invariant,
+ * keeps the part of its offset that those indices give in a new variable, computed in the first iteration after every entry to the loop.
+ * The following iterations only evaluate and check the other indices */
+static int reduceIndex(LoopPass* pass, Loop* loop, Node* node)
+{
+    int count = 0;
+    for(int i = 0; i < 4; ++i)
+        for(Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            count += reduceIndex(pass, loop, operand);
+
+    const Node* array = node->operands[0];
+    if(node->op != NODE_INDEX || node->count > REDUCE_MAX_INDICES || isScalar(&node->type) == false
+        || (array->op != NODE_LOCAL && array->op != NODE_GLOBAL) || assignmentsOf(loop, array) != 0)
+        return count;
+
+    unsigned long invariant = 0;
+    int position = 0;
+    for(const Node* index = node->operands[1]; index != NULL; index = index->next, ++position)
+        if(isInvariant(loop, index) && isPure(pass->ir, index))
+            invariant |= 1ul << position;
+    if(invariant == 0)
+        return count;
+
+    const long unknown = -1;
+    Node* offset = newTemporary(pass->ir->name, pass->routine, &Type_int, &node->location);
+    node->op = NODE_REDUCED_INDEX;
+    node->invariant = invariant;
+    node->operands[2] = offset;
+    addBeforeLoop(loop, newStatement(loop, Node_create(NODE_ASSIGN, &Type_int, cloneNode(offset), Node_constant(&Type_int, &unknown), NULL, NULL)));
+    return count + 1;
+}
+
+static bool reduceIndices(LoopPass* pass, Loop* loop)
+{
+    int count = 0;
+    Node* node = loop->node;
+    for(int i = (node->op == NODE_FOR ? 1 : 0); i < 4; ++i)
+        if(node->operands[i] != NULL)
+            count += reduceIndex(pass, loop, node->operands[i]);
+    return count > 0;
+}
+
+
+
+/* Inlining. A call to a function or method whose body only returns a scalar expression of at most program.inline_limit nodes,
+ * and whose parameters are scalars, becomes an INLINE node. The arguments go to new variables of the caller standing for the
+ * parameters, and a copy of the expression reads those. The copy keeps the locations of the routine, so errors point into it.
+ * Calls inside the copy are inlined too, except calls back to a routine being inlined, which stay calls */
+typedef struct Inliner
+{
+    Routine* routine;                            /* caller, NULL for top-level code */
+    const char* name;
+    const Routine* expanding[INLINE_MAX_DEPTH];  /* routines whose copies are being inlined into */
+    int depth;
+} Inliner;
+
+static const Node* returnedExpression(const Routine* routine)
+{
+    const Node* statement = routine->body;
+    if(statement != NULL && statement->op == NODE_BLOCK)
+        statement = statement->operands[0];
+    if(statement == NULL || statement->next != NULL || statement->op != NODE_RETURN || statement->operands[0] == NULL)
+        return NULL;
+
+    const Node* exp = statement->operands[0];
+    if(isScalar(&routine->return_type) == false || exp->type.type != routine->return_type.type || exp->type.dimensions != 0)
+        return NULL;
+
+    for(int i = (routine->method ? 1 : 0); i < routine->param_count; ++i)
+        if(isScalar(&routine->slots.elements[i]) == false)
+            return NULL;
+
+    return (countNodes(exp) <= program.inline_limit ? exp : NULL);
+}
+
+static bool isExpanding(const Inliner* inliner, const Routine* routine)
+{
+    if(routine == inliner->routine)
+        return true;
+
+    for(int i = 0; i < inliner->depth; ++i)
+        if(inliner->expanding[i] == routine)
+            return true;
+    return false;
+}
+
+/* The locals of the copy become the variables of the caller from the first one on */
+static void moveSlots(Node* node, const Node* first)
+{
+    if(node->op == NODE_LOCAL)
+    {
+        node->op = first->op;
+        node->slot += first->slot;
+    }
+
+    for(int i = 0; i < 4; ++i)
+        for(Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            moveSlots(operand, first);
+}
+
+static void inlineCalls(Inliner* inliner, Node* node)
+{
+    for(int i = 0; i < 4; ++i)
+        for(Node* operand = node->operands[i]; operand != NULL; operand = operand->next)
+            inlineCalls(inliner, operand);
+
+    if(node->op != NODE_CALL)
+        return;
+
+    const Routine* routine = node->routine;
+    const Node* exp = returnedExpression(routine);
+    if(exp == NULL || inliner->depth == INLINE_MAX_DEPTH || isExpanding(inliner, routine))
+        return;
+
+    /* this holds a borrowed object, so its variable has no type to release */
+    Node* first = NULL;
+    for(int i = 0; i < routine->slots.size; ++i)
+    {
+        const Type* type = (routine->method && i == 0 ? &Type_void : &routine->slots.elements[i]);
+        Node* variable = newTemporary(inliner->name, inliner->routine, type, &node->location);
+        if(first == NULL)
+            first = variable;
+    }
+
+    Node* copy = cloneNode(exp);
+    if(first != NULL)
+        moveSlots(copy, first);
+    inliner->expanding[inliner->depth++] = routine;
+    inlineCalls(inliner, copy);
+    --inliner->depth;
+
+    node->op = NODE_INLINE;
+    node->operands[1] = copy;
+    node->operands[2] = first;
+    if(program.inline_report != NULL)
+        fprintf(program.inline_report, "(%zu, %zu): inlined %s, %d nodes, into %s\n",
+                node->location.first_line, node->location.first_column, routine->name, countNodes(exp), inliner->name);
+}
+
+static void inlineCode(Routine* routine, Node* code)
+{
+    Inliner inliner = {routine, (routine == NULL ? "top level" : routine->name != NULL ? routine->name : "function"), {NULL}, 0};
+    for(Node* statement = code; statement != NULL; statement = statement->next)
+        inlineCalls(&inliner, statement);
+}
+
+
+
+/* Propagates constants and copies, and at level 2 removes common subexpressions */
+static void simplifyCode(Routine* routine, Node** code)
+{
+    Ir ir;
+    if(Ir_build(&ir, routine, *code) != 0)
+        return;
+    dump(&ir, "construction");
+
+    propagateConstants(&ir);
+    dump(&ir, "constant propagation");
+    propagateCopies(&ir);
+    dump(&ir, "copy propagation");
+
+    Rewriter rewriter = {&ir, routine, program.optimization >= 2};
+    if(rewriter.eliminate_common)
+    {
+        numberValues(&ir);
+        dump(&ir, "value numbering");
+        markNeeded(&ir);
+    }
+
+    (*code) = rewriteList(&rewriter, *code);
+    Ir_clear(&ir);
+}
+
+/* Runs a loop pass with the constants of the current code known */
+static int optimizeLoops(Routine* routine, Node* code, bool (*visit)(LoopPass*, Loop*), bool inner_first)
+{
+    Ir ir;
+    if(Ir_build(&ir, routine, code) != 0)
+        return 0;
+
+    propagateConstants(&ir);
+    const int changes = runLoopPass(&ir, routine, code, visit, inner_first);
+    Ir_clear(&ir);
+    return changes;
+}
+
+/* Calls are inlined first, so that the passes see through them.
+ * The code is built into the IR again after every change of the tree: once to simplify it, at level 2 once for every pass on loops,
+ * and at last to find what became dead. Unrolled loops are simplified again, and indices are reduced last,
+ * once no later pass needs to read them */
+static bool hasParallelLoop(const Node* node)
+{
+    for(; node != NULL; node = node->next)
+        if(node->op == NODE_PARALLEL_FOR || hasParallelLoop(node->operands[0]) || hasParallelLoop(node->operands[1])
+           || hasParallelLoop(node->operands[2]) || hasParallelLoop(node->operands[3]))
+            return true;
+
+    return false;
+}
+
+/* Code with a parallel loop runs as parsed, since its iterations were checked on the tree the parser built */
+static void optimizeCode(Routine* routine, Node** code)
+{
+    if(hasParallelLoop(*code))
+        return;
+
+    if(program.inline_limit > 0)
+        inlineCode(routine, *code);
+
+    simplifyCode(routine, code);
+    if(program.optimization >= 2)
+    {
+        if(optimizeLoops(routine, *code, unrollLoop, true) > 0)
+            simplifyCode(routine, code);
+        optimizeLoops(routine, *code, mergeInductions, true);
+        optimizeLoops(routine, *code, hoistInvariants, false);
+    }
+
+    Ir ir;
+    if(Ir_build(&ir, routine, *code) != 0)
+        return;
+
+    eliminateDeadCode(&ir);
+    dump(&ir, "dead code elimination");
+    (*code) = sweepList(&ir, *code);
+    if(program.optimization >= 2)
+        runLoopPass(&ir, routine, *code, reduceIndices, true);
+    Ir_clear(&ir);
+}
+
+void Program_optimize()
+{
+    if(program.optimization <= 0)
+        return;
+
+    for(int i = 0; i < program.routines.size; ++i)
+    {
+        Routine* routine = program.routines.elements[i];
+        if(routine->optimized == false && routine->body != NULL)
+            optimizeCode(routine, &routine->body);
+        routine->optimized = true;
+    }
+
+    optimizeCode(NULL, &program.code);
+}
@@ -0,0 +1,16 @@
+#ifndef INCLUDED_OPT_H
+#define INCLUDED_OPT_H
+
+#include "node.h"
+
+#define INLINE_DEFAULT_LIMIT 16 /* nodes of the returned expression */
+
+/* Optimize the top-level code of the program and the routines not optimized yet, at program.optimization.
+ * Level 1 propagates constants and copies and removes dead code and dead stores, level 2 also removes common subexpressions,
+ * unrolls short loops, merges induction variables, hoists invariant expressions out of loops and reduces the indexing by invariant indices.
+ * Both levels first inline calls to routines returning an expression of at most program.inline_limit nodes,
+ * writing a line to program.inline_report for each one if set.
+ * The IR is written to program.ir_dump after every pass */
+void Program_optimize();
+
+#endif
@@ -0,0 +1,623 @@
+#define _GNU_SOURCE /* sched_getaffinity */
+#include "parallel.h"
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "builtin.h"
+#include "util.h"
+#include "y.tab.h"
+
+extern Program program;
+
+
+
+/* Iterations next to end - 1 are left to the worker owning the part. Thieves read remaining without the lock to pick a victim */
+typedef struct __attribute__((aligned(64))) Part
+{
+    pthread_mutex_t mutex;
+    long next;
+    long end;
+    unsigned long remaining;
+} Part;
+
+/* The threads are started by the first range that needs them and wait for the next range once they are done */
+static struct
+{
+    pthread_mutex_t busy;    /* held by the thread running a range */
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation; /* of the range, every thread taking part in it starts once it changes */
+    int thread_count;
+    int workers;
+    int running;             /* threads other than the caller still taking chunks */
+    ParallelChunk chunk;
+    void* data;
+    Part parts[PARALLEL_MAX_THREADS];
+} pool =
+{
+    .busy = PTHREAD_MUTEX_INITIALIZER,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void initParts()
+{
+    for(int i = 0; i < PARALLEL_MAX_THREADS; ++i)
+        pthread_mutex_init(&pool.parts[i].mutex, NULL);
+}
+
+static void setRemaining(Part* part)
+{
+    __atomic_store_n(&part->remaining, (part->next < part->end ? (unsigned long)part->end - (unsigned long)part->next : 0), __ATOMIC_RELAXED);
+}
+
+/* A quarter of what is left, so the chunks get smaller as the part empties and the last ones balance the workers */
+static bool takeChunk(Part* part, long* first, long* end)
+{
+    pthread_mutex_lock(&part->mutex);
+    const bool found = (part->next < part->end);
+    if(found)
+    {
+        const unsigned long remaining = (unsigned long)part->end - (unsigned long)part->next;
+        (*first) = part->next;
+        part->next = (long)((unsigned long)part->next + (remaining + 3) / 4);
+        (*end) = part->next;
+        setRemaining(part);
+    }
+    pthread_mutex_unlock(&part->mutex);
+    return found;
+}
+
+/* Move the back half of the part with the most iterations left into the part of the thief.
+ * Returns false once no part has two iterations left, since the owner of a single one runs it as soon as a thief could */
+static bool steal(int thief)
+{
+    for(;;)
+    {
+        int victim = -1;
+        unsigned long largest = 1;
+        for(int i = 0; i < pool.workers; ++i)
+        {
+            const unsigned long remaining = __atomic_load_n(&pool.parts[i].remaining, __ATOMIC_RELAXED);
+            if(i != thief && remaining > largest)
+            {
+                victim = i;
+                largest = remaining;
+            }
+        }
+        if(victim < 0)
+            return false;
+
+        Part* part = &pool.parts[victim];
+        pthread_mutex_lock(&part->mutex);
+        if(part->next < part->end && (unsigned long)part->end - (unsigned long)part->next >= 2)
+        {
+            const long end = part->end;
+            part->end = (long)((unsigned long)end - ((unsigned long)end - (unsigned long)part->next) / 2);
+            setRemaining(part);
+            const long first = part->end;
+            pthread_mutex_unlock(&part->mutex);
+
+            Part* own = &pool.parts[thief];
+            pthread_mutex_lock(&own->mutex);
+            own->next = first;
+            own->end = end;
+            setRemaining(own);
+            pthread_mutex_unlock(&own->mutex);
+            return true;
+        }
+        pthread_mutex_unlock(&part->mutex);
+    }
+}
+
+static void work(int worker)
+{
+    long first, end;
+    do
+        while(takeChunk(&pool.parts[worker], &first, &end))
+            pool.chunk(pool.data, worker, first, end);
+    while(steal(worker));
+}
+
+static void* waitForRanges(void* data)
+{
+    const int worker = (int)(intptr_t)data;
+    unsigned long seen = 0;
+    for(;;)
+    {
+        pthread_mutex_lock(&pool.mutex);
+        while(pool.generation == seen)
+            pthread_cond_wait(&pool.start, &pool.mutex);
+        seen = pool.generation;
+        const bool taking_part = (worker < pool.workers);
+        pthread_mutex_unlock(&pool.mutex);
+
+        if(taking_part == false)
+            continue;
+
+        work(worker);
+
+        pthread_mutex_lock(&pool.mutex);
+        if(--pool.running == 0)
+            pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+
+    return NULL;
+}
+
+/* The threads of the pool leave the signals of the program (the timer of the sampler, a terminal interrupt) to its other threads */
+static int startThread(int worker)
+{
+    sigset_t blocked, previous;
+    sigfillset(&blocked);
+    sigdelset(&blocked, SIGSEGV);
+    sigdelset(&blocked, SIGBUS);
+    sigdelset(&blocked, SIGFPE);
+    sigdelset(&blocked, SIGILL);
+    sigdelset(&blocked, SIGABRT);
+    pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+
+    pthread_t thread;
+    int error = pthread_create(&thread, NULL, waitForRanges, (void*)(intptr_t)worker);
+    if(error == 0)
+        pthread_detach(thread);
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return error;
+}
+
+int Parallel_for(int threads, long first, long end, ParallelChunk chunk, void* data)
+{
+    if(end <= first)
+        return 1;
+
+    const unsigned long count = (unsigned long)end - (unsigned long)first;
+    if(threads > PARALLEL_MAX_THREADS)
+        threads = PARALLEL_MAX_THREADS;
+    if((unsigned long)threads > count)
+        threads = (int)count;
+    if(threads <= 1)
+    {
+        chunk(data, 0, first, end);
+        return 1;
+    }
+
+    if(pthread_mutex_trylock(&pool.busy) != 0)
+        return -1;
+
+    /* Starting a thread is only an optimization, the workers that started share the range */
+    while(pool.thread_count < threads - 1 && startThread(pool.thread_count + 1) == 0)
+        ++pool.thread_count;
+    const int workers = (pool.thread_count + 1 < threads ? pool.thread_count + 1 : threads);
+
+    pthread_once(&pool_once, initParts);
+    unsigned long position = (unsigned long)first;
+    for(int i = 0; i < workers; ++i)
+    {
+        Part* part = &pool.parts[i];
+        part->next = (long)position;
+        position += count / workers + ((unsigned long)i < count % workers);
+        part->end = (long)position;
+        setRemaining(part);
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.chunk = chunk;
+    pool.data = data;
+    pool.workers = workers;
+    pool.running = workers - 1;
+    ++pool.generation;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+
+    work(0);
+
+    pthread_mutex_lock(&pool.mutex);
+    while(pool.running > 0)
+        pthread_cond_wait(&pool.done, &pool.mutex);
+    pthread_mutex_unlock(&pool.mutex);
+
+    pthread_mutex_unlock(&pool.busy);
+    return workers;
+}
+
+/* Those the process may run on, counted by the first loop */
+int Parallel_processors()
+{
+    static int processors = 0;
+    int count = __atomic_load_n(&processors, __ATOMIC_RELAXED);
+    if(count != 0)
+        return count;
+
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+        count = CPU_COUNT(&set);
+    else
+        count = (sysconf(_SC_NPROCESSORS_ONLN) > 0 ? (int)sysconf(_SC_NPROCESSORS_ONLN) : 1);
+
+    __atomic_store_n(&processors, count, __ATOMIC_RELAXED);
+    return count;
+}
+
+
+
+/* VariableSet */
+static bool sameVariable(const Node* lval, const Node* rval)
+{
+    return lval->op == rval->op && lval->slot == rval->slot;
+}
+
+void VariableSet_clear(VariableSet* set)
+{
+    free(set->elements);
+    set->elements = NULL;
+    set->capacity = 0;
+    set->size = 0;
+}
+
+bool VariableSet_contains(const VariableSet* set, const Node* variable)
+{
+    for(int i = 0; i < set->size; ++i)
+        if(sameVariable(set->elements[i], variable))
+            return true;
+
+    return false;
+}
+
+static void VariableSet_insert(VariableSet* set, const Node* variable)
+{
+    if(VariableSet_contains(set, variable))
+        return;
+
+    if(set->size == set->capacity)
+    {
+        int new_capacity = 1 + set->capacity * 2;
+        const Node** new_elements = realloc(set->elements, new_capacity * sizeof(set->elements[0]));
+        if(new_elements == NULL)
+        {
+            yyerror("not enough memory to check a parallel loop");
+            abort();
+        }
+
+        set->elements = new_elements;
+        set->capacity = new_capacity;
+    }
+
+    set->elements[set->size++] = variable;
+}
+
+static void collectDeclarations(VariableSet* set, const Node* node)
+{
+    for(; node != NULL; node = node->next)
+    {
+        if(node->op == NODE_DECL || node->op == NODE_DECL_ARRAY)
+            VariableSet_insert(set, node->operands[0]);
+        for(int i = 0; i < 4; ++i)
+            collectDeclarations(set, node->operands[i]);
+    }
+}
+
+void VariableSet_collect(VariableSet* set, const Node* loop)
+{
+    VariableSet_insert(set, loop->operands[0]->operands[0]);
+    collectDeclarations(set, loop->operands[2]);
+}
+
+
+
+/* Checks of a loop. The routines it calls are checked once for every way they are reached: with the object of a method
+ * shared by the iterations or not */
+typedef struct CalledRoutine
+{
+    const Routine* routine;
+    bool shared_object;
+} CalledRoutine;
+
+typedef struct LoopCheck
+{
+    const Node* loop;
+    VariableSet variables;   /* private to the iterations */
+    CalledRoutine* called;
+    int called_size;
+    int called_capacity;
+    int errors;
+} LoopCheck;
+
+static bool isUpdate(NodeOp op)
+{
+    return (op >= NODE_ASSIGN && op <= NODE_POSTDEC);
+}
+
+/* What an assignment target belongs to: itself, or the object of a field. That is a variable or the element of an array */
+static const Node* baseOf(const Node* target)
+{
+    while(target->op == NODE_FIELD)
+        target = target->operands[0];
+    return target;
+}
+
+static bool isVariable(const Node* node)
+{
+    return node->op == NODE_LOCAL || node->op == NODE_GLOBAL;
+}
+
+/* The array a builtin writes: its first argument, for those that write one. Arrays are only passed whole, and parameters and
+ * fields are never arrays, so a routine only writes the global arrays it names */
+static const Node* writtenArray(const Node* node)
+{
+    return (node->op == NODE_BUILTIN && Builtin_writes(node->builtin) ? node->operands[0] : NULL);
+}
+
+static bool isReduction(const LoopCheck* check, const Node* variable)
+{
+    for(const Node* reduction = check->loop->operands[3]; reduction != NULL; reduction = reduction->next)
+        if(sameVariable(reduction, variable))
+            return true;
+
+    return false;
+}
+
+/* An element of an array declared outside of the loop */
+static bool isSharedElement(const LoopCheck* check, const Node* node)
+{
+    return node->op == NODE_INDEX && VariableSet_contains(&check->variables, node->operands[0]) == false;
+}
+
+/* Built from constants and the variables the iterations share, which they cannot assign */
+static bool isInvariant(const LoopCheck* check, const Node* node)
+{
+    switch(node->op)
+    {
+    case NODE_CONST:
+        return true;
+
+    case NODE_LOCAL:
+    case NODE_GLOBAL:
+        return VariableSet_contains(&check->variables, node) == false && isReduction(check, node) == false;
+
+    case NODE_ADD:
+    case NODE_SUB:
+    case NODE_MUL:
+        return isInvariant(check, node->operands[0]) && isInvariant(check, node->operands[1]);
+
+    case NODE_NEG:
+        return isInvariant(check, node->operands[0]);
+
+    default:
+        return false;
+    }
+}
+
+/* The loop variable, plus or minus an invariant term, so that every iteration has its own value */
+static bool isLoopIndex(const LoopCheck* check, const Node* index)
+{
+    const Node* variable = check->loop->operands[0]->operands[0];
+    if(index->op == NODE_LOCAL || index->op == NODE_GLOBAL)
+        return sameVariable(index, variable);
+    if(index->op == NODE_ADD)
+        return (isLoopIndex(check, index->operands[0]) && isInvariant(check, index->operands[1]))
+            || (isInvariant(check, index->operands[0]) && isLoopIndex(check, index->operands[1]));
+    if(index->op == NODE_SUB)
+        return isLoopIndex(check, index->operands[0]) && isInvariant(check, index->operands[1]);
+    return false;
+}
+
+static void reportLoop(LoopCheck* check, const Node* node, const char* msg, const char* name)
+{
+    yyerrorAt(&node->location, msg, name);
+    ++check->errors;
+}
+
+/* msg takes name if it is not NULL */
+static void reportCall(LoopCheck* check, const Node* call, const Routine* routine, const char* msg, const char* name)
+{
+    char message[512];
+    if(name != NULL)
+        snprintf(message, sizeof(message), msg, name);
+    else
+        snprintf(message, sizeof(message), "%s", msg);
+    yyerrorAt(&call->location, "%s, called in the body of a parallel loop, %s", routine->name, message);
+    ++check->errors;
+}
+
+static bool markCalled(LoopCheck* check, const Routine* routine, bool shared_object)
+{
+    for(int i = 0; i < check->called_size; ++i)
+        if(check->called[i].routine == routine && check->called[i].shared_object == shared_object)
+            return false;
+
+    if(check->called_size == check->called_capacity)
+    {
+        int new_capacity = 1 + check->called_capacity * 2;
+        CalledRoutine* new_called = realloc(check->called, new_capacity * sizeof(check->called[0]));
+        if(new_called == NULL)
+        {
+            yyerror("not enough memory to check a parallel loop");
+            abort();
+        }
+
+        check->called = new_called;
+        check->called_capacity = new_capacity;
+    }
+
+    check->called[check->called_size++] = (CalledRoutine){routine, shared_object};
+    return true;
+}
+
+static void checkRoutine(LoopCheck* check, const Node* call, const Routine* routine, bool shared_object);
+
+/* Code of a routine called by the loop, reached through call. Its locals belong to its frame, which every call has its own of,
+ * but for the object of a method. Globals are shared */
+static void checkCalled(LoopCheck* check, const Node* call, const Routine* routine, bool shared_object, const Node* node)
+{
+    for(; node != NULL; node = node->next)
+    {
+        if(isUpdate(node->op) || node->op == NODE_PARALLEL_FOR)
+        {
+            const Node* target = (node->op == NODE_PARALLEL_FOR ? node->operands[3] : node->operands[0]);
+            for(; target != NULL; target = (node->op == NODE_PARALLEL_FOR ? target->next : NULL))
+            {
+                const Node* base = baseOf(target);
+                if(base->op == NODE_GLOBAL)
+                    reportCall(check, call, routine, "writes to the global variable %s", base->name);
+                else if(base->op == NODE_INDEX && base->operands[0]->op == NODE_GLOBAL)
+                    reportCall(check, call, routine, "writes to an element of the global array %s", base->name);
+                else if(base != target && base->op == NODE_LOCAL && base->slot == 0 && routine->method && shared_object)
+                    reportCall(check, call, routine, "writes to a field of its object, which the iterations share", NULL);
+            }
+        }
+        else if(node->op == NODE_GLOBAL && isReduction(check, node))
+            reportCall(check, call, routine, "reads the reduction variable %s", node->name);
+        else if(writtenArray(node) != NULL && writtenArray(node)->op == NODE_GLOBAL)
+            reportCall(check, call, routine, "writes to the global variable %s", writtenArray(node)->name);
+        else if(node->op == NODE_CALL && node->routine->method)
+        {
+            const Node* base = baseOf(node->operands[0]);
+            const bool shared = (base->op == NODE_GLOBAL || (base->op == NODE_INDEX && base->operands[0]->op == NODE_GLOBAL)
+                                 || (base->op == NODE_LOCAL && base->slot == 0 && routine->method && shared_object));
+            checkRoutine(check, call, node->routine, shared);
+        }
+        else if(node->op == NODE_CALL)
+            checkRoutine(check, call, node->routine, false);
+
+        for(int i = 0; i < (node->op == NODE_PARALLEL_FOR ? 3 : 4); ++i)
+            checkCalled(check, call, routine, shared_object, node->operands[i]);
+    }
+}
+
+static void checkRoutine(LoopCheck* check, const Node* call, const Routine* routine, bool shared_object)
+{
+    if(routine->body != NULL && markCalled(check, routine, shared_object))
+        checkCalled(check, call, routine, shared_object, routine->body);
+}
+
+#define REDUCTION_MESSAGE "%s is a reduction variable of the parallel loop and can only be the target of a += statement in its body"
+
+/* Iterations only read the variables declared outside of the loop */
+static void checkTarget(LoopCheck* check, const Node* node, const Node* base)
+{
+    if(isReduction(check, base))
+        reportLoop(check, node, REDUCTION_MESSAGE, base->name);
+    else if(sameVariable(base, check->loop->operands[0]->operands[0]))
+        reportLoop(check, node, "the variable %s of a parallel loop cannot be assigned in its body", base->name);
+    else if(VariableSet_contains(&check->variables, base) == false)
+        reportLoop(check, node, "%s is shared by the iterations of the parallel loop and cannot be assigned in its body", base->name);
+}
+
+/* Iterations write the elements of shared arrays at one of their indices only they take */
+static void checkElement(LoopCheck* check, const Node* node, const Node* element)
+{
+    for(const Node* index = element->operands[1]; index != NULL; index = index->next)
+        if(isLoopIndex(check, index))
+            return;
+
+    reportLoop(check, node, "%s is shared by the iterations of the parallel loop, which can only assign its elements at the loop variable plus or minus a term they do not change", element->name);
+}
+
+/* A reduction variable is only used as the target of a += statement */
+static void checkBody(LoopCheck* check, const Node* node, const Node* parent)
+{
+    for(; node != NULL; node = node->next)
+    {
+        switch(node->op)
+        {
+        case NODE_RETURN:
+            reportLoop(check, node, "return cannot be used in the body of a parallel loop", NULL);
+            break;
+
+        case NODE_LOCAL:
+        case NODE_GLOBAL:
+            if(isReduction(check, node))
+                reportLoop(check, node, REDUCTION_MESSAGE, node->name);
+            break;
+
+        case NODE_CALL:
+        {
+            const Node* base = (node->routine->method ? baseOf(node->operands[0]) : NULL);
+            const bool shared = (base != NULL && (isSharedElement(check, base)
+                                                  || (isVariable(base) && VariableSet_contains(&check->variables, base) == false)));
+            checkRoutine(check, node, node->routine, shared);
+            break;
+        }
+
+        case NODE_BUILTIN:
+        {
+            /* A builtin writes every element of its array, so it must be an array of the iteration */
+            const Node* array = writtenArray(node);
+            if(array != NULL && isVariable(array) && VariableSet_contains(&check->variables, array) == false)
+                reportLoop(check, node, "%s is shared by the iterations of the parallel loop and cannot be written by a builtin in its body", array->name);
+            break;
+        }
+
+        case NODE_PARALLEL_FOR:
+            for(const Node* reduction = node->operands[3]; reduction != NULL; reduction = reduction->next)
+                checkTarget(check, node, reduction);
+            for(int i = 0; i < 3; ++i)
+                checkBody(check, node->operands[i], node);
+            continue;
+        }
+
+        const Node* base = (isUpdate(node->op) ? baseOf(node->operands[0]) : NULL);
+        if(base != NULL && isVariable(base) && isReduction(check, base))
+        {
+            if(node->op != NODE_ADD_ASSIGN || base != node->operands[0] || parent == NULL || parent->op != NODE_EXP)
+                reportLoop(check, node, REDUCTION_MESSAGE, base->name);
+            checkBody(check, node->operands[1], node);
+            continue;
+        }
+        if(base != NULL && isVariable(base))
+            checkTarget(check, node, base);
+        else if(base != NULL && isSharedElement(check, base))
+            checkElement(check, node, base);
+
+        for(int i = 0; i < 4; ++i)
+            checkBody(check, node->operands[i], node);
+    }
+}
+
+#undef REDUCTION_MESSAGE
+
+static int checkLoop(const Node* loop)
+{
+    LoopCheck check = {loop, {0}, NULL, 0, 0, 0};
+    VariableSet_collect(&check.variables, loop);
+    checkBody(&check, loop->operands[2], loop);
+
+    VariableSet_clear(&check.variables);
+    free(check.called);
+    return check.errors;
+}
+
+static int findLoops(const Node* node)
+{
+    int errors = 0;
+    for(; node != NULL; node = node->next)
+    {
+        if(node->op == NODE_PARALLEL_FOR)
+            errors += checkLoop(node);
+        for(int i = 0; i < 4; ++i)
+            errors += findLoops(node->operands[i]);
+    }
+
+    return errors;
+}
+
+int Program_checkParallelLoops(const Node* code)
+{
+    if(program.parallel_loops == 0)
+        return 0;
+
+    int errors = findLoops(code);
+    for(int i = 0; i < program.routines.size; ++i)
+        errors += findLoops(program.routines.elements[i]->body);
+    return errors;
+}
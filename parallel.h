@@ -0,0 +1,38 @@
+#ifndef INCLUDED_PARALLEL_H
+#define INCLUDED_PARALLEL_H
+
+#include <stdbool.h>
+#include "node.h"
+
+#define PARALLEL_MAX_THREADS 64
+
+/* Runs the iterations first to end - 1 of a loop, given to it in chunks of consecutive iterations */
+typedef void (*ParallelChunk)(void* data, int worker, long first, long end);
+
+/* Run a range of iterations on threads of a pool shared by the runs, the calling thread being worker 0.
+ * Every worker starts with an equal part of the range and takes chunks from its front, a quarter of what is left each time,
+ * and a worker without iterations left steals the back half of the largest part. Returns the number of workers that
+ * took part, or -1 without running anything if the pool is busy with another range */
+int Parallel_for(int threads, long first, long end, ParallelChunk chunk, void* data);
+
+/* Online processors, at least 1 */
+int Parallel_processors();
+
+/* Variables the iterations of a loop do not share: its own and those declared in its body */
+typedef struct VariableSet
+{
+    const Node** elements;
+    int size;
+    int capacity;
+} VariableSet;
+
+void VariableSet_clear(VariableSet* set);
+void VariableSet_collect(VariableSet* set, const Node* loop);
+bool VariableSet_contains(const VariableSet* set, const Node* variable);
+
+/* Report the parallel loops of the code and of the routines of the program whose iterations write to what they share:
+ * variables declared before the loop, except through an array element or as the target of += on a reduction variable,
+ * and global variables or fields of a shared object written by the routines they call. Returns the number of errors */
+int Program_checkParallelLoops(const Node* code);
+
+#endif
@@ -0,0 +1,294 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "util.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+
+static uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Every statement reads the time, so it comes from the time stamp counter where there is one, which is cheaper than the clock.
+ * The clock at the start and at the end of the runs gives the rate of the ticks */
+static uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now();
+#endif
+}
+
+static double nsPerTick(const Profile* profile)
+{
+    return (profile->run_ticks != 0 ? (double)profile->run_ns / profile->run_ticks : 1.0);
+}
+
+static void* grow(void* elements, size_t size, size_t* capacity, size_t needed)
+{
+    size_t new_capacity = 1 + (*capacity) * 2;
+    if(new_capacity < needed)
+        new_capacity = needed;
+
+    char* new_elements = realloc(elements, new_capacity * size);
+    if(new_elements == NULL)
+    {
+        yyerror("not enough memory for the profile");
+        abort();
+    }
+
+    memset(new_elements + (*capacity) * size, 0, (new_capacity - (*capacity)) * size);
+    (*capacity) = new_capacity;
+    return new_elements;
+}
+
+static RoutineProfile* routineProfile(Profile* profile, const Routine* routine)
+{
+    if(routine->index >= profile->routine_capacity)
+    {
+        size_t capacity = profile->routine_capacity;
+        profile->routines = grow(profile->routines, sizeof(profile->routines[0]), &capacity, routine->index + 1);
+        profile->routine_capacity = capacity;
+    }
+    return &profile->routines[routine->index];
+}
+
+/* The time since the last change goes to the current line */
+static void charge(Profile* profile, uint64_t time)
+{
+    profile->lines[profile->line].ticks += time - profile->last;
+    profile->last = time;
+}
+
+
+
+Profile* Profile_create()
+{
+    Profile* profile = calloc(1, sizeof(*profile));
+    if(profile == NULL)
+        return NULL;
+
+    profile->lines = grow(NULL, sizeof(profile->lines[0]), &profile->line_capacity, 64);
+    return profile;
+}
+
+void Profile_destroy(Profile* profile)
+{
+    if(profile == NULL)
+        return;
+
+    free(profile->lines);
+    free(profile->routines);
+    free(profile);
+}
+
+
+
+void Profile_start(Profile* profile)
+{
+    profile->line = 0;
+    profile->start_ns = now();
+    profile->start_ticks = ticks();
+    profile->last = profile->start_ticks;
+}
+
+void Profile_stop(Profile* profile)
+{
+    const uint64_t time = ticks();
+    charge(profile, time);
+    profile->run_ticks += time - profile->start_ticks;
+    profile->run_ns += now() - profile->start_ns;
+
+    profile->line = 0;
+    profile->hidden = 0;
+    for(int i = 0; i < profile->routine_capacity; ++i)
+        profile->routines[i].active = 0;
+}
+
+
+
+void Profile_line(Profile* profile, size_t line)
+{
+    if(profile->hidden != 0)
+        return;
+
+    charge(profile, ticks());
+    if(line >= profile->line_capacity)
+        profile->lines = grow(profile->lines, sizeof(profile->lines[0]), &profile->line_capacity, line + 1);
+
+    profile->lines[line].count += 1;
+    profile->line = line;
+}
+
+ProfileCall Profile_enter(Profile* profile, const Routine* routine)
+{
+    const ProfileCall call = {ticks(), profile->line};
+    if(profile->hidden == 0)
+        charge(profile, call.start);
+    if(routine->module >= 0)
+        profile->hidden += 1;
+
+    routineProfile(profile, routine)->active += 1;
+    return call;
+}
+
+void Profile_leave(Profile* profile, const Routine* routine, ProfileCall call)
+{
+    const uint64_t time = ticks();
+    RoutineProfile* record = routineProfile(profile, routine);
+    record->calls += 1;
+    record->active -= 1;
+    if(record->active == 0)
+        record->ticks += time - call.start;
+
+    if(routine->module >= 0)
+        profile->hidden -= 1;
+    if(profile->hidden == 0)
+    {
+        charge(profile, time);
+        profile->line = call.line;
+    }
+}
+
+void Profile_enterModule(Profile* profile)
+{
+    profile->hidden += 1;
+}
+
+void Profile_leaveModule(Profile* profile)
+{
+    profile->hidden -= 1;
+}
+
+
+
+/* Returns the start of a line of the source and its length, or NULL if the source is shorter */
+static const char* findLine(const char* source, size_t size, size_t line, int* length)
+{
+    if(source == NULL || line == 0)
+        return NULL;
+
+    const char* end = source + size;
+    const char* text = source;
+    for(size_t i = 1; i < line; ++i)
+    {
+        text = memchr(text, '\n', end - text);
+        if(text == NULL)
+            return NULL;
+        ++text;
+    }
+
+    const char* newline = memchr(text, '\n', end - text);
+    (*length) = (newline != NULL ? newline : end) - text;
+    return text;
+}
+
+static const Profile* sorted_profile;
+
+static int compareLines(const void* a, const void* b)
+{
+    const uint64_t lticks = sorted_profile->lines[*(const size_t*)a].ticks;
+    const uint64_t rticks = sorted_profile->lines[*(const size_t*)b].ticks;
+    return (lticks < rticks) - (lticks > rticks);
+}
+static int compareRoutines(const void* a, const void* b)
+{
+    const uint64_t lticks = sorted_profile->routines[*(const int*)a].ticks;
+    const uint64_t rticks = sorted_profile->routines[*(const int*)b].ticks;
+    return (lticks < rticks) - (lticks > rticks);
+}
+
+void Profile_report(const Profile* profile, const RoutineList* routines, FILE* fp, const char* source, size_t size)
+{
+    const double ms = nsPerTick(profile) / 1e6;
+    uint64_t total = 0;
+    size_t line_count = 0;
+    for(size_t line = 1; line < profile->line_capacity; ++line)
+    {
+        total += profile->lines[line].ticks;
+        line_count += (profile->lines[line].count != 0);
+    }
+    const double percent = (total != 0 ? 100.0 / total : 0.0);
+
+    size_t* lines = malloc((line_count + 1) * sizeof(lines[0]));
+    int* indices = malloc((profile->routine_capacity + 1) * sizeof(indices[0]));
+    if(lines == NULL || indices == NULL)
+    {
+        yyerror("not enough memory to sort the profile");
+        abort();
+    }
+
+    size_t count = 0;
+    for(size_t line = 1; line < profile->line_capacity; ++line)
+        if(profile->lines[line].count != 0)
+            lines[count++] = line;
+
+    sorted_profile = profile;
+    qsort(lines, count, sizeof(lines[0]), compareLines);
+
+    fprintf(fp, "profile: %.3f ms in %zu lines\n", total * ms, line_count);
+    fprintf(fp, "%8s %12s %12s %7s\n", "line", "count", "ms", "%");
+    for(size_t i = 0; i < count && i < PROFILE_REPORT_LINES; ++i)
+    {
+        const LineProfile* record = &profile->lines[lines[i]];
+        fprintf(fp, "%8zu %12llu %12.3f %6.1f%%", lines[i], (unsigned long long)record->count, record->ticks * ms, record->ticks * percent);
+
+        int length;
+        const char* text = findLine(source, size, lines[i], &length);
+        while(text != NULL && length > 0 && (*text == ' ' || *text == '\t'))
+            ++text, --length;
+        if(text != NULL)
+            fprintf(fp, "   %.*s", length, text);
+        fputc('\n', fp);
+    }
+
+    count = 0;
+    for(int i = 0; i < profile->routine_capacity && i < routines->size; ++i)
+        if(profile->routines[i].calls != 0)
+            indices[count++] = i;
+    qsort(indices, count, sizeof(indices[0]), compareRoutines);
+
+    if(count != 0)
+        fprintf(fp, "%8s %12s %12s %7s\n", "line", "calls", "ms", "%");
+    for(size_t i = 0; i < count; ++i)
+    {
+        const Routine* routine = routines->elements[indices[i]];
+        const RoutineProfile* record = &profile->routines[indices[i]];
+        /* The lines of the routines of modules are in other files */
+        if(routine->module >= 0)
+            fprintf(fp, "%8s", "-");
+        else
+            fprintf(fp, "%8zu", routine->location.first_line);
+        fprintf(fp, " %12llu %12.3f %6.1f%%   %s\n", (unsigned long long)record->calls, record->ticks * ms, record->ticks * percent, routine->name);
+    }
+
+    free(lines);
+    free(indices);
+}
+
+void Profile_annotate(const Profile* profile, FILE* fp, const char* source, size_t size)
+{
+    const double ms = nsPerTick(profile) / 1e6;
+    const char* end = source + size;
+    size_t line = 1;
+    for(const char* text = source; text < end; ++line)
+    {
+        const char* newline = memchr(text, '\n', end - text);
+        const int length = (newline != NULL ? newline : end) - text;
+
+        if(line < profile->line_capacity && profile->lines[line].count != 0)
+            fprintf(fp, "%12llu %12.3f | %.*s\n", (unsigned long long)profile->lines[line].count, profile->lines[line].ticks * ms, length, text);
+        else
+            fprintf(fp, "%12s %12s | %.*s\n", "", "", length, text);
+
+        text += length + 1;
+    }
+}
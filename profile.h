@@ -0,0 +1,70 @@
+#ifndef INCLUDED_PROFILE_H
+#define INCLUDED_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "node.h"
+
+#define PROFILE_REPORT_LINES 20
+
+typedef struct LineProfile
+{
+    uint64_t count;
+    uint64_t ticks;
+} LineProfile;
+
+typedef struct RoutineProfile
+{
+    uint64_t calls;
+    uint64_t ticks;   /* from the outermost call to its return, including the routines it calls */
+    int active;       /* calls not returned yet */
+} RoutineProfile;
+
+/* Executions and time of the source lines and routines of a program while it runs.
+ * A statement starting counts once for its line, and so does every iteration of a loop. The time between two statements
+ * goes to the line of the first one, so each line gets the time of its own work. The code of imported modules has lines
+ * of other files, so its time goes to the line of the program that runs it */
+typedef struct Profile
+{
+    LineProfile* lines;       /* by line number, 0 for the time outside the program */
+    size_t line_capacity;
+    RoutineProfile* routines; /* by index in the routines of the program */
+    int routine_capacity;
+
+    size_t line;              /* getting the time now */
+    uint64_t last;            /* when it started to, in ticks */
+    int hidden;               /* module code running */
+
+    uint64_t start_ticks;     /* of the run going on */
+    uint64_t start_ns;
+    uint64_t run_ticks;       /* of all the runs, to turn ticks into time */
+    uint64_t run_ns;
+} Profile;
+
+/* Returned by Profile_enter and given back to Profile_leave */
+typedef struct ProfileCall
+{
+    uint64_t start;   /* in ticks */
+    size_t line;      /* of the call, which gets the time again after the return */
+} ProfileCall;
+
+Profile*    Profile_create();
+void        Profile_destroy(Profile* profile);
+
+/* A run starts and ends, normally or because of an error in the middle of routines and modules */
+void        Profile_start(Profile* profile);
+void        Profile_stop(Profile* profile);
+
+void        Profile_line(Profile* profile, size_t line);
+ProfileCall Profile_enter(Profile* profile, const Routine* routine);
+void        Profile_leave(Profile* profile, const Routine* routine, ProfileCall call);
+void        Profile_enterModule(Profile* profile);
+void        Profile_leaveModule(Profile* profile);
+
+/* Write the lines that took the most time and the routines of the program that were called, sorted by time.
+ * source is the text of the program, to quote the lines, or NULL */
+void        Profile_report(const Profile* profile, const RoutineList* routines, FILE* fp, const char* source, size_t size);
+/* Write the source with the count and the time of every line that ran in front of it */
+void        Profile_annotate(const Profile* profile, FILE* fp, const char* source, size_t size);
+
+#endif
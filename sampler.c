@@ -0,0 +1,304 @@
+#define _GNU_SOURCE /* SIGEV_THREAD_ID */
+#include "sampler.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "util.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* SIGPROF has one handler for the process, so sampled runs take turns and one sampler at most has its timer running */
+static pthread_mutex_t sampled_run = PTHREAD_MUTEX_INITIALIZER;
+static Sampler* volatile active_sampler = NULL;
+
+
+
+Sampler* Sampler_create(int hz)
+{
+    Sampler* sampler = calloc(1, sizeof(*sampler));
+    if(sampler == NULL)
+        return NULL;
+
+    sampler->hz = hz;
+    return sampler;
+}
+
+void Sampler_destroy(Sampler* sampler)
+{
+    if(sampler == NULL)
+        return;
+
+    for(size_t i = 0; i < sampler->stack_capacity; ++i)
+        free(sampler->stacks[i].routines);
+    free(sampler->stacks);
+    free(sampler);
+}
+
+
+
+/* Only reads the sampler and writes the slot of the ring past the head, so it is safe whatever it interrupts */
+static void takeSample(int signal)
+{
+    Sampler* sampler = active_sampler;
+    if(sampler == NULL)
+        return;
+
+    const size_t head = sampler->head;
+    if(head - sampler->tail >= SAMPLER_RING_SIZE)
+    {
+        sampler->dropped += 1;
+        return;
+    }
+
+    Sample* sample = &sampler->ring[head % SAMPLER_RING_SIZE];
+    const int depth = sampler->depth;
+    sample->depth = depth;
+    sample->line = sampler->line;
+    for(int i = 0; i < depth && i < SAMPLER_DEPTH; ++i)
+        sample->routines[i] = sampler->stack[i].routine;
+
+    atomic_signal_fence(memory_order_seq_cst);
+    sampler->head = head + 1;
+    if(head + 1 - sampler->tail >= SAMPLER_RING_SIZE / 2)
+        sampler->full = 1;
+}
+
+int Sampler_start(Sampler* sampler)
+{
+    sampler->depth = 0;
+    sampler->line = 0;
+    pthread_mutex_lock(&sampled_run);
+
+    struct sigaction action = {0};
+    action.sa_handler = takeSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    /* The timer counts the CPU time of the thread running the program and signals that thread only */
+    struct sigevent event = {0};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+    if(timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &sampler->timer) != 0)
+    {
+        pthread_mutex_unlock(&sampled_run);
+        return -1;
+    }
+
+    if(sigaction(SIGPROF, &action, &sampler->previous) != 0)
+    {
+        timer_delete(sampler->timer);
+        pthread_mutex_unlock(&sampled_run);
+        return -1;
+    }
+
+    active_sampler = sampler;
+    const long interval = 1000000000L / sampler->hz;
+    const struct itimerspec spec = {{interval / 1000000000L, interval % 1000000000L}, {interval / 1000000000L, interval % 1000000000L}};
+    if(timer_settime(sampler->timer, 0, &spec, NULL) != 0)
+    {
+        active_sampler = NULL;
+        sigaction(SIGPROF, &sampler->previous, NULL);
+        timer_delete(sampler->timer);
+        pthread_mutex_unlock(&sampled_run);
+        return -1;
+    }
+
+    sampler->running = true;
+    return 0;
+}
+
+void Sampler_stop(Sampler* sampler)
+{
+    if(sampler->running)
+    {
+        timer_delete(sampler->timer);
+        active_sampler = NULL;
+        sigaction(SIGPROF, &sampler->previous, NULL);
+        sampler->running = false;
+        pthread_mutex_unlock(&sampled_run);
+    }
+
+    Sampler_drain(sampler);
+    sampler->depth = 0;
+    sampler->line = 0;
+}
+
+
+
+/* Stacks deeper than the frames kept count as one */
+static int keptDepth(int depth)
+{
+    return (depth > SAMPLER_DEPTH ? SAMPLER_DEPTH + 1 : depth);
+}
+
+static size_t hashStack(const Routine* const* routines, int depth, size_t line)
+{
+    size_t hash = line * 31 + depth;
+    for(int i = 0; i < depth && i < SAMPLER_DEPTH; ++i)
+        hash = hash * 31 + (uintptr_t)routines[i] / sizeof(void*);
+    return hash ^ (hash >> 17);
+}
+
+static bool sameStack(const FoldedStack* stack, const Sample* sample, int depth)
+{
+    if(stack->depth != depth || stack->line != sample->line)
+        return false;
+
+    for(int i = 0; i < depth && i < SAMPLER_DEPTH; ++i)
+        if(stack->routines[i] != sample->routines[i])
+            return false;
+    return true;
+}
+
+static void growStacks(Sampler* sampler)
+{
+    const size_t capacity = (sampler->stack_capacity == 0 ? 64 : sampler->stack_capacity * 2);
+    FoldedStack* stacks = calloc(capacity, sizeof(stacks[0]));
+    if(stacks == NULL)
+    {
+        yyerror("not enough memory for the samples");
+        abort();
+    }
+
+    for(size_t i = 0; i < sampler->stack_capacity; ++i)
+    {
+        const FoldedStack* stack = &sampler->stacks[i];
+        if(stack->count == 0)
+            continue;
+
+        size_t slot = hashStack(stack->routines, stack->depth, stack->line) & (capacity - 1);
+        while(stacks[slot].count != 0)
+            slot = (slot + 1) & (capacity - 1);
+        stacks[slot] = (*stack);
+    }
+
+    free(sampler->stacks);
+    sampler->stacks = stacks;
+    sampler->stack_capacity = capacity;
+}
+
+static void countSample(Sampler* sampler, const Sample* sample)
+{
+    if(2 * (sampler->stack_count + 1) > sampler->stack_capacity)
+        growStacks(sampler);
+
+    const int depth = keptDepth(sample->depth);
+    size_t slot = hashStack(sample->routines, depth, sample->line) & (sampler->stack_capacity - 1);
+    for(; sampler->stacks[slot].count != 0; slot = (slot + 1) & (sampler->stack_capacity - 1))
+        if(sameStack(&sampler->stacks[slot], sample, depth))
+        {
+            sampler->stacks[slot].count += 1;
+            return;
+        }
+
+    const int kept = (depth < SAMPLER_DEPTH ? depth : SAMPLER_DEPTH);
+    FoldedStack* stack = &sampler->stacks[slot];
+    stack->routines = malloc((kept + 1) * sizeof(stack->routines[0]));
+    if(stack->routines == NULL)
+    {
+        yyerror("not enough memory for the samples");
+        abort();
+    }
+
+    memcpy(stack->routines, sample->routines, kept * sizeof(stack->routines[0]));
+    stack->depth = depth;
+    stack->line = sample->line;
+    stack->count = 1;
+    sampler->stack_count += 1;
+}
+
+void Sampler_drain(Sampler* sampler)
+{
+    const size_t head = sampler->head;
+    atomic_signal_fence(memory_order_seq_cst);
+
+    for(size_t i = sampler->tail; i != head; ++i)
+        countSample(sampler, &sampler->ring[i % SAMPLER_RING_SIZE]);
+    sampler->sample_count += head - sampler->tail;
+
+    atomic_signal_fence(memory_order_seq_cst);
+    sampler->tail = head;
+    sampler->full = 0;
+}
+
+
+
+/* The signal handler may read the stack at any time, so a frame is complete before the depth counts it */
+void Sampler_enter(Sampler* sampler, const Routine* routine)
+{
+    const int depth = sampler->depth;
+    if(depth < SAMPLER_DEPTH)
+    {
+        sampler->stack[depth].routine = routine;
+        sampler->stack[depth].line = sampler->line;
+    }
+
+    atomic_signal_fence(memory_order_seq_cst);
+    sampler->depth = depth + 1;
+}
+
+void Sampler_leave(Sampler* sampler)
+{
+    const int depth = sampler->depth - 1;
+    sampler->depth = depth;
+    if(depth < SAMPLER_DEPTH)
+        sampler->line = sampler->stack[depth].line;
+}
+
+
+
+static const char* frameName(const Routine* routine)
+{
+    return (routine != NULL ? routine->name : "(module)");
+}
+
+/* Stacks are written sorted, so the ones sharing frames are next to each other */
+static int compareStacks(const void* a, const void* b)
+{
+    const FoldedStack* lstack = a;
+    const FoldedStack* rstack = b;
+    for(int i = 0; i < lstack->depth && i < rstack->depth && i < SAMPLER_DEPTH; ++i)
+    {
+        const int order = strcmp(frameName(lstack->routines[i]), frameName(rstack->routines[i]));
+        if(order != 0)
+            return order;
+    }
+
+    if(lstack->depth != rstack->depth)
+        return (lstack->depth > rstack->depth) - (lstack->depth < rstack->depth);
+    return (lstack->line > rstack->line) - (lstack->line < rstack->line);
+}
+
+void Sampler_write(const Sampler* sampler, FILE* fp)
+{
+    FoldedStack* stacks = malloc((sampler->stack_count + 1) * sizeof(stacks[0]));
+    if(stacks == NULL)
+    {
+        yyerror("not enough memory to sort the samples");
+        abort();
+    }
+
+    size_t count = 0;
+    for(size_t i = 0; i < sampler->stack_capacity; ++i)
+        if(sampler->stacks[i].count != 0)
+            stacks[count++] = sampler->stacks[i];
+    qsort(stacks, count, sizeof(stacks[0]), compareStacks);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        fputs("(program)", fp);
+        for(int j = 0; j < stacks[i].depth && j < SAMPLER_DEPTH; ++j)
+            fprintf(fp, ";%s", frameName(stacks[i].routines[j]));
+        if(stacks[i].depth > SAMPLER_DEPTH)
+            fputs(";...", fp);
+        fprintf(fp, ";line %zu %llu\n", stacks[i].line, (unsigned long long)stacks[i].count);
+    }
+
+    free(stacks);
+}
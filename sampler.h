@@ -0,0 +1,79 @@
+#ifndef INCLUDED_SAMPLER_H
+#define INCLUDED_SAMPLER_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "node.h"
+
+#define SAMPLER_DEPTH     64    /* outermost routines of a stack that samples keep */
+#define SAMPLER_RING_SIZE 1024  /* samples taken and not yet counted */
+
+/* A routine being run, or the code of a module when NULL */
+typedef struct SamplerFrame
+{
+    const Routine* routine;
+    size_t line;                 /* of the caller, running again after the return */
+} SamplerFrame;
+
+typedef struct Sample
+{
+    int depth;
+    size_t line;
+    const Routine* routines[SAMPLER_DEPTH];
+} Sample;
+
+/* Every distinct stack sampled and how many samples found it */
+typedef struct FoldedStack
+{
+    const Routine** routines;
+    int depth;
+    size_t line;
+    uint64_t count;
+} FoldedStack;
+
+/* Samples the routines and the line the program runs at a fixed rate of the CPU time of its thread.
+ * The interpreter keeps the stack and the line up to date. The signal handler only copies them into a ring
+ * allocated beforehand, and the interpreter counts the samples of the ring when it is half full and when the run ends */
+typedef struct Sampler
+{
+    int hz;
+    bool running;                /* the timer of a run started */
+    timer_t timer;
+    struct sigaction previous;   /* handler of SIGPROF before the run */
+
+    SamplerFrame stack[SAMPLER_DEPTH];
+    volatile int depth;          /* may be larger than SAMPLER_DEPTH, frames past it are not kept */
+    volatile size_t line;
+
+    Sample ring[SAMPLER_RING_SIZE];
+    volatile size_t head;        /* written by the signal handler */
+    volatile size_t tail;
+    volatile sig_atomic_t full;  /* the ring is half full */
+    volatile size_t dropped;     /* samples taken while the ring was full */
+
+    FoldedStack* stacks;         /* open addressing, by a hash of the routines and the line */
+    size_t stack_count;
+    size_t stack_capacity;
+    uint64_t sample_count;
+} Sampler;
+
+Sampler* Sampler_create(int hz);
+void     Sampler_destroy(Sampler* sampler);
+
+/* Start and stop the timer around a run. Sampled runs of different contexts wait for each other.
+ * Returns -1 if the timer could not start, and the run is not sampled */
+int      Sampler_start(Sampler* sampler);
+void     Sampler_stop(Sampler* sampler);
+/* Count the samples of the ring */
+void     Sampler_drain(Sampler* sampler);
+
+void     Sampler_enter(Sampler* sampler, const Routine* routine);
+void     Sampler_leave(Sampler* sampler);
+
+/* Write one line per distinct stack, its frames from the outermost separated by ';' then the number of samples,
+ * the format flame graph tools read. The top-level code is "(program)", module code "(module)" and the last frame is the line */
+void     Sampler_write(const Sampler* sampler, FILE* fp);
+
+#endif
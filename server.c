@@ -0,0 +1,302 @@
+#include "server.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define MAX_BLOCK_SIZE (64u * 1024u * 1024u)
+
+static volatile sig_atomic_t server_stopping = 0;
+
+
+
+void Response_clear(Response* response)
+{
+    free(response->output);
+    free(response->diagnostics);
+    response->output = NULL;
+    response->output_size = 0;
+    response->diagnostics = NULL;
+    response->diagnostics_size = 0;
+    response->error_count = 0;
+}
+
+
+
+int readAll(int fd, void* buffer, size_t size)
+{
+    char* p = buffer;
+    while(size > 0)
+    {
+        const ssize_t n = read(fd, p, size);
+        if(n == 0)
+            return 1;
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        p += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+int writeAll(int fd, const void* buffer, size_t size)
+{
+    const char* p = buffer;
+    while(size > 0)
+    {
+        const ssize_t n = write(fd, p, size);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        p += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+
+
+int readBlock(int fd, char** data, size_t* size)
+{
+    uint32_t block_size;
+    const int error = readAll(fd, &block_size, sizeof(block_size));
+    if(error != 0)
+        return error;
+    if(block_size > MAX_BLOCK_SIZE)
+        return -1;
+
+    (*data) = malloc(block_size + 1);
+    if((*data) == NULL)
+        return -1;
+
+    if(readAll(fd, (*data), block_size) != 0)
+    {
+        free(*data);
+        (*data) = NULL;
+        return -1;
+    }
+
+    (*data)[block_size] = '\0';
+    (*size) = block_size;
+    return 0;
+}
+
+int writeBlock(int fd, const void* data, size_t size)
+{
+    const uint32_t block_size = size;
+    if(size > MAX_BLOCK_SIZE)
+        return -1;
+
+    if(writeAll(fd, &block_size, sizeof(block_size)) != 0)
+        return -1;
+    return writeAll(fd, data, size);
+}
+
+
+
+int readResponse(int fd, Response* response)
+{
+    if(readAll(fd, &response->error_count, sizeof(response->error_count)) != 0)
+        return -1;
+    if(readBlock(fd, &response->output, &response->output_size) != 0)
+        return -1;
+    if(readBlock(fd, &response->diagnostics, &response->diagnostics_size) != 0)
+    {
+        Response_clear(response);
+        return -1;
+    }
+
+    return 0;
+}
+
+int writeResponse(int fd, const Response* response)
+{
+    if(writeAll(fd, &response->error_count, sizeof(response->error_count)) != 0)
+        return -1;
+    if(writeBlock(fd, response->output, response->output_size) != 0)
+        return -1;
+    return writeBlock(fd, response->diagnostics, response->diagnostics_size);
+}
+
+
+
+static int makeAddress(const char* path, struct sockaddr_un* address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if(strlen(path) >= sizeof(address->sun_path))
+    {
+        fprintf(stderr, "socket path %s is too long\n", path);
+        return -1;
+    }
+
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+int connectServer(const char* path)
+{
+    struct sockaddr_un address;
+    if(makeAddress(path, &address) != 0)
+        return -1;
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+
+    if(connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+
+static void handleStop(int s)
+{
+    server_stopping = 1;
+}
+
+/* Serves every request sent over one connection, until the client closes it */
+static void serveConnection(int fd, RequestHandler handler)
+{
+    while(1)
+    {
+        char* source;
+        size_t size;
+        if(readBlock(fd, &source, &size) != 0)
+            break;
+
+        Response response = {0};
+        handler(source, size, &response);
+        free(source);
+
+        const int error = writeResponse(fd, &response);
+        Response_clear(&response);
+        if(error != 0)
+            break;
+    }
+
+    close(fd);
+}
+
+static void runWorker(int listen_fd, RequestHandler handler)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+
+    while(1)
+    {
+        const int fd = accept(listen_fd, NULL, NULL);
+        if(fd < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            _exit(1);
+        }
+
+        serveConnection(fd, handler);
+    }
+}
+
+static pid_t spawnWorker(int listen_fd, RequestHandler handler)
+{
+    const pid_t pid = fork();
+    if(pid == 0)
+    {
+        runWorker(listen_fd, handler);
+        _exit(0);
+    }
+
+    return pid;
+}
+
+/* All workers block in accept() on the same socket, so the kernel hands each connection to an idle one.
+ * Workers that die (e.g. on abort()) are replaced. */
+int runServer(const char* path, int workers, RequestHandler handler)
+{
+    struct sockaddr_un address;
+    if(makeAddress(path, &address) != 0)
+        return 1;
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    unlink(path);
+    if(bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, 128) != 0)
+    {
+        perror(path);
+        close(listen_fd);
+        return 1;
+    }
+
+    if(workers < 1)
+        workers = 1;
+
+    pid_t* pids = calloc(workers, sizeof(pids[0]));
+    if(pids == NULL)
+    {
+        fprintf(stderr, "not enough memory for %d workers\n", workers);
+        close(listen_fd);
+        unlink(path);
+        return 1;
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = handleStop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    for(int i = 0; i < workers; ++i)
+        pids[i] = spawnWorker(listen_fd, handler);
+
+    while(server_stopping == 0)
+    {
+        const pid_t pid = wait(NULL);
+        if(pid < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+
+        for(int i = 0; i < workers; ++i)
+            if(pids[i] == pid && server_stopping == 0)
+                pids[i] = spawnWorker(listen_fd, handler);
+    }
+
+    for(int i = 0; i < workers; ++i)
+        if(pids[i] > 0)
+            kill(pids[i], SIGTERM);
+    while(wait(NULL) > 0 || errno == EINTR)
+        ;
+
+    free(pids);
+    close(listen_fd);
+    unlink(path);
+    return 0;
+}
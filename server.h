@@ -0,0 +1,39 @@
+#ifndef INCLUDED_SERVER_H
+#define INCLUDED_SERVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Protocol
+ * request:  uint32 size, source bytes
+ * response: int32 error count, uint32 size, print output, uint32 size, diagnostics
+ * All integers are in host byte order since the socket is local. */
+
+typedef struct Response
+{
+    int32_t error_count;
+    char* output;
+    size_t output_size;
+    char* diagnostics;
+    size_t diagnostics_size;
+} Response;
+
+void Response_clear(Response* response);
+
+typedef void (*RequestHandler)(const char* source, size_t size, Response* response);
+
+int readAll(int fd, void* buffer, size_t size);
+int writeAll(int fd, const void* buffer, size_t size);
+
+int readBlock(int fd, char** data, size_t* size);
+int writeBlock(int fd, const void* data, size_t size);
+
+int readResponse(int fd, Response* response);
+int writeResponse(int fd, const Response* response);
+
+int connectServer(const char* path);
+int runServer(const char* path, int workers, RequestHandler handler);
+
+#endif
@@ -0,0 +1,730 @@
+#include "simd.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+/* Tails and the single-lane steps of reductions use the same order at every level */
+#define LANES 4
+
+
+
+/* Portable */
+static void fill_int_scalar(long* a, size_t n, long value)
+{
+    for(size_t i = 0; i < n; ++i)
+        a[i] = value;
+}
+
+static void fill_double_scalar(double* a, size_t n, double value)
+{
+    for(size_t i = 0; i < n; ++i)
+        a[i] = value;
+}
+
+static long sum_int_scalar(const long* a, size_t n, unsigned long* magnitude)
+{
+    unsigned long sum = 0;
+    unsigned long bits = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        sum += (unsigned long)a[i];
+        bits |= (unsigned long)(a[i] ^ (a[i] >> 63));
+    }
+    *magnitude |= bits;
+    return (long)sum;
+}
+
+static double reduce_double(const double lanes[LANES])
+{
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static double sum_double_tail(double lanes[LANES], const double* a, size_t i, size_t n)
+{
+    for(; i < n; ++i)
+        lanes[i % LANES] += a[i];
+    return reduce_double(lanes);
+}
+
+static double sum_double_scalar(const double* a, size_t n)
+{
+    double lanes[LANES] = {0.0, 0.0, 0.0, 0.0};
+    return sum_double_tail(lanes, a, 0, n);
+}
+
+static long min_int_scalar(const long* a, size_t n)
+{
+    long min = a[0];
+    for(size_t i = 1; i < n; ++i)
+        if(a[i] < min)
+            min = a[i];
+    return min;
+}
+
+static long max_int_scalar(const long* a, size_t n)
+{
+    long max = a[0];
+    for(size_t i = 1; i < n; ++i)
+        if(a[i] > max)
+            max = a[i];
+    return max;
+}
+
+/* Same choices as MINPD and MAXPD, which give the second operand when the comparison fails */
+static double min_double_tail(double lanes[LANES], const double* a, size_t i, size_t n)
+{
+    for(; i < n; ++i)
+        lanes[i % LANES] = (a[i] < lanes[i % LANES] ? a[i] : lanes[i % LANES]);
+
+    const double low  = (lanes[0] < lanes[1] ? lanes[0] : lanes[1]);
+    const double high = (lanes[2] < lanes[3] ? lanes[2] : lanes[3]);
+    return (low < high ? low : high);
+}
+
+static double max_double_tail(double lanes[LANES], const double* a, size_t i, size_t n)
+{
+    for(; i < n; ++i)
+        lanes[i % LANES] = (a[i] > lanes[i % LANES] ? a[i] : lanes[i % LANES]);
+
+    const double low  = (lanes[0] > lanes[1] ? lanes[0] : lanes[1]);
+    const double high = (lanes[2] > lanes[3] ? lanes[2] : lanes[3]);
+    return (low > high ? low : high);
+}
+
+static void first_lanes(double lanes[LANES], const double* a, size_t n)
+{
+    for(int k = 0; k < LANES; ++k)
+        lanes[k] = a[(size_t)k < n ? (size_t)k : 0];
+}
+
+static double min_double_scalar(const double* a, size_t n)
+{
+    double lanes[LANES];
+    first_lanes(lanes, a, n);
+    return min_double_tail(lanes, a, 0, n);
+}
+
+static double max_double_scalar(const double* a, size_t n)
+{
+    double lanes[LANES];
+    first_lanes(lanes, a, n);
+    return max_double_tail(lanes, a, 0, n);
+}
+
+static long dot_int_scalar(const long* a, const long* b, size_t n, unsigned long magnitudes[2])
+{
+    unsigned long sum = 0;
+    unsigned long abits = 0;
+    unsigned long bbits = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        sum += (unsigned long)a[i] * (unsigned long)b[i];
+        abits |= (unsigned long)(a[i] ^ (a[i] >> 63));
+        bbits |= (unsigned long)(b[i] ^ (b[i] >> 63));
+    }
+    magnitudes[0] |= abits;
+    magnitudes[1] |= bbits;
+    return (long)sum;
+}
+
+static double dot_double_tail(double lanes[LANES], const double* a, const double* b, size_t i, size_t n)
+{
+    for(; i < n; ++i)
+        lanes[i % LANES] += a[i] * b[i];
+    return reduce_double(lanes);
+}
+
+static double dot_double_scalar(const double* a, const double* b, size_t n)
+{
+    double lanes[LANES] = {0.0, 0.0, 0.0, 0.0};
+    return dot_double_tail(lanes, a, b, 0, n);
+}
+
+static void add_int_scalar(long* dst, const long* a, const long* b, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = (long)((unsigned long)a[i] + (unsigned long)b[i]);
+}
+
+static void add_double_scalar(double* dst, const double* a, const double* b, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = a[i] + b[i];
+}
+
+static void mul_int_scalar(long* dst, const long* a, const long* b, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = (long)((unsigned long)a[i] * (unsigned long)b[i]);
+}
+
+static void mul_double_scalar(double* dst, const double* a, const double* b, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = a[i] * b[i];
+}
+
+static size_t count_int_scalar(const long* a, size_t n, long value)
+{
+    size_t count = 0;
+    for(size_t i = 0; i < n; ++i)
+        count += (a[i] == value);
+    return count;
+}
+
+static size_t count_double_scalar(const double* a, size_t n, double value)
+{
+    size_t count = 0;
+    for(size_t i = 0; i < n; ++i)
+        count += (a[i] == value);
+    return count;
+}
+
+static unsigned long magnitude_int_scalar(const long* a, size_t n)
+{
+    unsigned long bits = 0;
+    for(size_t i = 0; i < n; ++i)
+        bits |= (unsigned long)(a[i] ^ (a[i] >> 63));
+    return bits;
+}
+
+static const SimdKernels scalar_kernels =
+{
+    "scalar",
+    fill_int_scalar, fill_double_scalar,
+    sum_int_scalar, sum_double_scalar,
+    min_int_scalar, min_double_scalar,
+    max_int_scalar, max_double_scalar,
+    dot_int_scalar, dot_double_scalar,
+    add_int_scalar, add_double_scalar,
+    mul_int_scalar, mul_double_scalar,
+    count_int_scalar, count_double_scalar,
+    magnitude_int_scalar
+};
+
+
+
+#ifdef __SSE2__
+/* SSE2. Two registers hold the 4 lanes of the double reductions. SSE2 has no 64-bit comparison, so min and max of ints stay scalar */
+static __m128i mul_epi64_sse2(__m128i a, __m128i b)
+{
+    const __m128i low = _mm_mul_epu32(a, b);
+    const __m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+    return _mm_add_epi64(low, _mm_slli_epi64(cross, 32));
+}
+
+static __m128i cmpeq_epi64_sse2(__m128i a, __m128i b)
+{
+    const __m128i equal = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+/* SSE2 has no 64-bit arithmetic shift, the sign of each lane is copied from its high half */
+static __m128i magnitude_epi64_sse2(__m128i x)
+{
+    return _mm_xor_si128(x, _mm_shuffle_epi32(_mm_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1)));
+}
+
+static unsigned long reduce_bits_sse2(__m128i bits)
+{
+    unsigned long lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, bits);
+    return lanes[0] | lanes[1];
+}
+
+static long reduce_int_sse2(__m128i sum)
+{
+    long lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, sum);
+    return (long)((unsigned long)lanes[0] + (unsigned long)lanes[1]);
+}
+
+static void fill_int_sse2(long* a, size_t n, long value)
+{
+    const __m128i v = _mm_set1_epi64x(value);
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_si128((__m128i*)(a + i), v);
+    fill_int_scalar(a + i, n - i, value);
+}
+
+static void fill_double_sse2(double* a, size_t n, double value)
+{
+    const __m128d v = _mm_set1_pd(value);
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(a + i, v);
+    fill_double_scalar(a + i, n - i, value);
+}
+
+static long sum_int_sse2(const long* a, size_t n, unsigned long* magnitude)
+{
+    __m128i sum = _mm_setzero_si128();
+    __m128i bits = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        sum = _mm_add_epi64(sum, x);
+        bits = _mm_or_si128(bits, magnitude_epi64_sse2(x));
+    }
+    *magnitude |= reduce_bits_sse2(bits);
+    return (long)((unsigned long)reduce_int_sse2(sum) + (unsigned long)sum_int_scalar(a + i, n - i, magnitude));
+}
+
+static double sum_double_sse2(const double* a, size_t n)
+{
+    __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+    {
+        low  = _mm_add_pd(low,  _mm_loadu_pd(a + i));
+        high = _mm_add_pd(high, _mm_loadu_pd(a + i + 2));
+    }
+
+    double lanes[LANES];
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return sum_double_tail(lanes, a, i, n);
+}
+
+static double min_double_sse2(const double* a, size_t n)
+{
+    double lanes[LANES];
+    first_lanes(lanes, a, n);
+    __m128d low = _mm_loadu_pd(lanes), high = _mm_loadu_pd(lanes + 2);
+
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+    {
+        low  = _mm_min_pd(_mm_loadu_pd(a + i), low);
+        high = _mm_min_pd(_mm_loadu_pd(a + i + 2), high);
+    }
+
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return min_double_tail(lanes, a, i, n);
+}
+
+static double max_double_sse2(const double* a, size_t n)
+{
+    double lanes[LANES];
+    first_lanes(lanes, a, n);
+    __m128d low = _mm_loadu_pd(lanes), high = _mm_loadu_pd(lanes + 2);
+
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+    {
+        low  = _mm_max_pd(_mm_loadu_pd(a + i), low);
+        high = _mm_max_pd(_mm_loadu_pd(a + i + 2), high);
+    }
+
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return max_double_tail(lanes, a, i, n);
+}
+
+static long dot_int_sse2(const long* a, const long* b, size_t n, unsigned long magnitudes[2])
+{
+    __m128i sum = _mm_setzero_si128();
+    __m128i abits = _mm_setzero_si128();
+    __m128i bbits = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        const __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        sum = _mm_add_epi64(sum, mul_epi64_sse2(x, y));
+        abits = _mm_or_si128(abits, magnitude_epi64_sse2(x));
+        bbits = _mm_or_si128(bbits, magnitude_epi64_sse2(y));
+    }
+    magnitudes[0] |= reduce_bits_sse2(abits);
+    magnitudes[1] |= reduce_bits_sse2(bbits);
+    return (long)((unsigned long)reduce_int_sse2(sum) + (unsigned long)dot_int_scalar(a + i, b + i, n - i, magnitudes));
+}
+
+static double dot_double_sse2(const double* a, const double* b, size_t n)
+{
+    __m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+    {
+        low  = _mm_add_pd(low,  _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+
+    double lanes[LANES];
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+    return dot_double_tail(lanes, a, b, i, n);
+}
+
+static void add_int_sse2(long* dst, const long* a, const long* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi64(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+    add_int_scalar(dst + i, a + i, b + i, n - i);
+}
+
+static void add_double_sse2(double* dst, const double* a, const double* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    add_double_scalar(dst + i, a + i, b + i, n - i);
+}
+
+static void mul_int_sse2(long* dst, const long* a, const long* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_si128((__m128i*)(dst + i), mul_epi64_sse2(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+    mul_int_scalar(dst + i, a + i, b + i, n - i);
+}
+
+static void mul_double_sse2(double* dst, const double* a, const double* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    mul_double_scalar(dst + i, a + i, b + i, n - i);
+}
+
+/* Matching lanes are all ones, that is -1, so subtracting the masks counts them */
+static size_t count_int_sse2(const long* a, size_t n, long value)
+{
+    const __m128i v = _mm_set1_epi64x(value);
+    __m128i count = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        count = _mm_sub_epi64(count, cmpeq_epi64_sse2(_mm_loadu_si128((const __m128i*)(a + i)), v));
+    return (size_t)reduce_int_sse2(count) + count_int_scalar(a + i, n - i, value);
+}
+
+static size_t count_double_sse2(const double* a, size_t n, double value)
+{
+    const __m128d v = _mm_set1_pd(value);
+    __m128i count = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        count = _mm_sub_epi64(count, _mm_castpd_si128(_mm_cmpeq_pd(_mm_loadu_pd(a + i), v)));
+    return (size_t)reduce_int_sse2(count) + count_double_scalar(a + i, n - i, value);
+}
+
+static unsigned long magnitude_int_sse2(const long* a, size_t n)
+{
+    __m128i bits = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 2 <= n; i += 2)
+        bits = _mm_or_si128(bits, magnitude_epi64_sse2(_mm_loadu_si128((const __m128i*)(a + i))));
+    return reduce_bits_sse2(bits) | magnitude_int_scalar(a + i, n - i);
+}
+
+static const SimdKernels sse2_kernels =
+{
+    "sse2",
+    fill_int_sse2, fill_double_sse2,
+    sum_int_sse2, sum_double_sse2,
+    min_int_scalar, min_double_sse2,
+    max_int_scalar, max_double_sse2,
+    dot_int_sse2, dot_double_sse2,
+    add_int_sse2, add_double_sse2,
+    mul_int_sse2, mul_double_sse2,
+    count_int_sse2, count_double_sse2,
+    magnitude_int_sse2
+};
+#endif
+
+
+
+#ifdef SIMD_X86
+/* AVX2. Built for any x86 target and only called after the CPU was checked. Products are not fused, to round like the other levels */
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i mul_epi64_avx2(__m256i a, __m256i b)
+{
+    const __m256i low = _mm256_mul_epu32(a, b);
+    const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+AVX2 static __m256i magnitude_epi64_avx2(__m256i x)
+{
+    return _mm256_xor_si256(x, _mm256_cmpgt_epi64(_mm256_setzero_si256(), x));
+}
+
+AVX2 static unsigned long reduce_bits_avx2(__m256i bits)
+{
+    unsigned long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, bits);
+    return lanes[0] | lanes[1] | lanes[2] | lanes[3];
+}
+
+AVX2 static long reduce_int_avx2(__m256i sum)
+{
+    long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, sum);
+    return (long)(((unsigned long)lanes[0] + (unsigned long)lanes[1]) + ((unsigned long)lanes[2] + (unsigned long)lanes[3]));
+}
+
+AVX2 static void fill_int_avx2(long* a, size_t n, long value)
+{
+    const __m256i v = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_si256((__m256i*)(a + i), v);
+    fill_int_scalar(a + i, n - i, value);
+}
+
+AVX2 static void fill_double_avx2(double* a, size_t n, double value)
+{
+    const __m256d v = _mm256_set1_pd(value);
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(a + i, v);
+    fill_double_scalar(a + i, n - i, value);
+}
+
+AVX2 static long sum_int_avx2(const long* a, size_t n, unsigned long* magnitude)
+{
+    __m256i sum = _mm256_setzero_si256();
+    __m256i bits = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        sum = _mm256_add_epi64(sum, x);
+        bits = _mm256_or_si256(bits, magnitude_epi64_avx2(x));
+    }
+    *magnitude |= reduce_bits_avx2(bits);
+    return (long)((unsigned long)reduce_int_avx2(sum) + (unsigned long)sum_int_scalar(a + i, n - i, magnitude));
+}
+
+AVX2 static double sum_double_avx2(const double* a, size_t n)
+{
+    __m256d sum = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+        sum = _mm256_add_pd(sum, _mm256_loadu_pd(a + i));
+
+    double lanes[LANES];
+    _mm256_storeu_pd(lanes, sum);
+    return sum_double_tail(lanes, a, i, n);
+}
+
+AVX2 static long min_int_avx2(const long* a, size_t n)
+{
+    if(n < 4)
+        return min_int_scalar(a, n);
+
+    __m256i min = _mm256_loadu_si256((const __m256i*)a);
+    size_t i = 4;
+    for(; i + 4 <= n; i += 4)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(a + i));
+        min = _mm256_blendv_epi8(min, v, _mm256_cmpgt_epi64(min, v));
+    }
+
+    long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, min);
+    long result = min_int_scalar(lanes, 4);
+    for(; i < n; ++i)
+        if(a[i] < result)
+            result = a[i];
+    return result;
+}
+
+AVX2 static long max_int_avx2(const long* a, size_t n)
+{
+    if(n < 4)
+        return max_int_scalar(a, n);
+
+    __m256i max = _mm256_loadu_si256((const __m256i*)a);
+    size_t i = 4;
+    for(; i + 4 <= n; i += 4)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(a + i));
+        max = _mm256_blendv_epi8(max, v, _mm256_cmpgt_epi64(v, max));
+    }
+
+    long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, max);
+    long result = max_int_scalar(lanes, 4);
+    for(; i < n; ++i)
+        if(a[i] > result)
+            result = a[i];
+    return result;
+}
+
+AVX2 static double min_double_avx2(const double* a, size_t n)
+{
+    double lanes[LANES];
+    first_lanes(lanes, a, n);
+    __m256d min = _mm256_loadu_pd(lanes);
+
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+        min = _mm256_min_pd(_mm256_loadu_pd(a + i), min);
+
+    _mm256_storeu_pd(lanes, min);
+    return min_double_tail(lanes, a, i, n);
+}
+
+AVX2 static double max_double_avx2(const double* a, size_t n)
+{
+    double lanes[LANES];
+    first_lanes(lanes, a, n);
+    __m256d max = _mm256_loadu_pd(lanes);
+
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+        max = _mm256_max_pd(_mm256_loadu_pd(a + i), max);
+
+    _mm256_storeu_pd(lanes, max);
+    return max_double_tail(lanes, a, i, n);
+}
+
+AVX2 static long dot_int_avx2(const long* a, const long* b, size_t n, unsigned long magnitudes[2])
+{
+    __m256i sum = _mm256_setzero_si256();
+    __m256i abits = _mm256_setzero_si256();
+    __m256i bbits = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        const __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        sum = _mm256_add_epi64(sum, mul_epi64_avx2(x, y));
+        abits = _mm256_or_si256(abits, magnitude_epi64_avx2(x));
+        bbits = _mm256_or_si256(bbits, magnitude_epi64_avx2(y));
+    }
+    magnitudes[0] |= reduce_bits_avx2(abits);
+    magnitudes[1] |= reduce_bits_avx2(bbits);
+    return (long)((unsigned long)reduce_int_avx2(sum) + (unsigned long)dot_int_scalar(a + i, b + i, n - i, magnitudes));
+}
+
+AVX2 static double dot_double_avx2(const double* a, const double* b, size_t n)
+{
+    __m256d sum = _mm256_setzero_pd();
+    size_t i = 0;
+    for(; i + LANES <= n; i += LANES)
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+
+    double lanes[LANES];
+    _mm256_storeu_pd(lanes, sum);
+    return dot_double_tail(lanes, a, b, i, n);
+}
+
+AVX2 static void add_int_avx2(long* dst, const long* a, const long* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+    add_int_scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static void add_double_avx2(double* dst, const double* a, const double* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    add_double_scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static void mul_int_avx2(long* dst, const long* a, const long* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_si256((__m256i*)(dst + i), mul_epi64_avx2(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+    mul_int_scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static void mul_double_avx2(double* dst, const double* a, const double* b, size_t n)
+{
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    mul_double_scalar(dst + i, a + i, b + i, n - i);
+}
+
+AVX2 static size_t count_int_avx2(const long* a, size_t n, long value)
+{
+    const __m256i v = _mm256_set1_epi64x(value);
+    __m256i count = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        count = _mm256_sub_epi64(count, _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(a + i)), v));
+    return (size_t)reduce_int_avx2(count) + count_int_scalar(a + i, n - i, value);
+}
+
+AVX2 static size_t count_double_avx2(const double* a, size_t n, double value)
+{
+    const __m256d v = _mm256_set1_pd(value);
+    __m256i count = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        count = _mm256_sub_epi64(count, _mm256_castpd_si256(_mm256_cmp_pd(_mm256_loadu_pd(a + i), v, _CMP_EQ_OQ)));
+    return (size_t)reduce_int_avx2(count) + count_double_scalar(a + i, n - i, value);
+}
+
+AVX2 static unsigned long magnitude_int_avx2(const long* a, size_t n)
+{
+    __m256i bits = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 4 <= n; i += 4)
+        bits = _mm256_or_si256(bits, magnitude_epi64_avx2(_mm256_loadu_si256((const __m256i*)(a + i))));
+    return reduce_bits_avx2(bits) | magnitude_int_scalar(a + i, n - i);
+}
+
+static const SimdKernels avx2_kernels =
+{
+    "avx2",
+    fill_int_avx2, fill_double_avx2,
+    sum_int_avx2, sum_double_avx2,
+    min_int_avx2, min_double_avx2,
+    max_int_avx2, max_double_avx2,
+    dot_int_avx2, dot_double_avx2,
+    add_int_avx2, add_double_avx2,
+    mul_int_avx2, mul_double_avx2,
+    count_int_avx2, count_double_avx2,
+    magnitude_int_avx2
+};
+#endif
+
+
+
+/* Selection */
+static const SimdKernels* selected_kernels = &scalar_kernels;
+static pthread_once_t selection_once = PTHREAD_ONCE_INIT;
+
+static void selectKernels()
+{
+    const char* level = getenv("TEMA_SIMD");
+    if(level != NULL && strcmp(level, "scalar") == 0)
+        return;
+
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if((level == NULL || strcmp(level, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+    {
+        selected_kernels = &avx2_kernels;
+        return;
+    }
+#endif
+
+#ifdef __SSE2__
+    selected_kernels = &sse2_kernels;
+#endif
+}
+
+const SimdKernels* Simd_kernels()
+{
+    pthread_once(&selection_once, selectKernels);
+    return selected_kernels;
+}
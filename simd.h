@@ -0,0 +1,40 @@
+#ifndef INCLUDED_SIMD_H
+#define INCLUDED_SIMD_H
+
+#include <stddef.h>
+
+/* Loops of the bulk array builtins. Each has an AVX2, an SSE2 and a portable version, picked once by the features of the CPU.
+ * TEMA_SIMD=avx2, sse2 or scalar in the environment asks for a given level, to compare them.
+ * Reductions of doubles keep 4 separate lanes at every level, so their results do not depend on the level picked */
+typedef struct SimdKernels
+{
+    const char* name;
+
+    void   (*fill_int)   (long* a, size_t n, long value);
+    void   (*fill_double)(double* a, size_t n, double value);
+
+    /* The sums of ints also OR the magnitudes of a (and b) into magnitude, like magnitude_int, to tell whether they wrapped */
+    long   (*sum_int)   (const long* a, size_t n, unsigned long* magnitude);
+    double (*sum_double)(const double* a, size_t n);
+    long   (*min_int)   (const long* a, size_t n);
+    double (*min_double)(const double* a, size_t n);
+    long   (*max_int)   (const long* a, size_t n);
+    double (*max_double)(const double* a, size_t n);
+    long   (*dot_int)   (const long* a, const long* b, size_t n, unsigned long magnitudes[2]);
+    double (*dot_double)(const double* a, const double* b, size_t n);
+
+    void   (*add_int)   (long* dst, const long* a, const long* b, size_t n);
+    void   (*add_double)(double* dst, const double* a, const double* b, size_t n);
+    void   (*mul_int)   (long* dst, const long* a, const long* b, size_t n);
+    void   (*mul_double)(double* dst, const double* a, const double* b, size_t n);
+
+    size_t (*count_int)   (const long* a, size_t n, long value);
+    size_t (*count_double)(const double* a, size_t n, double value);
+
+    /* OR of the magnitudes of the elements, less one for negative ones, so its bit length bounds them */
+    unsigned long (*magnitude_int)(const long* a, size_t n);
+} SimdKernels;
+
+const SimdKernels* Simd_kernels();
+
+#endif
@@ -7,36 +7,95 @@
 {
 #include "yylloc.h"
 #include "util.h"
+#include "context.h"
 }
 
 %{
 #include <stdio.h>
 #include <stdint.h>
-#include <signal.h>
+#include <pthread.h>
 #include "yylloc.h"
 #include "util.h"
+#include "context.h"
+#include "builtin.h"
+#include "module.h"
+#include "node.h"
+#include "diagnostic.h"
+#include "parallel.h"
+
+/* Like the default, and the rule's location is also given to the nodes its action creates */
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                   \
+    do                                                                    \
+    {                                                                     \
+        if(N)                                                             \
+        {                                                                 \
+            (Current).first_line   = YYRHSLOC(Rhs, 1).first_line;         \
+            (Current).first_column = YYRHSLOC(Rhs, 1).first_column;       \
+            (Current).last_line    = YYRHSLOC(Rhs, N).last_line;          \
+            (Current).last_column  = YYRHSLOC(Rhs, N).last_column;        \
+        }                                                                 \
+        else                                                              \
+        {                                                                 \
+            (Current).first_line   = (Current).last_line   = YYRHSLOC(Rhs, 0).last_line;   \
+            (Current).first_column = (Current).last_column = YYRHSLOC(Rhs, 0).last_column; \
+        }                                                                 \
+        node_location = (Current);                                        \
+    }                                                                     \
+    while(0)
 
 int yylex();
+int scanToken();
 int yywrap();
+void beginNestedInput(FILE* fp);
+void endNestedInput();
 
-extern FILE* yyin;
-extern FILE* yyout;
-extern int error_count;
-extern int warning_count;
-int scope_level = 0;
+/* The scopes are those of the thread, since function bodies may be analyzed on several threads */
+extern __thread int error_count;
+extern __thread int warning_count;
+__thread int scope_level = 0;
 
-VariableList varlist = {0};
-VariableListStack varliststack = {0};
+__thread VariableList varlist = {0};
+__thread VariableListStack varliststack = {0};
 
-FunctionList funclist = {0};
-FunctionListStack funcliststack = {0};
+__thread FunctionList funclist = {0};
+__thread FunctionListStack funcliststack = {0};
+
+__thread ClassList classlist = {0};
 
 PrintQueue printqueue = {0};
+ModuleList modules = {0};
+
+Program program = {0};
+__thread Routine* current_routine = NULL;   /* function whose body is being parsed */
+__thread ClassLayout* current_class = NULL; /* class whose members are being parsed */
+__thread int member_access = 0;             /* PUBLIC or PRIVATE, for the members being declared */
 
 
 
 Variable* declareVariable(VariableList* varlist, int scope_level, char* name, const Type* type, bool constant, bool initialized, const YYLTYPE* yylloc);
 Function* declareFunction(FunctionList* funclist, int scope_level, char* name, const Type* return_type, TypeList* typelist, const YYLTYPE* yylloc);
+Class*    declareClass(ClassList* classlist, int scope_level, char* name, const YYLTYPE* yylloc);
+Type      classType(char* name, int dimensions);
+bool      resolveClass(Type* type);
+
+Variable* allocateVariable(char* name, const Type* type, bool constant, bool initialized, const YYLTYPE* yylloc);
+Node*     defineVariable(char* name, const Type* type, bool constant, const Expression* exp, const YYLTYPE* yylloc);
+Node*     declareArray(char* name, const Type* type, const NodeList* sizes, const YYLTYPE* yylloc);
+Node*     arraySize(long size);
+
+Routine* beginRoutine(const Type* return_type, const YYLTYPE* yylloc);
+void     copyTypes(const TypeList* src, TypeList* dst);
+void     declareRoutine(char* name, const Type* return_type, TypeList* paramtypes, const YYLTYPE* yylloc);
+void     deferBody(const YYLTYPE* declaration, int lookahead);
+void     endRoutine(Routine* previous, const NodeList* body);
+int      analyzeBody(Routine* routine);
+void     analyzeDeferredBodies();
+void     freeDeferredBody(struct DeferredBody* body);
+void     discardQueuedTokens();
+
+ClassLayout* beginClass(char* name, const YYLTYPE* yylloc);
+void         endClass(ClassLayout* previous);
+void         declareField(char* name, Type* type, const NodeList* sizes, const YYLTYPE* yylloc);
 
 void enterBlock();
 void exitBlock();
@@ -44,16 +103,54 @@ void exitBlock();
 Variable* isVarDecl(const char* name);
 bool      isVarInit(const Variable* var);
 void      initVar(Variable* var, const Expression* exp);
+void      indexArray(Expression* result, const char* name, Node* array, const NodeList* indices);
+Variable* findThis(const ClassLayout* layout);
+void      selectField(Expression* result, const Expression* object, const Field* field, const NodeList* indices);
+void      accessVariable(Expression* result, const char* name, const NodeList* indices);
+ClassLayout* memberOwner(const Expression* object, const char* name);
+void      accessField(Expression* result, const Expression* object, const char* name, const NodeList* indices);
+void      addIndex(NodeList* indices, const Expression* exp);
 
 Function* isFuncDecl(const char* name, const TypeList* typelist);
+void      addArgument(Arguments* arguments, const Expression* exp);
+void      setCall(Expression* result, const Type* return_type, Routine* routine, int builtin, const NodeList* arguments);
+void      callFunction(Expression* result, const char* name, Arguments* arguments);
+void      callMethod(Expression* result, const Expression* object, const char* name, Arguments* arguments);
+void      declareBuiltins();
 
 bool isExpConvToBool(const Expression* exp);
-void addExpToPrint(const Expression* exp);
+Node* statement(NodeOp op, Node* first, Node* second, Node* third, Node* fourth);
+Node* expStatement(const Expression* exp);
+Node* conditionStatement(NodeOp op, const Expression* exp, Node* first, Node* second);
+Node* returnStatement(const Expression* exp);
+Node* addExpToPrint(const Expression* exp);
+
+Node* caseLabel(const Expression* exp, const YYLTYPE* yylloc);
+Node* caseStatement(const NodeList* labels, const NodeList* statements);
+Node* switchStatement(const Expression* exp, const YYLTYPE* yylloc, const NodeList* cases);
+
+Node* reductionVariable(const char* name, const YYLTYPE* yylloc);
+Node* beginParallelLoop(char* name, const Expression* first, const YYLTYPE* yylloc);
+Node* endParallelLoop(Node* declaration, const char* compared, const YYLTYPE* compared_lloc, const Expression* end,
+                      const char* stepped, const YYLTYPE* stepped_lloc, Node* body, const NodeList* reductions);
+
+long divideConstants(long lval, long rval, bool remainder);
+
+int parseModule(FILE* fp, Context* module);
 %}
 
+%code provides
+{
+/* The parser is pure, so that function bodies can be parsed on several threads. The scanner returns the value and
+ * the location of a token in these, and errors are reported at the location of the last token read by the thread */
+extern YYSTYPE yylval;
+extern __thread YYLTYPE yylloc;
+}
+
 /* Flags for yacc */
 %defines
 %locations
+%define api.pure
 %yacc
 //%no-lines // Uncomment to be able to add breakpoints in y.tab.c
 
@@ -67,15 +164,19 @@ void addExpToPrint(const Expression* exp);
     char* idval;
     Type typeval;
     TypeList typelistval;
-    Variable* varval;
-    Function* funcval;
     Expression expval;
+    Node* nodeval;
+    NodeList nodelistval;
+    Arguments argsval;
+    Routine* routineval;
+    struct ClassLayout* layoutval;
 }
 
 /* Tokens */
 %start Pgm
 %token <intval> INT BOOL DOUBLE CHAR STRING VOID INVAL_TYPE
-%token CONST PRINT IF ELSE WHILE DO FOR RETURN CLASS THIS PUBLIC PRIVATE
+%token CONST PRINT IF ELSE WHILE DO FOR SWITCH CASE DEFAULT RETURN CLASS THIS PUBLIC PRIVATE IMPORT PARALLEL REDUCE
+%token DEFERRED_BODY SKIPPED_BODY /* start the analysis of a skipped function body, and stand for one */
 
 %token <idval> ID
 %token <intval> INT_CONSTANT
@@ -87,9 +188,12 @@ void addExpToPrint(const Expression* exp);
 %token ADD_ASSIGN SUB_ASSIGN MUL_ASSIGN DIV_ASSIGN MOD_ASSIGN INC_OP DEC_OP AND_OP OR_OP EQ_OP NE_OP LE_OP GE_OP
 
 /* Types for non-terminal */
-%type <intval> TypePredef
+%type <intval> TypePredef ConstIntExp
 %type <typeval> DeclParam
-%type <expval> Exp
+%type <expval> Exp VarAccess FuncCall
+%type <nodeval> Stmt DeclVar ForInitExp ForCondExp ForNextExp CaseGroup CaseLabel
+%type <nodelistval> Stmts ArrayDeclSize ArrayIndexing FuncBody Reductions ReductionList CaseGroups CaseLabels
+%type <argsval> FuncParamExpList
 
 /* Precedence */
 %left ','
@@ -111,59 +215,93 @@ void addExpToPrint(const Expression* exp);
 /*********************************** Rules ************************************/
 /******************************************************************************/
 %%
-Pgm :
-    | Stmts
+Pgm : Builtins       {program.code = NULL;}
+    | Builtins Stmts {program.code = $<nodelistval>2.first;}
+    | DEFERRED_BODY '{' Stmts '}' {endRoutine(current_routine, &$<nodelistval>3);}
     ;
 
+Builtins : {declareBuiltins();}
+         ;
+
 
 
-Stmts : Stmt
-      | Stmts Stmt
+Stmts : Stmt       {NodeList_init(&$<nodelistval>$); NodeList_append(&$<nodelistval>$, $<nodeval>1);}
+      | Stmts Stmt {$<nodelistval>$ = $<nodelistval>1; NodeList_append(&$<nodelistval>$, $<nodeval>2);}
       ;
 
-Stmt  : ';'
-      | DeclVar ';'
-      | DeclFunc
-      | DeclClass
-      | Exp ';'                       {Expression_clear(&$<expval>1);}
-      | '{' {enterBlock();} Stmts '}' {exitBlock();}
-      | '{''}'
+Stmt  : ';'                           {$<nodeval>$ = NULL;}
+      | DeclVar ';'                   {$<nodeval>$ = $<nodeval>1;}
+      | DeclFunc                      {$<nodeval>$ = NULL;}
+      | DeclClass                     {$<nodeval>$ = NULL;}
+      | Exp ';'                       {$<nodeval>$ = expStatement(&$<expval>1); Expression_clear(&$<expval>1);}
+      | '{' {enterBlock();} Stmts '}' {exitBlock(); $<nodeval>$ = statement(NODE_BLOCK, $<nodelistval>3.first, NULL, NULL, NULL);}
+      | '{''}'                        {$<nodeval>$ = NULL;}
 
-      | PRINT '(' Exp ')' ';'         {addExpToPrint(&$<expval>3); Expression_clear(&$<expval>3);}
-      | RETURN Exp ';'                {Expression_clear(&$<expval>2);}
+      | PRINT '(' Exp ')' ';'         {$<nodeval>$ = addExpToPrint(&$<expval>3); Expression_clear(&$<expval>3);}
+      | RETURN Exp ';'                {$<nodeval>$ = returnStatement(&$<expval>2); Expression_clear(&$<expval>2);}
+      | IMPORT STRING_LITERAL ';'     {$<nodeval>$ = importModule($2, &@2); free($2);}
 
-      | IF '(' Exp ')' Stmt           %prec NOELSE {isExpConvToBool(&$<expval>3); Expression_clear(&$<expval>3);}
-      | IF '(' Exp ')' Stmt ELSE Stmt              {isExpConvToBool(&$<expval>3); Expression_clear(&$<expval>3);}
+      | IF '(' Exp ')' Stmt           %prec NOELSE {$<nodeval>$ = conditionStatement(NODE_IF, &$<expval>3, $<nodeval>5, NULL); Expression_clear(&$<expval>3);}
+      | IF '(' Exp ')' Stmt ELSE Stmt              {$<nodeval>$ = conditionStatement(NODE_IF, &$<expval>3, $<nodeval>5, $<nodeval>7); Expression_clear(&$<expval>3);}
 
-      | WHILE '(' Exp ')' Stmt        {isExpConvToBool(&$<expval>3); Expression_clear(&$<expval>3);}
-      | DO Stmt WHILE '(' Exp ')' ';' {isExpConvToBool(&$<expval>5); Expression_clear(&$<expval>5);}
+      | WHILE '(' Exp ')' Stmt        {$<nodeval>$ = conditionStatement(NODE_WHILE, &$<expval>3, $<nodeval>5, NULL); Expression_clear(&$<expval>3);}
+      | DO Stmt WHILE '(' Exp ')' ';' {$<nodeval>$ = conditionStatement(NODE_DO, &$<expval>5, $<nodeval>2, NULL); Expression_clear(&$<expval>5);}
 
-      | FOR '(' ForInitExp ';' ForCondExp ';' ForNextExp ')' Stmt
+      | SWITCH '(' Exp ')' '{' CaseGroups '}' {$<nodeval>$ = switchStatement(&$<expval>3, &@3, &$<nodelistval>6); Expression_clear(&$<expval>3);}
+
+      | FOR '(' ForInitExp ';' ForCondExp ';' ForNextExp ')' Stmt {$<nodeval>$ = ($<nodeval>5 != NULL ? statement(NODE_FOR, $<nodeval>3, $<nodeval>5, $<nodeval>7, $<nodeval>9) : NULL);}
+      | PARALLEL Reductions FOR '(' INT ID '=' Exp {$<nodeval>$ = beginParallelLoop($6, &$<expval>8, &@6); Expression_clear(&$<expval>8);}
+        ';' ID '<' Exp ';' INC_OP ID ')' Stmt
+        {$<nodeval>$ = endParallelLoop($<nodeval>9, $11, &@11, &$<expval>13, $16, &@16, $<nodeval>18, &$<nodelistval>2); Expression_clear(&$<expval>13); free($11); free($16);}
       ;
 
 
 
-ForInitExp :
-           | Exp     {Expression_clear(&$<expval>1);}
-           | DeclVar
+/* A case runs the statements after its labels, without falling through to the next case */
+CaseGroups : /* empty */          {NodeList_init(&$<nodelistval>$);}
+           | CaseGroups CaseGroup {$<nodelistval>$ = $<nodelistval>1; NodeList_append(&$<nodelistval>$, $<nodeval>2); $<nodelistval>$.valid &= ($<nodeval>2 != NULL);}
+           ;
+CaseGroup  : CaseLabels {enterBlock();} Stmts {exitBlock(); $<nodeval>$ = caseStatement(&$<nodelistval>1, &$<nodelistval>3);}
+           ;
+CaseLabels : CaseLabel            {NodeList_init(&$<nodelistval>$); NodeList_append(&$<nodelistval>$, $<nodeval>1); $<nodelistval>$.valid = ($<nodeval>1 != NULL);}
+           | CaseLabels CaseLabel {$<nodelistval>$ = $<nodelistval>1; NodeList_append(&$<nodelistval>$, $<nodeval>2); $<nodelistval>$.valid &= ($<nodeval>2 != NULL);}
+           ;
+CaseLabel  : CASE Exp ':'         {$<nodeval>$ = caseLabel(&$<expval>2, &@2); Expression_clear(&$<expval>2);}
+           | DEFAULT ':'          {$<nodeval>$ = caseLabel(NULL, &@1);}
+           ;
+
+
+
+Reductions    :                            {NodeList_init(&$<nodelistval>$);}
+              | REDUCE '(' ReductionList ')' {$<nodelistval>$ = $<nodelistval>3;}
+              ;
+ReductionList : ID                   {Node* variable = reductionVariable($1, &@1); NodeList_init(&$<nodelistval>$); NodeList_append(&$<nodelistval>$, variable); $<nodelistval>$.valid = (variable != NULL); free($1);}
+              | ReductionList ',' ID {Node* variable = reductionVariable($3, &@3); $<nodelistval>$ = $<nodelistval>1; NodeList_append(&$<nodelistval>$, variable); $<nodelistval>$.valid &= (variable != NULL); free($3);}
+              ;
+
+
+
+ForInitExp :         {$<nodeval>$ = NULL;}
+           | Exp     {$<nodeval>$ = expStatement(&$<expval>1); Expression_clear(&$<expval>1);}
+           | DeclVar {$<nodeval>$ = $<nodeval>1;}
            ;
-ForCondExp :
-           | Exp     {isExpConvToBool(&$<expval>1); Expression_clear(&$<expval>1);}
+ForCondExp :         {bool forever = true; $<nodeval>$ = Node_constant(&Type_bool, &forever);}
+           | Exp     {isExpConvToBool(&$<expval>1); $<nodeval>$ = $<expval>1.node; Expression_clear(&$<expval>1);}
            ;
-ForNextExp :
-           | Exp     {Expression_clear(&$<expval>1);}
+ForNextExp :         {$<nodeval>$ = NULL;}
+           | Exp     {$<nodeval>$ = expStatement(&$<expval>1); Expression_clear(&$<expval>1);}
            ;
 
 
 
-Exp  : VarAccess   {if(isVarInit($<varval>1) == true) Expression_set(&$<expval>$, NULL, $<varval>1, NULL); else Expression_reset(&$<expval>$);}
-     | FuncCall    {if($<funcval>1 != NULL) Expression_set(&$<expval>$, &$<funcval>1->return_type, NULL, NULL); else Expression_reset(&$<expval>$);}
+Exp  : VarAccess   {$<expval>$ = $<expval>1;}
+     | FuncCall    {$<expval>$ = $<expval>1;}
 
      | INT_CONSTANT    {Expression_set(&$<expval>$, &Type_int   , NULL, &$1);}
      | BOOL_CONSTANT   {Expression_set(&$<expval>$, &Type_bool  , NULL, &$1);}
      | DOUBLE_CONSTANT {Expression_set(&$<expval>$, &Type_double, NULL, &$1);}
      | CHAR_CONSTANT   {Expression_set(&$<expval>$, &Type_char  , NULL, &$1);}
-     | STRING_LITERAL  {Expression_set(&$<expval>$, &Type_string, NULL, &$1);}
+     | STRING_LITERAL  {Expression_set(&$<expval>$, &Type_string, NULL, &$1); free($1);}
 
      | Exp '=' Exp        {Expression_assign(&$<expval>1, &$<expval>3, &$<expval>$); Expression_clear(&$<expval>1); Expression_clear(&$<expval>3);}
 
@@ -182,8 +320,8 @@ Exp  : VarAccess   {if(isVarInit($<varval>1) == true) Expression_set(&$<expval>$
 
      | INC_OP Exp {Expression_preinc (&$<expval>2, &$<expval>$); Expression_clear(&$<expval>2);}
      | DEC_OP Exp {Expression_predec (&$<expval>2, &$<expval>$); Expression_clear(&$<expval>2);}
-     | Exp DEC_OP {Expression_postinc(&$<expval>1, &$<expval>$); Expression_clear(&$<expval>1);}
-     | Exp INC_OP {Expression_postdec(&$<expval>1, &$<expval>$); Expression_clear(&$<expval>1);}
+     | Exp INC_OP {Expression_postinc(&$<expval>1, &$<expval>$); Expression_clear(&$<expval>1);}
+     | Exp DEC_OP {Expression_postdec(&$<expval>1, &$<expval>$); Expression_clear(&$<expval>1);}
 
      | '!' Exp        {Expression_not(&$<expval>2, &$<expval>$); Expression_clear(&$<expval>2);}
      | Exp AND_OP Exp {Expression_and(&$<expval>1, &$<expval>3, &$<expval>$); Expression_clear(&$<expval>1); Expression_clear(&$<expval>3);}
@@ -215,19 +353,19 @@ TypePredef : INT
 /************************/
 
 
-DeclVar       : TypePredef ID               {Type t = {$1, NULL}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, false, &@2);}
-              | TypePredef ID ArrayDeclSize {Type t = {$1, NULL}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, false, &@2);}
-              | TypePredef ID '=' Exp       {Type t = {$1, NULL}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, true , &@2); if(var != NULL) initVar(var, &$<expval>4); Expression_clear(&$<expval>4);}
+DeclVar       : TypePredef ID               {Type t = Type_make($1, NULL, 0, NULL); $<nodeval>$ = defineVariable($2, &t, false, NULL, &@2);}
+              | TypePredef ID ArrayDeclSize {Type t = Type_make($1, NULL, 0, NULL); $<nodeval>$ = declareArray($2, &t, &$<nodelistval>3, &@2);}
+              | TypePredef ID '=' Exp       {Type t = Type_make($1, NULL, 0, NULL); $<nodeval>$ = defineVariable($2, &t, false, &$<expval>4, &@2); Expression_clear(&$<expval>4);}
 
-              | ID ID               {Type t = {CLASS, $1}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, false, &@2);}
-              | ID ID ArrayDeclSize {Type t = {CLASS, $1}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, false, &@2);}
-              | ID ID '=' Exp       {Type t = {CLASS, $1}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, true , &@2); if(var != NULL) initVar(var, &$<expval>4); Expression_clear(&$<expval>4);}
+              | ID ID               {Type t = classType($1, 0); resolveClass(&t); $<nodeval>$ = defineVariable($2, &t, false, NULL, &@2);}
+              | ID ID ArrayDeclSize {Type t = classType($1, 0); resolveClass(&t); $<nodeval>$ = declareArray($2, &t, &$<nodelistval>3, &@2);}
+              | ID ID '=' Exp       {Type t = classType($1, 0); resolveClass(&t); $<nodeval>$ = defineVariable($2, &t, false, &$<expval>4, &@2); Expression_clear(&$<expval>4);}
 
-              | CONST TypePredef ID '=' Exp {Type t = {$2, NULL}; Variable* var = declareVariable(&varlist, scope_level, $3, &t, true, true, &@3); if(var != NULL) initVar(var, &$<expval>5); Expression_clear(&$<expval>5);}
+              | CONST TypePredef ID '=' Exp {Type t = Type_make($2, NULL, 0, NULL); $<nodeval>$ = defineVariable($3, &t, true, &$<expval>5, &@3); Expression_clear(&$<expval>5);}
               ;
 
-ArrayDeclSize : '[' ConstIntExp ']'
-              | '[' ConstIntExp ']' ArrayDeclSize
+ArrayDeclSize : '[' ConstIntExp ']'               {Node* size = arraySize($2); NodeList_init(&$<nodelistval>$); NodeList_append(&$<nodelistval>$, size); $<nodelistval>$.valid = (size != NULL);}
+              | ArrayDeclSize '[' ConstIntExp ']' {Node* size = arraySize($3); $<nodelistval>$ = $<nodelistval>1; NodeList_append(&$<nodelistval>$, size); $<nodelistval>$.valid &= (size != NULL);}
               ;
 
 
@@ -236,9 +374,13 @@ ArrayDeclSize : '[' ConstIntExp ']'
 /* Function declaration */
 /************************/
 
-DeclFunc              : TypePredef ID {enterBlock();} '(' DeclParamList ')' {Type ret_t = {$1,0};     declareFunction(FunctionListStack_top(&funcliststack), scope_level - 1, $2, &ret_t, &$<typelistval>5, &@2);} '{' Stmts '}' {exitBlock();}
-                      | ID         ID {enterBlock();} '(' DeclParamList ')' {Type ret_t = {CLASS,$1}; declareFunction(FunctionListStack_top(&funcliststack), scope_level - 1, $2, &ret_t, &$<typelistval>5, &@2);} '{' Stmts '}' {exitBlock();}
-                      | VOID       ID {enterBlock();} '(' DeclParamList ')' {Type ret_t = {VOID,0};   declareFunction(FunctionListStack_top(&funcliststack), scope_level - 1, $2, &ret_t, &$<typelistval>5, &@2);} '{' Stmts '}' {exitBlock();}
+DeclFunc              : TypePredef ID {enterBlock(); Type ret_t = Type_make($1, NULL, 0, NULL); $<routineval>$ = beginRoutine(&ret_t, &@2);} '(' DeclParamList ')' {Type ret_t = Type_make($1, NULL, 0, NULL); declareRoutine($2, &ret_t, &$<typelistval>5, &@2); deferBody(&@1, yychar);} FuncBody {endRoutine($<routineval>3, &$<nodelistval>8); exitBlock();}
+                      | ID         ID {enterBlock(); Type ret_t = classType($1, 0); resolveClass(&ret_t); $<routineval>$ = beginRoutine(&ret_t, &@2);} '(' DeclParamList ')' {Type ret_t = current_routine->return_type; declareRoutine($2, &ret_t, &$<typelistval>5, &@2); deferBody(&@1, yychar);} FuncBody {endRoutine($<routineval>3, &$<nodelistval>8); exitBlock();}
+                      | VOID       ID {enterBlock(); Type ret_t = Type_void; $<routineval>$ = beginRoutine(&ret_t, &@2);} '(' DeclParamList ')' {Type ret_t = Type_void; declareRoutine($2, &ret_t, &$<typelistval>5, &@2); deferBody(&@1, yychar);} FuncBody {endRoutine($<routineval>3, &$<nodelistval>8); exitBlock();}
+                      ;
+
+FuncBody              : '{' Stmts '}'  {$<nodelistval>$ = $<nodelistval>2;}
+                      | SKIPPED_BODY   {NodeList_init(&$<nodelistval>$);}
                       ;
 
 DeclParamList         :                       {$<typelistval>$.elements = NULL; $<typelistval>$.capacity = 0; $<typelistval>$.size = 0;}
@@ -249,8 +391,8 @@ DeclParamListNonEmpty : DeclParam                           {$<typelistval>$.ele
                       | DeclParamListNonEmpty ',' DeclParam {TypeList_insert(&$<typelistval>1, &$3); $<typelistval>$ = $<typelistval>1;}
                       ;
 
-DeclParam             : TypePredef ID {$$.type = $1; $$.class_name = NULL; Type t = {$1, NULL}; declareVariable(&varlist, scope_level, $2, &t, false, true, &@2);}
-                      | ID ID         {$$.type = CLASS; $$.class_name = $1; Type t = {CLASS, $1}; declareVariable(&varlist, scope_level, $2, &t, false, true, &@2);}
+DeclParam             : TypePredef ID {$$ = Type_make($1, NULL, 0, NULL); allocateVariable($2, &$$, false, true, &@2);}
+                      | ID ID         {$$ = classType($1, 0); resolveClass(&$$); allocateVariable($2, &$$, false, true, &@2);}
                       ;
 
 
@@ -259,11 +401,11 @@ DeclParam             : TypePredef ID {$$.type = $1; $$.class_name = NULL; Type
 /* Class declaration */
 /*********************/
 
-AccessModifier   : PUBLIC
-                 | PRIVATE
+AccessModifier   : PUBLIC  {member_access = PUBLIC;}
+                 | PRIVATE {member_access = PRIVATE;}
                  ;
 
-DeclClass        : CLASS ID {enterBlock(); Type t = {CLASS, strdup($2)}; declareVariable(&varlist, scope_level, strdup("this"), &t, true, true, &yylloc);} '{' DeclClassMembers '}' {exitBlock();}
+DeclClass        : CLASS ID {$<layoutval>$ = beginClass($2, &@2); enterBlock();} '{' DeclClassMembers '}' {exitBlock(); endClass($<layoutval>3);}
                  ;
 
 DeclClassMembers : DeclClassMember
@@ -276,11 +418,11 @@ DeclClassMember  : AccessModifier ClassDeclVar ';'
 
 
 
-ClassDeclVar     : TypePredef ID               {Type t = {$1, NULL}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, true, &@2);}
-                 | TypePredef ID ArrayDeclSize {Type t = {$1, NULL}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, true, &@2);}
+ClassDeclVar     : TypePredef ID               {Type t = Type_make($1, NULL, 0, NULL); declareField($2, &t, NULL, &@2);}
+                 | TypePredef ID ArrayDeclSize {Type t = Type_make($1, NULL, $<nodelistval>3.size, NULL); declareField($2, &t, &$<nodelistval>3, &@2);}
 
-                 | ID ID               {Type t = {CLASS, $1}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, true, &@2);}
-                 | ID ID ArrayDeclSize {Type t = {CLASS, $1}; Variable* var = declareVariable(&varlist, scope_level, $2, &t, false, true, &@2);}
+                 | ID ID               {Type t = classType($1, 0); declareField($2, &t, NULL, &@2);}
+                 | ID ID ArrayDeclSize {Type t = classType($1, $<nodelistval>3.size); declareField($2, &t, &$<nodelistval>3, &@2);}
                  ;
 
 
@@ -289,20 +431,16 @@ ClassDeclVar     : TypePredef ID               {Type t = {$1, NULL}; Variable* v
 /* Variable access */
 /*******************/
 
-VarAccess       : ID                  {$<varval>$ = isVarDecl($<idval>1); free($<idval>1);}
-                | ID VarAccessExtra   {$<varval>$ = NULL; isVarDecl($<idval>1); free($<idval>1);}
-                | THIS                {$<varval>$ = isVarDecl($<idval>1); free($<idval>1);}
-                | THIS VarAccessExtra {$<varval>$ = NULL; isVarDecl($<idval>1); free($<idval>1);}
-                ;
-
-VarAccessExtra  : '.' ID                       {free($2);}
-                | '.' ID VarAccessExtra        {free($2);}
-                | ArrayIndexing                {}
-                | ArrayIndexing VarAccessExtra {}
+VarAccess       : ID                             {accessVariable(&$<expval>$, $<idval>1, NULL); free($<idval>1);}
+                | ID ArrayIndexing               {accessVariable(&$<expval>$, $<idval>1, &$<nodelistval>2); free($<idval>1);}
+                | THIS                           {accessVariable(&$<expval>$, $<idval>1, NULL); free($<idval>1);}
+                | THIS ArrayIndexing             {accessVariable(&$<expval>$, $<idval>1, &$<nodelistval>2); free($<idval>1);}
+                | VarAccess '.' ID               {accessField(&$<expval>$, &$<expval>1, $3, NULL); free($3);}
+                | VarAccess '.' ID ArrayIndexing {accessField(&$<expval>$, &$<expval>1, $3, &$<nodelistval>4); free($3);}
                 ;
 
-ArrayIndexing   : '[' Exp ']'               {Expression_clear(&$<expval>2);}
-                | '[' Exp ']' ArrayIndexing {Expression_clear(&$<expval>2);}
+ArrayIndexing   : '[' Exp ']'               {NodeList_init(&$<nodelistval>$); addIndex(&$<nodelistval>$, &$<expval>2); Expression_clear(&$<expval>2);}
+                | ArrayIndexing '[' Exp ']' {$<nodelistval>$ = $<nodelistval>1; addIndex(&$<nodelistval>$, &$<expval>3); Expression_clear(&$<expval>3);}
                 ;
 
 
@@ -311,23 +449,13 @@ ArrayIndexing   : '[' Exp ']'               {Expression_clear(&$<expval>2);}
 /* Function call */
 /*****************/
 
-FuncCall         : FuncAccess '(' FuncParamExpList ')' {Function* func = isFuncDecl($<idval>1, &$<typelistval>3); $<funcval>$ = func; TypeList_clear(&$<typelistval>3); free($<idval>1);}
-                 ;
-
-FuncParamExpList :                          {$<typelistval>$.elements = NULL; $<typelistval>$.capacity = 0; $<typelistval>$.size = 0;}
-                 | Exp                      {$<typelistval>$.elements = NULL; $<typelistval>$.capacity = 0; $<typelistval>$.size = 0; TypeList_insert(&$<typelistval>$, &$<expval>1.type); Expression_clear(&$<expval>1);}
-                 | FuncParamExpList ',' Exp {$<typelistval>$ = $<typelistval>1; TypeList_insert(&$<typelistval>$, &$<expval>3.type); Expression_clear(&$<expval>3);}
-                 ;
-
-FuncAccess       : ID                   {$<idval>$ = $<idval>1;}
-                 | ID FuncAccessExtra   {$<idval>$ = NULL; isVarDecl($<idval>1); free($<idval>1);}
-                 | THIS                 {$<idval>$ = $<idval>1;}
-                 | THIS FuncAccessExtra {$<idval>$ = NULL; isVarDecl($<idval>1); free($<idval>1);}
+FuncCall         : ID '(' FuncParamExpList ')'               {callFunction(&$<expval>$, $<idval>1, &$<argsval>3); free($<idval>1);}
+                 | VarAccess '.' ID '(' FuncParamExpList ')' {callMethod(&$<expval>$, &$<expval>1, $3, &$<argsval>5); free($3);}
                  ;
 
-FuncAccessExtra  : '.' ID                        {free($2);}
-                 | '.' ID FuncAccessExtra        {free($2);}
-                 | ArrayIndexing FuncAccessExtra {}
+FuncParamExpList :                          {memset(&$<argsval>$.types, 0, sizeof(TypeList)); NodeList_init(&$<argsval>$.nodes);}
+                 | Exp                      {memset(&$<argsval>$.types, 0, sizeof(TypeList)); NodeList_init(&$<argsval>$.nodes); addArgument(&$<argsval>$, &$<expval>1); Expression_clear(&$<expval>1);}
+                 | FuncParamExpList ',' Exp {$<argsval>$ = $<argsval>1; addArgument(&$<argsval>$, &$<expval>3); Expression_clear(&$<expval>3);}
                  ;
 
 
@@ -336,16 +464,16 @@ FuncAccessExtra  : '.' ID                        {free($2);}
 /* Constants */
 /*************/
 
-ConstIntExp : INT_CONSTANT
+ConstIntExp : INT_CONSTANT {$$ = $1;}
 
-            | ConstIntExp '+' ConstIntExp
-            | ConstIntExp '-' ConstIntExp
-            | ConstIntExp '*' ConstIntExp
-            | ConstIntExp '/' ConstIntExp
-            | ConstIntExp '%' ConstIntExp
+            | ConstIntExp '+' ConstIntExp {$$ = (long)((unsigned long)$1 + (unsigned long)$3);}
+            | ConstIntExp '-' ConstIntExp {$$ = (long)((unsigned long)$1 - (unsigned long)$3);}
+            | ConstIntExp '*' ConstIntExp {$$ = (long)((unsigned long)$1 * (unsigned long)$3);}
+            | ConstIntExp '/' ConstIntExp {$$ = divideConstants($1, $3, false);}
+            | ConstIntExp '%' ConstIntExp {$$ = divideConstants($1, $3, true);}
 
-            | '-' ConstIntExp     %prec ','
-            | '(' ConstIntExp ')'
+            | '-' ConstIntExp     %prec ',' {$$ = (long)(0ul - (unsigned long)$2);}
+            | '(' ConstIntExp ')'           {$$ = $2;}
             ;
 
 
@@ -356,47 +484,104 @@ ConstIntExp : INT_CONSTANT
 /******************************************************************************/
 int yywrap()
 {
-    if(error_count == 0)
-    {
-        for(int i = 0; i < printqueue.size; ++i)
-            fprintf(yyout, "%ld\n", printqueue.elements[i]);
-        PrintQueue_clear(&printqueue);
-    }
-
     return 1;
 }
 
-void handleSIGSEGV(int s)
-{
-    yyerror("SIGSEGV caught... aborting");
-    abort();
-}
+/* Only the main thread scans, the threads analyzing bodies read tokens it recorded */
+YYSTYPE yylval;
+__thread YYLTYPE yylloc = {1, 1, 1, 1};
 
-int main(int argc, char** argv)
+
+
+/* A token as the scanner returned it */
+typedef struct Token
 {
-    signal(SIGSEGV, handleSIGSEGV);
+    int kind;
+    YYSTYPE value;
+    YYLTYPE location;
+} Token;
 
-    if(argc >= 2)
+typedef struct TokenList
+{
+    Token* elements;
+    int size;
+    int capacity;
+} TokenList;
+
+/* What a skipped function body needs to be parsed later as if it were parsed where it was declared: its tokens,
+ * starting with DEFERRED_BODY, and its parameters. The global declarations it sees are those made before it,
+ * which are found by their order instead of being copied for every body */
+typedef struct DeferredBody
+{
+    TokenList tokens;
+    VariableList params;
+    long order;      /* of the last declaration it sees */
+    int class_count; /* the classes it sees are the first ones of the list */
+    bool declares;   /* it may declare functions or classes, which are added to the program */
+} DeferredBody;
+
+/* Tokens yylex returns before scanning more: tokens read ahead and put back, or the rest of the body being analyzed */
+static __thread TokenList queued = {0};
+static __thread int queued_position = 0;
+static __thread bool queued_ends_input = false; /* the queued tokens are a whole body, nothing follows them */
+
+static void appendToken(TokenList* list, const Token* token)
+{
+    if(list->size == list->capacity)
     {
-        FILE* fp = fopen(argv[1], "r");
-        if(fp == NULL)
-        {
-            fprintf(stderr, "could not open file %s\n", argv[1]);
-            return 1;
-        }
-
-        if((yyin != NULL && fclose(yyin) != 0) || fclose(stdin) != 0)
+        int new_capacity = 1 + list->capacity * 2;
+        Token* new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_list == NULL)
         {
-            fprintf(stderr, "fclose failed\n");
-            return 1;
+            yyerror("not enough memory to skip function body");
+            abort();
         }
 
-        yyin = fp;
-        stdin = yyin;
+        list->elements = new_list;
+        list->capacity = new_capacity;
     }
 
-    yyparse();
-    return 0;
+    list->elements[list->size] = (*token);
+    ++list->size;
+}
+
+static void freeTokenValue(Token* token)
+{
+    if(token->kind == ID || token->kind == THIS)
+        free(token->value.idval);
+    else if(token->kind == STRING_LITERAL)
+        free(token->value.strval);
+}
+
+/* A parse stopped by a syntax error may leave tokens read ahead */
+void discardQueuedTokens()
+{
+    for(int i = queued_position; i < queued.size; ++i)
+        freeTokenValue(&queued.elements[i]);
+    free(queued.elements);
+    memset(&queued, 0, sizeof(queued));
+    queued_position = 0;
+}
+
+int yylex(YYSTYPE* value, YYLTYPE* location)
+{
+    if(queued_position < queued.size)
+    {
+        const Token* token = &queued.elements[queued_position++];
+        yylloc = token->location;
+        (*value) = token->value;
+        (*location) = token->location;
+        return token->kind;
+    }
+    if(queued_ends_input)
+        return 0;
+
+    if(queued.capacity != 0)
+        discardQueuedTokens();
+    const int kind = scanToken();
+    (*value) = yylval;
+    (*location) = yylloc;
+    return kind;
 }
 
 
@@ -414,12 +599,16 @@ Variable* declareVariable(VariableList* varlist, int scope_level, char* name, co
 
     if(current_position >= 0)
     {
-        if(varlist->elements[current_position].scope_level == scope_level)
+        if(varlist->declarations[current_position].scope_level == scope_level)
         {
-            yyerror("variable %s was already declared at (%zu,%zu)", name, varlist->elements[current_position].decl_line, varlist->elements[current_position].decl_column);
+            const Declaration* previous = &varlist->declarations[current_position];
+            const YYLTYPE related = {previous->decl_line, previous->decl_column, previous->decl_line, previous->decl_column};
+            yyerrorRelated(&related, "variable %s was already declared at (%d,%d)", name, previous->decl_line, previous->decl_column);
+            free(name);
             return NULL;
         }
 
+        insert_position = current_position;
         const int error = VariableList_replace(varlist, name, strlen(name), type, scope_level, constant, initialized, yylloc->first_line, yylloc->first_column, current_position);
         if(error == -1)
         {
@@ -453,16 +642,20 @@ Function* declareFunction(FunctionList* funclist, int scope_level, char* name, c
 
     if(current_position >= 0)
     {
-        if(funclist->elements[current_position].scope_level == scope_level)
+        if(funclist->declarations[current_position].scope_level == scope_level)
         {
-            yyerror("function %s was already declared at (%zu,%zu) with the following parameter types",
-                name, funclist->elements[current_position].decl_line, funclist->elements[current_position].decl_column);
-            fputc('\t', stderr);
-            TypeList_print(typelist, stderr);
-            fputc('\n', stderr);
+            const Declaration* previous = &funclist->declarations[current_position];
+            const YYLTYPE related = {previous->decl_line, previous->decl_column, previous->decl_line, previous->decl_column};
+            char* types = TypeList_toString(typelist);
+            yyerrorRelated(&related, "function %s was already declared at (%d,%d) with the following parameter types\n\t%s",
+                name, previous->decl_line, previous->decl_column, types);
+            free(types);
+            TypeList_clear(typelist);
+            free(name);
             return NULL;
         }
 
+        insert_position = current_position;
         const int error = FunctionList_replace(funclist, name, strlen(name), scope_level, return_type, typelist, yylloc->first_line, yylloc->first_column, current_position);
         if(error == -1)
         {
@@ -483,123 +676,1302 @@ Function* declareFunction(FunctionList* funclist, int scope_level, char* name, c
     return &funclist->elements[insert_position];
 }
 
-
-
-void enterBlock()
+Class* declareClass(ClassList* classlist, int scope_level, char* name, const YYLTYPE* yylloc)
 {
-    if(VariableListStack_push(&varliststack, &varlist) != 0)
+    if(name == NULL)
     {
-        yyerror("not enough memory to push variable declarations list on the stack");
+        yyerror("not enough memory to declare class");
         abort();
     }
 
-    if(FunctionListStack_push(&funcliststack, &funclist) != 0)
+    const int current_position = ClassList_find(classlist, name);
+    if(current_position >= 0 && classlist->elements[current_position].scope_level == scope_level)
     {
-        yyerror("not enough memory to push function declarations list on the stack");
+        const Class* previous = &classlist->elements[current_position];
+        const YYLTYPE related = {previous->decl_line, previous->decl_column, previous->decl_line, previous->decl_column};
+        yyerrorRelated(&related, "class %s was already declared at (%d,%d)", name, previous->decl_line, previous->decl_column);
+        free(name);
+        return NULL;
+    }
+
+    if(ClassList_insert(classlist, name, scope_level, yylloc->first_line, yylloc->first_column) != 0)
+    {
+        yyerror("not enough memory to declare class %s", name);
         abort();
     }
 
-    ++scope_level;
+    return &classlist->elements[classlist->size - 1];
 }
-void exitBlock()
+
+/* Takes the name of the class, of which the type keeps its own copy */
+Type classType(char* name, int dimensions)
 {
-    VariableListStack_pop(&varliststack, &varlist);
-    FunctionListStack_pop(&funcliststack, &funclist);
-    --scope_level;
+    const Type type = Type_make(CLASS, name, dimensions, NULL);
+    free(name);
+    return type;
+}
+
+/* An undeclared class is reported and leaves the layout NULL */
+bool resolveClass(Type* type)
+{
+    const int position = ClassList_find(&classlist, Type_className(type));
+    (*type) = Type_withLayout(type, (position >= 0 ? classlist.elements[position].layout : NULL));
+    if(type->layout == NULL)
+        yyerror("class %s is undeclared", Type_className(type));
+    return type->layout != NULL;
 }
 
 
 
-Variable* isVarDecl(const char* name)
+/* Declare a variable and give it storage among the locals of the current function, or among the globals */
+Variable* allocateVariable(char* name, const Type* type, bool constant, bool initialized, const YYLTYPE* yylloc)
 {
-    if(name == NULL)
+    Variable* var = declareVariable(&varlist, scope_level, name, type, constant, initialized, yylloc);
+    if(var == NULL)
         return NULL;
 
-    const int position = VariableList_find(&varlist, name, NULL);
-    if(position == -1)
+    var->routine = current_routine;
+    if(current_routine == NULL)
     {
-        yyerror("Variable %s is undeclared", name);
-        return NULL;
+        var->slot = Program_addGlobal(&var->type);
+        return var;
     }
 
-    return &varlist.elements[position];
+    Type slot = var->type;
+    if(TypeList_insert(&current_routine->slots, &slot) != 0)
+    {
+        yyerror("not enough memory to declare variable %s", var->name);
+        abort();
+    }
+
+    var->slot = current_routine->slots.size - 1;
+    return var;
 }
-bool isVarInit(const Variable* var)
+
+/* Objects declared without a value are created with every field zeroed */
+Node* defineVariable(char* name, const Type* type, bool constant, const Expression* exp, const YYLTYPE* yylloc)
 {
+    Variable* var = allocateVariable(name, type, constant, (exp != NULL || type->type == CLASS), yylloc);
     if(var == NULL)
-        return false;
+        return NULL;
 
-    if(var->initialized == false)
-        yyerror("Variable %s was not explicitly initialized", var->name);
-    return var->initialized;
+    if(exp != NULL)
+        initVar(var, exp);
+
+    return Node_create(NODE_DECL, &var->type, Node_variable(var), (exp != NULL ? exp->node : NULL), NULL, NULL);
 }
-void initVar(Variable* var, const Expression* exp)
+
+/* The elements start zeroed, so an array is initialized by its declaration */
+Node* declareArray(char* name, const Type* type, const NodeList* sizes, const YYLTYPE* yylloc)
 {
-    if(exp->type.type == INVAL_TYPE)
+    const Type array_type = Type_withDimensions(type, sizes->size);
+
+    Variable* var = allocateVariable(name, &array_type, false, true, yylloc);
+    if(var == NULL || sizes->valid == false)
+        return NULL;
+
+    Node* node = Node_create(NODE_DECL_ARRAY, &var->type, Node_variable(var), sizes->first, NULL, NULL);
+    node->count = sizes->size;
+    return node;
+}
+
+Node* arraySize(long size)
+{
+    if(size <= 0)
+    {
+        yyerror("the size of an array must be positive");
+        return NULL;
+    }
+
+    return Node_constant(&Type_int, &size);
+}
+
+
+
+/* Start the code of a function. Returns the function whose body was being parsed.
+ * The functions declared among the members of a class are its methods, which take this as a hidden first parameter */
+Routine* beginRoutine(const Type* return_type, const YYLTYPE* yylloc)
+{
+    Routine* previous = current_routine;
+    current_routine = Program_addRoutine(return_type, yylloc);
+
+    if(current_class != NULL && previous == current_class->routine)
+    {
+        const Type self = Type_make(CLASS, current_class->name, 0, current_class);
+        current_routine->method = true;
+        allocateVariable(strdup("this"), &self, false, true, yylloc);
+    }
+
+    return previous;
+}
+
+void copyTypes(const TypeList* src, TypeList* dst)
+{
+    memset(dst, 0, sizeof(*dst));
+    for(int i = 0; i < src->size; ++i)
+    {
+        Type type = src->elements[i];
+        if(TypeList_insert(dst, &type) != 0)
+        {
+            yyerror("not enough memory to copy parameter types");
+            abort();
+        }
+    }
+}
+
+void declareRoutine(char* name, const Type* return_type, TypeList* paramtypes, const YYLTYPE* yylloc)
+{
+    const bool method = current_routine->method;
+    const char* class_name = (method ? current_class->name : "");
+
+    char* types = TypeList_toString(paramtypes);
+    current_routine->name = malloc(strlen(class_name) + strlen(name) + (types != NULL ? strlen(types) : 0) + 4);
+    if(current_routine->name == NULL)
+    {
+        yyerror("not enough memory to declare function %s", name);
+        abort();
+    }
+
+    sprintf(current_routine->name, "%s%s%s%s", class_name, (method ? "." : ""), name, (types != NULL ? types : "()"));
+    current_routine->param_count = paramtypes->size + (method ? 1 : 0);
+    free(types);
+
+    TypeList method_params = {0};
+    if(method)
+        copyTypes(paramtypes, &method_params);
+
+    FunctionList* outer = FunctionListStack_top(&funcliststack);
+    Function* func = declareFunction(outer, scope_level - 1, name, return_type, paramtypes, yylloc);
+    if(func == NULL)
+    {
+        TypeList_clear(&method_params);
         return;
-    if(Type_equal(&var->type, &exp->type) == false)
+    }
+
+    func->routine = current_routine;
+    if(method)
     {
-        yyerror("the sides of '=' have different types");
+        func->owner = current_class;
+        if(ClassLayout_addMethod(current_class, strdup(func->name), &method_params, current_routine, member_access) != 0)
+        {
+            yyerror("not enough memory to declare method %s", func->name);
+            abort();
+        }
+    }
+
+    /* The body sees the function too, so that it can call itself. The copy belongs to the outer scope, which frees it */
+    int insert_position;
+    const int current_position = FunctionList_find(&funclist, func->name, &func->paramtypes, &insert_position);
+    const Declaration* declaration = FunctionList_declaration(outer, func);
+    if(current_position >= 0)
+        FunctionList_assign(&funclist, current_position, func, declaration);
+    else if(FunctionList_insertElement(&funclist, func, declaration, insert_position) != 0)
+    {
+        yyerror("not enough memory to declare function %s", func->name);
+        abort();
+    }
+}
+
+/* With lazy analysis or several jobs, skip the body of a function declared at global scope: record its tokens up to
+ * the matching brace and keep the scope it sees, for analyzeBody. The parser reads SKIPPED_BODY instead of the body.
+ * declaration is its location. The parser has not read the '{' yet, since the rule reduced here needs no lookahead */
+void deferBody(const YYLTYPE* declaration, int lookahead)
+{
+    if((program.analysis == ANALYSIS_EAGER && program.jobs <= 1) || scope_level != 1 || current_class != NULL || lookahead != YYEMPTY
+        || queued_position < queued.size || queued_ends_input)
         return;
+
+    DeferredBody* body = calloc(1, sizeof(*body));
+    if(body == NULL)
+    {
+        yyerror("not enough memory to skip function body");
+        abort();
     }
 
-    switch(var->type.type)
+    Token token = {DEFERRED_BODY, {0}, (*declaration)};
+    appendToken(&body->tokens, &token);
+
+    /* A function is declared by a type, its name and '(', a call only by its name and '(' */
+    int depth = 0;
+    int previous[2] = {0, 0};
+    do
     {
-    case INT:    var->intval    = exp->intval;    break;
-    case BOOL:   var->boolval   = exp->boolval;   break;
-    case DOUBLE: var->doubleval = exp->doubleval; break;
-    case CHAR:   var->charval   = exp->charval;   break;
-    case STRING: var->strval    = exp->strval;    break;
-    case CLASS:  break;
+        token.kind = scanToken();
+        token.value = yylval;
+        token.location = yylloc;
+        appendToken(&body->tokens, &token);
+        depth += (token.kind == '{') - (token.kind == '}');
+
+        if(token.kind == CLASS || token.kind == IMPORT)
+            body->declares = true;
+        else if(token.kind == '(' && previous[1] == ID)
+            body->declares |= (previous[0] == INT || previous[0] == BOOL || previous[0] == DOUBLE || previous[0] == CHAR
+                               || previous[0] == STRING || previous[0] == VOID || previous[0] == ID);
+        previous[0] = previous[1];
+        previous[1] = token.kind;
+    }
+    while(depth > 0 && token.kind != 0);
+
+    /* Not a body, or one the input ends in. The parser reads the tokens and reports the error */
+    if(body->tokens.elements[1].kind != '{' || depth != 0)
+    {
+        queued = body->tokens;
+        queued_position = 1;
+        free(body);
+        return;
+    }
+
+    /* The parameters move to the body, the scope that is left ends with the SKIPPED_BODY token */
+    int kept = 0;
+    for(int i = 0; i < varlist.size; ++i)
+    {
+        if(varlist.declarations[i].scope_level != scope_level)
+            VariableList_assign(&varlist, kept++, &varlist.elements[i], &varlist.declarations[i]);
+        else if(VariableList_insertElement(&body->params, &varlist.elements[i], &varlist.declarations[i], body->params.size) != 0)
+        {
+            yyerror("not enough memory to skip function body");
+            abort();
+        }
     }
+    varlist.size = kept;
+
+    body->order = declaration_count;
+    body->class_count = classlist.size;
+    current_routine->deferred = body;
+    ++program.skipped_bodies;
+
+    const YYLTYPE* first = &body->tokens.elements[1].location;
+    Token skipped = {SKIPPED_BODY, {0}, {first->first_line, first->first_column, token.location.last_line, token.location.last_column}};
+    appendToken(&queued, &skipped);
 }
 
-Function* isFuncDecl(const char* name, const TypeList* typelist)
+void endRoutine(Routine* previous, const NodeList* body)
 {
-    if(name == NULL || typelist == NULL)
-        return NULL;
+    current_routine->body = statement(NODE_BLOCK, body->first, NULL, NULL, NULL);
+    current_routine = previous;
+}
 
-    const int position = FunctionList_find(&funclist, name, typelist, NULL);
-    if(position == -1)
+/* The global declarations, which the outermost analysis finds at the bottom of the stack of scopes */
+static __thread VariableList global_variables;
+static __thread FunctionList global_functions;
+static __thread ClassList global_classes;
+static __thread int analysis_depth = 0;
+
+/* The scope of a skipped body: the global declarations made before it, then its parameters */
+static void restoreScope(const DeferredBody* body)
+{
+    for(int i = 0; i < global_variables.size; ++i)
+        if(global_variables.declarations[i].scope_level == 0 && global_variables.declarations[i].order <= body->order
+            && VariableList_insertElement(&varlist, &global_variables.elements[i], &global_variables.declarations[i], varlist.size) != 0)
+        {
+            yyerror("not enough memory to analyze function body");
+            abort();
+        }
+
+    for(int i = 0; i < global_functions.size; ++i)
+        if(global_functions.declarations[i].scope_level == 0 && global_functions.declarations[i].order <= body->order
+            && FunctionList_insertElement(&funclist, &global_functions.elements[i], &global_functions.declarations[i], funclist.size) != 0)
+        {
+            yyerror("not enough memory to analyze function body");
+            abort();
+        }
+
+    for(int i = 0; i < body->params.size; ++i)
     {
-        yyerror("No function %s was declared with the following parameter types", name);
-        fputc('\t', stderr);
-        TypeList_print(typelist, stderr);
-        fputc('\n', stderr);
-        return NULL;
+        int insert_position;
+        const int current_position = VariableList_find(&varlist, body->params.elements[i].name, &insert_position);
+        if(current_position >= 0)
+            VariableList_assign(&varlist, current_position, &body->params.elements[i], &body->params.declarations[i]);
+        else if(VariableList_insertElement(&varlist, &body->params.elements[i], &body->params.declarations[i], insert_position) != 0)
+        {
+            yyerror("not enough memory to analyze function body");
+            abort();
+        }
     }
 
-    return &funclist.elements[position];
+    classlist.elements = (body->class_count != 0 ? memdup(global_classes.elements, body->class_count * sizeof(classlist.elements[0])) : NULL);
+    if(classlist.elements == NULL && body->class_count != 0)
+    {
+        yyerror("not enough memory to analyze function body");
+        abort();
+    }
+    classlist.size = body->class_count;
+    classlist.capacity = body->class_count;
 }
 
-bool isExpConvToBool(const Expression* exp)
+/* Parse a skipped body in the scope it was declared in, then go back to what was being parsed.
+ * The parser is pure, so the lookahead token of the current parse stays in its frame. Returns the result of yyparse */
+static int parseBody(Routine* routine, DeferredBody* body)
 {
-    switch(exp->type.type)
+    const YYLTYPE saved_lloc = yylloc;
+    const YYLTYPE saved_node_location = node_location;
+    const TokenList saved_queued = queued;
+    const int saved_position = queued_position;
+    const bool saved_ends_input = queued_ends_input;
+    const int saved_scope_level = scope_level;
+    const int saved_stack_size = varliststack.size;
+    const VariableList saved_varlist = varlist;
+    const FunctionList saved_funclist = funclist;
+    const ClassList saved_classlist = classlist;
+    Routine* const saved_routine = current_routine;
+    ClassLayout* const saved_class = current_class;
+
+    scope_level = 1;
+    memset(&varlist, 0, sizeof(varlist));
+    memset(&funclist, 0, sizeof(funclist));
+    restoreScope(body);
+    current_routine = routine;
+    current_class = NULL;
+    queued = body->tokens;
+    queued_position = 0;
+    queued_ends_input = true;
+
+    const int result = yyparse();
+
+    /* A syntax error leaves blocks open and tokens unread */
+    while(varliststack.size > saved_stack_size)
+        exitBlock();
+    discardQueuedTokens();
+    VariableList_clear(&varlist, scope_level);
+    FunctionList_clear(&funclist, scope_level);
+    ClassList_pop(&classlist, scope_level);
+    free(classlist.elements);
+    VariableList_release(&body->params);
+    free(body);
+
+    yylloc = saved_lloc;
+    node_location = saved_node_location;
+    queued = saved_queued;
+    queued_position = saved_position;
+    queued_ends_input = saved_ends_input;
+    scope_level = saved_scope_level;
+    varlist = saved_varlist;
+    funclist = saved_funclist;
+    classlist = saved_classlist;
+    current_routine = saved_routine;
+    current_class = saved_class;
+    return result;
+}
+
+/* Analyze a skipped body, on the first call that resolves to it with lazy analysis */
+int analyzeBody(Routine* routine)
+{
+    DeferredBody* body = routine->deferred;
+    routine->deferred = NULL; /* recursive calls find it analyzed */
+    ++program.deferred_bodies;
+
+    if(analysis_depth == 0)
     {
-    case INT:
-    case BOOL:
-    case DOUBLE:
-    case CHAR:
-    case STRING:
-        return true;
+        global_variables = (varliststack.size != 0 ? varliststack.elements[0] : varlist);
+        global_functions = (funcliststack.size != 0 ? funcliststack.elements[0] : funclist);
+        global_classes = classlist;
     }
 
-    return false;
+    ++analysis_depth;
+    const int result = parseBody(routine, body);
+    --analysis_depth;
+    return result;
 }
-void addExpToPrint(const Expression* exp)
+
+
+
+/* Analysis of the skipped bodies on several threads. Every body keeps its diagnostics and its counts of errors,
+ * which are merged in the order of the bodies once they are all analyzed */
+typedef struct BodyTask
 {
-    if(exp->type.type == INVAL_TYPE)
-        return;
+    Routine* routine;
+    DeferredBody* body; /* freed once analyzed */
+    bool declares;
+    DiagnosticList diagnostics;
+    int error_count;
+    int warning_count;
+    int result;
+} BodyTask;
+
+typedef struct BodyQueue
+{
+    BodyTask* tasks;
+    int size;
+    int next; /* the first task no thread took, updated atomically */
+    VariableList variables;
+    FunctionList functions;
+    ClassList classes;
+} BodyQueue;
+
+typedef struct BodyWorker
+{
+    BodyQueue* queue;
+    Arena arena; /* of the nodes it creates, merged into the arena of the program */
+    pthread_t thread;
+} BodyWorker;
+
+static void runTask(BodyTask* task)
+{
+    diagnostic_buffer = &task->diagnostics;
+    error_count = 0;
+    warning_count = 0;
+
+    task->result = parseBody(task->routine, task->body);
+
+    task->error_count = error_count;
+    task->warning_count = warning_count;
+    diagnostic_buffer = NULL;
+}
+
+/* Takes the tasks that do not change the program until there are none left */
+static void* analyzeBodies(void* data)
+{
+    BodyWorker* worker = data;
+    BodyQueue* queue = worker->queue;
+    const int saved_error_count = error_count;
+    const int saved_warning_count = warning_count;
+
+    global_variables = queue->variables;
+    global_functions = queue->functions;
+    global_classes = queue->classes;
+    node_arena = &worker->arena;
+    ++analysis_depth;
+
+    for(int i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED); i < queue->size; i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED))
+        if(queue->tasks[i].declares == false)
+            runTask(&queue->tasks[i]);
+
+    --analysis_depth;
+    node_arena = NULL;
+    error_count = saved_error_count;
+    warning_count = saved_warning_count;
+    return NULL;
+}
 
-    if(exp->type.type != INT)
+/* Bodies declaring functions or classes add them to the program, so they are analyzed first, on this thread */
+static void analyzeInParallel(BodyTask* tasks, int size)
+{
+    BodyQueue queue = {tasks, size, 0, {0}, {0}, {0}};
+    queue.variables = varlist;
+    queue.functions = funclist;
+    queue.classes = classlist;
+
+    const int saved_error_count = error_count;
+    const int saved_warning_count = warning_count;
+    global_variables = queue.variables;
+    global_functions = queue.functions;
+    global_classes = queue.classes;
+    ++analysis_depth;
+    for(int i = 0; i < size; ++i)
+        if(tasks[i].declares)
+            runTask(&tasks[i]);
+    --analysis_depth;
+    error_count = saved_error_count;
+    warning_count = saved_warning_count;
+
+    const int count = (program.jobs < size ? program.jobs : size);
+    BodyWorker* workers = calloc(count, sizeof(*workers));
+    if(workers == NULL)
     {
-        yyerror("Invalid parameter of type %s. Function print has the following signature: void print(int)", Type_toString(&exp->type));
+        yyerror("not enough memory to analyze function bodies");
+        abort();
+    }
+
+    /* This thread is the first worker. The others are only an optimization, so failing to start one is not an error */
+    int started = 1;
+    for(int i = 0; i < count; ++i)
+        workers[i].queue = &queue;
+    for(; started < count && pthread_create(&workers[started].thread, NULL, analyzeBodies, &workers[started]) == 0; ++started);
+    analyzeBodies(&workers[0]);
+    for(int i = 1; i < started; ++i)
+        pthread_join(workers[i].thread, NULL);
+
+    for(int i = 0; i < count; ++i)
+        Arena_merge(&program.arena, &workers[i].arena);
+    free(workers);
+}
+
+/* Analyze the skipped bodies no call resolved to, so that their errors are reported.
+ * Like the eager analysis, the first syntax error ends it: the bodies after it are analyzed, but their diagnostics are dropped */
+void analyzeDeferredBodies()
+{
+    if(program.jobs <= 1)
+    {
+        for(int i = 0; i < program.routines.size; ++i)
+            if(program.routines.elements[i]->deferred != NULL && analyzeBody(program.routines.elements[i]) != 0)
+                break;
         return;
     }
 
-    if(PrintQueue_push(&printqueue, exp->intval) != 0)
+    int size = 0;
+    for(int i = 0; i < program.routines.size; ++i)
+        size += (program.routines.elements[i]->deferred != NULL);
+    if(size == 0)
+        return;
+
+    BodyTask* tasks = calloc(size, sizeof(*tasks));
+    if(tasks == NULL)
     {
-        yyerror("not enough memory to add integer to the print queue");
+        yyerror("not enough memory to analyze function bodies");
         abort();
     }
+
+    /* No call resolving to a body while they are analyzed analyzes it again */
+    size = 0;
+    for(int i = 0; i < program.routines.size; ++i)
+    {
+        Routine* routine = program.routines.elements[i];
+        if(routine->deferred != NULL)
+        {
+            tasks[size].routine = routine;
+            tasks[size].body = routine->deferred;
+            tasks[size].declares = routine->deferred->declares;
+            routine->deferred = NULL;
+            ++size;
+        }
+    }
+
+    analyzeInParallel(tasks, size);
+
+    bool failed = false;
+    for(int i = 0; i < size; ++i)
+    {
+        BodyTask* task = &tasks[i];
+        for(size_t j = 0; j < task->diagnostics.size && !failed; ++j)
+            addDiagnostic(&task->diagnostics.elements[j]);
+        if(!failed)
+        {
+            error_count += task->error_count;
+            warning_count += task->warning_count;
+            task->diagnostics.size = 0;
+        }
+
+        DiagnosticList_clear(&task->diagnostics);
+        failed = failed || (task->result != 0);
+    }
+
+    program.deferred_bodies += size;
+    free(tasks);
+}
+
+void freeDeferredBody(DeferredBody* body)
+{
+    if(body == NULL)
+        return;
+
+    for(int i = 0; i < body->tokens.size; ++i)
+        freeTokenValue(&body->tokens.elements[i]);
+    free(body->tokens.elements);
+    VariableList_clear(&body->params, 1);
+    free(body);
+}
+
+
+
+/* Start the members of a class. Returns the class whose members were being parsed */
+ClassLayout* beginClass(char* name, const YYLTYPE* yylloc)
+{
+    ClassLayout* previous = current_class;
+    ClassLayout* layout = Program_addLayout(name);
+    layout->routine = current_routine;
+
+    Class* class = declareClass(&classlist, scope_level, name, yylloc);
+    if(class != NULL)
+        class->layout = layout;
+
+    current_class = layout;
+    member_access = PUBLIC;
+    return previous;
+}
+
+void endClass(ClassLayout* previous)
+{
+    ClassLayout_finish(current_class);
+    current_class = previous;
+}
+
+/* Fields are variables of the scope of the class whose slot is their index in the layout.
+ * A class can only contain the classes declared before it, so its size is known */
+void declareField(char* name, Type* type, const NodeList* sizes, const YYLTYPE* yylloc)
+{
+    bool valid = (sizes == NULL || sizes->valid);
+    if(type->type == CLASS && resolveClass(type) && type->layout->complete == false)
+    {
+        yyerror("class %s is incomplete until the end of its declaration", Type_className(type));
+        (*type) = Type_withLayout(type, NULL);
+    }
+    if(type->type == CLASS && type->layout == NULL)
+        valid = false;
+
+    Variable* var = declareVariable(&varlist, scope_level, name, type, false, true, yylloc);
+    if(var == NULL)
+        return;
+
+    var->owner = current_class;
+    if(valid == false)
+        return;
+
+    long* array_sizes = NULL;
+    if(sizes != NULL)
+    {
+        array_sizes = malloc(sizes->size * sizeof(long));
+        if(array_sizes == NULL)
+        {
+            yyerror("not enough memory to declare field %s", var->name);
+            abort();
+        }
+
+        int count = 0;
+        for(const Node* size = sizes->first; size != NULL && count < sizes->size; size = size->next)
+            array_sizes[count++] = size->value.intval;
+    }
+
+    Type field_type = var->type;
+    if(ClassLayout_addField(current_class, strdup(var->name), &field_type, array_sizes, member_access) != 0)
+    {
+        yyerror("not enough memory to declare field %s", var->name);
+        abort();
+    }
+
+    var->slot = current_class->fields.size - 1;
+}
+
+
+
+void enterBlock()
+{
+    if(VariableListStack_push(&varliststack, &varlist) != 0)
+    {
+        yyerror("not enough memory to push variable declarations list on the stack");
+        abort();
+    }
+
+    if(FunctionListStack_push(&funcliststack, &funclist) != 0)
+    {
+        yyerror("not enough memory to push function declarations list on the stack");
+        abort();
+    }
+
+    ++scope_level;
+}
+void exitBlock()
+{
+    VariableListStack_pop(&varliststack, &varlist);
+    FunctionListStack_pop(&funcliststack, &funclist);
+    ClassList_pop(&classlist, scope_level);
+    --scope_level;
+}
+
+
+
+Variable* isVarDecl(const char* name)
+{
+    if(name == NULL)
+        return NULL;
+
+    const int position = VariableList_find(&varlist, name, NULL);
+    if(position == -1)
+    {
+        yyerror("Variable %s is undeclared", name);
+        return NULL;
+    }
+
+    return &varlist.elements[position];
+}
+bool isVarInit(const Variable* var)
+{
+    if(var == NULL)
+        return false;
+
+    if(var->initialized == false)
+        yyerror("Variable %s was not explicitly initialized", var->name);
+    return var->initialized;
+}
+void initVar(Variable* var, const Expression* exp)
+{
+    if(exp->type.type == INVAL_TYPE)
+        return;
+    if(Type_equal(&var->type, &exp->type) == false)
+    {
+        yyerror("the sides of '=' have different types");
+        return;
+    }
+
+    /* Constants initialized with a constant expression are replaced by their value where they are used */
+    if(var->constant == false || exp->node->op != NODE_CONST)
+        return;
+
+    var->known = true;
+    switch(var->type.type)
+    {
+    case INT:    var->intval    = exp->node->value.intval;    break;
+    case BOOL:   var->boolval   = exp->node->value.boolval;   break;
+    case DOUBLE: var->doubleval = exp->node->value.doubleval; break;
+    case CHAR:   var->charval   = exp->node->value.charval;   break;
+    case STRING: var->strval    = strdup(exp->node->value.strval); break;
+    case CLASS:  break;
+    }
+}
+
+/* Index the array computed by a node. The variable of the result is already set */
+void indexArray(Expression* result, const char* name, Node* array, const NodeList* indices)
+{
+    Variable* var = result->variable;
+    Expression_reset(result);
+
+    if(array->type.dimensions == 0)
+    {
+        yyerror("variable %s is not an array", name);
+        return;
+    }
+    if(indices->size != array->type.dimensions && indices->valid)
+    {
+        yyerror("array %s has %d dimensions", name, array->type.dimensions);
+        return;
+    }
+    if(indices->valid == false)
+        return;
+
+    for(const Node* index = indices->first; index != NULL; index = index->next)
+    {
+        if(index->type.type != INT || index->type.dimensions != 0)
+        {
+            yyerror("the index of an array must have type int");
+            return;
+        }
+    }
+
+    result->type = Type_withDimensions(&array->type, 0);
+    result->variable = var;
+    result->node = Node_create(NODE_INDEX, &result->type, array, indices->first, NULL, NULL);
+    result->node->count = indices->size;
+    result->node->name = array->name;
+}
+
+/* The object a method was called on, if the current function is a method of the given class */
+Variable* findThis(const ClassLayout* layout)
+{
+    const int position = VariableList_find(&varlist, "this", NULL);
+    if(position < 0)
+        return NULL;
+
+    Variable* self = &varlist.elements[position];
+    return (self->routine == current_routine && self->type.layout == layout ? self : NULL);
+}
+
+/* The offsets of nested fields add up, so a member access is a single node whatever its depth */
+void selectField(Expression* result, const Expression* object, const Field* field, const NodeList* indices)
+{
+    Node* node;
+    if(object->node->op == NODE_FIELD)
+    {
+        node = Node_create(NODE_FIELD, &field->type, object->node->operands[0], NULL, NULL, NULL);
+        node->offset = object->node->offset + field->offset;
+    }
+    else
+    {
+        node = Node_create(NODE_FIELD, &field->type, object->node, NULL, NULL, NULL);
+        node->offset = field->offset;
+    }
+
+    node->name = Arena_strdup(Node_arena(), field->name);
+    result->variable = object->variable;
+    if(indices != NULL)
+    {
+        indexArray(result, field->name, node, indices);
+        return;
+    }
+
+    result->type = node->type;
+    result->node = node;
+}
+
+void accessVariable(Expression* result, const char* name, const NodeList* indices)
+{
+    Expression_reset(result);
+
+    Variable* var = isVarDecl(name);
+    if(isVarInit(var) == false)
+        return;
+
+    /* A field named by itself is a field of this */
+    if(var->owner != NULL)
+    {
+        Variable* self = findThis(var->owner);
+        if(self == NULL)
+        {
+            yyerror("field %s can only be used by the methods of class %s", name, var->owner->name);
+            return;
+        }
+        if(var->slot < 0)
+            return;
+
+        Expression object;
+        Expression_set(&object, NULL, self, NULL);
+        selectField(result, &object, &var->owner->fields.elements[var->slot], indices);
+        return;
+    }
+
+    if(var->routine != NULL && var->routine != current_routine)
+    {
+        yyerror("%s is a local variable of another function", name);
+        return;
+    }
+
+    if(indices == NULL)
+    {
+        Expression_set(result, NULL, var, NULL);
+        return;
+    }
+
+    result->variable = var;
+    indexArray(result, name, Node_variable(var), indices);
+}
+
+/* Members are only accessed through variables, since the objects computed by expressions have no storage */
+ClassLayout* memberOwner(const Expression* object, const char* name)
+{
+    if(object->type.type == INVAL_TYPE)
+        return NULL;
+
+    if(object->type.type != CLASS || object->type.dimensions != 0)
+    {
+        yyerror("%s has no member %s", Type_toString(&object->type), name);
+        return NULL;
+    }
+    if(object->type.layout != NULL && object->variable == NULL)
+    {
+        yyerror("the member %s can only be accessed through a variable", name);
+        return NULL;
+    }
+
+    return object->type.layout;
+}
+
+void accessField(Expression* result, const Expression* object, const char* name, const NodeList* indices)
+{
+    Expression_reset(result);
+
+    ClassLayout* layout = memberOwner(object, name);
+    if(layout == NULL)
+        return;
+
+    const Field* field = ClassLayout_findField(layout, name);
+    if(field == NULL)
+    {
+        yyerror("class %s has no field %s", layout->name, name);
+        return;
+    }
+    if(field->access == PRIVATE && layout != current_class)
+    {
+        yyerror("%s is a private member of class %s", name, layout->name);
+        return;
+    }
+
+    selectField(result, object, field, indices);
+}
+
+void addIndex(NodeList* indices, const Expression* exp)
+{
+    if(exp->node == NULL)
+        indices->valid = false;
+    else
+        NodeList_append(indices, exp->node);
+}
+
+Function* isFuncDecl(const char* name, const TypeList* typelist)
+{
+    if(name == NULL || typelist == NULL)
+        return NULL;
+
+    const int position = FunctionList_find(&funclist, name, typelist, NULL);
+    if(position == -1)
+    {
+        char* types = TypeList_toString(typelist);
+        yyerror("No function %s was declared with the following parameter types\n\t%s", name, types);
+        free(types);
+        return NULL;
+    }
+
+    return &funclist.elements[position];
+}
+
+void addArgument(Arguments* arguments, const Expression* exp)
+{
+    Type type = exp->type;
+    if(TypeList_insert(&arguments->types, &type) != 0)
+    {
+        yyerror("not enough memory to call function");
+        abort();
+    }
+
+    if(exp->node == NULL)
+        arguments->nodes.valid = false;
+    else
+        NodeList_append(&arguments->nodes, exp->node);
+}
+
+void setCall(Expression* result, const Type* return_type, Routine* routine, int builtin, const NodeList* arguments)
+{
+    result->node = Node_create((builtin >= 0 ? NODE_BUILTIN : NODE_CALL), return_type, arguments->first, NULL, NULL, NULL);
+    result->node->count = arguments->size;
+    result->type = result->node->type;
+    if(builtin >= 0)
+        result->node->builtin = builtin;
+    else
+        result->node->routine = routine;
+}
+
+/* A method named by itself is called on this */
+void callFunction(Expression* result, const char* name, Arguments* arguments)
+{
+    Expression_reset(result);
+
+    const Function* func = isFuncDecl(name, &arguments->types);
+    TypeList_clear(&arguments->types);
+    if(func != NULL && func->routine != NULL && func->routine->deferred != NULL && program.analysis != ANALYSIS_EAGER)
+        analyzeBody(func->routine);
+    if(func == NULL || arguments->nodes.valid == false)
+        return;
+
+    if(func->owner != NULL)
+    {
+        Variable* self = findThis(func->owner);
+        if(self == NULL)
+        {
+            yyerror("method %s can only be called by the methods of class %s or through an object", name, func->owner->name);
+            return;
+        }
+
+        Expression object;
+        Expression_set(&object, NULL, self, NULL);
+        NodeList_prepend(&arguments->nodes, object.node);
+    }
+
+    setCall(result, &func->return_type, func->routine, func->builtin, &arguments->nodes);
+}
+
+/* Methods are found in the layout of the object, so the call refers to the routine directly */
+void callMethod(Expression* result, const Expression* object, const char* name, Arguments* arguments)
+{
+    Expression_reset(result);
+
+    ClassLayout* layout = memberOwner(object, name);
+    const Method* method = NULL;
+    if(layout != NULL)
+    {
+        method = ClassLayout_findMethod(layout, name, &arguments->types);
+        if(method == NULL)
+        {
+            char* types = TypeList_toString(&arguments->types);
+            yyerror("class %s has no method %s with the following parameter types\n\t%s", layout->name, name, types);
+            free(types);
+        }
+        else if(method->access == PRIVATE && layout != current_class)
+        {
+            yyerror("%s is a private member of class %s", name, layout->name);
+            method = NULL;
+        }
+    }
+
+    TypeList_clear(&arguments->types);
+    if(method == NULL || arguments->nodes.valid == false)
+        return;
+
+    NodeList_prepend(&arguments->nodes, object->node);
+    setCall(result, &method->routine->return_type, method->routine, -1, &arguments->nodes);
+}
+
+/* Builtins are marked as imported, so modules do not export them. Sources compiled later into the same context find them declared */
+void declareBuiltins()
+{
+    static const YYLTYPE location = {0, 0, 0, 0};
+
+    for(int i = 0; i < builtin_count; ++i)
+    {
+        const Builtin* builtin = &builtins[i];
+
+        TypeList params = {0};
+        for(int j = 0; j < builtin->param_count; ++j)
+        {
+            Type param = Type_make(builtin->params[j].type, NULL, builtin->params[j].dimensions, NULL);
+            if(TypeList_insert(&params, &param) != 0)
+            {
+                yyerror("not enough memory to declare function %s", builtin->name);
+                abort();
+            }
+        }
+
+        if(FunctionList_find(&funclist, builtin->name, &params, NULL) >= 0)
+        {
+            TypeList_clear(&params);
+            continue;
+        }
+
+        const Type return_type = Type_make(builtin->return_type, NULL, 0, NULL);
+        Function* func = declareFunction(&funclist, 0, strdup(builtin->name), &return_type, &params, &location);
+        FunctionList_declaration(&funclist, func)->imported = true;
+        func->builtin = i;
+    }
+}
+
+
+
+bool isExpConvToBool(const Expression* exp)
+{
+    if(exp->type.dimensions != 0)
+    {
+        yyerror("%s cannot be converted to bool", Type_toString(&exp->type));
+        return false;
+    }
+
+    switch(exp->type.type)
+    {
+    case INT:
+    case BOOL:
+    case DOUBLE:
+    case CHAR:
+    case STRING:
+        return true;
+    }
+
+    return false;
+}
+
+Node* statement(NodeOp op, Node* first, Node* second, Node* third, Node* fourth)
+{
+    return Node_create(op, &Type_void, first, second, third, fourth);
+}
+
+Node* expStatement(const Expression* exp)
+{
+    if(exp->node == NULL)
+        return NULL;
+    return statement(NODE_EXP, exp->node, NULL, NULL, NULL);
+}
+
+Node* conditionStatement(NodeOp op, const Expression* exp, Node* first, Node* second)
+{
+    if(isExpConvToBool(exp) == false)
+        return NULL;
+    return statement(op, exp->node, first, second, NULL);
+}
+
+/* A return outside of functions ends the program */
+Node* returnStatement(const Expression* exp)
+{
+    if(exp->type.type == INVAL_TYPE)
+        return NULL;
+
+    if(current_routine == NULL)
+    {
+        Node* value = expStatement(exp);
+        value->next = statement(NODE_RETURN, NULL, NULL, NULL, NULL);
+        return statement(NODE_BLOCK, value, NULL, NULL, NULL);
+    }
+
+    if(current_routine->return_type.type == VOID)
+    {
+        yyerror("a void function cannot return a value");
+        return NULL;
+    }
+    if(Type_equal(&current_routine->return_type, &exp->type) == false)
+    {
+        yyerror("the returned value must have type %s", Type_toString(&current_routine->return_type));
+        return NULL;
+    }
+
+    return statement(NODE_RETURN, exp->node, NULL, NULL, NULL);
+}
+
+Node* addExpToPrint(const Expression* exp)
+{
+    if(exp->type.type == INVAL_TYPE)
+        return NULL;
+
+    if(exp->type.type != INT || exp->type.dimensions != 0)
+    {
+        yyerror("Invalid parameter of type %s. Function print has the following signature: void print(int)", Type_toString(&exp->type));
+        return NULL;
+    }
+
+    return statement(NODE_PRINT, exp->node, NULL, NULL, NULL);
+}
+
+/* A label is a constant int or char, or a void constant for default */
+Node* caseLabel(const Expression* exp, const YYLTYPE* yylloc)
+{
+    Node* label;
+    if(exp == NULL)
+        label = Node_create(NODE_CONST, &Type_void, NULL, NULL, NULL, NULL);
+    else if(exp->type.type == INVAL_TYPE)
+        return NULL;
+    else if(exp->type.dimensions != 0 || (exp->type.type != INT && exp->type.type != CHAR))
+    {
+        yyerrorAt(yylloc, "a case value must be an int or a char, not %s", Type_toString(&exp->type));
+        return NULL;
+    }
+    else if(exp->node->op != NODE_CONST)
+    {
+        yyerrorAt(yylloc, "a case value must be a constant");
+        return NULL;
+    }
+    else
+        label = exp->node;
+
+    label->location = (*yylloc);
+    return label;
+}
+
+Node* caseStatement(const NodeList* labels, const NodeList* statements)
+{
+    if(labels->valid == false)
+        return NULL;
+
+    Node* node = statement(NODE_CASE, labels->first, statements->first, NULL, NULL);
+    for(const Node* label = labels->first; label != NULL; label = label->next)
+        node->count += (label->type.type != VOID);
+    return node;
+}
+
+static void duplicateCase(const Node* label, const Node* previous)
+{
+    const int line = previous->location.first_line, column = previous->location.first_column;
+    if(label->type.type == VOID)
+        yyerrorAt(&label->location, "default was already used at (%d,%d)", line, column);
+    else if(label->type.type == CHAR)
+        yyerrorAt(&label->location, "duplicate case value '%c', already used at (%d,%d)", label->value.charval, line, column);
+    else
+        yyerrorAt(&label->location, "duplicate case value %ld, already used at (%d,%d)", label->value.intval, line, column);
+}
+
+Node* switchStatement(const Expression* exp, const YYLTYPE* yylloc, const NodeList* cases)
+{
+    if(exp->type.type == INVAL_TYPE)
+        return NULL;
+    if(exp->type.dimensions != 0 || (exp->type.type != INT && exp->type.type != CHAR))
+    {
+        yyerrorAt(yylloc, "the value of a switch must be an int or a char, not %s", Type_toString(&exp->type));
+        return NULL;
+    }
+    if(cases->valid == false)
+        return NULL;
+
+    int errors = 0;
+    for(const Node* target = cases->first; target != NULL; target = target->next)
+        for(const Node* label = target->operands[0]; label != NULL; label = label->next)
+            if(label->type.type != VOID && label->type.type != exp->type.type)
+            {
+                yyerrorAt(&label->location, "the case value has type %s but the switch is on a %s", Type_toString(&label->type), Type_toString(&exp->type));
+                ++errors;
+            }
+    if(errors != 0)
+        return NULL;
+
+    Node* node = statement(NODE_SWITCH, exp->node, cases->first, NULL, NULL);
+    return (Node_compileSwitch(node, duplicateCase) == 0 ? node : NULL);
+}
+
+/* The iterations of a parallel loop each add to a copy of its reduction variables, which are added to them once the loop ends */
+Node* reductionVariable(const char* name, const YYLTYPE* yylloc)
+{
+    Variable* var = isVarDecl(name);
+    if(isVarInit(var) == false)
+        return NULL;
+
+    if(var->owner != NULL || (var->routine != NULL && var->routine != current_routine))
+    {
+        yyerrorAt(yylloc, "%s cannot be reduced, only the variables of the function can", name);
+        return NULL;
+    }
+    if(var->constant)
+    {
+        yyerrorAt(yylloc, "constant %s cannot be reduced", name);
+        return NULL;
+    }
+    if((var->type.type != INT && var->type.type != DOUBLE) || var->type.dimensions != 0)
+    {
+        yyerrorAt(yylloc, "reduction variable %s must be an int or a double, not %s", name, Type_toString(&var->type));
+        return NULL;
+    }
+
+    return Node_variable(var);
+}
+
+/* parallel for(int i = first; i < end; ++i) declares its variable in a block of its own, which its body is parsed in.
+ * The end is computed once, and the iterations are checked once the whole program is analyzed */
+Node* beginParallelLoop(char* name, const Expression* first, const YYLTYPE* yylloc)
+{
+    enterBlock();
+    return defineVariable(name, &Type_int, false, first, yylloc);
+}
+
+Node* endParallelLoop(Node* declaration, const char* compared, const YYLTYPE* compared_lloc, const Expression* end,
+                      const char* stepped, const YYLTYPE* stepped_lloc, Node* body, const NodeList* reductions)
+{
+    exitBlock();
+    if(declaration == NULL)
+        return NULL;
+
+    const char* name = declaration->operands[0]->name;
+    if(strcmp(compared, name) != 0)
+    {
+        yyerrorAt(compared_lloc, "a parallel loop must compare its variable %s with its end", name);
+        return NULL;
+    }
+    if(strcmp(stepped, name) != 0)
+    {
+        yyerrorAt(stepped_lloc, "a parallel loop must increment its variable %s", name);
+        return NULL;
+    }
+    if(end->type.type == INVAL_TYPE || reductions->valid == false)
+        return NULL;
+    if(end->type.type != INT || end->type.dimensions != 0)
+    {
+        yyerror("the end of a parallel loop must be an int, not %s", Type_toString(&end->type));
+        return NULL;
+    }
+
+    Node* loop = statement(NODE_PARALLEL_FOR, declaration, end->node, body, reductions->first);
+    loop->count = reductions->size;
+    __atomic_add_fetch(&program.parallel_loops, 1, __ATOMIC_RELAXED);
+    return loop;
+}
+
+long divideConstants(long lval, long rval, bool remainder)
+{
+    if(rval == 0)
+    {
+        yyerror("division by zero");
+        return 0;
+    }
+
+    if(rval == -1)
+        return (remainder ? 0 : (long)(0ul - (unsigned long)lval));
+    return (remainder ? lval % rval : lval / rval);
+}
+
+
+
+/* Parse a module into its own context while the current program waits.
+ * The parser is pure, so the lookahead token of the current program stays in its frame */
+int parseModule(FILE* fp, Context* module)
+{
+    const TokenList saved_queued = queued;
+    const int saved_position = queued_position;
+    const bool saved_ends_input = queued_ends_input;
+    memset(&queued, 0, sizeof(queued));
+    queued_position = 0;
+    queued_ends_input = false;
+
+    Context_swap(module);
+    Context_resetLocation();
+
+    beginNestedInput(fp);
+    yyparse();
+    endNestedInput();
+    discardQueuedTokens();
+    Program_checkParallelLoops(program.code);
+
+    Context_swap(module);
+
+    queued = saved_queued;
+    queued_position = saved_position;
+    queued_ends_input = saved_ends_input;
+    return module->error_count;
 }
@@ -1,7 +1,11 @@
 #include "util.h"
+#include <pthread.h>
+#include "bigint.h"
+#include "node.h"
+#include "operators.h"
 #include "y.tab.h"
 
-extern int scope_level;
+extern __thread int scope_level;
 
 
 
@@ -14,6 +18,19 @@ void* memdup(const void* mem, size_t size)
    return new_mem;
 }
 
+/* 64 bit FNV-1a. Pass HASH_INIT to start a new hash or a previous result to continue it */
+uint64_t hashBytes(const void* mem, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = mem;
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
 int compareStrings(const char* lval, const char* rval)
 {
     if(lval == NULL || lval[0] == '\0')
@@ -62,19 +79,236 @@ char* appendString(char* lval, const char* rval)
 
 
 /* Type */
-const Type Type_invalid = {INVAL_TYPE, NULL};
-const Type Type_int     = {INT, NULL};
-const Type Type_bool    = {BOOL, NULL};
-const Type Type_double  = {DOUBLE, NULL};
-const Type Type_char    = {CHAR, NULL};
-const Type Type_string  = {STRING, NULL};
-const Type Type_void    = {VOID, NULL};
+/* Every distinct type gets an id from one table shared by all contexts and threads. The scalars have fixed ids and the other
+ * types are added under a lock. The types of a class go away with its layout, and their ids are reused. The entries are kept
+ * in chunks that never move, the first of TYPE_CHUNK entries and every next one twice as large as the last, so reading
+ * the entry of an id takes no lock */
+#define TYPE_CHUNK  64
+#define TYPE_CHUNKS 24
+
+typedef struct TypeEntry
+{
+    int type;
+    int dimensions;
+    struct ClassLayout* layout;
+    char* class_name;
+} TypeEntry;
+
+static TypeEntry  type_first_chunk[TYPE_CHUNK] = {{INVAL_TYPE}, {INT}, {BOOL}, {DOUBLE}, {CHAR}, {STRING}, {VOID}};
+static TypeEntry* type_chunks[TYPE_CHUNKS] = {type_first_chunk};
+static int        type_count = TYPE_ID_SCALARS; /* ids given so far */
+static int        type_live = TYPE_ID_SCALARS;  /* of them, those not released */
+static int*       type_slots = NULL;   /* open addressing, ids plus one and 0 for empty slots */
+static int        type_slot_count = 0;
+static int*       type_free = NULL;    /* ids of released types */
+static int        type_free_size = 0;
+static int        type_free_capacity = 0;
+static pthread_mutex_t type_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const Type Type_invalid = {INVAL_TYPE, TYPE_ID_INVAL_TYPE};
+const Type Type_int     = {INT, TYPE_ID_INT};
+const Type Type_bool    = {BOOL, TYPE_ID_BOOL};
+const Type Type_double  = {DOUBLE, TYPE_ID_DOUBLE};
+const Type Type_char    = {CHAR, TYPE_ID_CHAR};
+const Type Type_string  = {STRING, TYPE_ID_STRING};
+const Type Type_void    = {VOID, TYPE_ID_VOID};
+
+/* The chunk of the id is the position of the highest bit of id + TYPE_CHUNK, less the one of TYPE_CHUNK */
+static int typeChunk(int id)
+{
+    return __builtin_clz(TYPE_CHUNK) - __builtin_clz(id + TYPE_CHUNK);
+}
+
+static TypeEntry* typeEntry(int id)
+{
+    const int chunk = typeChunk(id);
+    return &type_chunks[chunk][id + TYPE_CHUNK - (TYPE_CHUNK << chunk)];
+}
+
+static uint64_t hashType(int type, const char* class_name, int dimensions, const struct ClassLayout* layout)
+{
+    uint64_t hash = hashBytes(&type, sizeof(type), HASH_INIT);
+    hash = hashBytes(&dimensions, sizeof(dimensions), hash);
+    hash = hashBytes(&layout, sizeof(layout), hash);
+    return (class_name != NULL ? hashBytes(class_name, strlen(class_name), hash) : hash);
+}
+
+static bool sameType(const TypeEntry* entry, int type, const char* class_name, int dimensions, const struct ClassLayout* layout)
+{
+    return entry->type == type && entry->dimensions == dimensions && entry->layout == layout && compareStrings(entry->class_name, class_name) == 0;
+}
+
+/* Called with the lock held */
+static void growTypeSlots()
+{
+    const int new_count = (type_slot_count == 0 ? 256 : type_slot_count * 2);
+    int* new_slots = calloc(new_count, sizeof(new_slots[0]));
+    if(new_slots == NULL)
+    {
+        yyerror("not enough memory to allocate %zu bytes for the type table", new_count * sizeof(new_slots[0]));
+        abort();
+    }
+
+    for(int i = 0; i < type_slot_count; ++i)
+    {
+        if(type_slots[i] == 0)
+            continue;
+        const TypeEntry* entry = typeEntry(type_slots[i] - 1);
+        size_t slot = hashType(entry->type, entry->class_name, entry->dimensions, entry->layout) & (new_count - 1);
+        while(new_slots[slot] != 0)
+            slot = (slot + 1) & (new_count - 1);
+        new_slots[slot] = type_slots[i];
+    }
+
+    free(type_slots);
+    type_slots = new_slots;
+    type_slot_count = new_count;
+}
+
+/* Called with the lock held */
+static int addType(int type, const char* class_name, int dimensions, struct ClassLayout* layout)
+{
+    const int id = (type_free_size != 0 ? type_free[--type_free_size] : type_count);
+    const int chunk = typeChunk(id);
+    if(chunk >= TYPE_CHUNKS)
+    {
+        yyerror("too many types");
+        abort();
+    }
+    if(type_chunks[chunk] == NULL)
+    {
+        type_chunks[chunk] = malloc((TYPE_CHUNK << chunk) * sizeof(TypeEntry));
+        if(type_chunks[chunk] == NULL)
+        {
+            yyerror("not enough memory to allocate %zu bytes for the type table", (TYPE_CHUNK << chunk) * sizeof(TypeEntry));
+            abort();
+        }
+    }
+
+    char* name = NULL;
+    if(class_name != NULL && (name = strdup(class_name)) == NULL)
+    {
+        yyerror("not enough memory to allocate %zu bytes for string", strlen(class_name) + 1);
+        abort();
+    }
+
+    *typeEntry(id) = (TypeEntry){type, dimensions, layout, name};
+    type_count += (id == type_count);
+    ++type_live;
+    return id;
+}
+
+/* Called with the lock held. Entries after the slot that probed past it move back, so no search stops early */
+static void removeTypeSlot(size_t slot)
+{
+    const size_t mask = type_slot_count - 1;
+    size_t hole = slot;
+    type_slots[hole] = 0;
+    for(size_t next = (hole + 1) & mask; type_slots[next] != 0; next = (next + 1) & mask)
+    {
+        const TypeEntry* entry = typeEntry(type_slots[next] - 1);
+        const size_t home = hashType(entry->type, entry->class_name, entry->dimensions, entry->layout) & mask;
+        if(((next - home) & mask) >= ((next - hole) & mask))
+        {
+            type_slots[hole] = type_slots[next];
+            type_slots[next] = 0;
+            hole = next;
+        }
+    }
+}
+
+void Type_releaseLayout(const struct ClassLayout* layout)
+{
+    pthread_mutex_lock(&type_mutex);
+    for(int id = TYPE_ID_SCALARS; id < type_count; ++id)
+    {
+        TypeEntry* entry = typeEntry(id);
+        if(entry->layout != layout)
+            continue;
+
+        size_t slot = hashType(entry->type, entry->class_name, entry->dimensions, entry->layout) & (type_slot_count - 1);
+        while(type_slots[slot] != id + 1)
+            slot = (slot + 1) & (type_slot_count - 1);
+        removeTypeSlot(slot);
+
+        if(type_free_size == type_free_capacity)
+        {
+            int new_capacity = 1 + type_free_capacity * 2;
+            int* new_free = realloc(type_free, new_capacity * sizeof(type_free[0]));
+            if(new_free == NULL)
+            {
+                yyerror("not enough memory to allocate %zu bytes for the type table", new_capacity * sizeof(type_free[0]));
+                abort();
+            }
+
+            type_free = new_free;
+            type_free_capacity = new_capacity;
+        }
+
+        free(entry->class_name);
+        *entry = (TypeEntry){INVAL_TYPE};
+        type_free[type_free_size++] = id;
+        --type_live;
+    }
+    pthread_mutex_unlock(&type_mutex);
+}
+
+Type Type_make(int type, const char* class_name, int dimensions, struct ClassLayout* layout)
+{
+    if(type != CLASS)
+    {
+        class_name = NULL;
+        layout = NULL;
+        if(dimensions == 0)
+        {
+            switch(type)
+            {
+            case INT:    return Type_int;
+            case BOOL:   return Type_bool;
+            case DOUBLE: return Type_double;
+            case CHAR:   return Type_char;
+            case STRING: return Type_string;
+            case VOID:   return Type_void;
+            default:     return Type_invalid;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&type_mutex);
+    if(type_live * 2 >= type_slot_count)
+        growTypeSlots();
+
+    size_t slot = hashType(type, class_name, dimensions, layout) & (type_slot_count - 1);
+    while(type_slots[slot] != 0 && !sameType(typeEntry(type_slots[slot] - 1), type, class_name, dimensions, layout))
+        slot = (slot + 1) & (type_slot_count - 1);
+    if(type_slots[slot] == 0)
+        type_slots[slot] = addType(type, class_name, dimensions, layout) + 1;
+
+    const Type result = {type, type_slots[slot] - 1, dimensions, layout};
+    pthread_mutex_unlock(&type_mutex);
+    return result;
+}
+
+Type Type_withDimensions(const Type* type, int dimensions)
+{
+    return Type_make(type->type, Type_className(type), dimensions, type->layout);
+}
+
+Type Type_withLayout(const Type* type, struct ClassLayout* layout)
+{
+    return Type_make(type->type, Type_className(type), type->dimensions, layout);
+}
+
+const char* Type_className(const Type* type)
+{
+    return typeEntry(type->id)->class_name;
+}
 
 bool Type_equal(const Type* lval, const Type* rval)
 {
-    return lval->type == rval->type && (lval->type != CLASS || strcmp(lval->class_name, rval->class_name) == 0);
+    return lval->id == rval->id;
 }
-const char* Type_toString(const Type* type)
+static const char* scalarName(const Type* type)
 {
     switch(type->type)
     {
@@ -83,8 +317,23 @@ const char* Type_toString(const Type* type)
     case DOUBLE: return "double";
     case CHAR:   return "char";
     case STRING: return "string";
-    case CLASS:  return type->class_name;
+    case VOID:   return "void";
+    case CLASS:  return Type_className(type);
     }
+
+    return "invalid";
+}
+/* Array types are spelled into a per thread buffer, valid until the next call */
+const char* Type_toString(const Type* type)
+{
+    if(type->dimensions == 0)
+        return scalarName(type);
+
+    static __thread char buffer[256];
+    int length = snprintf(buffer, sizeof(buffer), "%s", scalarName(type));
+    for(int i = 0; i < type->dimensions && length + 2 < sizeof(buffer); ++i)
+        length += snprintf(buffer + length, sizeof(buffer) - length, "[]");
+    return buffer;
 }
 
 
@@ -93,10 +342,6 @@ void TypeList_clear(TypeList* list)
 {
     if(list->capacity != 0)
     {
-        for(int i = 0; i < list->size; ++i)
-            if(list->elements[i].type == CLASS)
-                free(list->elements[i].class_name);
-
         free(list->elements);
         list->elements = NULL;
         list->capacity = 0;
@@ -124,6 +369,7 @@ int TypeList_insert(TypeList* list, Type* element)
 
     list->elements[list->size] = (*element);
     ++list->size;
+    return 0;
 }
 
 bool TypeList_equal(const TypeList* llist, const TypeList* rlist)
@@ -132,12 +378,8 @@ bool TypeList_equal(const TypeList* llist, const TypeList* rlist)
         return false;
 
     for(int i = 0; i < llist->size; ++i)
-    {
-        if(llist->elements[i].type != rlist->elements[i].type)
-            return false;
-        if(llist->elements[i].type == CLASS && strcmp(llist->elements[i].class_name, rlist->elements[i].class_name) != 0)
+        if(llist->elements[i].id != rlist->elements[i].id)
             return false;
-    }
 
     return true;
 }
@@ -154,39 +396,125 @@ void TypeList_print(const TypeList* list, FILE* fp)
     fprintf(fp, ")");
 }
 
+char* TypeList_toString(const TypeList* list)
+{
+    char* text = NULL;
+    size_t size = 0;
+    FILE* fp = open_memstream(&text, &size);
+    if(fp == NULL)
+        return NULL;
+
+    TypeList_print(list, fp);
+    fclose(fp);
+    return text;
+}
+
 
 
 /* VariableList */
+long declaration_count = 0;
+
+/* The first 8 bytes of a name, the first one highest, so that keys are ordered as the names they start */
+static uint64_t nameKey(const char* name)
+{
+    uint64_t key = 0;
+    for(int i = 0; i < 8; ++i)
+    {
+        key <<= 8;
+        if(name[i] == '\0')
+            return key << (8 * (7 - i));
+        key |= (unsigned char)name[i];
+    }
+
+    return key;
+}
+
+/* Orders name, whose key is given, and an element of a list as strcmp does. Equal keys ending with a zero byte mean equal
+ * names. The name of the element is only read when the keys are equal */
+static int compareNames(const char* name, uint64_t key, char* const* element_name, uint64_t element_key)
+{
+    if(key != element_key)
+        return (key < element_key ? -1 : 1);
+    if((key & 0xff) == 0)
+        return 0;
+    return strcmp(name + 8, (*element_name) + 8);
+}
+
+/* Grows the parallel arrays of a list of variables or functions, whose elements have element_size bytes */
+static int growSymbolList(void** elements, size_t element_size, Declaration** declarations, uint64_t** keys, int* capacity)
+{
+    const int capacities[2] = {1 + (*capacity) * 2, 1 + (*capacity)};
+    for(int i = 0; i < 2; ++i)
+    {
+        void* new_elements = realloc(*elements, capacities[i] * element_size);
+        if(new_elements != NULL)
+            (*elements) = new_elements;
+        Declaration* new_declarations = realloc(*declarations, capacities[i] * sizeof(Declaration));
+        if(new_declarations != NULL)
+            (*declarations) = new_declarations;
+        uint64_t* new_keys = realloc(*keys, capacities[i] * sizeof(uint64_t));
+        if(new_keys != NULL)
+            (*keys) = new_keys;
+
+        if(new_elements != NULL && new_declarations != NULL && new_keys != NULL)
+        {
+            (*capacity) = capacities[i];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int copySymbolList(const void* elements, size_t element_size, const Declaration* declarations, const uint64_t* keys, int capacity,
+                          void** dst_elements, Declaration** dst_declarations, uint64_t** dst_keys)
+{
+    (*dst_elements) = memdup(elements, capacity * element_size);
+    (*dst_declarations) = memdup(declarations, capacity * sizeof(Declaration));
+    (*dst_keys) = memdup(keys, capacity * sizeof(uint64_t));
+    if((*dst_elements) == NULL || (*dst_declarations) == NULL || (*dst_keys) == NULL)
+    {
+        free(*dst_elements);
+        free(*dst_declarations);
+        free(*dst_keys);
+        return -1;
+    }
+
+    return 0;
+}
+
 void VariableList_clear(VariableList* list, int scope_level)
 {
     for(int i = 0; i < list->size; ++i)
     {
-        if(list->elements[i].scope_level == scope_level || scope_level == -1)
+        if(list->declarations[i].scope_level == scope_level || scope_level == -1)
         {
-            switch(list->elements[i].type.type)
-            {
-            case STRING:
+            if(list->elements[i].type.type == STRING)
                 free(list->elements[i].strval);
-                break;
-            case CLASS:
-                free(list->elements[i].type.class_name);
-                break;
-            }
 
             free(list->elements[i].name);
         }
     }
 
+    VariableList_release(list);
+}
+
+void VariableList_release(VariableList* list)
+{
     free(list->elements);
+    free(list->declarations);
+    free(list->keys);
     list->elements = NULL;
+    list->declarations = NULL;
+    list->keys = NULL;
     list->capacity = 0;
     list->size = 0;
 }
 
 int VariableList_copy(const VariableList* src, VariableList* dst)
 {
-    dst->elements = memdup(src->elements, src->capacity * sizeof(src->elements[0]));
-    if(dst->elements == NULL)
+    if(copySymbolList(src->elements, sizeof(src->elements[0]), src->declarations, src->keys, src->capacity,
+                      (void**)&dst->elements, &dst->declarations, &dst->keys) != 0)
         return -1;
 
     dst->capacity = src->capacity;
@@ -196,13 +524,14 @@ int VariableList_copy(const VariableList* src, VariableList* dst)
 
 int VariableList_find(const VariableList* list, const char* name, int* insert_pos)
 {
+    const uint64_t key = nameKey(name);
     int first = 0;
     int last = list->size - 1;
 
     while(first <= last)
     {
         const int mid = (first + last) / 2;
-        const int cmp = strcmp(name, list->elements[mid].name);
+        const int cmp = compareNames(name, key, &list->elements[mid].name, list->keys[mid]);
 
         if(cmp == 0)
             return mid;
@@ -218,35 +547,39 @@ int VariableList_find(const VariableList* list, const char* name, int* insert_po
     return -1;
 }
 
-int VariableList_insertElement(VariableList* list, Variable* element, int position)
+int VariableList_insertElement(VariableList* list, const Variable* element, const Declaration* declaration, int position)
 {
-    if(list->size == list->capacity)
-    {
-        int new_capacity = 1 + list->capacity * 2;
-        Variable* new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
-        if(new_list == NULL)
-        {
-            new_capacity = 1 + list->capacity;
-            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
-            if(new_list == NULL)
-                return -1;
-        }
-
-        list->elements = new_list;
-        list->capacity = new_capacity;
-    }
+    if(list->size == list->capacity
+        && growSymbolList((void**)&list->elements, sizeof(list->elements[0]), &list->declarations, &list->keys, &list->capacity) != 0)
+        return -1;
 
-    memmove(list->elements + position + 1, list->elements + position, (list->size - position) * sizeof(list->elements[0]));
-    list->elements[position] = (*element);
+    const int moved = list->size - position;
+    memmove(list->elements + position + 1, list->elements + position, moved * sizeof(list->elements[0]));
+    memmove(list->declarations + position + 1, list->declarations + position, moved * sizeof(list->declarations[0]));
+    memmove(list->keys + position + 1, list->keys + position, moved * sizeof(list->keys[0]));
     ++list->size;
 
+    VariableList_assign(list, position, element, declaration);
     return 0;
 }
 
+void VariableList_assign(VariableList* list, int position, const Variable* element, const Declaration* declaration)
+{
+    list->elements[position] = (*element);
+    list->declarations[position] = (*declaration);
+    list->keys[position] = nameKey(element->name);
+}
+
+Declaration* VariableList_declaration(const VariableList* list, const Variable* element)
+{
+    return &list->declarations[element - list->elements];
+}
+
 int VariableList_insertAt(VariableList* list, char* name, int name_length, const Type* type, int scope_level, bool constant, bool initialized,
                           int decl_line, int decl_column, int position)
 {
     Variable element;
+    Declaration declaration;
 
     switch(type->type)
     {
@@ -259,15 +592,22 @@ int VariableList_insertAt(VariableList* list, char* name, int name_length, const
     }
 
     element.name        = name;
-    element.name_length = name_length;
     element.type        = (*type);
-    element.scope_level = scope_level;
     element.constant    = constant;
     element.initialized = initialized;
-    element.decl_line   = decl_line;
-    element.decl_column = decl_column;
-
-    if(VariableList_insertElement(list, &element, position) != 0)
+    element.known       = false;
+    element.slot        = -1;
+    element.routine     = NULL;
+    element.owner       = NULL;
+
+    declaration.name_length = name_length;
+    declaration.scope_level = scope_level;
+    declaration.decl_line   = decl_line;
+    declaration.decl_column = decl_column;
+    declaration.order       = __atomic_add_fetch(&declaration_count, 1, __ATOMIC_RELAXED);
+    declaration.imported    = false;
+
+    if(VariableList_insertElement(list, &element, &declaration, position) != 0)
         return -1;
 
     return 0;
@@ -287,6 +627,7 @@ int VariableList_replace(VariableList* list, char* name, int name_length, const
                          int decl_line, int decl_column, int position)
 {
     Variable* element = &list->elements[position];
+    Declaration* declaration = &list->declarations[position];
 
     switch(type->type)
     {
@@ -299,14 +640,22 @@ int VariableList_replace(VariableList* list, char* name, int name_length, const
     }
 
     element->name        = name;
-    element->name_length = name_length;
     element->type        = (*type);
-    element->scope_level = scope_level;
     element->constant    = constant;
     element->initialized = initialized;
-    element->decl_line   = decl_line;
-    element->decl_column = decl_column;
-
+    element->known       = false;
+    element->slot        = -1;
+    element->routine     = NULL;
+    element->owner       = NULL;
+
+    declaration->name_length = name_length;
+    declaration->scope_level = scope_level;
+    declaration->decl_line   = decl_line;
+    declaration->decl_column = decl_column;
+    declaration->order       = __atomic_add_fetch(&declaration_count, 1, __ATOMIC_RELAXED);
+    declaration->imported    = false;
+
+    list->keys[position] = nameKey(name);
     return 0;
 }
 
@@ -374,26 +723,27 @@ void FunctionList_clear(FunctionList* list, int scope_level)
 {
     for(int i = 0; i < list->size; ++i)
     {
-        if(list->elements[i].scope_level == scope_level || scope_level == -1)
+        if(list->declarations[i].scope_level == scope_level || scope_level == -1)
         {
-            if(list->elements[i].return_type.type == CLASS)
-                free(list->elements[i].return_type.class_name);
-
             TypeList_clear(&list->elements[i].paramtypes);
             free(list->elements[i].name);
         }
     }
 
     free(list->elements);
+    free(list->declarations);
+    free(list->keys);
     list->elements = NULL;
+    list->declarations = NULL;
+    list->keys = NULL;
     list->capacity = 0;
     list->size = 0;
 }
 
 int FunctionList_copy(const FunctionList* src, FunctionList* dst)
 {
-    dst->elements = memdup(src->elements, src->capacity * sizeof(src->elements[0]));
-    if(dst->elements == NULL)
+    if(copySymbolList(src->elements, sizeof(src->elements[0]), src->declarations, src->keys, src->capacity,
+                      (void**)&dst->elements, &dst->declarations, &dst->keys) != 0)
         return -1;
 
     dst->capacity = src->capacity;
@@ -403,13 +753,14 @@ int FunctionList_copy(const FunctionList* src, FunctionList* dst)
 
 int FunctionList_find(const FunctionList* list, const char* name, const TypeList* typelist, int* insert_pos)
 {
+    const uint64_t key = nameKey(name);
     int first = 0;
     int last = list->size - 1;
 
     while(first <= last)
     {
         const int mid = (first + last) / 2;
-        const int cmp = strcmp(name, list->elements[mid].name);
+        const int cmp = compareNames(name, key, &list->elements[mid].name, list->keys[mid]);
 
         if(cmp == 0)
         {
@@ -420,15 +771,15 @@ int FunctionList_find(const FunctionList* list, const char* name, const TypeList
             int found_pos = -1;
             (*insert_pos) = mid;
 
-            while((*insert_pos) < list->size && strcmp(name, list->elements[*insert_pos].name) == 0)
+            while((*insert_pos) < list->size && compareNames(name, key, &list->elements[*insert_pos].name, list->keys[*insert_pos]) == 0)
             {
                 if(found_pos == -1 && TypeList_equal(&list->elements[*insert_pos].paramtypes, typelist) == true)
                     found_pos = (*insert_pos);
                 ++(*insert_pos);
             }
 
-            for(int i = mid - 1; found_pos == -1 && i >= 0 && strcmp(name, list->elements[i].name) == 0; --i)
-                if(TypeList_equal(&list->elements[i].paramtypes, typelist) == 0)
+            for(int i = mid - 1; found_pos == -1 && i >= 0 && compareNames(name, key, &list->elements[i].name, list->keys[i]) == 0; --i)
+                if(TypeList_equal(&list->elements[i].paramtypes, typelist) == true)
                     found_pos = i;
 
             return found_pos;
@@ -445,45 +796,55 @@ int FunctionList_find(const FunctionList* list, const char* name, const TypeList
     return -1;
 }
 
-int FunctionList_insertElement(FunctionList* list, Function* element, int position)
+int FunctionList_insertElement(FunctionList* list, const Function* element, const Declaration* declaration, int position)
 {
-    if(list->size == list->capacity)
-    {
-        int new_capacity = 1 + list->capacity * 2;
-        Function* new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
-        if(new_list == NULL)
-        {
-            new_capacity = 1 + list->capacity;
-            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
-            if(new_list == NULL)
-                return -1;
-        }
-
-        list->elements = new_list;
-        list->capacity = new_capacity;
-    }
+    if(list->size == list->capacity
+        && growSymbolList((void**)&list->elements, sizeof(list->elements[0]), &list->declarations, &list->keys, &list->capacity) != 0)
+        return -1;
 
-    memmove(list->elements + position + 1, list->elements + position, (list->size - position) * sizeof(list->elements[0]));
-    list->elements[position] = (*element);
+    const int moved = list->size - position;
+    memmove(list->elements + position + 1, list->elements + position, moved * sizeof(list->elements[0]));
+    memmove(list->declarations + position + 1, list->declarations + position, moved * sizeof(list->declarations[0]));
+    memmove(list->keys + position + 1, list->keys + position, moved * sizeof(list->keys[0]));
     ++list->size;
 
+    FunctionList_assign(list, position, element, declaration);
     return 0;
 }
 
+void FunctionList_assign(FunctionList* list, int position, const Function* element, const Declaration* declaration)
+{
+    list->elements[position] = (*element);
+    list->declarations[position] = (*declaration);
+    list->keys[position] = nameKey(element->name);
+}
+
+Declaration* FunctionList_declaration(const FunctionList* list, const Function* element)
+{
+    return &list->declarations[element - list->elements];
+}
+
 int FunctionList_insertAt(FunctionList* itemlist, char* name, int name_length, int scope_level, const Type* return_type, TypeList* paramtypes,
                           int decl_line, int decl_column, int position)
 {
     Function element;
+    Declaration declaration;
 
     element.name         = name;
-    element.name_length  = name_length;
-    element.scope_level  = scope_level;
     element.return_type  = (*return_type);
     element.paramtypes   = (*paramtypes);
-    element.decl_line    = decl_line;
-    element.decl_column  = decl_column;
-
-    if(FunctionList_insertElement(itemlist, &element, position) == -1)
+    element.routine      = NULL;
+    element.builtin      = -1;
+    element.owner        = NULL;
+
+    declaration.name_length = name_length;
+    declaration.scope_level = scope_level;
+    declaration.decl_line   = decl_line;
+    declaration.decl_column = decl_column;
+    declaration.order       = __atomic_add_fetch(&declaration_count, 1, __ATOMIC_RELAXED);
+    declaration.imported    = false;
+
+    if(FunctionList_insertElement(itemlist, &element, &declaration, position) == -1)
         return -1;
 
     return 0;
@@ -503,15 +864,23 @@ int FunctionList_replace(FunctionList* list, char* name, int name_length, int sc
                          int decl_line, int decl_column, int position)
 {
     Function* element = &list->elements[position];
+    Declaration* declaration = &list->declarations[position];
 
     element->name        = name;
-    element->name_length = name_length;
-    element->scope_level = scope_level;
     element->return_type = (*return_type);
     element->paramtypes  = (*paramtypes);
-    element->decl_line   = decl_line;
-    element->decl_column = decl_column;
-
+    element->routine     = NULL;
+    element->builtin     = -1;
+    element->owner       = NULL;
+
+    declaration->name_length = name_length;
+    declaration->scope_level = scope_level;
+    declaration->decl_line   = decl_line;
+    declaration->decl_column = decl_column;
+    declaration->order       = __atomic_add_fetch(&declaration_count, 1, __ATOMIC_RELAXED);
+    declaration->imported    = false;
+
+    list->keys[position] = nameKey(name);
     return 0;
 }
 
@@ -574,690 +943,275 @@ FunctionList* FunctionListStack_top(FunctionListStack* stack)
 
 
 
-/* Expression */
-void Expression_set(Expression* exp, const Type* type, Variable* variable, void* data)
+/* ClassList */
+void ClassList_clear(ClassList* list)
 {
-    exp->variable = variable;
-
-    if(variable == NULL)
-    {
-        if(type == NULL)
-            exp->type = Type_invalid;
-        else
-        {
-            exp->type = (*type);
-
-            if(data != NULL)
-            {
-                switch(type->type)
-                {
-                case INT:    exp->intval    = *((int*)   data); break;
-                case BOOL:   exp->boolval   = *((bool*)  data); break;
-                case DOUBLE: exp->doubleval = *((double*)data); break;
-                case CHAR:   exp->charval   = *((char*)  data); break;
-                case STRING: exp->strval    = *((char**) data); break;
-                }
-            }
-        }
-    }
-    else
-    {
-        exp->type = variable->type;
+    for(int i = 0; i < list->size; ++i)
+        free(list->elements[i].name);
 
-        switch(variable->type.type)
-        {
-        case INT:    exp->intval    = variable->intval;    break;
-        case BOOL:   exp->boolval   = variable->boolval;   break;
-        case DOUBLE: exp->doubleval = variable->doubleval; break;
-        case CHAR:   exp->charval   = variable->charval;   break;
-        case STRING: exp->strval    = variable->strval;    break;
-        }
-    }
-}
-void Expression_reset(Expression* exp)
-{
-    exp->type = Type_invalid;
-    exp->variable = NULL;
+    free(list->elements);
+    list->elements = NULL;
+    list->capacity = 0;
+    list->size = 0;
 }
-void Expression_clear(Expression* exp)
+
+void ClassList_pop(ClassList* list, int scope_level)
 {
-    if(exp->variable == NULL)
+    while(list->size > 0 && list->elements[list->size - 1].scope_level >= scope_level)
     {
-        if(exp->type.type == STRING)
-            free(exp->strval);
-        else if(exp->type.type == CLASS)
-            free(exp->type.class_name);
+        --list->size;
+        free(list->elements[list->size].name);
     }
-
-    Expression_reset(exp);
 }
 
-void Expression_assign(const Expression* lval, const Expression* rval, Expression* result)
+int ClassList_find(const ClassList* list, const char* name)
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(lval->variable == NULL || lval->variable->constant == true)
-    {
-        yyerror("the left operand of '=' must be a lval");
-        return;
-    }
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '=' must have the same type");
-        return;
-    }
-
-    switch(lval->type.type)
-    {
-    case INT:    lval->variable->intval    = rval->intval;    break;
-    case BOOL:   lval->variable->boolval   = rval->boolval;   break;
-    case DOUBLE: lval->variable->doubleval = rval->doubleval; break;
-    case CHAR:   lval->variable->charval   = rval->charval;   break;
-    case STRING: free(lval->variable->strval); lval->variable->strval = rval->strval; break;
-    case CLASS:  break;
-    }
+    for(int i = list->size - 1; i >= 0; --i)
+        if(strcmp(name, list->elements[i].name) == 0)
+            return i;
 
-    (*result) = (*lval);
+    return -1;
 }
 
-void Expression_addassign(const Expression* lval, const Expression* rval, Expression* result)
+int ClassList_insert(ClassList* list, char* name, int scope_level, int decl_line, int decl_column)
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(lval->variable == NULL || lval->variable->constant == true)
-    {
-        yyerror("the left operand of '+=' must be a lval");
-        return;
-    }
-    if(Type_equal(&lval->type, &rval->type) == false)
+    if(list->size == list->capacity)
     {
-        yyerror("the operands of '+=' must have the same type");
-        return;
-    }
+        int new_capacity = 1 + list->capacity * 2;
+        Class* new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+        if(new_list == NULL)
+        {
+            new_capacity = 1 + list->capacity;
+            new_list = realloc(list->elements, new_capacity * sizeof(list->elements[0]));
+            if(new_list == NULL)
+                return -1;
+        }
 
-    switch(lval->type.type)
-    {
-    case INT:    lval->variable->intval    += rval->variable->intval;    break;
-    case BOOL:   lval->variable->boolval   += rval->variable->boolval;   break;
-    case DOUBLE: lval->variable->doubleval += rval->variable->doubleval; break;
-    case CHAR:   lval->variable->charval   += rval->variable->charval;   break;
-    case STRING: appendString(lval->variable->strval, rval->variable->strval); break;
-    case CLASS:  yyerror("addition is an invalid operation for %s", lval->type.class_name); break;
+        list->elements = new_list;
+        list->capacity = new_capacity;
     }
 
-    (*result) = (*lval);
+    Class* element = &list->elements[list->size];
+    element->name        = name;
+    element->scope_level = scope_level;
+    element->decl_line   = decl_line;
+    element->decl_column = decl_column;
+    element->imported    = false;
+    element->layout      = NULL;
+
+    ++list->size;
+    return 0;
 }
-void Expression_subassign(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
 
-    if(lval->variable == NULL || lval->variable->constant == true)
-    {
-        yyerror("the left operand of '-=' must be a lval");
-        return;
-    }
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '-=' must have the same type");
-        return;
-    }
 
-    switch(lval->type.type)
-    {
-    case INT:    lval->variable->intval    -= rval->variable->intval;    break;
-    case BOOL:   lval->variable->boolval   -= rval->variable->boolval;   break;
-    case DOUBLE: lval->variable->doubleval -= rval->variable->doubleval; break;
-    case CHAR:   lval->variable->charval   -= rval->variable->charval;   break;
-    case STRING: yyerror("substraction is an invalid operation for string"); break;
-    case CLASS:  yyerror("substraction is an invalid operation for %s", lval->type.class_name); break;
-    }
 
-    (*result) = (*lval);
-}
-void Expression_mulassign(const Expression* lval, const Expression* rval, Expression* result)
+/* Expression */
+void Expression_set(Expression* exp, const Type* type, Variable* variable, void* data)
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
+    exp->variable = variable;
 
-    if(lval->variable == NULL || lval->variable->constant == true)
-    {
-        yyerror("the left operand of '*=' must be a lval");
-        return;
-    }
-    if(Type_equal(&lval->type, &rval->type) == false)
+    if(variable == NULL)
     {
-        yyerror("the operands of '*=' must have the same type");
-        return;
+        if(type == NULL)
+            Expression_reset(exp);
+        else
+        {
+            exp->type = (*type);
+            exp->node = Node_constant(type, data);
+        }
     }
-
-    switch(lval->type.type)
+    else
     {
-    case INT:    lval->variable->intval    *= rval->variable->intval;    break;
-    case BOOL:   lval->variable->boolval    = lval->variable->boolval && rval->variable->boolval; break;
-    case DOUBLE: lval->variable->doubleval *= rval->variable->doubleval; break;
-    case CHAR:   lval->variable->charval   *= rval->variable->charval;   break;
-    case STRING: yyerror("multiplication is an invalid operation for string"); break;
-    case CLASS:  yyerror("multiplication is an invalid operation for %s", lval->type.class_name); break;
+        exp->type = variable->type;
+        exp->node = (variable->known ? Node_constant(&variable->type, &variable->intval) : Node_variable(variable));
     }
-
-    (*result) = (*lval);
 }
-void Expression_divassign(const Expression* lval, const Expression* rval, Expression* result)
+void Expression_reset(Expression* exp)
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(lval->variable == NULL || lval->variable->constant == true)
-    {
-        yyerror("the left operand of '/=' must be a lval");
-        return;
-    }
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '/=' must have the same type");
-        return;
-    }
-
-    switch(lval->type.type)
-    {
-    case INT:    lval->variable->intval    /= rval->variable->intval;    break;
-    case BOOL:   yyerror("division is an invalid operation for bool");   break;
-    case DOUBLE: lval->variable->doubleval /= rval->variable->doubleval; break;
-    case CHAR:   lval->variable->charval   /= rval->variable->charval;   break;
-    case STRING: yyerror("division is an invalid operation for string"); break;
-    case CLASS:  yyerror("division is an invalid operation for %s", lval->type.class_name); break;
-    }
-
-    (*result) = (*lval);
+    exp->type = Type_invalid;
+    exp->variable = NULL;
+    exp->node = NULL;
 }
-void Expression_modassign(const Expression* lval, const Expression* rval, Expression* result)
+/* Nodes belong to the program and class names are borrowed, so an expression owns nothing */
+void Expression_clear(Expression* exp)
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(lval->variable == NULL || lval->variable->constant == true)
-    {
-        yyerror("the left operand of '%%=' must be a lval");
-        return;
-    }
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '%%=' must have the same type");
-        return;
-    }
-
-    switch(lval->type.type)
-    {
-    case INT:    lval->variable->intval  %= rval->variable->intval;     break;
-    case BOOL:   yyerror("modulus is an invalid operation for bool");   break;
-    case DOUBLE: yyerror("modulus is an invalid operation for double"); break;
-    case CHAR:   lval->variable->charval %= rval->variable->charval;    break;
-    case STRING: yyerror("modulus is an invalid operation for string"); break;
-    case CLASS:  yyerror("modulus is an invalid operation for %s", lval->type.class_name); break;
-    }
-
-    (*result) = (*lval);
+    Expression_reset(exp);
 }
 
-void Expression_add(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
 
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '+' must have the same type");
-        return;
-    }
 
-    switch(lval->type.type)
-    {
-    case INT:    {long   x = lval->intval    + rval->intval;    Expression_set(result, &lval->type, NULL, &x);} break;
-    case BOOL:   {bool   x = lval->boolval  != rval->boolval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case DOUBLE: {double x = lval->doubleval + rval->doubleval; Expression_set(result, &lval->type, NULL, &x);} break;
-    case CHAR:   {char   x = lval->charval   + rval->charval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case STRING: {char*  x = concatStrings(lval->strval, rval->strval); Expression_set(result, &lval->type, NULL, &x); break;}
-    case CLASS: yyerror("addition is an invalid operation for %s", lval->type.class_name); break;
-    }
-}
-void Expression_sub(const Expression* lval, const Expression* rval, Expression* result)
+typedef enum OperatorForm
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '-' must have the same type");
-        return;
-    }
-
-    switch(lval->type.type)
-    {
-    case INT:    {long   x = lval->intval    - rval->intval;    Expression_set(result, &lval->type, NULL, &x);} break;
-    case BOOL:   {bool   x = lval->boolval  != rval->boolval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case DOUBLE: {double x = lval->doubleval - rval->doubleval; Expression_set(result, &lval->type, NULL, &x);} break;
-    case CHAR:   {char   x = lval->charval   - rval->charval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case STRING: yyerror("substraction is an invalid operation for string"); break;
-    case CLASS:  yyerror("substraction is an invalid operation for %s", lval->type.class_name); break;
-    }
-}
-void Expression_mul(const Expression* lval, const Expression* rval, Expression* result)
+    FORM_ASSIGNMENT,
+    FORM_COMPOUND,
+    FORM_PREFIX,
+    FORM_POSTFIX,
+    FORM_BINARY,
+    FORM_UNARY,
+    FORM_LOGICAL,
+    FORM_COMPARISON
+} OperatorForm;
+
+typedef struct Operator
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
+    const char* symbol;
+    const char* name;
+    OperatorForm form;
+    NodeOp kernel;
+} Operator;
 
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '*' must have the same type");
-        return;
-    }
+#define OPERATOR(op, function, symbol, name, form, kernel) [op] = {symbol, name, FORM_##form, kernel},
+static const Operator operators[NODE_GT + 1] = {OPERATORS(OPERATOR)};
+#undef OPERATOR
 
-    switch(lval->type.type)
-    {
-    case INT:    {long   x = lval->intval    * rval->intval;    Expression_set(result, &lval->type, NULL, &x);} break;
-    case BOOL:   {bool   x = lval->boolval  && rval->boolval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case DOUBLE: {double x = lval->doubleval * rval->doubleval; Expression_set(result, &lval->type, NULL, &x);} break;
-    case CHAR:   {char   x = lval->charval   * rval->charval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case STRING: yyerror("multiplication is an invalid operation for string"); break;
-    case CLASS:  yyerror("multiplication is an invalid operation for %s", lval->type.class_name); break;
-    }
-}
-void Expression_div(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
+#define KERNEL(op, type, field, expression) [op][type] = true,
+static const bool has_kernel[NODE_GT + 1][TYPE_ID_SCALARS] = {OPERATOR_KERNELS(KERNEL)};
+#undef KERNEL
 
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '/' must have the same type");
-        return;
-    }
 
-    switch(lval->type.type)
-    {
-    case INT:    {long   x = lval->intval    / rval->intval;    Expression_set(result, &lval->type, NULL, &x);} break;
-    case BOOL:   yyerror("division is an invalid operation for bool");                      break;
-    case DOUBLE: {double x = lval->doubleval / rval->doubleval; Expression_set(result, &lval->type, NULL, &x);} break;
-    case CHAR:   {char   x = lval->charval   / rval->charval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case STRING: yyerror("division is an invalid operation for string");                    break;
-    case CLASS:  yyerror("division is an invalid operation for %s", lval->type.class_name); break;
-    }
-}
-void Expression_mod(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '%%' must have the same type");
-        return;
-    }
 
-    switch(lval->type.type)
-    {
-    case INT:    {long   x = lval->intval    / rval->intval;    Expression_set(result, &lval->type, NULL, &x);} break;
-    case BOOL:   yyerror("modulus is an invalid operation for bool");                      break;
-    case DOUBLE: yyerror("modulus is an invalid operation for double");                    break;
-    case CHAR:   {char   x = lval->charval   / rval->charval;   Expression_set(result, &lval->type, NULL, &x);} break;
-    case STRING: yyerror("modulus is an invalid operation for string");                    break;
-    case CLASS:  yyerror("modulus is an invalid operation for %s", lval->type.class_name); break;
-    }
-}
-void Expression_neg(const Expression* val, Expression* result)
+static bool isArray(const Expression* exp, const char* op)
 {
-    Expression_clear(result);
-    if(val->type.type == INVAL_TYPE)
-        return;
+    if(exp->type.dimensions == 0)
+        return false;
 
-    switch(val->type.type)
-    {
-    case INT:    {long   x = -val->intval;    Expression_set(result, &val->type, NULL, &x);} break;
-    case BOOL:   {bool   x = -val->boolval;   Expression_set(result, &val->type, NULL, &x);} break;
-    case DOUBLE: {double x = -val->doubleval; Expression_set(result, &val->type, NULL, &x);} break;
-    case CHAR:   {char   x = -val->charval;   Expression_set(result, &val->type, NULL, &x);} break;
-    case STRING: yyerror("unary minus is an invalid operation for string");                   break;
-    case CLASS:  yyerror("unary minus is an invalid operation for %s", val->type.class_name); break;
-    }
+    yyerror("'%s' is an invalid operation for %s", op, Type_toString(&exp->type));
+    return true;
 }
 
-void Expression_preinc(const Expression* val, Expression* result)
-{
-    Expression_clear(result);
-    if(val->type.type == INVAL_TYPE)
-        return;
-
-    if(val->variable == NULL || val->variable->constant == true)
-    {
-        yyerror("operand of '++X' must be a lval");
-        return;
-    }
-
-    switch(val->type.type)
-    {
-    case INT:    ++val->variable->intval;    break;
-    case BOOL:   ++val->variable->boolval;   break;
-    case DOUBLE: ++val->variable->doubleval; break;
-    case CHAR:   ++val->variable->charval;   break;
-    case STRING: yyerror("preincrement is an invalid operation for string"); break;
-    case CLASS:  yyerror("preincrement is an invalid operation for %s", val->type.class_name); break;
-    }
-
-    (*result) = (*val);
-}
-void Expression_predec(const Expression* val, Expression* result)
+static bool isLval(const Expression* exp, const Operator* operator)
 {
-    Expression_clear(result);
-    if(val->type.type == INVAL_TYPE)
-        return;
-
-    if(val->variable == NULL || val->variable->constant == true)
-    {
-        yyerror("operand of '--X' must be a lval");
-        return;
-    }
-
-    switch(val->type.type)
-    {
-    case INT:    --val->variable->intval;    break;
-    case BOOL:   --val->variable->boolval;   break;
-    case DOUBLE: --val->variable->doubleval; break;
-    case CHAR:   --val->variable->charval;   break;
-    case STRING: yyerror("predecrement is an invalid operation for string"); break;
-    case CLASS:  yyerror("predecrement is an invalid operation for %s", val->type.class_name); break;
-    }
+    if(exp->variable != NULL && exp->variable->constant == false)
+        return true;
 
-    (*result) = (*val);
+    if(operator->form == FORM_PREFIX || operator->form == FORM_POSTFIX)
+        yyerror("operand of '%s' must be a lval", operator->symbol);
+    else
+        yyerror("the left operand of '%s' must be a lval", operator->symbol);
+    return false;
 }
-void Expression_postinc(const Expression* val, Expression* result)
-{
-    Expression_clear(result);
-    if(val->type.type == INVAL_TYPE)
-        return;
 
-    if(val->variable == NULL || val->variable->constant == true)
-    {
-        yyerror("operand of 'X++' must be a lval");
-        return;
-    }
-
-    switch(val->type.type)
-    {
-    case INT:    Expression_set(result, &val->type, NULL, &val->variable->intval);    ++val->variable->intval;    break;
-    case BOOL:   Expression_set(result, &val->type, NULL, &val->variable->boolval);   ++val->variable->boolval;   break;
-    case DOUBLE: Expression_set(result, &val->type, NULL, &val->variable->doubleval); ++val->variable->doubleval; break;
-    case CHAR:   Expression_set(result, &val->type, NULL, &val->variable->charval);   ++val->variable->charval;   break;
-    case STRING: yyerror("postincrement is an invalid operation for string"); break;
-    case CLASS:  yyerror("postincrement is an invalid operation for %s", val->type.class_name); break;
-    }
-}
-void Expression_postdec(const Expression* val, Expression* result)
+static bool convertsToBool(const Expression* val, const Operator* operator)
 {
-    Expression_clear(result);
-    if(val->type.type == INVAL_TYPE)
-        return;
-
-    if(val->variable == NULL || val->variable->constant == true)
+    if(val->type.type == CLASS || val->type.type == VOID)
     {
-        yyerror("operand of 'X--' must be a lval");
-        return;
+        yyerror("%s is an invalid operation for %s", operator->name, scalarName(&val->type));
+        return false;
     }
 
-    switch(val->type.type)
-    {
-    case INT:    Expression_set(result, &val->type, NULL, &val->variable->intval);    --val->variable->intval;    break;
-    case BOOL:   Expression_set(result, &val->type, NULL, &val->variable->boolval);   --val->variable->boolval;   break;
-    case DOUBLE: Expression_set(result, &val->type, NULL, &val->variable->doubleval); --val->variable->doubleval; break;
-    case CHAR:   Expression_set(result, &val->type, NULL, &val->variable->charval);   --val->variable->charval;   break;
-    case STRING: yyerror("postdecrement is an invalid operation for string"); break;
-    case CLASS:  yyerror("postdecrement is an invalid operation for %s", val->type.class_name); break;
-    }
+    return isArray(val, operator->symbol) == false;
 }
 
-void Expression_not(const Expression* val, Expression* result)
+/* Scalars of the types the operator has a kernel for */
+static bool appliesTo(const Operator* operator, const Expression* val)
 {
-    Expression_clear(result);
-    if(val->type.type == INVAL_TYPE)
-        return;
+    if(isArray(val, operator->symbol))
+        return false;
+    if(operator->form == FORM_ASSIGNMENT || (val->type.id < TYPE_ID_SCALARS && has_kernel[operator->kernel][val->type.id]))
+        return true;
 
-    switch(val->type.type)
-    {
-    case INT:    {long   x = !val->intval;    Expression_set(result, &val->type, NULL, &x);} break;
-    case BOOL:   {bool   x = !val->boolval;   Expression_set(result, &val->type, NULL, &x);} break;
-    case DOUBLE: {double x = !val->doubleval; Expression_set(result, &val->type, NULL, &x);} break;
-    case CHAR:   {char   x = !val->charval;   Expression_set(result, &val->type, NULL, &x);} break;
-    case STRING: yyerror("'!' is an invalid operation for string");                   break;
-    case CLASS:  yyerror("'!' is an invalid operation for %s", val->type.class_name); break;
-    }
+    yyerror("%s is an invalid operation for %s", operator->name, Type_toString(&val->type));
+    return false;
 }
-void Expression_and(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
 
-    if(lval->type.type == CLASS)
-    {
-        yyerror("conversion to bool is an invalid operation for %s", lval->type.class_name);
-        return;
-    }
-    if(rval->type.type == CLASS)
-    {
-        yyerror("conversion to bool is an invalid operation for %s", rval->type.class_name);
-        return;
-    }
-
-    bool x = Expression_getBool(lval) && Expression_getBool(rval);
-    Expression_set(result, &Type_bool, NULL, &x);
+/* The result of an assignment is its left operand */
+static void setAssignment(Expression* result, NodeOp op, const Expression* lval, const Expression* rval)
+{
+    result->type = lval->type;
+    result->variable = lval->variable;
+    result->node = Node_create(op, &lval->type, lval->node, (rval != NULL ? rval->node : NULL), NULL, NULL);
 }
-void Expression_or(const Expression* lval, const Expression* rval, Expression* result)
+/* Operations on constants are computed right away */
+static void setOperation(Expression* result, NodeOp op, const Type* type, const Expression* lval, const Expression* rval)
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(lval->type.type == CLASS)
-    {
-        yyerror("conversion to bool is an invalid operation for %s", lval->type.class_name);
-        return;
-    }
-    if(rval->type.type == CLASS)
-    {
-        yyerror("conversion to bool is an invalid operation for %s", rval->type.class_name);
-        return;
-    }
-
-    bool x = Expression_getBool(lval) || Expression_getBool(rval);
-    Expression_set(result, &Type_bool, NULL, &x);
+    result->type = (*type);
+    result->variable = NULL;
+    result->node = Node_fold(Node_create(op, type, lval->node, (rval != NULL ? rval->node : NULL), NULL, NULL));
 }
 
-void Expression_eq(const Expression* lval, const Expression* rval, Expression* result)
+/* Checks the operands of an operator, rval being NULL for those taking one, and makes the node computing it */
+static void operate(NodeOp op, const Expression* lval, const Expression* rval, Expression* result)
 {
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '==' must have the same type");
-        return;
-    }
-
-    bool x;
+    const Operator* operator = &operators[op];
 
-    switch(lval->type.type)
-    {
-    case INT:    x = (lval->intval    == rval->intval);         break;
-    case BOOL:   x = (lval->boolval   == rval->boolval);        break;
-    case DOUBLE: x = (lval->doubleval == rval->doubleval);      break;
-    case CHAR:   x = (lval->charval   == rval->charval);        break;
-    case STRING: x = (compareStrings(lval->strval, rval->strval) == 0); break;
-    case CLASS: yyerror("'==' is an invalid operation for %s", lval->type.class_name); break;
-    }
-
-    Expression_set(result, &Type_bool, NULL, &x);
-}
-void Expression_neq(const Expression* lval, const Expression* rval, Expression* result)
-{
     Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
-
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '!=' must have the same type");
+    if(lval->type.type == INVAL_TYPE || (rval != NULL && rval->type.type == INVAL_TYPE))
         return;
-    }
-
-    bool x;
 
-    switch(lval->type.type)
+    switch(operator->form)
     {
-    case INT:    x = (lval->intval    != rval->intval);         break;
-    case BOOL:   x = (lval->boolval   != rval->boolval);        break;
-    case DOUBLE: x = (lval->doubleval != rval->doubleval);      break;
-    case CHAR:   x = (lval->charval   != rval->charval);        break;
-    case STRING: x = (compareStrings(lval->strval, rval->strval) != 0); break;
-    case CLASS: yyerror("'!=' is an invalid operation for %s", lval->type.class_name); break;
-    }
-
-    Expression_set(result, &Type_bool, NULL, &x);
-}
-void Expression_leq(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
+    case FORM_ASSIGNMENT:
+    case FORM_COMPOUND:
+    case FORM_PREFIX:
+    case FORM_POSTFIX:
+        if(isLval(lval, operator) == false)
+            return;
+        break;
 
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '<=' must have the same type");
+    case FORM_LOGICAL:
+        if(convertsToBool(lval, operator) && convertsToBool(rval, operator))
+            setOperation(result, op, &Type_bool, lval, rval);
         return;
     }
 
-    bool x;
-
-    switch(lval->type.type)
+    if(rval != NULL && Type_equal(&lval->type, &rval->type) == false)
     {
-    case INT:    x = (lval->intval    <= rval->intval);         break;
-    case BOOL:   x = (lval->boolval   <= rval->boolval);        break;
-    case DOUBLE: x = (lval->doubleval <= rval->doubleval);      break;
-    case CHAR:   x = (lval->charval   <= rval->charval);        break;
-    case STRING: x = (compareStrings(lval->strval, rval->strval) <= 0); break;
-    case CLASS: yyerror("'<=' is an invalid operation for %s", lval->type.class_name); break;
-    }
-
-    Expression_set(result, &Type_bool, NULL, &x);
-}
-void Expression_geq(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
+        yyerror("the operands of '%s' must have the same type", operator->symbol);
         return;
-
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '>=' must have the same type");
-        return;
-    }
-
-    bool x;
-
-    switch(lval->type.type)
-    {
-    case INT:    x = (lval->intval    >= rval->intval);         break;
-    case BOOL:   x = (lval->boolval   >= rval->boolval);        break;
-    case DOUBLE: x = (lval->doubleval >= rval->doubleval);      break;
-    case CHAR:   x = (lval->charval   >= rval->charval);        break;
-    case STRING: x = (compareStrings(lval->strval, rval->strval) >= 0); break;
-    case CLASS: yyerror("'>=' is an invalid operation for %s", lval->type.class_name); break;
     }
-
-    Expression_set(result, &Type_bool, NULL, &x);
-}
-void Expression_low(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
+    if(appliesTo(operator, lval) == false)
         return;
 
-    if(Type_equal(&lval->type, &rval->type) == false)
+    switch(operator->form)
     {
-        yyerror("the operands of '<' must have the same type");
-        return;
-    }
+    case FORM_ASSIGNMENT:
+    case FORM_COMPOUND:
+    case FORM_PREFIX:
+        setAssignment(result, op, lval, rval);
+        break;
 
-    bool x;
+    case FORM_POSTFIX:
+        result->type = lval->type;
+        result->node = Node_create(op, &lval->type, lval->node, NULL, NULL, NULL);
+        break;
 
-    switch(lval->type.type)
-    {
-    case INT:    x = (lval->intval    < rval->intval);         break;
-    case BOOL:   x = (lval->boolval   < rval->boolval);        break;
-    case DOUBLE: x = (lval->doubleval < rval->doubleval);      break;
-    case CHAR:   x = (lval->charval   < rval->charval);        break;
-    case STRING: x = (compareStrings(lval->strval, rval->strval) < 0); break;
-    case CLASS: yyerror("'<' is an invalid operation for %s", lval->type.class_name); break;
-    }
+    case FORM_BINARY:
+    case FORM_UNARY:
+        setOperation(result, op, &lval->type, lval, rval);
+        break;
 
-    Expression_set(result, &Type_bool, NULL, &x);
+    case FORM_COMPARISON:
+        setOperation(result, op, &Type_bool, lval, rval);
+        break;
+    }
 }
-void Expression_gre(const Expression* lval, const Expression* rval, Expression* result)
-{
-    Expression_clear(result);
-    if(lval->type.type == INVAL_TYPE || rval->type.type == INVAL_TYPE)
-        return;
 
-    if(Type_equal(&lval->type, &rval->type) == false)
-    {
-        yyerror("the operands of '>' must have the same type");
-        return;
-    }
 
-    bool x;
 
-    switch(lval->type.type)
-    {
-    case INT:    x = (lval->intval    > rval->intval);         break;
-    case BOOL:   x = (lval->boolval   > rval->boolval);        break;
-    case DOUBLE: x = (lval->doubleval > rval->doubleval);      break;
-    case CHAR:   x = (lval->charval   > rval->charval);        break;
-    case STRING: x = (compareStrings(lval->strval, rval->strval) > 0); break;
-    case CLASS: yyerror("'>' is an invalid operation for %s", lval->type.class_name); break;
+/* Expression_assign and the others, by arity of their form */
+#define BINARY_FUNCTION(op, function)                                                               \
+    void Expression_##function(const Expression* lval, const Expression* rval, Expression* result) \
+    {                                                                                               \
+        operate(op, lval, rval, result);                                                            \
     }
+#define UNARY_FUNCTION(op, function)                                    \
+    void Expression_##function(const Expression* val, Expression* result) \
+    {                                                                   \
+        operate(op, val, NULL, result);                                 \
+    }
+#define FUNCTION_ASSIGNMENT BINARY_FUNCTION
+#define FUNCTION_COMPOUND   BINARY_FUNCTION
+#define FUNCTION_PREFIX     UNARY_FUNCTION
+#define FUNCTION_POSTFIX    UNARY_FUNCTION
+#define FUNCTION_BINARY     BINARY_FUNCTION
+#define FUNCTION_UNARY      UNARY_FUNCTION
+#define FUNCTION_LOGICAL    BINARY_FUNCTION
+#define FUNCTION_COMPARISON BINARY_FUNCTION
+#define FUNCTION(op, function, symbol, name, form, kernel) FUNCTION_##form(op, function)
 
-    Expression_set(result, &Type_bool, NULL, &x);
-}
-
-
+OPERATORS(FUNCTION)
 
-bool Expression_getBool(const Expression* val)
-{
-    switch(val->type.type)
-    {
-    case INT:    return val->intval;                   break;
-    case BOOL:   return val->boolval;                  break;
-    case DOUBLE: return val->doubleval;                break;
-    case CHAR:   return val->charval;                  break;
-    case STRING: return val->strval && val->strval[0]; break;
-    default:
-        yyerror("debug: Expression_getBool: expression is invalid");
-        abort();
-    }
-}
+#undef FUNCTION
 
 
 
@@ -1266,6 +1220,8 @@ void PrintQueue_clear(PrintQueue* queue)
 {
     if(queue->capacity != 0)
     {
+        for(int i = 0; i < queue->size; ++i)
+            Int_release(queue->elements[i]);
         free(queue->elements);
         queue->elements = NULL;
         queue->capacity = 0;
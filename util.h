@@ -1,36 +1,79 @@
 #ifndef INCLUDED_ITEM_H
 #define INCLUDED_ITEM_H
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include "yylloc.h"
 
 void yyerror(const char* msg, ...);
+void yyerrorAt(const YYLTYPE* location, const char* msg, ...);
+void yyverrorAt(const YYLTYPE* location, const char* msg, va_list args);
+/* An error about something declared earlier, at related */
+void yyerrorRelated(const YYLTYPE* related, const char* msg, ...);
 void yywarning(const char* msg, ...);
 
 
 
 /* Memory */
 void* memdup(const void* mem, size_t size);
+uint64_t hashBytes(const void* mem, size_t size, uint64_t hash);
+
+#define HASH_INIT 14695981039346656037ull
+
+/* NULL strings compare as empty ones */
+int   compareStrings(const char* lval, const char* rval);
+char* concatStrings(const char* lval, const char* rval);
+char* appendString(char* lval, const char* rval);
 
 
 
 /* Type */
+struct ClassLayout;
+
+/* Types are made by Type_make, which gives equal types the same id, so comparing types compares their ids.
+ * The other fields are copies of what the id stands for and are not changed on their own */
 typedef struct Type
 {
     int type;
-    char* class_name;
+    int id;
+    int dimensions;             /* 0 for scalars */
+    struct ClassLayout* layout; /* of a class, owned by the program */
 } Type;
 
-const Type Type_invalid;
-const Type Type_int;
-const Type Type_bool;
-const Type Type_double;
-const Type Type_char;
-const Type Type_string;
-const Type Type_void;
-
+/* Ids of the types without dimensions other than classes, which are made first. Named after their token */
+enum
+{
+    TYPE_ID_INVAL_TYPE,
+    TYPE_ID_INT,
+    TYPE_ID_BOOL,
+    TYPE_ID_DOUBLE,
+    TYPE_ID_CHAR,
+    TYPE_ID_STRING,
+    TYPE_ID_VOID,
+    TYPE_ID_SCALARS
+};
+
+extern const Type Type_invalid;
+extern const Type Type_int;
+extern const Type Type_bool;
+extern const Type Type_double;
+extern const Type Type_char;
+extern const Type Type_string;
+extern const Type Type_void;
+
+/* A class type without a layout is one whose class is undeclared or not resolved yet */
+Type Type_make(int type, const char* class_name, int dimensions, struct ClassLayout* layout);
+Type Type_withDimensions(const Type* type, int dimensions);
+Type Type_withLayout(const Type* type, struct ClassLayout* layout);
+/* Forget the types made with a layout that is being freed. Their ids are given to the next new types, and a layout allocated
+ * at the same address later gets types of its own */
+void Type_releaseLayout(const struct ClassLayout* layout);
+/* NULL for types other than classes. Kept as long as the layout of the class, or as the process for classes without one */
+const char* Type_className(const Type* type);
 bool Type_equal(const Type* lval, const Type* rval);
 const char* Type_toString(const Type* type);
 
@@ -47,20 +90,40 @@ void TypeList_clear(TypeList* list);
 int  TypeList_insert(TypeList* list, Type* element);
 bool TypeList_equal(const TypeList* llist, const TypeList* rlist);
 void TypeList_print(const TypeList* list, FILE* fp);
+char* TypeList_toString(const TypeList* list);
 
 
 
 /* Variable */
-typedef struct Variable
+struct Routine;
+
+/* Counts the declarations inserted in a list of variables or functions, which numbers them in the order they were made.
+ * Incremented atomically, by every thread analyzing function bodies */
+extern long declaration_count;
+
+/* The cold part of a variable or function: what declaring it, reporting it declared twice and leaving its scope read. Lists
+ * keep it apart from their elements, so that lookups and the analysis of expressions go through fewer cache lines */
+typedef struct Declaration
 {
-    char* name;
     int name_length;
-    Type type;
     int scope_level;
     int decl_line;
     int decl_column;
+    long order;              /* of the declaration, among all of them */
+    bool imported;
+} Declaration;
+
+typedef struct Variable
+{
+    char* name;
+    Type type;
     bool constant;
     bool initialized;
+    bool known;              /* a constant whose value was computed during the analysis */
+
+    int slot;                /* storage of the variable among the globals or the locals of its routine, or index of a field */
+    struct Routine* routine; /* NULL for globals */
+    struct ClassLayout* owner; /* class of a field, NULL for variables */
 
     union
     {
@@ -72,17 +135,25 @@ typedef struct Variable
     };
 } Variable;
 
+/* Sorted by name. declarations and keys are parallel to elements: the key of an element holds the first bytes of its name,
+ * which the binary search compares before reading the name itself */
 typedef struct VariableList
 {
     Variable* elements;
+    Declaration* declarations;
+    uint64_t* keys;
     int size;
     int capacity;
 } VariableList;
 
-void VariableList_destroy(VariableList* list, int scope_level);
+void VariableList_clear(VariableList* list, int scope_level);
+/* Frees the arrays of a list whose elements belong to another one */
+void VariableList_release(VariableList* list);
 int  VariableList_copy(const VariableList* src, VariableList* dst);
 int  VariableList_find(const VariableList* list, const char* name, int* insert_pos);
-int  VariableList_insertElement(VariableList* list, Variable* element, int position);
+int  VariableList_insertElement(VariableList* list, const Variable* element, const Declaration* declaration, int position);
+void VariableList_assign(VariableList* list, int position, const Variable* element, const Declaration* declaration);
+Declaration* VariableList_declaration(const VariableList* list, const Variable* element);
 
 int  VariableList_insertAt(VariableList* list, char* name, int name_length, const Type* type, int scope_level, bool constant, bool initialized,
                            int decl_line, int decl_column, int position);
@@ -100,7 +171,7 @@ typedef struct VariableListStack
     int capacity;
 }VariableListStack;
 
-void VariableListStack_destroy(VariableListStack* stack);
+void VariableListStack_clear(VariableListStack* stack);
 int  VariableListStack_push(VariableListStack* stack, const VariableList* list);
 int  VariableListStack_pop(VariableListStack* stack, VariableList* list);
 VariableList* VariableListStack_top(VariableListStack* stack);
@@ -111,18 +182,19 @@ VariableList* VariableListStack_top(VariableListStack* stack);
 typedef struct Function
 {
     char* name;
-    int name_length;
-    int scope_level;
-    int decl_line;
-    int decl_column;
-
     Type return_type;
     TypeList paramtypes;
+    struct Routine* routine;
+    int builtin;            /* index in the table of builtins, -1 for functions written in tema */
+    struct ClassLayout* owner; /* class of a method, NULL for functions */
 } Function;
 
+/* Sorted by name, with overloads next to each other. declarations and keys are as in VariableList */
 typedef struct FunctionList
 {
     Function* elements;
+    Declaration* declarations;
+    uint64_t* keys;
     int size;
     int capacity;
 } FunctionList;
@@ -130,7 +202,9 @@ typedef struct FunctionList
 void FunctionList_clear(FunctionList* list, int scope_level);
 int  FunctionList_copy(const FunctionList* src, FunctionList* dst);
 int  FunctionList_find(const FunctionList* list, const char* name, const TypeList* typelist, int* insert_pos);
-int  FunctionList_insertElement(FunctionList* list, Function* element, int position);
+int  FunctionList_insertElement(FunctionList* list, const Function* element, const Declaration* declaration, int position);
+void FunctionList_assign(FunctionList* list, int position, const Function* element, const Declaration* declaration);
+Declaration* FunctionList_declaration(const FunctionList* list, const Function* element);
 
 int  FunctionList_insertAt(FunctionList* list, char* name, int name_length, int scope_level, const Type* return_type, TypeList* paramtypes,
                            int decl_line, int decl_column, int position);
@@ -155,20 +229,42 @@ FunctionList* FunctionListStack_top(FunctionListStack* stack);
 
 
 
+/* Class */
+typedef struct Class
+{
+    char* name;
+    int scope_level;
+    int decl_line;
+    int decl_column;
+    bool imported;
+    struct ClassLayout* layout;
+} Class;
+
+/* Classes are kept in declaration order. Lookups search backwards so inner declarations shadow outer ones */
+typedef struct ClassList
+{
+    Class* elements;
+    int size;
+    int capacity;
+} ClassList;
+
+void ClassList_clear(ClassList* list);
+void ClassList_pop(ClassList* list, int scope_level);
+int  ClassList_find(const ClassList* list, const char* name);
+int  ClassList_insert(ClassList* list, char* name, int scope_level, int decl_line, int decl_column);
+
+
+
 /* Expresion */
+struct Node;
+
+/* The type of an expression and the code computing it. The class name is borrowed.
+ * variable is set for lvals and for constants, node is NULL if the expression is invalid */
 typedef struct Expression
 {
     Type type;
     Variable* variable;
-
-    union
-    {
-        long intval;
-        bool boolval;
-        double doubleval;
-        char charval;
-        char* strval;
-    };
+    struct Node* node;
 } Expression;
 
 void Expression_set(Expression* exp, const Type* type, Variable* variable, void* data);
@@ -208,11 +304,7 @@ void Expression_gre(const Expression* lval, const Expression* rval, Expression*
 
 
 
-bool Expression_getBool(const Expression* val);
-
-
-
-/* PrintQueue */
+/* PrintQueue. The queue owns the BigInts it holds */
 typedef struct PrintQueue
 {
     long* elements;